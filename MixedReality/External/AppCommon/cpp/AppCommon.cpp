@@ -13,39 +13,6 @@ XrPosef idPose = {.orientation = {.x = 0, .y = 0, .z = 0, .w = 1.0},
                   .position = {.x = 0, .y = 0, .z = 0}};
 
 namespace AppCommon {
-/*
-void *thermal_func(void *arg)
-{
-    int ret = 0;
-    while(ThermalLoop) {
-        sleep(THERMAL_INTERVAL);
-        struct base_engine* engine = (struct base_engine*)arg;
-        XrPerfSettingsDomainEXT cpu_domain = XR_PERF_SETTINGS_DOMAIN_CPU_EXT;
-        XrPerfSettingsDomainEXT gpu_domain = XR_PERF_SETTINGS_DOMAIN_GPU_EXT;
-        XrPerfSettingsNotificationLevelEXT cpu_notificationLevel =
-XR_PERF_SETTINGS_NOTIF_LEVEL_NORMAL_EXT; XrPerfSettingsNotificationLevelEXT
-gpu_notificationLevel = XR_PERF_SETTINGS_NOTIF_LEVEL_NORMAL_EXT; float
-cpu_tempHeadroom = 0, gpu_tempHeadroom = 0; float cpu_tempSlope = 0,
-gpu_tempSlope = 0; ret =
-xrThermalGetTemperatureTrendEXT(engine->state.xrSession, cpu_domain,
-&cpu_notificationLevel, &cpu_tempHeadroom, &cpu_tempSlope); if(ret !=
-XR_SUCCESS) { LOGE(LOG_TAG, "%s %d get thermal data error", __func__, __LINE__);
-        } else {
-            LOGI(LOG_TAG, "cpu thermal data:  tempHeadroom=%f, tempSlope=%f,
-notificationLevel=%d", cpu_tempHeadroom, cpu_tempSlope, cpu_notificationLevel);
-        }
-
-        ret = xrThermalGetTemperatureTrendEXT(engine->state.xrSession,
-gpu_domain, &gpu_notificationLevel, &gpu_tempHeadroom, &gpu_tempSlope); if(ret
-!= XR_SUCCESS) { LOGE(LOG_TAG, "%s %d get thermal data error", __func__,
-__LINE__); } else { LOGI(LOG_TAG, "gpu thermal data:  tempHeadroom=%f,
-tempSlope=%f, notificationLevel=%d", gpu_tempHeadroom, gpu_tempSlope,
-gpu_notificationLevel);
-        }
-    }
-    return NULL;
-}
- */
 
 const char *to_string(XrSessionState state)
 {
@@ -80,8 +47,7 @@ void app_begin_session(struct base_engine *engine)
     XrSessionBeginInfo sessionBeginInfo = {
             .type = XR_TYPE_SESSION_BEGIN_INFO,
             .next = nullptr,
-            .primaryViewConfigurationType =
-                    XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO};
+            .primaryViewConfigurationType = engine->state.viewConfigType};
     XrResult result =
             xrBeginSession(engine->state.xrSession, &sessionBeginInfo);
     if (XR_SUCCESS != result) {
@@ -239,6 +205,21 @@ void app_poll_events(struct base_engine *engine)
         }
         case XR_TYPE_EVENT_DATA_INTERACTION_PROFILE_CHANGED:
             break;
+        case XR_TYPE_EVENT_DATA_VISIBILITY_MASK_CHANGED_KHR: {
+            const auto &maskChanged =
+                    *reinterpret_cast<const XrEventDataVisibilityMaskChangedKHR *>(
+                            event);
+            LOGI(LOG_TAG, "XrEventDataVisibilityMaskChangedKHR view %u",
+                 maskChanged.viewIndex);
+            engine->visibility_mask_changed |= 1u << maskChanged.viewIndex;
+            break;
+        }
+        case XR_TYPE_EVENT_DATA_PERF_SETTINGS_EXT: {
+            engine->perf_settings_events.push_back(
+                    *reinterpret_cast<const XrEventDataPerfSettingsEXT *>(
+                            event));
+            break;
+        }
         case XR_TYPE_EVENT_DATA_REFERENCE_SPACE_CHANGE_PENDING:
         default: {
             LOGI(LOG_TAG, "Ignoring event type %d", event->type);
@@ -302,27 +283,6 @@ void app_wait_window(struct base_engine *engine)
     }
 }
 
-void *get_file_buffer(const char *pFileName, int *pBufferSize)
-{
-    LOGI(LOG_TAG, "Opening File: %s", pFileName);
-    FILE *fp = fopen(pFileName, "rb");
-    if (!fp) {
-        return nullptr;
-    }
-
-    fseek(fp, 0, SEEK_END);
-    *pBufferSize = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-
-    char *pRetBuff = new char[*pBufferSize + 1];
-    fread(pRetBuff, 1, *pBufferSize, fp);
-    pRetBuff[*pBufferSize] = 0;
-
-    fclose(fp);
-
-    return pRetBuff;
-}
-
 void GetSysProperty(char const *name, char *value, size_t const len,
                     char const *defaultValue) {
   if (0 == __system_property_get(name, value)) {
@@ -497,6 +457,21 @@ void app_query_layers_and_extensions(struct base_engine *engine,JavaVM* vm, void
       if (strcmp(XR_KHR_COMPOSITION_LAYER_DEPTH_EXTENSION_NAME, extensionProperties[i].extensionName) == 0) {
           engine->depthInfo.supported = true;
       }
+      if (strcmp(XR_KHR_COMPOSITION_LAYER_CYLINDER_EXTENSION_NAME, extensionProperties[i].extensionName) == 0) {
+          engine->cylinder_layer_supported = true;
+      }
+      if (strcmp(XR_KHR_VISIBILITY_MASK_EXTENSION_NAME, extensionProperties[i].extensionName) == 0) {
+          engine->visibility_mask_supported = true;
+      }
+      if (strcmp(XR_VARJO_QUAD_VIEWS_EXTENSION_NAME, extensionProperties[i].extensionName) == 0) {
+          engine->quad_views_supported = true;
+      }
+      if (strcmp(XR_FB_SPACE_WARP_EXTENSION_NAME, extensionProperties[i].extensionName) == 0) {
+          engine->space_warp_supported = true;
+      }
+      if (strcmp(XR_EXT_PERFORMANCE_SETTINGS_EXTENSION_NAME, extensionProperties[i].extensionName) == 0) {
+          engine->perf_settings_supported = true;
+      }
     }
   };
 
@@ -624,20 +599,27 @@ void app_enum_view_configuration(struct base_engine *engine)
         assert(0);
     }
 
-    // Ensure runtime supports XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO
-    XrViewConfigurationType stereoViewConfigType =
-            XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
+    // Quad views if the app asked for them, otherwise
+    // XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO, which has to be there
     bool stereoIsSupported = false;
+    bool quadIsSupported = false;
     for (auto const &conf : viewConfigurations) {
-        if (conf == stereoViewConfigType) {
+        if (conf == XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO) {
             stereoIsSupported = true;
-            break;
+        } else if (conf == XR_VIEW_CONFIGURATION_TYPE_PRIMARY_QUAD_VARJO) {
+            quadIsSupported = true;
         }
     }
-    if (stereoIsSupported)
+    if (engine->quad_views_enabled && quadIsSupported) {
+        engine->state.viewConfigType =
+                XR_VIEW_CONFIGURATION_TYPE_PRIMARY_QUAD_VARJO;
+        LOGI(LOG_TAG, "Using XR_VIEW_CONFIGURATION_TYPE_PRIMARY_QUAD_VARJO");
+    } else if (stereoIsSupported) {
+        engine->state.viewConfigType =
+                XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
         LOGI(LOG_TAG,
              "Runtime supports XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO");
-    else {
+    } else {
         LOGE(LOG_TAG, "Runtime doesn't support "
                       "XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO");
         assert(0);
@@ -645,26 +627,24 @@ void app_enum_view_configuration(struct base_engine *engine)
 
     result = xrEnumerateViewConfigurationViews(
             engine->state.xrInstance, engine->state.xrSysId,
-            stereoViewConfigType, 0, &engine->state.viewCount, nullptr);
+            engine->state.viewConfigType, 0, &engine->state.viewCount,
+            nullptr);
     if (XR_SUCCESS != result) {
         LOGE(LOG_TAG, "xrEnumerateViewConfigurationViews failed: %d", result);
         assert(0);
     }
 
-    // Assert 2 views for stereo
-    assert(2 == engine->state.viewCount);
+    // 2 views for stereo, 4 for quad views
+    assert(engine->state.viewCount > 0);
 
     engine->state.m_views.resize(engine->state.viewCount, {XR_TYPE_VIEW});
-
-    for (uint32_t i = 0; i < engine->state.viewCount; i++) {
-        engine->state.viewConfigs[i].type = XR_TYPE_VIEW_CONFIGURATION_VIEW;
-        engine->state.viewConfigs[i].next = nullptr;
-    }
+    engine->state.viewConfigs.resize(engine->state.viewCount,
+                                     {XR_TYPE_VIEW_CONFIGURATION_VIEW});
 
     result = xrEnumerateViewConfigurationViews(
             engine->state.xrInstance, engine->state.xrSysId,
-            stereoViewConfigType, engine->state.viewCount,
-            &engine->state.viewCount, engine->state.viewConfigs);
+            engine->state.viewConfigType, engine->state.viewCount,
+            &engine->state.viewCount, engine->state.viewConfigs.data());
     if (XR_SUCCESS != result) {
         LOGE(LOG_TAG, "xrEnumerateViewConfigurationViews failed: %d", result);
         assert(0);
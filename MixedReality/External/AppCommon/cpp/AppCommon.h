@@ -25,8 +25,6 @@
 #include "xr_linear.h"
 
 #define LOG_TAG "AppCommon"
-//#define THERMAL_INTERVAL 1
-// bool ThermalLoop;
 extern XrPosef idPose;
 
 namespace AppCommon {
@@ -43,8 +41,8 @@ struct Swapchain {
 struct DepthInfo
 {
     // supporting depth layers is *optional* for runtimes
-    bool supported;
-    XrCompositionLayerDepthInfoKHR* infos;
+    bool supported = false;
+    XrCompositionLayerDepthInfoKHR* infos = nullptr;
 };
 
 /**
@@ -59,8 +57,12 @@ struct base_saved_state {
     XrSession xrSession = XR_NULL_HANDLE;
     XrSpace xrLocalSpace = XR_NULL_HANDLE;
     XrSpace xrViewSpace = XR_NULL_HANDLE;
+    // stereo, or quad views (wide context views 0-1, high resolution
+    // insets 2-3) when the app enabled them and the runtime has them
+    XrViewConfigurationType viewConfigType =
+            XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
     uint32_t viewCount = 0;
-    XrViewConfigurationView viewConfigs[2];
+    std::vector<XrViewConfigurationView> viewConfigs;
     std::vector<XrView> m_views;
 };
 
@@ -90,12 +92,24 @@ struct base_engine {
         false; // if support displaying on both host and viewer
     bool projection_layer_only = true;
     DepthInfo depthInfo;
+    bool cylinder_layer_supported = false;
+    bool visibility_mask_supported = false;
+    bool quad_views_supported = false;
+    // set by the app when it enabled XR_VARJO_quad_views on the instance
+    bool quad_views_enabled = false;
+    bool space_warp_supported = false;
+    bool perf_settings_supported = false;
+    // bit per view whose visibility mask changed, cleared by the app
+    uint32_t visibility_mask_changed = 0;
+    // XR_EXT_performance_settings notifications, drained by the app
+    std::vector<XrEventDataPerfSettingsEXT> perf_settings_events;
 };
 
 /**
- * Thermal Test func
+ * Reads an android system property, defaultValue if unset or empty.
  */
-// void *thermal_func(void *arg);
+void GetSysProperty(char const *name, char *value, size_t const len,
+                    char const *defaultValue);
 
 /**
  * Process the next main command.
@@ -124,11 +138,6 @@ void app_end_session(struct base_engine *engine);
  */
 void app_wait_window(struct base_engine *engine);
 
-/**
- * Get content from given files.
- */
-void *get_file_buffer(const char *pFileName, int *pBufferSize);
-
 /**
  * Initialize an EGL context for the current display.
  */
@@ -0,0 +1,399 @@
+/****************************************************************
+ * Copyright (c) 2020-2021 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+
+#include "KtxLoader.h"
+#include "LayerManager.h"
+#include "LogUtils.h"
+#include <assert.h>
+
+namespace AppCommon {
+
+LayerManager::LayerManager()
+    : session(XR_NULL_HANDLE), space(XR_NULL_HANDLE),
+      cylinderSupported(false), renderCount(0)
+{
+}
+
+void LayerManager::init(XrSession session, XrSpace space,
+                        bool cylinderSupported)
+{
+    this->session = session;
+    this->space = space;
+    this->cylinderSupported = cylinderSupported;
+    renderCount = 0;
+    // layers are cleared to their clear color, there is no depth
+    pass.SetDepthOps(QtiGL::RenderPass::kLoadOpDontCare,
+                     QtiGL::RenderPass::kStoreOpDiscard);
+}
+
+int LayerManager::add_layer(const LayerDesc &desc)
+{
+    if (desc.width == 0 || desc.height == 0 || desc.render == nullptr) {
+        LOGE(LOG_TAG, "add_layer: invalid layer description");
+        return -1;
+    }
+    if (layers.size() >= LAYER_MANAGER_MAX_LAYERS) {
+        LOGE(LOG_TAG, "add_layer: already %d layers", LAYER_MANAGER_MAX_LAYERS);
+        return -1;
+    }
+
+    layers.emplace_back();
+    Layer &layer = layers.back();
+    layer.desc = desc;
+    if (desc.shape == LAYER_SHAPE_CYLINDER && !cylinderSupported) {
+        // same width at the same distance, flat
+        LOGW(LOG_TAG, "cylinder layers not supported, using a quad");
+        layer.desc.shape = LAYER_SHAPE_QUAD;
+        layer.desc.size.width = desc.radius * desc.centralAngle;
+        layer.desc.size.height = layer.desc.size.width / desc.aspectRatio;
+        layer.desc.pose.position.z -= desc.radius;
+    }
+    layer.swapchain = XR_NULL_HANDLE;
+    layer.dirty = true;
+    layer.visible = true;
+    layer.rendered = false;
+
+    // the runtime only ever samples the resolved image
+    XrSwapchainCreateInfo info = {XR_TYPE_SWAPCHAIN_CREATE_INFO};
+    info.usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT |
+                      XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT;
+    info.format = GL_RGBA8;
+    info.sampleCount = 1;
+    info.width = desc.width;
+    info.height = desc.height;
+    info.faceCount = 1;
+    info.arraySize = 1;
+    info.mipCount = 1;
+    XrResult result = xrCreateSwapchain(session, &info, &layer.swapchain);
+    if (XR_SUCCESS != result) {
+        LOGE(LOG_TAG, "xrCreateSwapchain layer failed: %d", result);
+        layers.pop_back();
+        return -1;
+    }
+
+    uint32_t length = 0;
+    xrEnumerateSwapchainImages(layer.swapchain, 0, &length, nullptr);
+    layer.images.resize(length);
+    for (uint32_t i = 0; i < length; i++) {
+        layer.images[i].type = XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_ES_KHR;
+        layer.images[i].next = nullptr;
+    }
+    result = xrEnumerateSwapchainImages(
+            layer.swapchain, length, &length,
+            (XrSwapchainImageBaseHeader *)&layer.images[0]);
+    if (XR_SUCCESS != result) {
+        LOGE(LOG_TAG, "xrEnumerateSwapchainImages layer failed: %d", result);
+        xrDestroySwapchain(layer.swapchain);
+        layers.pop_back();
+        return -1;
+    }
+
+    bool const implicitResolve =
+            QtiGL::RenderTarget::IsImplicitResolveSupported();
+    layer.targets.resize(length);
+    for (uint32_t i = 0; i < length; i++) {
+        if (implicitResolve) {
+            layer.targets[i].InitializeImplicitResolveExternal(
+                    desc.width, desc.height, LAYER_SAMPLES,
+                    layer.images[i].image, false);
+        } else {
+            layer.targets[i].InitializeImageTargetRenderbuffer(
+                    desc.width, desc.height, layer.images[i].image, false);
+        }
+    }
+
+    fill_layer(layer);
+    LOGI(LOG_TAG, "layer %d: %s %ux%u, %u images", (int)layers.size() - 1,
+         layer.desc.shape == LAYER_SHAPE_CYLINDER ? "cylinder" : "quad",
+         desc.width, desc.height, length);
+    return (int)layers.size() - 1;
+}
+
+int LayerManager::add_equirect_layer(const LayerDesc &desc, const void *ktx,
+                                     uint32_t ktxSize, uint32_t maxWidth)
+{
+    if (layers.size() >= LAYER_MANAGER_MAX_LAYERS) {
+        LOGE(LOG_TAG, "add_equirect_layer: already %d layers",
+             LAYER_MANAGER_MAX_LAYERS);
+        return -1;
+    }
+
+    // the levels are uploaded in place from the mapped file
+    QtiGL::KtxTexture parser;
+    QtiGL::TKTXHeader header;
+    std::vector<QtiGL::TKTXImage> images;
+    QtiGL::TKTXErrorCode error =
+            parser.ParseLevels(ktx, ktxSize, &header, &images);
+    if (error != QtiGL::KTX_SUCCESS || header.numberOfFaces != 1) {
+        LOGE(LOG_TAG, "add_equirect_layer: unsupported panorama (%d)", error);
+        return -1;
+    }
+    if (!is_format_supported(header.glInternalFormat)) {
+        LOGE(LOG_TAG, "add_equirect_layer: swapchain format 0x%x unsupported",
+             header.glInternalFormat);
+        return -1;
+    }
+
+    // lower tiers skip the top levels, they'd be minified anyway
+    uint32_t firstLevel = 0;
+    while (firstLevel + 1 < images.size() &&
+           images[firstLevel].nWidth > maxWidth) {
+        firstLevel++;
+    }
+    uint32_t const levelCount = (uint32_t)images.size() - firstLevel;
+
+    layers.emplace_back();
+    Layer &layer = layers.back();
+    layer.desc = desc;
+    layer.desc.shape = LAYER_SHAPE_EQUIRECT;
+    layer.desc.width = images[firstLevel].nWidth;
+    layer.desc.height = images[firstLevel].nHeight;
+    layer.desc.render = nullptr;
+    layer.swapchain = XR_NULL_HANDLE;
+    layer.dirty = false;
+    layer.visible = true;
+    layer.rendered = false;
+
+    XrSwapchainCreateInfo info = {XR_TYPE_SWAPCHAIN_CREATE_INFO};
+    info.createFlags = XR_SWAPCHAIN_CREATE_STATIC_IMAGE_BIT;
+    info.usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT |
+                      XR_SWAPCHAIN_USAGE_TRANSFER_DST_BIT;
+    info.format = header.glInternalFormat;
+    info.sampleCount = 1;
+    info.width = layer.desc.width;
+    info.height = layer.desc.height;
+    info.faceCount = 1;
+    info.arraySize = 1;
+    info.mipCount = levelCount;
+    XrResult result = xrCreateSwapchain(session, &info, &layer.swapchain);
+    if (XR_SUCCESS != result) {
+        LOGE(LOG_TAG, "xrCreateSwapchain equirect failed: %d", result);
+        layers.pop_back();
+        return -1;
+    }
+
+    // a static swapchain has a single image, acquired exactly once
+    layer.images.resize(1);
+    layer.images[0].type = XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_ES_KHR;
+    layer.images[0].next = nullptr;
+    uint32_t length = 0;
+    result = xrEnumerateSwapchainImages(
+            layer.swapchain, 1, &length,
+            (XrSwapchainImageBaseHeader *)&layer.images[0]);
+    uint32_t index = 0;
+    XrSwapchainImageAcquireInfo acquireInfo = {
+            XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO};
+    if (XR_SUCCESS == result) {
+        result = xrAcquireSwapchainImage(layer.swapchain, &acquireInfo, &index);
+    }
+    if (XR_SUCCESS != result) {
+        LOGE(LOG_TAG, "equirect swapchain image unavailable: %d", result);
+        xrDestroySwapchain(layer.swapchain);
+        layers.pop_back();
+        return -1;
+    }
+    XrSwapchainImageWaitInfo waitInfo = {XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO};
+    waitInfo.timeout = XR_INFINITE_DURATION;
+    xrWaitSwapchainImage(layer.swapchain, &waitInfo);
+
+    bool const compressed = (header.glType == 0);
+    glBindTexture(GL_TEXTURE_2D, layer.images[0].image);
+    for (uint32_t level = 0; level < levelCount; level++) {
+        const QtiGL::TKTXImage &image = images[firstLevel + level];
+        if (compressed) {
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, image.nWidth,
+                                      image.nHeight, header.glInternalFormat,
+                                      image.nSize, image.pData);
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, image.nWidth,
+                            image.nHeight, header.glFormat, header.glType,
+                            image.pData);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    XrSwapchainImageReleaseInfo releaseInfo = {
+            XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO};
+    xrReleaseSwapchainImage(layer.swapchain, &releaseInfo);
+    layer.rendered = true;
+
+    fill_layer(layer);
+    LOGI(LOG_TAG, "layer %d: equirect %ux%u, %u of %u levels, format 0x%x",
+         (int)layers.size() - 1, layer.desc.width, layer.desc.height,
+         levelCount, (uint32_t)images.size(), header.glInternalFormat);
+    return (int)layers.size() - 1;
+}
+
+bool LayerManager::is_format_supported(int64_t format)
+{
+    uint32_t count = 0;
+    if (XR_SUCCESS !=
+        xrEnumerateSwapchainFormats(session, 0, &count, nullptr)) {
+        return false;
+    }
+    std::vector<int64_t> formats(count);
+    if (count == 0 || XR_SUCCESS != xrEnumerateSwapchainFormats(
+                                            session, count, &count,
+                                            formats.data())) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (formats[i] == format) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LayerManager::fill_layer(Layer &layer)
+{
+    const LayerDesc &desc = layer.desc;
+    XrSwapchainSubImage subImage;
+    subImage.swapchain = layer.swapchain;
+    subImage.imageRect.offset = {0, 0};
+    subImage.imageRect.extent = {(int32_t)desc.width, (int32_t)desc.height};
+    subImage.imageArrayIndex = 0;
+
+    layer.quad = {XR_TYPE_COMPOSITION_LAYER_QUAD};
+    layer.quad.layerFlags = desc.flags;
+    layer.quad.space = space;
+    layer.quad.eyeVisibility = XR_EYE_VISIBILITY_BOTH;
+    layer.quad.subImage = subImage;
+    layer.quad.pose = desc.pose;
+    layer.quad.size = desc.size;
+
+    layer.cylinder = {XR_TYPE_COMPOSITION_LAYER_CYLINDER_KHR};
+    layer.cylinder.layerFlags = desc.flags;
+    layer.cylinder.space = space;
+    layer.cylinder.eyeVisibility = XR_EYE_VISIBILITY_BOTH;
+    layer.cylinder.subImage = subImage;
+    layer.cylinder.pose = desc.pose;
+    layer.cylinder.radius = desc.radius;
+    layer.cylinder.centralAngle = desc.centralAngle;
+    layer.cylinder.aspectRatio = desc.aspectRatio;
+
+    // whole panorama; KTX rows are top down, so v is flipped for GL
+    layer.equirect = {XR_TYPE_COMPOSITION_LAYER_EQUIRECT_KHR};
+    layer.equirect.layerFlags = desc.flags;
+    layer.equirect.space = space;
+    layer.equirect.eyeVisibility = XR_EYE_VISIBILITY_BOTH;
+    layer.equirect.subImage = subImage;
+    layer.equirect.pose = desc.pose;
+    layer.equirect.radius = desc.radius;
+    layer.equirect.scale = {1.0f, -1.0f};
+    layer.equirect.bias = {0.0f, 1.0f};
+}
+
+void LayerManager::mark_dirty(int layer)
+{
+    assert(layer >= 0 && layer < (int)layers.size());
+    // static swapchains can't be acquired again
+    if (layers[layer].desc.shape == LAYER_SHAPE_EQUIRECT) {
+        return;
+    }
+    layers[layer].dirty = true;
+}
+
+void LayerManager::set_pose(int layer, const XrPosef &pose)
+{
+    // moving a layer is a compositor job, nothing to re-render
+    assert(layer >= 0 && layer < (int)layers.size());
+    layers[layer].desc.pose = pose;
+    layers[layer].quad.pose = pose;
+    layers[layer].cylinder.pose = pose;
+    layers[layer].equirect.pose = pose;
+}
+
+void LayerManager::set_visible(int layer, bool visible)
+{
+    assert(layer >= 0 && layer < (int)layers.size());
+    layers[layer].visible = visible;
+}
+
+void LayerManager::update()
+{
+    for (size_t i = 0; i < layers.size(); i++) {
+        Layer &layer = layers[i];
+        if (!layer.dirty || !layer.visible) {
+            continue;
+        }
+
+        uint32_t index = 0;
+        XrSwapchainImageAcquireInfo acquireInfo = {
+                XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO};
+        XrResult result =
+                xrAcquireSwapchainImage(layer.swapchain, &acquireInfo, &index);
+        if (XR_SUCCESS != result) {
+            LOGE(LOG_TAG, "xrAcquireSwapchainImage layer %zu failed: %d", i,
+                 result);
+            continue;
+        }
+        XrSwapchainImageWaitInfo waitInfo = {
+                XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO};
+        waitInfo.timeout = XR_INFINITE_DURATION;
+        xrWaitSwapchainImage(layer.swapchain, &waitInfo);
+
+        const float *clear = layer.desc.clearColor;
+        pass.SetColorOps(QtiGL::RenderPass::kLoadOpClear,
+                         QtiGL::RenderPass::kStoreOpStore, clear[0],
+                         clear[1], clear[2], clear[3]);
+        pass.Begin(layer.targets[index]);
+        layer.desc.render(layer.desc.userData, layer.desc.width,
+                          layer.desc.height);
+        pass.End();
+
+        XrSwapchainImageReleaseInfo releaseInfo = {
+                XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO};
+        xrReleaseSwapchainImage(layer.swapchain, &releaseInfo);
+
+        layer.dirty = false;
+        layer.rendered = true;
+        renderCount++;
+    }
+}
+
+uint32_t LayerManager::assemble_layers(
+        const XrCompositionLayerBaseHeader *projection,
+        const XrCompositionLayerBaseHeader **out, uint32_t capacity)
+{
+    uint32_t count = 0;
+    const auto append = [&](bool underlays) {
+        for (auto &layer : layers) {
+            if (layer.desc.underlay != underlays || !layer.visible ||
+                !layer.rendered || count >= capacity) {
+                continue;
+            }
+            if (layer.desc.shape == LAYER_SHAPE_CYLINDER) {
+                out[count++] = (XrCompositionLayerBaseHeader *)&layer.cylinder;
+            } else if (layer.desc.shape == LAYER_SHAPE_EQUIRECT) {
+                out[count++] = (XrCompositionLayerBaseHeader *)&layer.equirect;
+            } else {
+                out[count++] = (XrCompositionLayerBaseHeader *)&layer.quad;
+            }
+        }
+    };
+
+    append(true);
+    if (projection != nullptr && count < capacity) {
+        out[count++] = projection;
+    }
+    append(false);
+    return count;
+}
+
+void LayerManager::destroy()
+{
+    for (auto &layer : layers) {
+        for (auto &target : layer.targets) {
+            target.Destroy();
+        }
+        if (layer.swapchain != XR_NULL_HANDLE) {
+            xrDestroySwapchain(layer.swapchain);
+        }
+    }
+    layers.clear();
+}
+}; // namespace AppCommon
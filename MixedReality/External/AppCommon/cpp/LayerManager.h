@@ -0,0 +1,120 @@
+/****************************************************************
+ * Copyright (c) 2020-2021 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+
+#pragma once
+
+#include <vector>
+
+#include "AppCommon.h"
+#include "RenderPass.h"
+#include "RenderTarget.h"
+
+// most layers a LayerManager submits besides the projection layer
+#define LAYER_MANAGER_MAX_LAYERS 8
+// msaa of layer content, resolved on tile into the layer swapchain images
+#define LAYER_SAMPLES 4
+
+namespace AppCommon {
+
+enum LayerShape {
+    LAYER_SHAPE_QUAD = 0,
+    LAYER_SHAPE_CYLINDER, // falls back to a quad without XR_KHR_composition_layer_cylinder
+    LAYER_SHAPE_EQUIRECT, // static panorama, needs XR_KHR_composition_layer_equirect
+};
+
+/**
+ * Draws a layer's content. The layer framebuffer is bound and cleared, and
+ * the viewport covers the whole swapchain image.
+ */
+typedef void (*LayerRenderFunc)(void *userData, uint32_t width,
+                                uint32_t height);
+
+struct LayerDesc {
+    LayerShape shape = LAYER_SHAPE_QUAD;
+    // swapchain size in pixels
+    uint32_t width = 0;
+    uint32_t height = 0;
+    XrPosef pose = {{0.0f, 0.0f, 0.0f, 1.0f}, {0.0f, 0.0f, 0.0f}};
+    // quad size in meters
+    XrExtent2Df size = {1.0f, 1.0f};
+    // cylinder radius in meters, arc in radians and width / height; an
+    // equirect radius of 0 is an infinitely far sphere
+    float radius = 1.0f;
+    float centralAngle = 1.0f;
+    float aspectRatio = 1.0f;
+    // underlays go before the projection layer and show through wherever it
+    // is transparent, overlays go after it
+    bool underlay = false;
+    XrCompositionLayerFlags flags =
+            XR_COMPOSITION_LAYER_BLEND_TEXTURE_SOURCE_ALPHA_BIT;
+    float clearColor[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    LayerRenderFunc render = nullptr;
+    void *userData = nullptr;
+};
+
+/**
+ * Composition layers for static or slowly changing content.
+ *
+ * Every layer has its own swapchain that its content is rendered into once,
+ * and again only after mark_dirty(). In between, the runtime keeps
+ * compositing the last released image at display resolution, so an
+ * unchanged layer costs the app no GPU time at all. assemble_layers() builds
+ * the layers[] array for xrEndFrame() around the projection layer.
+ */
+class LayerManager {
+public:
+    LayerManager();
+
+    void init(XrSession session, XrSpace space, bool cylinderSupported);
+    // returns the layer id, -1 on failure; new layers start dirty
+    int add_layer(const LayerDesc &desc);
+    // equirect layer uploaded once from a KTX 1 panorama into a static
+    // swapchain, starting at the first mip level no wider than maxWidth;
+    // the layer is never re-rendered and desc.render is unused
+    int add_equirect_layer(const LayerDesc &desc, const void *ktx,
+                           uint32_t ktxSize, uint32_t maxWidth);
+    void mark_dirty(int layer);
+    void set_pose(int layer, const XrPosef &pose);
+    void set_visible(int layer, bool visible);
+    // renders the dirty layers, call between xrBeginFrame() and xrEndFrame()
+    void update();
+    // underlays, the projection layer (if any) and overlays, in the order
+    // they were added; returns the number of layers written
+    uint32_t assemble_layers(const XrCompositionLayerBaseHeader *projection,
+                             const XrCompositionLayerBaseHeader **layers,
+                             uint32_t capacity);
+    void destroy();
+
+    uint32_t get_layer_count() const { return (uint32_t)layers.size(); }
+    // layer re-renders since init()
+    uint32_t get_render_count() const { return renderCount; }
+
+private:
+    struct Layer {
+        LayerDesc desc;
+        XrSwapchain swapchain;
+        std::vector<XrSwapchainImageOpenGLESKHR> images;
+        std::vector<QtiGL::RenderTarget> targets;
+        bool dirty;
+        bool visible;
+        // nothing can be submitted before the first release
+        bool rendered;
+        XrCompositionLayerQuad quad;
+        XrCompositionLayerCylinderKHR cylinder;
+        XrCompositionLayerEquirectKHR equirect;
+    };
+
+    void fill_layer(Layer &layer);
+    bool is_format_supported(int64_t format);
+
+    XrSession session;
+    XrSpace space;
+    bool cylinderSupported;
+    std::vector<Layer> layers;
+    QtiGL::RenderPass pass;
+    uint32_t renderCount;
+};
+}; // namespace AppCommon
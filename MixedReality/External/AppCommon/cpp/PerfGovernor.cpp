@@ -0,0 +1,186 @@
+/****************************************************************
+ * Copyright (c) 2020-2021 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+
+#include "PerfGovernor.h"
+#include "LogUtils.h"
+
+namespace AppCommon {
+
+// highest quality first; every step changes at least one knob that is live
+// whatever foveation level is configured
+static const QualitySettings gTiers[] = {
+        // scale  samples  lodErrorScale  foveation
+        {1.0f, 4, 1.0f, QtiGL::Foveation::kLevelOff},
+        {0.9f, 4, 1.5f, QtiGL::Foveation::kLevelHigh},
+        {0.9f, 2, 2.0f, QtiGL::Foveation::kLevelHigh},
+        {0.8f, 2, 2.0f, QtiGL::Foveation::kLevelHigh},
+        {0.7f, 1, 3.0f, QtiGL::Foveation::kLevelHigh},
+};
+static const uint32_t gTierCount = sizeof(gTiers) / sizeof(gTiers[0]);
+
+static const char *level_name(XrPerfSettingsNotificationLevelEXT level)
+{
+    switch (level) {
+    case XR_PERF_SETTINGS_NOTIF_LEVEL_NORMAL_EXT:
+        return "normal";
+    case XR_PERF_SETTINGS_NOTIF_LEVEL_WARNING_EXT:
+        return "warning";
+    case XR_PERF_SETTINGS_NOTIF_LEVEL_IMPAIRED_EXT:
+        return "impaired";
+    default:
+        return "unknown";
+    }
+}
+
+PerfGovernor::PerfGovernor()
+    : session(XR_NULL_HANDLE), setPerformanceLevel(nullptr), maxSamples(4),
+      loading(false), cpuLevel(XR_PERF_SETTINGS_LEVEL_SUSTAINED_HIGH_EXT),
+      gpuLevel(XR_PERF_SETTINGS_LEVEL_SUSTAINED_HIGH_EXT), escalated(false),
+      lastChangeFrame(0), tier(0), settings(gTiers[0])
+{
+    for (uint32_t d = 0; d < 2; d++) {
+        for (uint32_t s = 0; s < PERF_GOVERNOR_SUB_DOMAINS; s++) {
+            levels[d][s] = XR_PERF_SETTINGS_NOTIF_LEVEL_NORMAL_EXT;
+        }
+    }
+}
+
+void PerfGovernor::init(XrInstance instance, XrSession session,
+                        bool supported, uint32_t maxSamples)
+{
+    this->session = session;
+    this->maxSamples = maxSamples > 0 ? maxSamples : 1;
+    if (supported && setPerformanceLevel == nullptr) {
+        xrGetInstanceProcAddr(instance, "xrPerfSettingsSetPerformanceLevelEXT",
+                              (PFN_xrVoidFunction *)&setPerformanceLevel);
+        if (setPerformanceLevel == nullptr) {
+            LOGW(LOG_TAG, "xrPerfSettingsSetPerformanceLevelEXT not found");
+        }
+    }
+    set_tier(0);
+    apply_performance_levels();
+}
+
+void PerfGovernor::set_level_func(PFN_xrPerfSettingsSetPerformanceLevelEXT func)
+{
+    setPerformanceLevel = func;
+}
+
+void PerfGovernor::set_loading(bool loading)
+{
+    if (this->loading == loading) {
+        return;
+    }
+    this->loading = loading;
+    apply_performance_levels();
+}
+
+void PerfGovernor::apply_performance_levels()
+{
+    cpuLevel = loading ? XR_PERF_SETTINGS_LEVEL_BOOST_EXT
+                       : XR_PERF_SETTINGS_LEVEL_SUSTAINED_LOW_EXT;
+    gpuLevel = loading ? XR_PERF_SETTINGS_LEVEL_SUSTAINED_LOW_EXT
+                       : XR_PERF_SETTINGS_LEVEL_SUSTAINED_HIGH_EXT;
+    LOGI(LOG_TAG, "Performance levels (%s): cpu %d, gpu %d",
+         loading ? "loading" : "steady", cpuLevel, gpuLevel);
+    if (setPerformanceLevel == nullptr) {
+        return;
+    }
+    XrResult result = setPerformanceLevel(
+            session, XR_PERF_SETTINGS_DOMAIN_CPU_EXT, cpuLevel);
+    if (XR_SUCCESS != result) {
+        LOGE(LOG_TAG, "Setting the cpu performance level failed: %d", result);
+    }
+    result = setPerformanceLevel(session, XR_PERF_SETTINGS_DOMAIN_GPU_EXT,
+                                 gpuLevel);
+    if (XR_SUCCESS != result) {
+        LOGE(LOG_TAG, "Setting the gpu performance level failed: %d", result);
+    }
+}
+
+void PerfGovernor::on_event(const XrEventDataPerfSettingsEXT &event)
+{
+    uint32_t const domain =
+            event.domain == XR_PERF_SETTINGS_DOMAIN_GPU_EXT ? 1 : 0;
+    uint32_t const subDomain = (uint32_t)event.subDomain - 1;
+    if (subDomain >= PERF_GOVERNOR_SUB_DOMAINS) {
+        return;
+    }
+    LOGI(LOG_TAG, "Perf settings: %s sub domain %d %s -> %s",
+         domain ? "gpu" : "cpu", event.subDomain,
+         level_name(event.fromLevel), level_name(event.toLevel));
+    if (event.toLevel > levels[domain][subDomain]) {
+        escalated = true;
+    }
+    levels[domain][subDomain] = event.toLevel;
+}
+
+XrPerfSettingsNotificationLevelEXT PerfGovernor::get_level() const
+{
+    XrPerfSettingsNotificationLevelEXT worst =
+            XR_PERF_SETTINGS_NOTIF_LEVEL_NORMAL_EXT;
+    for (uint32_t d = 0; d < 2; d++) {
+        for (uint32_t s = 0; s < PERF_GOVERNOR_SUB_DOMAINS; s++) {
+            if (levels[d][s] > worst) {
+                worst = levels[d][s];
+            }
+        }
+    }
+    return worst;
+}
+
+XrPerfSettingsLevelEXT
+PerfGovernor::get_performance_level(XrPerfSettingsDomainEXT domain) const
+{
+    return domain == XR_PERF_SETTINGS_DOMAIN_GPU_EXT ? gpuLevel : cpuLevel;
+}
+
+uint32_t PerfGovernor::get_tier_count() const
+{
+    return gTierCount;
+}
+
+void PerfGovernor::set_tier(uint32_t newTier)
+{
+    tier = newTier < gTierCount ? newTier : gTierCount - 1;
+    settings = gTiers[tier];
+    if (settings.samples > maxSamples) {
+        settings.samples = maxSamples;
+    }
+}
+
+bool PerfGovernor::update(uint32_t frameIndex)
+{
+    uint32_t const lowest = gTierCount - 1;
+    uint32_t newTier = tier;
+    XrPerfSettingsNotificationLevelEXT const level = get_level();
+    if (level >= XR_PERF_SETTINGS_NOTIF_LEVEL_IMPAIRED_EXT) {
+        newTier = lowest;
+        lastChangeFrame = frameIndex;
+    } else if (level >= XR_PERF_SETTINGS_NOTIF_LEVEL_WARNING_EXT) {
+        if (escalated ||
+            frameIndex - lastChangeFrame >= PERF_GOVERNOR_STEP_FRAMES) {
+            if (tier < lowest) {
+                newTier = tier + 1;
+            }
+            lastChangeFrame = frameIndex;
+        }
+    } else if (frameIndex - lastChangeFrame >= PERF_GOVERNOR_RECOVER_FRAMES &&
+               tier > 0) {
+        newTier = tier - 1;
+        lastChangeFrame = frameIndex;
+    }
+    escalated = false;
+
+    if (newTier == tier) {
+        return false;
+    }
+    LOGI(LOG_TAG, "Quality tier %u -> %u (%s)", tier, newTier,
+         level_name(level));
+    set_tier(newTier);
+    return true;
+}
+}; // namespace AppCommon
@@ -0,0 +1,105 @@
+/****************************************************************
+ * Copyright (c) 2020-2021 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+
+#pragma once
+
+#include "AppCommon.h"
+#include "Foveation.h"
+
+// frames a warning has to last before quality drops another tier
+#define PERF_GOVERNOR_STEP_FRAMES 300
+// frames everything has to be normal before quality comes back up a tier
+#define PERF_GOVERNOR_RECOVER_FRAMES 900
+// XrPerfSettingsSubDomainEXT values run from 1 to this
+#define PERF_GOVERNOR_SUB_DOMAINS 3
+
+namespace AppCommon {
+
+/**
+ * Quality knobs of one governor tier.
+ */
+struct QualitySettings {
+    // eye images are rendered to this fraction of their width and height
+    float resolutionScale;
+    // msaa, capped by the sample count passed to init()
+    uint32_t samples;
+    // multiplies the pixel error allowed when picking mesh LODs
+    float lodErrorScale;
+    // least foveation, applied on top of the configured level
+    QtiGL::Foveation::Level foveation;
+};
+
+/**
+ * Steps quality down before the runtime has to throttle the app.
+ *
+ * XR_EXT_performance_settings reports a notification level for each CPU
+ * and GPU sub domain (compositing, rendering, thermal). While the worst of
+ * them is normal nothing changes. The first warning drops quality a tier,
+ * and it keeps dropping every PERF_GOVERNOR_STEP_FRAMES frames while the
+ * warning lasts. Impaired, where the runtime throttles, goes straight to
+ * the lowest tier. Tiers come back one at a time after
+ * PERF_GOVERNOR_RECOVER_FRAMES frames of everything being normal. Cheap
+ * knobs go first: high foveation, LOD and a slight resolution cut, then
+ * msaa, then more resolution.
+ *
+ * The CPU and GPU performance levels follow the phase: while loading the
+ * CPU is boosted and the GPU kept low, in steady state the CPU is sustained
+ * low and the GPU sustained high.
+ *
+ * Everything is driven by on_event() and the frame index given to update(),
+ * never by a clock, so a stub runtime can inject notifications and check
+ * the tiers and levels that result; set_level_func() replaces
+ * xrPerfSettingsSetPerformanceLevelEXT for that. perf_governor_check() does
+ * exactly this.
+ */
+class PerfGovernor {
+public:
+    PerfGovernor();
+
+    // supported: XR_EXT_performance_settings is enabled on the instance
+    void init(XrInstance instance, XrSession session, bool supported,
+              uint32_t maxSamples);
+    void set_level_func(PFN_xrPerfSettingsSetPerformanceLevelEXT func);
+    void set_loading(bool loading);
+    void on_event(const XrEventDataPerfSettingsEXT &event);
+    // once per frame; true if the tier changed
+    bool update(uint32_t frameIndex);
+
+    uint32_t get_tier() const { return tier; }
+    uint32_t get_tier_count() const;
+    const QualitySettings &get_settings() const { return settings; }
+    // worst notification level across all domains
+    XrPerfSettingsNotificationLevelEXT get_level() const;
+    XrPerfSettingsLevelEXT get_performance_level(
+            XrPerfSettingsDomainEXT domain) const;
+
+private:
+    void apply_performance_levels();
+    void set_tier(uint32_t newTier);
+
+    XrSession session;
+    PFN_xrPerfSettingsSetPerformanceLevelEXT setPerformanceLevel;
+    uint32_t maxSamples;
+    bool loading;
+    XrPerfSettingsLevelEXT cpuLevel;
+    XrPerfSettingsLevelEXT gpuLevel;
+    // [cpu, gpu][sub domain - 1]
+    XrPerfSettingsNotificationLevelEXT levels[2][PERF_GOVERNOR_SUB_DOMAINS];
+    bool escalated;
+    uint32_t lastChangeFrame;
+    uint32_t tier;
+    QualitySettings settings;
+};
+
+/**
+ * Drives a governor through a stub runtime: loading and steady performance
+ * levels, a warning stepping down a tier at once and again after
+ * PERF_GOVERNOR_STEP_FRAMES, impaired dropping to the lowest tier, recovery
+ * after PERF_GOVERNOR_RECOVER_FRAMES and the msaa cap. Logs every mismatch;
+ * true if there were none. Needs no XR instance or GL context.
+ */
+bool perf_governor_check();
+}; // namespace AppCommon
@@ -0,0 +1,163 @@
+/****************************************************************
+ * Copyright (c) 2020-2021 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+
+#include "PerfGovernor.h"
+#include "LogUtils.h"
+
+namespace AppCommon {
+
+// what the stub runtime was last told, per domain
+static XrPerfSettingsLevelEXT gStubLevels[2];
+static uint32_t gStubCalls;
+
+static XRAPI_ATTR XrResult XRAPI_CALL
+stub_set_performance_level(XrSession session, XrPerfSettingsDomainEXT domain,
+                           XrPerfSettingsLevelEXT level)
+{
+    gStubLevels[domain == XR_PERF_SETTINGS_DOMAIN_GPU_EXT ? 1 : 0] = level;
+    gStubCalls++;
+    return XR_SUCCESS;
+}
+
+static XrEventDataPerfSettingsEXT
+make_event(XrPerfSettingsDomainEXT domain, XrPerfSettingsSubDomainEXT subDomain,
+           XrPerfSettingsNotificationLevelEXT fromLevel,
+           XrPerfSettingsNotificationLevelEXT toLevel)
+{
+    XrEventDataPerfSettingsEXT event = {XR_TYPE_EVENT_DATA_PERF_SETTINGS_EXT};
+    event.domain = domain;
+    event.subDomain = subDomain;
+    event.fromLevel = fromLevel;
+    event.toLevel = toLevel;
+    return event;
+}
+
+static bool expect_tier(const PerfGovernor &governor, uint32_t tier,
+                        const char *step)
+{
+    if (governor.get_tier() == tier) {
+        return true;
+    }
+    LOGE(LOG_TAG, "Perf governor check, %s: tier %u, expected %u", step,
+         governor.get_tier(), tier);
+    return false;
+}
+
+static bool expect_levels(const PerfGovernor &governor,
+                          XrPerfSettingsLevelEXT cpu,
+                          XrPerfSettingsLevelEXT gpu, const char *step)
+{
+    bool ok = governor.get_performance_level(XR_PERF_SETTINGS_DOMAIN_CPU_EXT) ==
+                      cpu &&
+              governor.get_performance_level(XR_PERF_SETTINGS_DOMAIN_GPU_EXT) ==
+                      gpu &&
+              gStubLevels[0] == cpu && gStubLevels[1] == gpu;
+    if (!ok) {
+        LOGE(LOG_TAG,
+             "Perf governor check, %s: runtime cpu %d gpu %d, expected %d %d",
+             step, gStubLevels[0], gStubLevels[1], cpu, gpu);
+    }
+    return ok;
+}
+
+bool perf_governor_check()
+{
+    bool ok = true;
+    gStubLevels[0] = gStubLevels[1] = (XrPerfSettingsLevelEXT)0;
+    gStubCalls = 0;
+
+    PerfGovernor governor;
+    governor.set_level_func(stub_set_performance_level);
+    governor.init(XR_NULL_HANDLE, XR_NULL_HANDLE, true, 4);
+    ok &= expect_tier(governor, 0, "init");
+    ok &= expect_levels(governor, XR_PERF_SETTINGS_LEVEL_SUSTAINED_LOW_EXT,
+                        XR_PERF_SETTINGS_LEVEL_SUSTAINED_HIGH_EXT, "init");
+    if (gStubCalls != 2) {
+        LOGE(LOG_TAG, "Perf governor check, init: %u runtime calls",
+             gStubCalls);
+        ok = false;
+    }
+
+    governor.set_loading(true);
+    ok &= expect_levels(governor, XR_PERF_SETTINGS_LEVEL_BOOST_EXT,
+                        XR_PERF_SETTINGS_LEVEL_SUSTAINED_LOW_EXT, "loading");
+    governor.set_loading(false);
+    ok &= expect_levels(governor, XR_PERF_SETTINGS_LEVEL_SUSTAINED_LOW_EXT,
+                        XR_PERF_SETTINGS_LEVEL_SUSTAINED_HIGH_EXT, "steady");
+
+    // nothing changes while everything is normal
+    uint32_t frame = 1;
+    ok &= !governor.update(frame);
+    ok &= expect_tier(governor, 0, "normal");
+
+    // a warning drops a tier at once, then one per PERF_GOVERNOR_STEP_FRAMES
+    governor.on_event(make_event(XR_PERF_SETTINGS_DOMAIN_GPU_EXT,
+                                 XR_PERF_SETTINGS_SUB_DOMAIN_RENDERING_EXT,
+                                 XR_PERF_SETTINGS_NOTIF_LEVEL_NORMAL_EXT,
+                                 XR_PERF_SETTINGS_NOTIF_LEVEL_WARNING_EXT));
+    ok &= governor.update(++frame);
+    ok &= expect_tier(governor, 1, "warning");
+    const QualitySettings &tier1 = governor.get_settings();
+    if (tier1.resolutionScale >= 1.0f &&
+        tier1.foveation <= QtiGL::Foveation::kLevelMedium) {
+        LOGE(LOG_TAG, "Perf governor check, warning: tier 1 changes nothing");
+        ok = false;
+    }
+    ok &= !governor.update(++frame);
+    ok &= expect_tier(governor, 1, "warning held");
+    frame += PERF_GOVERNOR_STEP_FRAMES;
+    ok &= governor.update(frame);
+    ok &= expect_tier(governor, 2, "warning lasted");
+
+    // impaired goes straight to the lowest tier
+    governor.on_event(make_event(XR_PERF_SETTINGS_DOMAIN_CPU_EXT,
+                                 XR_PERF_SETTINGS_SUB_DOMAIN_THERMAL_EXT,
+                                 XR_PERF_SETTINGS_NOTIF_LEVEL_WARNING_EXT,
+                                 XR_PERF_SETTINGS_NOTIF_LEVEL_IMPAIRED_EXT));
+    ok &= governor.update(++frame);
+    uint32_t const lowest = governor.get_tier_count() - 1;
+    ok &= expect_tier(governor, lowest, "impaired");
+    if (governor.get_level() != XR_PERF_SETTINGS_NOTIF_LEVEL_IMPAIRED_EXT) {
+        LOGE(LOG_TAG, "Perf governor check, impaired: level %d",
+             governor.get_level());
+        ok = false;
+    }
+
+    // sub domains outside the enum are ignored
+    governor.on_event(make_event(XR_PERF_SETTINGS_DOMAIN_CPU_EXT,
+                                 (XrPerfSettingsSubDomainEXT)0,
+                                 XR_PERF_SETTINGS_NOTIF_LEVEL_NORMAL_EXT,
+                                 XR_PERF_SETTINGS_NOTIF_LEVEL_IMPAIRED_EXT));
+
+    // back to normal, one tier comes back per PERF_GOVERNOR_RECOVER_FRAMES
+    governor.on_event(make_event(XR_PERF_SETTINGS_DOMAIN_CPU_EXT,
+                                 XR_PERF_SETTINGS_SUB_DOMAIN_THERMAL_EXT,
+                                 XR_PERF_SETTINGS_NOTIF_LEVEL_IMPAIRED_EXT,
+                                 XR_PERF_SETTINGS_NOTIF_LEVEL_NORMAL_EXT));
+    governor.on_event(make_event(XR_PERF_SETTINGS_DOMAIN_GPU_EXT,
+                                 XR_PERF_SETTINGS_SUB_DOMAIN_RENDERING_EXT,
+                                 XR_PERF_SETTINGS_NOTIF_LEVEL_WARNING_EXT,
+                                 XR_PERF_SETTINGS_NOTIF_LEVEL_NORMAL_EXT));
+    ok &= !governor.update(++frame);
+    ok &= expect_tier(governor, lowest, "recovering");
+    frame += PERF_GOVERNOR_RECOVER_FRAMES;
+    ok &= governor.update(frame);
+    ok &= expect_tier(governor, lowest - 1, "recovered");
+
+    // tiers never ask for more samples than the eye buffers have
+    PerfGovernor capped;
+    capped.set_level_func(stub_set_performance_level);
+    capped.init(XR_NULL_HANDLE, XR_NULL_HANDLE, true, 2);
+    if (capped.get_settings().samples != 2) {
+        LOGE(LOG_TAG, "Perf governor check, cap: %u samples",
+             capped.get_settings().samples);
+        ok = false;
+    }
+
+    LOGI(LOG_TAG, "Perf governor check %s", ok ? "passed" : "FAILED");
+    return ok;
+}
+}; // namespace AppCommon
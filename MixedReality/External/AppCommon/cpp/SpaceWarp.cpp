@@ -0,0 +1,199 @@
+/****************************************************************
+ * Copyright (c) 2020-2021 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+
+#include "SpaceWarp.h"
+#include "LogUtils.h"
+#include <assert.h>
+#include <string.h>
+
+namespace AppCommon {
+
+SpaceWarp::SpaceWarp()
+    : session(XR_NULL_HANDLE), viewCount(0), enabled(false), width(0),
+      height(0)
+{
+    for (uint32_t i = 0; i < SPACE_WARP_MAX_VIEWS; i++) {
+        views[i].swapchain.xrSwapchain = XR_NULL_HANDLE;
+        views[i].swapchain.xrSwapchainDepth = XR_NULL_HANDLE;
+        views[i].motionIndex = 0;
+        views[i].depthIndex = 0;
+        views[i].drawn = false;
+    }
+    memset(infos, 0, sizeof(infos));
+}
+
+bool SpaceWarp::init(XrInstance instance, XrSystemId systemId,
+                     XrSession session, uint32_t viewCount, bool supported)
+{
+    this->session = session;
+    this->viewCount = viewCount < SPACE_WARP_MAX_VIEWS ? viewCount
+                                                       : SPACE_WARP_MAX_VIEWS;
+
+    char propValue[PROP_VALUE_MAX];
+    GetSysProperty("debug.mixedreality.spaceWarp", propValue,
+                   sizeof(propValue), "false");
+    enabled = supported && propValue[0] == 't';
+    if (!enabled) {
+        LOGI(LOG_TAG, "Space warp: %s",
+             supported ? "disabled" : "not supported");
+        return true;
+    }
+
+    XrSystemSpaceWarpPropertiesFB spaceWarpProperties = {
+            XR_TYPE_SYSTEM_SPACE_WARP_PROPERTIES_FB};
+    XrSystemProperties systemProperties = {XR_TYPE_SYSTEM_PROPERTIES};
+    systemProperties.next = &spaceWarpProperties;
+    XrResult result =
+            xrGetSystemProperties(instance, systemId, &systemProperties);
+    if (XR_SUCCESS != result ||
+        spaceWarpProperties.recommendedMotionVectorImageRectWidth == 0) {
+        LOGE(LOG_TAG, "Space warp properties failed: %d", result);
+        enabled = false;
+        return false;
+    }
+    width = spaceWarpProperties.recommendedMotionVectorImageRectWidth;
+    height = spaceWarpProperties.recommendedMotionVectorImageRectHeight;
+    LOGI(LOG_TAG, "Space warp: %ux%u motion vectors", width, height);
+
+    XrSwapchainCreateInfo motionCreateInfo = {XR_TYPE_SWAPCHAIN_CREATE_INFO};
+    motionCreateInfo.usageFlags = XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT;
+    motionCreateInfo.format = SPACE_WARP_MOTION_FORMAT;
+    motionCreateInfo.sampleCount = 1;
+    motionCreateInfo.width = width;
+    motionCreateInfo.height = height;
+    motionCreateInfo.faceCount = 1;
+    motionCreateInfo.arraySize = 1;
+    motionCreateInfo.mipCount = 1;
+    XrSwapchainCreateInfo depthCreateInfo = motionCreateInfo;
+    depthCreateInfo.usageFlags =
+            XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    depthCreateInfo.format = SPACE_WARP_DEPTH_FORMAT;
+
+    for (uint32_t i = 0; i < this->viewCount; i++) {
+        app_create_swapchain(&motionCreateInfo, &this->session,
+                             &views[i].swapchain);
+        app_create_swapchain_depth(&depthCreateInfo, &this->session,
+                                   &views[i].swapchain);
+    }
+    return true;
+}
+
+bool SpaceWarp::begin_view(uint32_t view)
+{
+    if (!enabled || view >= viewCount) {
+        return false;
+    }
+    View &v = views[view];
+
+    XrSwapchainImageAcquireInfo acquireInfo = {
+            XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO};
+    XrSwapchainImageWaitInfo waitInfo = {XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO};
+    waitInfo.timeout = XR_INFINITE_DURATION;
+    XrResult result = xrAcquireSwapchainImage(v.swapchain.xrSwapchain,
+                                              &acquireInfo, &v.motionIndex);
+    if (XR_SUCCESS == result) {
+        result = xrWaitSwapchainImage(v.swapchain.xrSwapchain, &waitInfo);
+    }
+    if (XR_SUCCESS != result) {
+        LOGE(LOG_TAG, "Space warp motion image failed: %d", result);
+        return false;
+    }
+    result = xrAcquireSwapchainImage(v.swapchain.xrSwapchainDepth,
+                                     &acquireInfo, &v.depthIndex);
+    if (XR_SUCCESS == result) {
+        result = xrWaitSwapchainImage(v.swapchain.xrSwapchainDepth,
+                                      &waitInfo);
+    }
+    if (XR_SUCCESS != result) {
+        LOGE(LOG_TAG, "Space warp depth image failed: %d", result);
+        XrSwapchainImageReleaseInfo releaseInfo = {
+                XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO};
+        xrReleaseSwapchainImage(v.swapchain.xrSwapchain, &releaseInfo);
+        return false;
+    }
+
+    // color and depth indices can drift apart, attach whatever came back
+    glBindFramebuffer(GL_FRAMEBUFFER,
+                      v.swapchain.glFramebuffers[v.motionIndex]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D,
+                           v.swapchain.xrImages[v.motionIndex].image, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+                           v.swapchain.xrImagesDepth[v.depthIndex].image, 0);
+    glViewport(0, 0, width, height);
+    glScissor(0, 0, width, height);
+    glDepthMask(GL_TRUE);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClearDepthf(1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    v.drawn = true;
+    return true;
+}
+
+void SpaceWarp::end_view(uint32_t view)
+{
+    if (!enabled || view >= viewCount || !views[view].drawn) {
+        return;
+    }
+    View &v = views[view];
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    XrSwapchainImageReleaseInfo releaseInfo = {
+            XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO};
+    XrResult result =
+            xrReleaseSwapchainImage(v.swapchain.xrSwapchain, &releaseInfo);
+    if (XR_SUCCESS != result) {
+        LOGW(LOG_TAG, "Space warp motion release failed: %d", result);
+    }
+    result = xrReleaseSwapchainImage(v.swapchain.xrSwapchainDepth,
+                                     &releaseInfo);
+    if (XR_SUCCESS != result) {
+        LOGW(LOG_TAG, "Space warp depth release failed: %d", result);
+    }
+}
+
+void SpaceWarp::chain_layer_info(
+        uint32_t view, XrCompositionLayerProjectionView &projectionView,
+        float nearZ, float farZ)
+{
+    if (!enabled || view >= viewCount || !views[view].drawn) {
+        return;
+    }
+    views[view].drawn = false;
+
+    XrCompositionLayerSpaceWarpInfoFB &info = infos[view];
+    info.type = XR_TYPE_COMPOSITION_LAYER_SPACE_WARP_INFO_FB;
+    info.next = projectionView.next;
+    info.layerFlags = 0;
+    info.motionVectorSubImage.swapchain = views[view].swapchain.xrSwapchain;
+    info.motionVectorSubImage.imageArrayIndex = 0;
+    info.motionVectorSubImage.imageRect = {{0, 0},
+                                           {(int32_t)width, (int32_t)height}};
+    info.appSpaceDeltaPose = idPose;
+    info.depthSubImage = info.motionVectorSubImage;
+    info.depthSubImage.swapchain = views[view].swapchain.xrSwapchainDepth;
+    info.minDepth = 0.0f;
+    info.maxDepth = 1.0f;
+    info.nearZ = nearZ;
+    info.farZ = farZ;
+    projectionView.next = &info;
+}
+
+void SpaceWarp::destroy()
+{
+    for (uint32_t i = 0; i < viewCount; i++) {
+        if (views[i].swapchain.xrSwapchain != XR_NULL_HANDLE) {
+            app_destroy_swapchain(&views[i].swapchain);
+        }
+        if (views[i].swapchain.xrSwapchainDepth != XR_NULL_HANDLE) {
+            app_destroy_swapchain_depth(&views[i].swapchain);
+        }
+        views[i].drawn = false;
+    }
+    viewCount = 0;
+    enabled = false;
+}
+}; // namespace AppCommon
@@ -0,0 +1,74 @@
+/****************************************************************
+ * Copyright (c) 2020-2021 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+
+#pragma once
+
+#include "AppCommon.h"
+
+// most views space warp images are kept for
+#define SPACE_WARP_MAX_VIEWS 4
+// NDC motion in xyz
+#define SPACE_WARP_MOTION_FORMAT GL_RGBA16F
+#define SPACE_WARP_DEPTH_FORMAT GL_DEPTH_COMPONENT24
+
+namespace AppCommon {
+
+/**
+ * Application spacewarp through XR_FB_space_warp.
+ *
+ * Each view gets a motion vector swapchain and a depth swapchain at the
+ * runtime's recommended motion vector size. After the eye pass, begin_view()
+ * acquires this frame's images and binds them cleared, the app draws its
+ * motion vectors (see QtiGL::VelocityPass), and end_view() releases them.
+ * chain_layer_info() then hangs an XrCompositionLayerSpaceWarpInfoFB off the
+ * view's projection view. While the layer carries it the runtime throttles
+ * the app to half the display rate and synthesizes every other frame from
+ * the last one, its motion vectors and depth.
+ *
+ * The app space is the local space, which never moves, so appSpaceDeltaPose
+ * is the identity. Opt in: disabled without the extension, or unless
+ * debug.mixedreality.spaceWarp is set to true.
+ */
+class SpaceWarp {
+public:
+    SpaceWarp();
+
+    // supported: XR_FB_space_warp is enabled on the instance
+    bool init(XrInstance instance, XrSystemId systemId, XrSession session,
+              uint32_t viewCount, bool supported);
+    // acquires the view's images and binds them, motion cleared to 0 and
+    // depth to 1
+    bool begin_view(uint32_t view);
+    // releases the view's images; call before xrEndFrame
+    void end_view(uint32_t view);
+    // chains the view's space warp info in front of the projection view's
+    // next, if the view was drawn this frame
+    void chain_layer_info(uint32_t view,
+                          XrCompositionLayerProjectionView &projectionView,
+                          float nearZ, float farZ);
+    void destroy();
+
+    bool is_enabled() const { return enabled; }
+    uint32_t get_width() const { return width; }
+    uint32_t get_height() const { return height; }
+
+private:
+    struct View {
+        Swapchain swapchain;
+        uint32_t motionIndex;
+        uint32_t depthIndex;
+        bool drawn;
+    };
+
+    XrSession session;
+    uint32_t viewCount;
+    bool enabled;
+    uint32_t width;
+    uint32_t height;
+    View views[SPACE_WARP_MAX_VIEWS];
+    XrCompositionLayerSpaceWarpInfoFB infos[SPACE_WARP_MAX_VIEWS];
+};
+}; // namespace AppCommon
@@ -0,0 +1,274 @@
+/****************************************************************
+ * Copyright (c) 2020-2021 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+
+#include "VisibilityMask.h"
+#include "LogUtils.h"
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+namespace AppCommon {
+
+// mask vertices are in view space on the z = -1 plane; z is pinned to the
+// near plane so the primed depth always wins
+static const char *gMaskVertSrc =
+        "#version 320 es\n"
+        "layout(location = 0) in vec2 position;\n"
+        "uniform mat4 projectionMatrix;\n"
+        "void main()\n"
+        "{\n"
+        "    gl_Position = projectionMatrix * vec4(position, -1.0, 1.0);\n"
+        "    gl_Position.z = -gl_Position.w;\n"
+        "}\n";
+
+static const char *gMaskFragSrc =
+        "#version 320 es\n"
+        "precision mediump float;\n"
+        "out vec4 outColor;\n"
+        "void main()\n"
+        "{\n"
+        "    outColor = vec4(0.0);\n"
+        "}\n";
+
+VisibilityMask::VisibilityMask()
+    : session(XR_NULL_HANDLE),
+      viewConfigType(XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO), viewCount(0),
+      synthetic(true), getVisibilityMask(nullptr)
+{
+    memset(views, 0, sizeof(views));
+}
+
+bool VisibilityMask::init(XrInstance instance, XrSession session,
+                          XrViewConfigurationType viewConfigType,
+                          uint32_t viewCount, bool supported)
+{
+    this->session = session;
+    this->viewConfigType = viewConfigType;
+    this->viewCount = viewCount < VISIBILITY_MASK_MAX_VIEWS
+                              ? viewCount
+                              : VISIBILITY_MASK_MAX_VIEWS;
+
+    char propValue[PROP_VALUE_MAX];
+    GetSysProperty("debug.mixedreality.syntheticVisibilityMask", propValue,
+                   sizeof(propValue), "false");
+    synthetic = propValue[0] == 't';
+    getVisibilityMask = nullptr;
+    if (!synthetic && supported) {
+        xrGetInstanceProcAddr(instance, "xrGetVisibilityMaskKHR",
+                              (PFN_xrVoidFunction *)&getVisibilityMask);
+        if (getVisibilityMask == nullptr) {
+            LOGW(LOG_TAG, "xrGetVisibilityMaskKHR not found");
+        }
+    }
+    LOGI(LOG_TAG, "Visibility mask: %s",
+         synthetic ? "synthetic"
+                   : (getVisibilityMask != nullptr ? "runtime" : "none"));
+
+    if (!shader.Initialize(1, &gMaskVertSrc, 1, &gMaskFragSrc,
+                           "visibility_mask_v", "visibility_mask_f")) {
+        LOGE(LOG_TAG, "Visibility mask shader failed");
+        return false;
+    }
+    for (uint32_t i = 0; i < this->viewCount; i++) {
+        glGenBuffers(1, &views[i].vertexBuffer);
+        glGenBuffers(1, &views[i].indexBuffer);
+        views[i].indexCount = 0;
+        views[i].valid = false;
+        views[i].hiddenFraction = 0.0f;
+    }
+    return true;
+}
+
+void VisibilityMask::invalidate(uint32_t view)
+{
+    if (view < viewCount) {
+        views[view].valid = false;
+    }
+}
+
+bool VisibilityMask::query(uint32_t view, std::vector<XrVector2f> &vertices,
+                           std::vector<uint32_t> &indices)
+{
+    XrVisibilityMaskKHR mask = {XR_TYPE_VISIBILITY_MASK_KHR};
+    XrResult result = getVisibilityMask(
+            session, viewConfigType, view,
+            XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR, &mask);
+    if (XR_SUCCESS != result) {
+        LOGE(LOG_TAG, "xrGetVisibilityMaskKHR failed: %d", result);
+        return false;
+    }
+
+    vertices.resize(mask.vertexCountOutput);
+    indices.resize(mask.indexCountOutput);
+    mask.vertexCapacityInput = mask.vertexCountOutput;
+    mask.vertices = vertices.data();
+    mask.indexCapacityInput = mask.indexCountOutput;
+    mask.indices = indices.data();
+    if (mask.vertexCapacityInput == 0 || mask.indexCapacityInput == 0) {
+        // nothing hidden in this view
+        return true;
+    }
+    result = getVisibilityMask(session, viewConfigType, view,
+                               XR_VISIBILITY_MASK_TYPE_HIDDEN_TRIANGLE_MESH_KHR,
+                               &mask);
+    if (XR_SUCCESS != result) {
+        LOGE(LOG_TAG, "xrGetVisibilityMaskKHR failed: %d", result);
+        return false;
+    }
+    vertices.resize(mask.vertexCountOutput);
+    indices.resize(mask.indexCountOutput);
+    return true;
+}
+
+void VisibilityMask::build_synthetic(const XrFovf &fov,
+                                     std::vector<XrVector2f> &vertices,
+                                     std::vector<uint32_t> &indices)
+{
+    // the image spans these tangents; the ellipse touches each edge
+    float const left = tanf(fov.angleLeft);
+    float const right = tanf(fov.angleRight);
+    float const down = tanf(fov.angleDown);
+    float const up = tanf(fov.angleUp);
+
+    vertices.clear();
+    indices.clear();
+    for (uint32_t i = 0; i < VISIBILITY_MASK_SYNTHETIC_SEGMENTS; i++) {
+        float const angle =
+                2.0f * (float)M_PI * i / VISIBILITY_MASK_SYNTHETIC_SEGMENTS;
+        float const c = cosf(angle);
+        float const s = sinf(angle);
+        XrVector2f inner = {c * (c > 0.0f ? right : -left),
+                            s * (s > 0.0f ? up : -down)};
+
+        // the image edge along the same ray from the view axis; the chord
+        // between two of these cuts corners, which only hides less
+        float t = 1e30f;
+        if (c > 0.0f) t = fminf(t, right / c);
+        if (c < 0.0f) t = fminf(t, left / c);
+        if (s > 0.0f) t = fminf(t, up / s);
+        if (s < 0.0f) t = fminf(t, down / s);
+        XrVector2f outer = {c * t, s * t};
+
+        vertices.push_back(inner);
+        vertices.push_back(outer);
+    }
+
+    uint32_t const count = VISIBILITY_MASK_SYNTHETIC_SEGMENTS * 2;
+    for (uint32_t i = 0; i < count; i += 2) {
+        uint32_t const next = (i + 2) % count;
+        indices.push_back(i);
+        indices.push_back(i + 1);
+        indices.push_back(next + 1);
+        indices.push_back(i);
+        indices.push_back(next + 1);
+        indices.push_back(next);
+    }
+}
+
+void VisibilityMask::upload(uint32_t view, const XrFovf &fov,
+                            const std::vector<XrVector2f> &vertices,
+                            const std::vector<uint32_t> &indices)
+{
+    View &v = views[view];
+    v.indexCount = (uint32_t)indices.size();
+    v.valid = true;
+
+    // share of the image the mask removes, for the log
+    float hiddenArea = 0.0f;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const XrVector2f &a = vertices[indices[i]];
+        const XrVector2f &b = vertices[indices[i + 1]];
+        const XrVector2f &c = vertices[indices[i + 2]];
+        hiddenArea += 0.5f * fabsf((b.x - a.x) * (c.y - a.y) -
+                                   (c.x - a.x) * (b.y - a.y));
+    }
+    float const imageArea = (tanf(fov.angleRight) - tanf(fov.angleLeft)) *
+                            (tanf(fov.angleUp) - tanf(fov.angleDown));
+    v.hiddenFraction = imageArea > 0.0f ? hiddenArea / imageArea : 0.0f;
+    LOGI(LOG_TAG, "Visibility mask view %u: %u triangles hide %.1f%%", view,
+         v.indexCount / 3, v.hiddenFraction * 100.0f);
+
+    if (v.indexCount == 0) {
+        return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, v.vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(XrVector2f),
+                 vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, v.indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t),
+                 indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void VisibilityMask::prime_depth(uint32_t view, const XrFovf &fov,
+                                 const glm::mat4 &projection)
+{
+    if (view >= viewCount) {
+        return;
+    }
+    View &v = views[view];
+    if (!v.valid) {
+        std::vector<XrVector2f> vertices;
+        std::vector<uint32_t> indices;
+        if (synthetic) {
+            build_synthetic(fov, vertices, indices);
+        } else if (getVisibilityMask == nullptr ||
+                   !query(view, vertices, indices)) {
+            // no mask from the runtime, nothing is primed for this view
+            vertices.clear();
+            indices.clear();
+        }
+        upload(view, fov, vertices, indices);
+    }
+    if (v.indexCount == 0) {
+        return;
+    }
+
+    // the mesh winding isn't specified, and only depth is written
+    GLboolean const cull = glIsEnabled(GL_CULL_FACE);
+    glDisable(GL_CULL_FACE);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_TRUE);
+    glDepthFunc(GL_ALWAYS);
+
+    glm::mat4 proj = projection;
+    shader.Bind();
+    shader.SetUniformMat4("projectionMatrix", proj);
+    glBindBuffer(GL_ARRAY_BUFFER, v.vertexBuffer);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(XrVector2f),
+                          (void *)0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, v.indexBuffer);
+    glDrawElements(GL_TRIANGLES, v.indexCount, GL_UNSIGNED_INT, (void *)0);
+    glDisableVertexAttribArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    shader.Unbind();
+
+    glDepthFunc(GL_LESS);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    if (cull) {
+        glEnable(GL_CULL_FACE);
+    }
+}
+
+float VisibilityMask::get_hidden_fraction(uint32_t view) const
+{
+    return view < viewCount ? views[view].hiddenFraction : 0.0f;
+}
+
+void VisibilityMask::destroy()
+{
+    for (uint32_t i = 0; i < viewCount; i++) {
+        glDeleteBuffers(1, &views[i].vertexBuffer);
+        glDeleteBuffers(1, &views[i].indexBuffer);
+        views[i].valid = false;
+    }
+    viewCount = 0;
+    shader.Destroy();
+}
+}; // namespace AppCommon
@@ -0,0 +1,82 @@
+/****************************************************************
+ * Copyright (c) 2020-2021 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+
+#pragma once
+
+#include <vector>
+
+#include "AppCommon.h"
+#include "Shader.h"
+
+// most views a mask is kept for
+#define VISIBILITY_MASK_MAX_VIEWS 4
+// segments of the synthetic mask's ellipse
+#define VISIBILITY_MASK_SYNTHETIC_SEGMENTS 64
+
+namespace AppCommon {
+
+/**
+ * Depth priming with the hidden area mesh of each view.
+ *
+ * The corners of an eye buffer are never seen through the lens. The hidden
+ * triangle mesh from XR_KHR_visibility_mask is drawn at the near plane with
+ * color writes off right after the pass clears depth, so the depth test
+ * rejects every scene fragment there before it is shaded. Meshes are
+ * queried when first needed, cached in a buffer per view, and queried again
+ * after invalidate() (on XrEventDataVisibilityMaskChangedKHR).
+ *
+ * Without the extension, or when the query fails, nothing is primed: a
+ * guessed mask could hide pixels the lens does show. For testing,
+ * debug.mixedreality.syntheticVisibilityMask set to true builds a synthetic
+ * mask from the view's fov instead of querying: everything outside the
+ * ellipse touching the edges of the image, about a fifth of it.
+ */
+class VisibilityMask {
+public:
+    VisibilityMask();
+
+    // supported: XR_KHR_visibility_mask is enabled on the instance
+    bool init(XrInstance instance, XrSession session,
+              XrViewConfigurationType viewConfigType, uint32_t viewCount,
+              bool supported);
+    // the mask of the view changed, query it again before the next draw
+    void invalidate(uint32_t view);
+    // draws the hidden area of the view at the near plane, depth only; call
+    // right after the eye pass cleared depth
+    void prime_depth(uint32_t view, const XrFovf &fov,
+                     const glm::mat4 &projection);
+    void destroy();
+
+    bool is_synthetic() const { return synthetic; }
+    // fraction of the view's image covered by its hidden mesh
+    float get_hidden_fraction(uint32_t view) const;
+
+private:
+    struct View {
+        GLuint vertexBuffer;
+        GLuint indexBuffer;
+        uint32_t indexCount;
+        bool valid;
+        float hiddenFraction;
+    };
+
+    bool query(uint32_t view, std::vector<XrVector2f> &vertices,
+               std::vector<uint32_t> &indices);
+    void build_synthetic(const XrFovf &fov, std::vector<XrVector2f> &vertices,
+                         std::vector<uint32_t> &indices);
+    void upload(uint32_t view, const XrFovf &fov,
+                const std::vector<XrVector2f> &vertices,
+                const std::vector<uint32_t> &indices);
+
+    XrSession session;
+    XrViewConfigurationType viewConfigType;
+    uint32_t viewCount;
+    bool synthetic;
+    PFN_xrGetVisibilityMaskKHR getVisibilityMask;
+    View views[VISIBILITY_MASK_MAX_VIEWS];
+    QtiGL::Shader shader;
+};
+}; // namespace AppCommon
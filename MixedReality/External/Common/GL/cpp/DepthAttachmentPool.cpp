@@ -0,0 +1,128 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <GLES3/gl32.h>
+#include <cassert>
+
+#include "DepthAttachmentPool.h"
+#include "LogUtils.h"
+
+namespace QtiGL
+{
+    static uint64_t GetDepthBytes(int32_t const width, int32_t const height, int32_t const samples, GLenum const sizedFormat)
+    {
+        uint64_t bytesPerPixel = 4;
+        if (sizedFormat == GL_DEPTH_COMPONENT16)
+        {
+            bytesPerPixel = 2;
+        }
+        else if (sizedFormat == GL_DEPTH32F_STENCIL8)
+        {
+            bytesPerPixel = 8;
+        }
+        return (uint64_t)width * (uint64_t)height * (uint64_t)samples * bytesPerPixel;
+    }
+
+    DepthAttachmentPool::DepthAttachmentPool()
+    {
+    }
+
+    GLuint DepthAttachmentPool::Acquire(int32_t const width, int32_t const height, int32_t const samples, GLenum const sizedFormat)
+    {
+        for (auto itr = mEntries.begin(); itr != mEntries.end(); ++itr)
+        {
+            if (itr->width == width && itr->height == height && itr->samples == samples && itr->sizedFormat == sizedFormat)
+            {
+                itr->refCount++;
+                return itr->renderbuffer;
+            }
+        }
+
+        static PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC glRenderbufferStorageMultisampleEXT = nullptr;
+        if (!glRenderbufferStorageMultisampleEXT)
+        {
+            glRenderbufferStorageMultisampleEXT = (PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC)eglGetProcAddress("glRenderbufferStorageMultisampleEXT");
+            if (!glRenderbufferStorageMultisampleEXT)
+            {
+                LOGE("DepthAttachmentPool::Acquire", "glRenderbufferStorageMultisampleEXT isn't supported!");
+                return 0;
+            }
+        }
+
+        Entry entry;
+        entry.width = width;
+        entry.height = height;
+        entry.samples = samples;
+        entry.sizedFormat = sizedFormat;
+        entry.refCount = 1;
+        glGenRenderbuffers(1, &entry.renderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, entry.renderbuffer);
+        glRenderbufferStorageMultisampleEXT(GL_RENDERBUFFER, samples, sizedFormat, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        mEntries.push_back(entry);
+        return entry.renderbuffer;
+    }
+
+    void DepthAttachmentPool::Release(GLuint const renderbuffer)
+    {
+        for (auto itr = mEntries.begin(); itr != mEntries.end(); ++itr)
+        {
+            if (itr->renderbuffer == renderbuffer)
+            {
+                assert(itr->refCount > 0);
+                itr->refCount--;
+                if (itr->refCount == 0)
+                {
+                    glDeleteRenderbuffers(1, &itr->renderbuffer);
+                    mEntries.erase(itr);
+                }
+                return;
+            }
+        }
+        LOGW("DepthAttachmentPool::Release", "Renderbuffer %u isn't from the pool", renderbuffer);
+    }
+
+    void DepthAttachmentPool::Destroy()
+    {
+        for (auto itr = mEntries.begin(); itr != mEntries.end(); ++itr)
+        {
+            glDeleteRenderbuffers(1, &itr->renderbuffer);
+        }
+        mEntries.clear();
+    }
+
+    DepthPoolStats DepthAttachmentPool::GetStats(int32_t const samples) const
+    {
+        DepthPoolStats stats = {};
+        for (auto itr = mEntries.begin(); itr != mEntries.end(); ++itr)
+        {
+            if (samples != 0 && itr->samples != samples)
+            {
+                continue;
+            }
+            uint64_t const bytes = GetDepthBytes(itr->width, itr->height, itr->samples, itr->sizedFormat);
+            stats.buffers++;
+            stats.references += itr->refCount;
+            stats.allocatedBytes += bytes;
+            stats.savedBytes += bytes * (itr->refCount - 1);
+        }
+        return stats;
+    }
+
+    void DepthAttachmentPool::LogStats() const
+    {
+        for (int32_t samples = 1; samples <= 16; samples *= 2)
+        {
+            DepthPoolStats const stats = GetStats(samples);
+            if (stats.buffers == 0)
+            {
+                continue;
+            }
+            LOGI("DepthAttachmentPool", "%dx MSAA: %u depth buffers for %u targets, %.2f MB allocated, %.2f MB saved",
+                 samples, stats.buffers, stats.references,
+                 stats.allocatedBytes / (1024.0 * 1024.0), stats.savedBytes / (1024.0 * 1024.0));
+        }
+    }
+}
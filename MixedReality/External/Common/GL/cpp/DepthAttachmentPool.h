@@ -0,0 +1,60 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Extensions.h"
+
+namespace QtiGL
+{
+    struct DepthPoolStats
+    {
+        uint32_t    buffers;            // Renderbuffers allocated
+        uint32_t    references;         // Render targets using them
+        uint64_t    allocatedBytes;
+        uint64_t    savedBytes;         // What a buffer per reference would have cost on top
+    };
+
+    // Transient multisampled depth renderbuffers, shared by every render
+    // target with the same size, sample count and format.
+    //
+    // An implicit resolve target's depth never outlives its pass: the samples
+    // are dropped when the tiles are resolved, and the pass clears or
+    // invalidates depth before drawing.  Passes run one after another, so a
+    // single buffer can back the depth of every swapchain image of every eye.
+    // Buffers are allocated on the first Acquire() with
+    // glRenderbufferStorageMultisampleEXT (which drivers may keep in tile
+    // memory only) and deleted with their last Release().
+    class DepthAttachmentPool
+    {
+    public:
+        DepthAttachmentPool();
+
+        // Returns 0 if EXT_multisampled_render_to_texture isn't available
+        GLuint Acquire(int32_t const width, int32_t const height, int32_t const samples, GLenum const sizedFormat);
+        void Release(GLuint const renderbuffer);
+        // Deletes every buffer regardless of references
+        void Destroy();
+
+        // Usage of the buffers with the given sample count, or of all of them for 0
+        DepthPoolStats GetStats(int32_t const samples = 0) const;
+        void LogStats() const;
+
+    private:
+        struct Entry
+        {
+            int32_t     width;
+            int32_t     height;
+            int32_t     samples;
+            GLenum      sizedFormat;
+            GLuint      renderbuffer;
+            uint32_t    refCount;
+        };
+
+        std::vector<Entry>  mEntries;
+    };
+}
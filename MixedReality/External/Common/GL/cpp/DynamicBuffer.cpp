@@ -0,0 +1,246 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <GLES3/gl32.h>
+#include <cassert>
+#include <cstring>
+
+#include "DynamicBuffer.h"
+#include "Extensions.h"
+#include "LogUtils.h"
+
+// How long to block on a region still in flight before giving up on the frame's data
+#define DYNAMIC_BUFFER_WAIT_TIMEOUT_NS  1000000000ULL
+
+namespace QtiGL
+{
+    static bool HasBufferStorage()
+    {
+        GLint nExtensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &nExtensions);
+        for (GLint i = 0; i < nExtensions; i++)
+        {
+            char const* pExtension = (char const*)glGetStringi(GL_EXTENSIONS, i);
+            if (pExtension != nullptr && strcmp(pExtension, "GL_EXT_buffer_storage") == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    DynamicBuffer::DynamicBuffer()
+        : mTarget(GL_ARRAY_BUFFER)
+        , mBufferId(0)
+        , mRegionSize(0)
+        , mNumRegions(0)
+        , mCurrentRegion(0)
+        , mCursor(0)
+        , mRegionReady(false)
+        , mMapped(false)
+        , mpPersistent(nullptr)
+        , mStallCount(0)
+    {
+    }
+
+    DynamicBuffer::~DynamicBuffer()
+    {
+        Destroy();
+    }
+
+    bool DynamicBuffer::Initialize(GLenum const target, uint32_t const regionSize,
+                                   uint32_t const numRegions, Mode const mode)
+    {
+        assert(mBufferId == 0);
+        assert(regionSize > 0 && numRegions > 0);
+
+        mTarget = target;
+        mRegionSize = regionSize;
+        mNumRegions = numRegions;
+        mCurrentRegion = 0;
+        mCursor = 0;
+        mRegionReady = false;
+        mMapped = false;
+        mStallCount = 0;
+        mFences.assign(numRegions, (GLsync)0);
+
+        GLsizeiptr const totalSize = (GLsizeiptr)regionSize * numRegions;
+        glGenBuffers(1, &mBufferId);
+        assert(mBufferId != 0);
+        glBindBuffer(mTarget, mBufferId);
+
+        static PFNGLBUFFERSTORAGEEXTPROC glBufferStorageEXT = nullptr;
+        if (mode != kModeUnsynchronizedMap && glBufferStorageEXT == nullptr && HasBufferStorage())
+        {
+            glBufferStorageEXT = (PFNGLBUFFERSTORAGEEXTPROC)eglGetProcAddress("glBufferStorageEXT");
+        }
+
+        if (mode != kModeUnsynchronizedMap && glBufferStorageEXT != nullptr)
+        {
+            GLbitfield const flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT_EXT | GL_MAP_COHERENT_BIT_EXT;
+            glBufferStorageEXT(mTarget, totalSize, nullptr, flags);
+            mpPersistent = (uint8_t*)glMapBufferRange(mTarget, 0, totalSize, flags);
+            if (mpPersistent == nullptr)
+            {
+                // Immutable storage can't be re-specified, so start over with a fresh buffer
+                LOGE("DynamicBuffer::Initialize", "Persistent mapping failed, using unsynchronized maps");
+                glBindBuffer(mTarget, 0);
+                glDeleteBuffers(1, &mBufferId);
+                glGenBuffers(1, &mBufferId);
+                glBindBuffer(mTarget, mBufferId);
+            }
+        }
+        else if (mode == kModePersistent)
+        {
+            LOGE("DynamicBuffer::Initialize", "EXT_buffer_storage not supported, using unsynchronized maps");
+        }
+
+        if (mpPersistent == nullptr)
+        {
+            glBufferData(mTarget, totalSize, nullptr, GL_DYNAMIC_DRAW);
+        }
+        glBindBuffer(mTarget, 0);
+
+        LOGI("DynamicBuffer::Initialize", "%u regions of %u bytes, %s", numRegions, regionSize,
+             (mpPersistent != nullptr) ? "persistently mapped" : "unsynchronized maps");
+        return true;
+    }
+
+    void DynamicBuffer::Destroy()
+    {
+        for (auto& fence : mFences)
+        {
+            if (fence != 0)
+            {
+                glDeleteSync(fence);
+            }
+        }
+        mFences.clear();
+
+        if (mBufferId != 0)
+        {
+            if (mpPersistent != nullptr || mMapped)
+            {
+                glBindBuffer(mTarget, mBufferId);
+                glUnmapBuffer(mTarget);
+                glBindBuffer(mTarget, 0);
+            }
+            glDeleteBuffers(1, &mBufferId);
+        }
+        mBufferId = 0;
+        mpPersistent = nullptr;
+        mMapped = false;
+        mRegionSize = 0;
+        mNumRegions = 0;
+    }
+
+    void DynamicBuffer::WaitForRegion(uint32_t const region)
+    {
+        GLsync& fence = mFences[region];
+        if (fence == 0)
+        {
+            return;
+        }
+
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED)
+        {
+            // The GPU is more than numRegions - 1 frames behind
+            mStallCount++;
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, DYNAMIC_BUFFER_WAIT_TIMEOUT_NS);
+        }
+        if (status == GL_WAIT_FAILED || status == GL_TIMEOUT_EXPIRED)
+        {
+            LOGE("DynamicBuffer::WaitForRegion", "Waiting for region %u failed (0x%x)", region, status);
+        }
+
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    void* DynamicBuffer::Map(uint32_t const size, uint32_t const alignment, uint32_t& outOffset)
+    {
+        assert(!mMapped);
+        assert(alignment > 0);
+        if (mBufferId == 0)
+        {
+            return nullptr;
+        }
+
+        if (!mRegionReady)
+        {
+            WaitForRegion(mCurrentRegion);
+            mRegionReady = true;
+        }
+
+        uint32_t const regionStart = mCurrentRegion * mRegionSize;
+        uint32_t const offset = (regionStart + mCursor + alignment - 1) / alignment * alignment;
+        if (offset + size > regionStart + mRegionSize)
+        {
+            LOGE("DynamicBuffer::Map", "%u bytes don't fit in the %u byte region (%u used)", size, mRegionSize, mCursor);
+            return nullptr;
+        }
+        mCursor = offset + size - regionStart;
+        outOffset = offset;
+
+        if (mpPersistent != nullptr)
+        {
+            return mpPersistent + offset;
+        }
+
+        // The range was fenced above, so the driver needn't synchronize or keep its contents
+        glBindBuffer(mTarget, mBufferId);
+        void* pData = glMapBufferRange(mTarget, offset, size,
+                                       GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        if (pData == nullptr)
+        {
+            LOGE("DynamicBuffer::Map", "glMapBufferRange failed (0x%x)", glGetError());
+            glBindBuffer(mTarget, 0);
+            return nullptr;
+        }
+        mMapped = true;
+        return pData;
+    }
+
+    void DynamicBuffer::Unmap()
+    {
+        if (!mMapped)
+        {
+            // Coherent persistent mappings need no flush
+            return;
+        }
+
+        glUnmapBuffer(mTarget);
+        glBindBuffer(mTarget, 0);
+        mMapped = false;
+    }
+
+    bool DynamicBuffer::Write(void const* pData, uint32_t const size, uint32_t const alignment, uint32_t& outOffset)
+    {
+        void* pDst = Map(size, alignment, outOffset);
+        if (pDst == nullptr)
+        {
+            return false;
+        }
+        memcpy(pDst, pData, size);
+        Unmap();
+        return true;
+    }
+
+    void DynamicBuffer::EndFrame()
+    {
+        assert(!mMapped);
+        if (mBufferId == 0 || !mRegionReady)
+        {
+            // Nothing was written this frame, the region can be reused as is
+            return;
+        }
+
+        mFences[mCurrentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        mCurrentRegion = (mCurrentRegion + 1) % mNumRegions;
+        mCursor = 0;
+        mRegionReady = false;
+    }
+}
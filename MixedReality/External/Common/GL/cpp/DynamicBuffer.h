@@ -0,0 +1,79 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <GLES3/gl32.h>
+
+// Enough regions for the CPU to write one frame while the GPU still reads the previous two
+#define DYNAMIC_BUFFER_DEFAULT_REGIONS  3
+
+namespace QtiGL
+{
+    // Ring buffer for vertex/instance/uniform data rewritten every frame.
+    //
+    // The buffer is split into numRegions regions of regionSize bytes; each
+    // frame sub-allocates from one region and EndFrame() fences it and moves
+    // on to the next.  A region is only written again once its fence has
+    // signalled, so no write ever waits on the driver to orphan or copy a
+    // buffer.  With EXT_buffer_storage the whole buffer stays persistently
+    // (and coherently) mapped; otherwise each write maps just its range with
+    // GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT.
+    //
+    // Must be used on the GL thread.
+    class DynamicBuffer
+    {
+    public:
+        enum Mode
+        {
+            kModeAuto = 0,          // Persistent when EXT_buffer_storage is available
+            kModeUnsynchronizedMap,
+            kModePersistent
+        };
+
+        DynamicBuffer();
+        ~DynamicBuffer();
+
+        bool Initialize(GLenum const target, uint32_t const regionSize,
+                        uint32_t const numRegions = DYNAMIC_BUFFER_DEFAULT_REGIONS, Mode const mode = kModeAuto);
+        void Destroy();
+
+        // Returns a write-only pointer to size bytes of the current region, or nullptr
+        // if the region is full.  outOffset is where the data lands in GetBufferId(),
+        // a multiple of alignment (which need not be a power of two, e.g. a vertex stride).
+        // Every Map() must be followed by Unmap() before drawing from the data.
+        void* Map(uint32_t const size, uint32_t const alignment, uint32_t& outOffset);
+        void Unmap();
+        // Map() + memcpy + Unmap(); returns false if the region is full
+        bool Write(void const* pData, uint32_t const size, uint32_t const alignment, uint32_t& outOffset);
+
+        // Call once per frame, after the draws reading this frame's data were issued
+        void EndFrame();
+
+        GLuint GetBufferId() const { return mBufferId; }
+        GLenum GetTarget() const { return mTarget; }
+        uint32_t GetRegionSize() const { return mRegionSize; }
+        bool IsPersistent() const { return mpPersistent != nullptr; }
+        // Number of times a region was still in flight when it came round again
+        uint64_t GetStallCount() const { return mStallCount; }
+
+    private:
+        void WaitForRegion(uint32_t const region);
+
+        GLenum              mTarget;
+        GLuint              mBufferId;
+        uint32_t            mRegionSize;
+        uint32_t            mNumRegions;
+        uint32_t            mCurrentRegion;
+        uint32_t            mCursor;            // Bytes used in the current region
+        bool                mRegionReady;       // Current region's fence has been waited on
+        bool                mMapped;
+        uint8_t*            mpPersistent;       // Whole buffer, when persistently mapped
+        std::vector<GLsync> mFences;            // One per region, 0 when not in flight
+        uint64_t            mStallCount;
+    };
+}
@@ -0,0 +1,247 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <GLES3/gl32.h>
+#include <algorithm>
+#include <cstring>
+
+#include "Foveation.h"
+#include "LogUtils.h"
+
+namespace QtiGL
+{
+    static PFNGLTEXTUREFOVEATIONPARAMETERSQCOMPROC gTextureFoveationParametersQCOM = nullptr;
+
+    static char const* const gLevelNames[Foveation::kLevelCount] = { "off", "low", "medium", "high" };
+
+    static bool LoadTextureFoveated()
+    {
+        static bool checked = false;
+        if (checked)
+        {
+            return gTextureFoveationParametersQCOM != nullptr;
+        }
+        checked = true;
+
+        GLint nExtensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &nExtensions);
+        for (GLint i = 0; i < nExtensions; i++)
+        {
+            char const* pExtension = (char const*)glGetStringi(GL_EXTENSIONS, i);
+            if (pExtension != nullptr && strcmp(pExtension, "GL_QCOM_texture_foveated") == 0)
+            {
+                gTextureFoveationParametersQCOM = (PFNGLTEXTUREFOVEATIONPARAMETERSQCOMPROC)eglGetProcAddress("glTextureFoveationParametersQCOM");
+                break;
+            }
+        }
+        return gTextureFoveationParametersQCOM != nullptr;
+    }
+
+    Foveation::Foveation()
+        : mMode(kModeMultiRes)
+        , mLevel(kLevelOff)
+        , mWidth(0)
+        , mHeight(0)
+        , mRenderWidth(0)
+        , mRenderHeight(0)
+        , mSamples(1)
+        , mColorSizedFormat(GL_RGBA8)
+        , mHasPeriphery(false)
+        , mReadFramebuffer(0)
+        , mDrawFramebuffer(0)
+    {
+    }
+
+    bool Foveation::IsTextureFoveationSupported()
+    {
+        return LoadTextureFoveated();
+    }
+
+    char const* Foveation::GetLevelName(Level const level)
+    {
+        return gLevelNames[level < kLevelCount ? level : kLevelOff];
+    }
+
+    Foveation::Level Foveation::ParseLevel(char const* pName)
+    {
+        for (int32_t i = 0; i < kLevelCount; i++)
+        {
+            if (pName != nullptr && strcmp(pName, gLevelNames[i]) == 0)
+            {
+                return (Level)i;
+            }
+        }
+        return kLevelOff;
+    }
+
+    Foveation::LevelParams const& Foveation::GetParams(Level const level)
+    {
+        // Density falls off as 1 / (gain^2 * distance^2 - foveaArea) from the
+        // focal point (in NDC), clamped to [minDensity, 1]
+        static LevelParams const levelParams[kLevelCount] =
+        {
+            // gain  area   minDensity  inset  peripheryScale
+            {  0.0f, 0.0f,  1.0f,       1.0f,  1.0f  },     // kLevelOff
+            {  1.5f, 1.0f,  0.5f,       0.6f,  0.5f  },     // kLevelLow
+            {  2.0f, 0.5f,  0.25f,      0.5f,  0.5f  },     // kLevelMedium
+            {  3.0f, 0.25f, 0.125f,     0.4f,  0.33f },     // kLevelHigh
+        };
+        return levelParams[level < kLevelCount ? level : kLevelOff];
+    }
+
+    bool Foveation::Initialize(int32_t const width, int32_t const height, int32_t const samples, GLenum const colorSizedFormat,
+                               bool const allowTextureFoveation)
+    {
+        mWidth = width;
+        mHeight = height;
+        mRenderWidth = width;
+        mRenderHeight = height;
+        mSamples = samples;
+        mColorSizedFormat = colorSizedFormat;
+        mMode = (allowTextureFoveation && IsTextureFoveationSupported()) ? kModeTextureQCOM : kModeMultiRes;
+        mFoveatedTextures.clear();
+        LOGI("Foveation::Initialize", "%s foveation", mMode == kModeTextureQCOM ? "QCOM texture" : "Multi-res");
+
+        if (mMode == kModeMultiRes)
+        {
+            glGenFramebuffers(1, &mReadFramebuffer);
+            glGenFramebuffers(1, &mDrawFramebuffer);
+            return InitializePeriphery();
+        }
+        return true;
+    }
+
+    bool Foveation::InitializePeriphery()
+    {
+        if (mHasPeriphery)
+        {
+            mPeriphery.Destroy();
+            mHasPeriphery = false;
+        }
+        if (mLevel == kLevelOff)
+        {
+            return true;
+        }
+
+        float const scale = GetParams(mLevel).peripheryScale;
+        int32_t const width = std::max((int32_t)(mWidth * scale), 1);
+        int32_t const height = std::max((int32_t)(mHeight * scale), 1);
+        if (!mPeriphery.InitializeImplicitResolve(width, height, mSamples, mColorSizedFormat, true))
+        {
+            LOGE("Foveation::InitializePeriphery", "Failed to create the %dx%d periphery target", width, height);
+            return false;
+        }
+        mHasPeriphery = true;
+
+        // The blit reads the resolved texture through a single sampled framebuffer
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, mReadFramebuffer);
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mPeriphery.GetColorAttachment(), 0);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        return true;
+    }
+
+    void Foveation::Destroy()
+    {
+        if (mHasPeriphery)
+        {
+            mPeriphery.Destroy();
+            mHasPeriphery = false;
+        }
+        if (mReadFramebuffer != 0)
+        {
+            glDeleteFramebuffers(1, &mReadFramebuffer);
+            mReadFramebuffer = 0;
+        }
+        if (mDrawFramebuffer != 0)
+        {
+            glDeleteFramebuffers(1, &mDrawFramebuffer);
+            mDrawFramebuffer = 0;
+        }
+        mFoveatedTextures.clear();
+    }
+
+    void Foveation::SetLevel(Level const level)
+    {
+        if (level == mLevel || level >= kLevelCount)
+        {
+            return;
+        }
+        LOGI("Foveation::SetLevel", "%s -> %s", GetLevelName(mLevel), GetLevelName(level));
+        mLevel = level;
+        if (mMode == kModeMultiRes && mReadFramebuffer != 0)
+        {
+            InitializePeriphery();
+        }
+    }
+
+    void Foveation::ApplyTextureFoveation(GLuint const texture, float const focalX, float const focalY)
+    {
+        if (mMode != kModeTextureQCOM)
+        {
+            return;
+        }
+
+        LevelParams const& params = GetParams(mLevel);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        // Foveation can't be turned off on a texture again; off is a gain of 0
+        if (std::find(mFoveatedTextures.begin(), mFoveatedTextures.end(), texture) == mFoveatedTextures.end())
+        {
+            if (mFoveatedTextures.size() >= FOVEATION_MAX_TEXTURES)
+            {
+                LOGW("Foveation::ApplyTextureFoveation", "More than %d foveated textures", FOVEATION_MAX_TEXTURES);
+                mFoveatedTextures.erase(mFoveatedTextures.begin());
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_FOVEATED_FEATURE_BITS_QCOM,
+                            GL_FOVEATION_ENABLE_BIT_QCOM | GL_FOVEATION_SCALED_BIN_METHOD_BIT_QCOM);
+            mFoveatedTextures.push_back(texture);
+        }
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_FOVEATED_MIN_PIXEL_DENSITY_QCOM, params.minDensity);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        gTextureFoveationParametersQCOM(texture, 0, 0, focalX, focalY, params.gain, params.gain, params.foveaArea);
+    }
+
+    void Foveation::SetRenderSize(int32_t const width, int32_t const height)
+    {
+        mRenderWidth = std::min(std::max(width, 1), mWidth);
+        mRenderHeight = std::min(std::max(height, 1), mHeight);
+    }
+
+    void Foveation::GetInsetRect(int32_t& x, int32_t& y, int32_t& width, int32_t& height) const
+    {
+        float const fraction = IsMultiRes() ? GetParams(mLevel).insetFraction : 1.0f;
+        width = (int32_t)(mRenderWidth * fraction);
+        height = (int32_t)(mRenderHeight * fraction);
+        x = (mRenderWidth - width) / 2;
+        y = (mRenderHeight - height) / 2;
+    }
+
+    void Foveation::CompositePeriphery(GLuint const dstTexture)
+    {
+        if (!IsMultiRes() || !mHasPeriphery)
+        {
+            return;
+        }
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, mReadFramebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mDrawFramebuffer);
+        glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dstTexture, 0);
+        glBlitFramebuffer(0, 0, mPeriphery.GetWidth(), mPeriphery.GetHeight(),
+                          0, 0, mRenderWidth, mRenderHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    }
+
+    float Foveation::GetShadedFraction() const
+    {
+        LevelParams const& params = GetParams(mLevel);
+        if (mMode == kModeTextureQCOM || !IsMultiRes())
+        {
+            // The driver decides per bin; not known up front
+            return 1.0f;
+        }
+        return params.insetFraction * params.insetFraction + params.peripheryScale * params.peripheryScale;
+    }
+}
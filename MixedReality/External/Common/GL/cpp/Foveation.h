@@ -0,0 +1,115 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Extensions.h"
+#include "RenderTarget.h"
+
+// Swapchain images that can have QCOM foveation enabled at once
+#define FOVEATION_MAX_TEXTURES  16
+
+namespace QtiGL
+{
+    // Fixed foveated rendering of an eye image: full resolution in the
+    // middle, less of it towards the edges, where the lens blurs anyway.
+    //
+    // With GL_QCOM_texture_foveated the driver does it per bin: the render
+    // target texture is flagged once, and ApplyTextureFoveation() sets the
+    // focal point, gain and full density area for the current level.  The
+    // scene is drawn once, as usual.
+    //
+    // Otherwise it falls back to two resolutions (kModeMultiRes).  The whole
+    // fov is first drawn into the periphery target at a fraction of the
+    // resolution, CompositePeriphery() upscales it into the eye image with a
+    // linear blit, and the eye pass then loads that and draws the scene
+    // again scissored to GetInsetRect(), the full resolution middle.
+    //
+    // kLevelOff keeps the full resolution everywhere; the level can change
+    // any time between frames.
+    class Foveation
+    {
+    public:
+        enum Level
+        {
+            kLevelOff = 0,
+            kLevelLow,
+            kLevelMedium,
+            kLevelHigh,
+            kLevelCount
+        };
+
+        enum Mode
+        {
+            kModeTextureQCOM = 0,
+            kModeMultiRes
+        };
+
+        Foveation();
+
+        static bool IsTextureFoveationSupported();
+        static char const* GetLevelName(Level const level);
+        // "off", "low", "medium" or "high"; anything else is off
+        static Level ParseLevel(char const* pName);
+
+        // Size of the eye images; the periphery target gets the samples and format
+        bool Initialize(int32_t const width, int32_t const height, int32_t const samples, GLenum const colorSizedFormat,
+                        bool const allowTextureFoveation = true);
+        void Destroy();
+
+        void SetLevel(Level const level);
+        Level GetLevel() const { return mLevel; }
+        Mode GetMode() const { return mMode; }
+
+        // kModeTextureQCOM: flags the texture and applies the level, call before drawing into it.
+        // The focal point is in NDC of the image.
+        void ApplyTextureFoveation(GLuint const texture, float const focalX = 0.0f, float const focalY = 0.0f);
+
+        // kModeMultiRes with the level on: the scene goes through the periphery target first
+        bool IsMultiRes() const { return mMode == kModeMultiRes && mLevel != kLevelOff; }
+        RenderTarget& GetPeripheryTarget() { return mPeriphery; }
+        // Part of the eye image that is rendered to when resolution is scaled down, from the
+        // bottom left; at most the Initialize() size, which is also the default
+        void SetRenderSize(int32_t const width, int32_t const height);
+        // Full resolution part of the rendered area, in pixels
+        void GetInsetRect(int32_t& x, int32_t& y, int32_t& width, int32_t& height) const;
+        // Upscales the periphery target into the rendered area of the single sampled eye image texture
+        void CompositePeriphery(GLuint const dstTexture);
+
+        // Share of the eye image's pixels that are shaded at the current level
+        float GetShadedFraction() const;
+
+    private:
+        struct LevelParams
+        {
+            // GL_QCOM_texture_foveated
+            float   gain;
+            float   foveaArea;
+            float   minDensity;
+            // multi-res: inset size as a fraction of the image, periphery resolution scale
+            float   insetFraction;
+            float   peripheryScale;
+        };
+
+        static LevelParams const& GetParams(Level const level);
+        bool InitializePeriphery();
+
+        Mode                mMode;
+        Level               mLevel;
+        int32_t             mWidth;
+        int32_t             mHeight;
+        int32_t             mRenderWidth;
+        int32_t             mRenderHeight;
+        int32_t             mSamples;
+        GLenum              mColorSizedFormat;
+        RenderTarget        mPeriphery;
+        bool                mHasPeriphery;
+        GLuint              mReadFramebuffer;
+        GLuint              mDrawFramebuffer;
+        std::vector<GLuint> mFoveatedTextures;
+    };
+}
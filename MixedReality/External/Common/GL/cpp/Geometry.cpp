@@ -4,34 +4,69 @@
  * Confidential and Proprietary - Qualcomm Technologies, Inc.
  ****************************************************************/
 #include <GLES3/gl32.h>
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 
 #include "tiny_obj_loader.h"
 #include <vector>
 #include <string>
 
+#include "AssetView.h"
 #include "Geometry.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ObjParser.h"
 #include "Shader.h"
 #include "LogUtils.h"
 
 namespace QtiGL
 {
 
+    uint32_t Geometry::gCurrentBoundVao = 0;
+    bool Geometry::gBatching = false;
+
     Geometry::Geometry()
         : mVbId(0)
         , mIbId(0)
         , mVaoId(0)
         , mVertexCount(0)
         , mIndexCount(0)
+        , mIndexType(GL_UNSIGNED_INT)
+        , mVbSize(0)
+        , mIbSize(0)
+        , mBaseVertex(0)
+        , mIndexOffset(0)
         , mMatIndex(UINT_MAX)
+        , mBoundsMin{0.0f, 0.0f, 0.0f}
+        , mBoundsMax{0.0f, 0.0f, 0.0f}
+        , mVertexFormat(kVertexFloat)
+        , mVertexDecode{{1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f}, {1.0f, 1.0f}, {0.0f, 0.0f}}
+        , mLodCount(1)
+        , mCurrentLod(0)
+        , mpArena(nullptr)
+        , mpDynamicBuffer(nullptr)
+        , mDynamicStride(0)
     {
-
+        mArenaAllocation.pool = -1;
+        ResetLods();
     }
 
     void Geometry::Initialize(ProgramAttribute const* pAttribs, int32_t const nAttribs,
                               uint32_t const* pIndices, int32_t const nIndices,
                               void const* pVertexData, int32_t const bufferSize, int32_t const nVertices)
     {
+        Initialize(pAttribs, nAttribs, pIndices, nIndices, GL_UNSIGNED_INT, pVertexData, bufferSize, nVertices);
+    }
+
+    void Geometry::Initialize(ProgramAttribute const* pAttribs, int32_t const nAttribs,
+                              void const* pIndices, int32_t const nIndices, uint32_t const indexType,
+                              void const* pVertexData, int32_t const bufferSize, int32_t const nVertices)
+    {
+        assert(indexType == GL_UNSIGNED_SHORT || indexType == GL_UNSIGNED_INT);
+        size_t const indexSize = (indexType == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+
         //Create the VBO
         glGenBuffers( 1, &mVbId);
         assert(mVbId != 0);
@@ -42,15 +77,91 @@ namespace QtiGL
         //Create the Index Buffer
         glGenBuffers( 1, &mIbId);
         assert(mIbId != 0);
+        SetVertexArray( 0 );
         glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, mIbId );
-        glBufferData( GL_ELEMENT_ARRAY_BUFFER, nIndices * sizeof(uint32_t), pIndices, GL_STATIC_DRAW);
+        glBufferData( GL_ELEMENT_ARRAY_BUFFER, nIndices * indexSize, pIndices, GL_STATIC_DRAW);
         glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0);
 
         //Create the VAO
         glGenVertexArrays( 1, &mVaoId );
         assert(mVaoId != 0);
+        CreateVertexArray(mVaoId, pAttribs, nAttribs);
+
+        mVertexCount = nVertices;
+        mIndexCount = nIndices;
+        mIndexType = indexType;
+        mVbSize = bufferSize;
+        mIbSize = nIndices * (int32_t)indexSize;
+        ResetLods();
+    }
+
+    void Geometry::Initialize(GeometryArena& arena, ProgramAttribute const* pAttribs, int32_t const nAttribs,
+                              void const* pIndices, int32_t const nIndices, uint32_t const indexType,
+                              void const* pVertexData, int32_t const bufferSize, int32_t const nVertices)
+    {
+        assert(indexType == GL_UNSIGNED_SHORT || indexType == GL_UNSIGNED_INT);
+        uint32_t const indexSize = (indexType == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+
+        if (!arena.Allocate(pAttribs, nAttribs, pVertexData, nVertices, pIndices, nIndices, indexSize, mArenaAllocation))
+        {
+            // Fall back to buffers of our own
+            Initialize(pAttribs, nAttribs, pIndices, nIndices, indexType, pVertexData, bufferSize, nVertices);
+            return;
+        }
+
+        mpArena = &arena;
+        mVbId = arena.GetVbId(mArenaAllocation);
+        mIbId = arena.GetIbId(mArenaAllocation);
+        mVaoId = arena.GetVaoId(mArenaAllocation);
+        mVertexCount = nVertices;
+        mIndexCount = nIndices;
+        mIndexType = indexType;
+        mBaseVertex = mArenaAllocation.baseVertex;
+        mIndexOffset = mArenaAllocation.indexOffset;
+        ResetLods();
+    }
+
+    void Geometry::Initialize(DynamicBuffer& vertexBuffer, ProgramAttribute const* pAttribs, int32_t const nAttribs,
+                              void const* pIndices, int32_t const nIndices, uint32_t const indexType,
+                              void const* pVertexData, int32_t const bufferSize, int32_t const nVertices)
+    {
+        assert(indexType == GL_UNSIGNED_SHORT || indexType == GL_UNSIGNED_INT);
+        assert(vertexBuffer.GetTarget() == GL_ARRAY_BUFFER);
+        if (nAttribs <= 0 || pAttribs[0].stride <= 0)
+        {
+            LOGE("Geometry::Initialize", "Dynamic geometry needs interleaved attributes with a stride");
+            return;
+        }
+        size_t const indexSize = (indexType == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+
+        mpDynamicBuffer = &vertexBuffer;
+        mDynamicStride = (uint32_t)pAttribs[0].stride;
+        mVbId = vertexBuffer.GetBufferId();
+
+        glGenBuffers( 1, &mIbId);
+        assert(mIbId != 0);
+        SetVertexArray( 0 );
+        glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, mIbId );
+        glBufferData( GL_ELEMENT_ARRAY_BUFFER, nIndices * indexSize, pIndices, GL_STATIC_DRAW);
+        glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0);
+
+        glGenVertexArrays( 1, &mVaoId );
+        assert(mVaoId != 0);
+        CreateVertexArray(mVaoId, pAttribs, nAttribs);
 
-        glBindVertexArray( mVaoId );
+        mIndexCount = nIndices;
+        mIndexType = indexType;
+        mIbSize = nIndices * (int32_t)indexSize;
+        ResetLods();
+        if (pVertexData != nullptr)
+        {
+            Update(pVertexData, bufferSize, nVertices);
+        }
+    }
+
+    void Geometry::CreateVertexArray(uint32_t const vaoId, ProgramAttribute const* pAttribs, int32_t const nAttribs)
+    {
+        SetVertexArray( vaoId );
 
         glBindBuffer( GL_ARRAY_BUFFER, mVbId );
 
@@ -66,92 +177,443 @@ namespace QtiGL
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIbId);
 
-        glBindVertexArray( 0 );
-
-        mVertexCount = nVertices;
-        mIndexCount = nIndices;
+        SetVertexArray( 0 );
     }
 
     void Geometry::Update(void const* pVertexData, int32_t const bufferSize, int32_t const nVertices)
     {
+        if (mpArena != nullptr)
+        {
+            // Shared buffer: only rewrite our own range
+            if ((uint32_t)nVertices > mArenaAllocation.vertexCount)
+            {
+                LOGE("Geometry::Update", "Arena geometry cannot grow from %u to %d vertices",
+                     mArenaAllocation.vertexCount, nVertices);
+                return;
+            }
+            int32_t const stride = (nVertices > 0) ? bufferSize / nVertices : 0;
+            glBindBuffer(GL_ARRAY_BUFFER, mVbId);
+            glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)mArenaAllocation.baseVertex * stride, bufferSize, pVertexData);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            mVertexCount = nVertices;
+            return;
+        }
+
+        if (mpDynamicBuffer != nullptr)
+        {
+            // A fresh copy each time; the old ones stay valid until the GPU is done with them
+            uint32_t offset = 0;
+            if (!mpDynamicBuffer->Write(pVertexData, (uint32_t)bufferSize, mDynamicStride, offset))
+            {
+                // Nothing to draw this frame
+                mVertexCount = 0;
+                return;
+            }
+            mBaseVertex = (int32_t)(offset / mDynamicStride);
+            mVertexCount = nVertices;
+            return;
+        }
+
         glBindBuffer(GL_ARRAY_BUFFER, mVbId);
-        glBufferData(GL_ARRAY_BUFFER, bufferSize, pVertexData, GL_STATIC_DRAW);
+        if (bufferSize <= mVbSize)
+        {
+            glBufferSubData(GL_ARRAY_BUFFER, 0, bufferSize, pVertexData);
+        }
+        else
+        {
+            // Data that gets updated is better off with the dynamic usage hint from now on
+            glBufferData(GL_ARRAY_BUFFER, bufferSize, pVertexData, GL_DYNAMIC_DRAW);
+            mVbSize = bufferSize;
+        }
         glBindBuffer(GL_ARRAY_BUFFER, 0);
+        mVertexCount = nVertices;
     }
 
     void Geometry::Update(
             void const* pVertexData, int32_t const bufferSize, int32_t const nVertices,
             uint32_t const* pIndices, int32_t const nIndices)
     {
+        if (mpArena != nullptr)
+        {
+            LOGE("Geometry::Update", "Indices of arena geometry cannot be replaced");
+            return;
+        }
+
         Update(pVertexData, bufferSize, nVertices);
+
+        int32_t const indexBytes = nIndices * (int32_t)sizeof(uint32_t);
+        // A batch may still have a VAO bound, keep its index buffer out of this
+        SetVertexArray( 0 );
         glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, mIbId );
-        glBufferData( GL_ELEMENT_ARRAY_BUFFER, nIndices * sizeof(uint32_t), pIndices, GL_STATIC_DRAW);
+        if (indexBytes <= mIbSize)
+        {
+            glBufferSubData( GL_ELEMENT_ARRAY_BUFFER, 0, indexBytes, pIndices);
+        }
+        else
+        {
+            glBufferData( GL_ELEMENT_ARRAY_BUFFER, indexBytes, pIndices, GL_DYNAMIC_DRAW);
+            mIbSize = indexBytes;
+        }
         glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0);
+        mIndexCount = nIndices;
+        mIndexType = GL_UNSIGNED_INT;
+        ResetLods();
     }
 
     void Geometry::Destroy()
     {
-        if (mIbId > 0)
-            glDeleteBuffers( 1, &mIbId );
-        if (mVbId > 0)
-            glDeleteBuffers( 1, &mVbId );
+        for (auto& attribVao : mAttribVaos)
+        {
+            if (gCurrentBoundVao == attribVao.vaoId)
+                gCurrentBoundVao = 0;
+            glDeleteVertexArrays( 1, &attribVao.vaoId );
+        }
+        mAttribVaos.clear();
+
+        if (mpArena != nullptr)
+        {
+            // The buffers and VAO belong to the arena
+            mpArena->Free(mArenaAllocation);
+            mpArena = nullptr;
+        }
+        else
+        {
+            if (mVaoId > 0)
+            {
+                if (gCurrentBoundVao == mVaoId)
+                    gCurrentBoundVao = 0;
+                glDeleteVertexArrays( 1, &mVaoId );
+            }
+            if (mIbId > 0)
+                glDeleteBuffers( 1, &mIbId );
+            // A dynamic geometry's vertex buffer belongs to its DynamicBuffer
+            if (mVbId > 0 && mpDynamicBuffer == nullptr)
+                glDeleteBuffers( 1, &mVbId );
+        }
+        mpDynamicBuffer = nullptr;
 
         mVbId = 0;
         mIbId = 0;
         mVaoId = 0;
         mVertexCount = 0;
         mIndexCount = 0;
+        mVbSize = 0;
+        mIbSize = 0;
+        mBaseVertex = 0;
+        mIndexOffset = 0;
+        ResetLods();
+    }
+
+    void Geometry::ResetLods()
+    {
+        mLods[0].indexOffset = 0;
+        mLods[0].indexCount = (uint32_t)mIndexCount;
+        mLods[0].error = 0.0f;
+        mLodCount = 1;
+        mCurrentLod = 0;
+    }
+
+    void Geometry::SetLods(uint32_t const lodCount, uint32_t const* pIndexCounts, float const* pErrors)
+    {
+        uint32_t const indexSize = (mIndexType == GL_UNSIGNED_SHORT) ? sizeof(uint16_t) : sizeof(uint32_t);
+        uint32_t offset = 0;
+        uint32_t total = 0;
+        mLodCount = std::max(1u, std::min(lodCount, (uint32_t)MESH_LOD_MAX_COUNT));
+        for (uint32_t i = 0; i < mLodCount; i++)
+        {
+            mLods[i].indexOffset = offset;
+            mLods[i].indexCount = pIndexCounts[i];
+            mLods[i].error = pErrors[i];
+            offset += pIndexCounts[i] * indexSize;
+            total += pIndexCounts[i];
+        }
+        assert(total <= (uint32_t)mIndexCount);
+        (void)total;
+        mCurrentLod = 0;
+    }
+
+    LodView Geometry::MakeLodView(float const* pEyePosition, float const angleUp, float const angleDown,
+                                  uint32_t const viewportHeight)
+    {
+        LodView view;
+        for (int32_t c = 0; c < 3; c++)
+        {
+            view.eyePosition[c] = pEyePosition[c];
+        }
+        float const frustumHeight = tanf(angleUp) - tanf(angleDown);
+        view.pixelsPerUnit = (frustumHeight > 0.0f) ? (float)viewportHeight / frustumHeight : 0.0f;
+        return view;
+    }
+
+    uint32_t Geometry::SelectLod(LodView const& view, float const* pModelMatrix, uint32_t const currentLod,
+                                 float const maxPixelError, float const hysteresis) const
+    {
+        if (mLodCount <= 1)
+        {
+            return 0;
+        }
+
+        float const* m = pModelMatrix;
+        float center[3];
+        float size[3];
+        for (int32_t c = 0; c < 3; c++)
+        {
+            center[c] = 0.5f * (mBoundsMin[c] + mBoundsMax[c]);
+            size[c] = mBoundsMax[c] - mBoundsMin[c];
+        }
+
+        float worldCenter[3];
+        for (int32_t r = 0; r < 3; r++)
+        {
+            worldCenter[r] = m[r] * center[0] + m[4 + r] * center[1] + m[8 + r] * center[2] + m[12 + r];
+        }
+        float maxScaleSq = 0.0f;
+        for (int32_t c = 0; c < 3; c++)
+        {
+            maxScaleSq = std::max(maxScaleSq, m[4 * c] * m[4 * c] + m[4 * c + 1] * m[4 * c + 1] + m[4 * c + 2] * m[4 * c + 2]);
+        }
+        float const scale = sqrtf(maxScaleSq);
+        float const radius = 0.5f * sqrtf(size[0] * size[0] + size[1] * size[1] + size[2] * size[2]) * scale;
+        float const extent = std::max(size[0], std::max(size[1], size[2])) * scale;
+
+        float const dx = worldCenter[0] - view.eyePosition[0];
+        float const dy = worldCenter[1] - view.eyePosition[1];
+        float const dz = worldCenter[2] - view.eyePosition[2];
+        float const distance = sqrtf(dx * dx + dy * dy + dz * dz) - radius;
+        if (distance <= 0.0f)
+        {
+            // Inside the bounding sphere
+            return 0;
+        }
+
+        // Projected size of the extent; level errors scale with it
+        float const extentPixels = extent / distance * view.pixelsPerUnit;
+        for (uint32_t lod = mLodCount - 1; lod > 0; lod--)
+        {
+            float const limit = maxPixelError * ((lod > currentLod) ? (1.0f - hysteresis) : (1.0f + hysteresis));
+            if (mLods[lod].error * extentPixels <= limit)
+            {
+                return lod;
+            }
+        }
+        return 0;
+    }
+
+    void Geometry::BeginBatch()
+    {
+        gBatching = true;
+    }
+
+    void Geometry::EndBatch()
+    {
+        gBatching = false;
+        SetVertexArray( 0 );
+    }
+
+    void Geometry::SetVertexArray(uint32_t const vaoId)
+    {
+        glBindVertexArray( vaoId );
+        gCurrentBoundVao = vaoId;
+    }
+
+    void Geometry::BindVertexArray(uint32_t const vaoId)
+    {
+        if (!gBatching || gCurrentBoundVao != vaoId)
+        {
+            SetVertexArray( vaoId );
+        }
+    }
+
+    void Geometry::UnbindVertexArray()
+    {
+        if (!gBatching)
+        {
+            SetVertexArray( 0 );
+        }
+    }
+
+    void Geometry::Draw(uint32_t const instanceCount)
+    {
+        Lod const& lod = mLods[mCurrentLod];
+        if (mVertexCount == 0 || lod.indexCount == 0)
+            return;
+
+        void const* pOffset = (void const*)(uint64_t)(mIndexOffset + lod.indexOffset);
+        if (mpArena != nullptr || mpDynamicBuffer != nullptr)
+        {
+            if (instanceCount > 1)
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lod.indexCount, mIndexType, pOffset, instanceCount, mBaseVertex);
+            else
+                glDrawElementsBaseVertex(GL_TRIANGLES, lod.indexCount, mIndexType, pOffset, mBaseVertex);
+        }
+        else
+        {
+            if (instanceCount > 1)
+                glDrawElementsInstanced(GL_TRIANGLES, lod.indexCount, mIndexType, pOffset, instanceCount);
+            else
+                glDrawElements(GL_TRIANGLES, lod.indexCount, mIndexType, pOffset);
+        }
     }
 
     void Geometry::Submit()
     {
-        glBindVertexArray( mVaoId );
-        glDrawElements(GL_TRIANGLES, mIndexCount, GL_UNSIGNED_INT, nullptr);
-        glBindVertexArray( 0 );
+        BindVertexArray( mVaoId );
+        Draw(1);
+        UnbindVertexArray();
     }
 
     void Geometry::Submit(ProgramAttribute const* pAttribs, int32_t const nAttribs)
     {
-        glBindBuffer(GL_ARRAY_BUFFER, mVbId);
+        uint64_t const layoutKey = GeometryArena::GetLayoutKey(pAttribs, nAttribs);
 
-        for (int32_t i = 0; i < nAttribs; i++)
+        uint32_t vaoId = 0;
+        for (auto& attribVao : mAttribVaos)
         {
-            glEnableVertexAttribArray(pAttribs[i].index);
-            glVertexAttribPointer(pAttribs[i].index, pAttribs[i].size,
-                pAttribs[i].type, pAttribs[i].normalized,
-                pAttribs[i].stride, (void*)(uint64_t)(pAttribs[i].offset));
+            if (attribVao.layoutKey == layoutKey)
+            {
+                vaoId = attribVao.vaoId;
+                break;
+            }
         }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIbId);
+        if (vaoId == 0)
+        {
+            glGenVertexArrays( 1, &vaoId );
+            assert(vaoId != 0);
+            CreateVertexArray(vaoId, pAttribs, nAttribs);
+
+            AttribVao attribVao = { layoutKey, vaoId };
+            mAttribVaos.push_back(attribVao);
+        }
+
+        BindVertexArray( vaoId );
+        Draw(1);
+        UnbindVertexArray();
+    }
+
+    void Geometry::SubmitInstanced(uint32_t instanceCount)
+    {
+        BindVertexArray( mVaoId );
+        Draw(instanceCount);
+        UnbindVertexArray();
+    }
 
-        glDrawElements(GL_TRIANGLES, mIndexCount, GL_UNSIGNED_INT, nullptr);
+    // Interleaved position/normal/texcoord layout used for OBJ meshes
+    static int32_t const kObjVertexFloats = 8;
+    static int32_t const kObjVertexSize = kObjVertexFloats * sizeof(float);
 
+    static bool CreateFromMeshEntries(std::vector<MeshCacheEntry> const& entries, uint32_t const vertexFormat,
+            GeometryArena* pArena, Geometry** pOutGeometry, int32_t& outNumGeometry)
+    {
+        ProgramAttribute attribs[3];
+        int32_t const numAttribs = VertexFormat::GetAttributes(vertexFormat, attribs);
 
-        for (int32_t i = 0; i < nAttribs; i++)
+        *pOutGeometry = new Geometry[(int32_t)entries.size()];
+        for (size_t i = 0; i < entries.size(); i++)
         {
-            glDisableVertexAttribArray(pAttribs[i].index);
+            MeshCacheEntry const& entry = entries[i];
+            uint32_t const indexType = (entry.indexSize == sizeof(uint16_t)) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+            if (pArena != nullptr)
+            {
+                (*pOutGeometry)[i].Initialize(*pArena, &attribs[0], numAttribs,
+                    entry.pIndices, entry.indexCount, indexType,
+                    entry.pVertices, entry.vertexBytes, entry.vertexCount);
+            }
+            else
+            {
+                (*pOutGeometry)[i].Initialize(&attribs[0], numAttribs,
+                    entry.pIndices, entry.indexCount, indexType,
+                    entry.pVertices, entry.vertexBytes, entry.vertexCount);
+            }
+            (*pOutGeometry)[i].SetMeshInfo(entry.materialIndex, entry.boundsMin, entry.boundsMax);
+            (*pOutGeometry)[i].SetLods(entry.lodCount, entry.lodIndexCount, entry.lodError);
+            (*pOutGeometry)[i].SetVertexFormat(vertexFormat, VertexFormat::GetDecode(vertexFormat,
+                entry.boundsMin, entry.boundsMax, entry.texcoordMin, entry.texcoordMax));
+
+            LOGD("CreateFromObjFile", "OBJ Geom Initialized, idx count:%d, vertex count:%d", (int32_t)entry.indexCount, (int32_t)entry.vertexCount);
         }
 
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        outNumGeometry = (int32_t)entries.size();
+        return true;
     }
 
-    void Geometry::SubmitInstanced(uint32_t instanceCount)
+    void Geometry::SetMeshInfo(uint32_t const matIndex, float const* pBoundsMin, float const* pBoundsMax)
     {
-        glBindVertexArray( mVaoId );
-        glDrawElementsInstanced(GL_TRIANGLES, mIndexCount, GL_UNSIGNED_INT, nullptr, instanceCount);
-        glBindVertexArray( 0 );
+        mMatIndex = matIndex;
+        for (int32_t i = 0; i < 3; i++)
+        {
+            mBoundsMin[i] = pBoundsMin[i];
+            mBoundsMax[i] = pBoundsMax[i];
+        }
+    }
+
+    void Geometry::SetVertexFormat(uint32_t const vertexFormat, VertexDecode const& decode)
+    {
+        mVertexFormat = vertexFormat;
+        mVertexDecode = decode;
     }
 
     bool Geometry::CreateFromObjFile(std::string const& objFilePath, Geometry** pOutGeometry, int32_t& outNumGeometry,
-            bool normalize, std::vector<std::string>* outDiffusePaths)
+            bool normalize, std::vector<std::string>* outDiffusePaths, char const* pCacheDir,
+            uint32_t const vertexQuantization, GeometryArena* pArena)
+    {
+        QtiIO::AssetView objView;
+        if (!objView.OpenFile(objFilePath.c_str()))
+        {
+            LOGE("CreateFromObjFile", "Could not map %s", objFilePath.c_str());
+            *pOutGeometry = nullptr;
+            outNumGeometry = 0;
+            return false;
+        }
+
+        size_t const nameStart = objFilePath.find_last_of('/') + 1;
+        std::string materialPath = objFilePath.substr(0, nameStart);
+        std::string cachePath = (pCacheDir != nullptr)
+                ? std::string(pCacheDir) + "/" + objFilePath.substr(nameStart) + ".qmesh"
+                : objFilePath + ".qmesh";
+        return CreateFromObjBuffer(objView.GetData(), objView.GetSize(), materialPath,
+                                   pOutGeometry, outNumGeometry, normalize, outDiffusePaths, cachePath.c_str(),
+                                   vertexQuantization, pArena);
+    }
+
+    bool Geometry::CreateFromObjBuffer(void const* pObjData, size_t const objSize, std::string const& materialPath,
+            Geometry** pOutGeometry, int32_t& outNumGeometry,
+            bool normalize, std::vector<std::string>* outDiffusePaths, char const* pCacheFilePath,
+            uint32_t const vertexQuantization, GeometryArena* pArena)
     {
+        uint32_t const vertexFormat = VertexFormat::Sanitize(vertexQuantization);
+        uint32_t const vertexSize = VertexFormat::GetVertexSize(vertexFormat);
+        uint64_t const sourceHash = MeshCache::HashSource(pObjData, objSize, (normalize ? 1 : 0) | (vertexFormat << 1));
+
+        // Fast path: vertex and index blocks go to glBufferData straight from the mapped cache
+        if (pCacheFilePath != nullptr)
+        {
+            MeshCache cache;
+            if (cache.Open(pCacheFilePath, sourceHash) && cache.GetVertexStride() == vertexSize &&
+                cache.GetVertexFormat() == vertexFormat)
+            {
+                if (outDiffusePaths)
+                {
+                    for (auto& texName : cache.GetMaterialTexNames())
+                        outDiffusePaths->push_back(materialPath + texName);
+                }
+
+                std::vector<MeshCacheEntry> entries(cache.GetShapeCount());
+                for (uint32_t i = 0; i < cache.GetShapeCount(); i++)
+                {
+                    entries[i] = cache.GetShape(i);
+                }
+                return CreateFromMeshEntries(entries, vertexFormat, pArena, pOutGeometry, outNumGeometry);
+            }
+        }
+
         std::vector<tinyobj::shape_t>       shapes;
         std::vector<tinyobj::material_t>    materials;
         std::string err;
 
-        std::string materialPath = objFilePath.substr(0, objFilePath.find_last_of('/')) + "/";
-        bool ret = tinyobj::LoadObj(shapes, materials, err, objFilePath.c_str(), materialPath.c_str());
+        // Parse in place on all cores, the OBJ text is never copied out of the mapping
+        tinyobj::MaterialFileReader materialReader(materialPath);
+        bool ret = ObjParser::Parse(pObjData, objSize, materialReader, shapes, materials, err);
         if (!ret)
         {
             LOGE("CreateFromObjFile", "%s", err.c_str());
@@ -160,23 +622,24 @@ namespace QtiGL
             return false;
         }
 
-        ProgramAttribute attribs[3];
-
-        *pOutGeometry = new Geometry[(int32_t)shapes.size()];
         LOGD("CreateFromObjFile", "Found %d shapes", (int32_t)shapes.size());
         LOGD("CreateFromObjFile", "Found %d materials", (int32_t)materials.size());
 
+        std::vector<std::string> texNames;
+        for (auto& mat : materials)
+            texNames.push_back(mat.diffuse_texname);
+
         if (outDiffusePaths)
         {
-            for (auto& mat : materials)
-                outDiffusePaths->push_back(materialPath + mat.diffuse_texname);
+            for (auto& texName : texNames)
+                outDiffusePaths->push_back(materialPath + texName);
         }
 
         glm::mat4 normalizeMatrix(1.0f);
 
         if (normalize)
         {
-            glm::vec3 max(std::numeric_limits<float>::min());
+            glm::vec3 max(-std::numeric_limits<float>::max());
             glm::vec3 min(std::numeric_limits<float>::max());
 
             for (size_t i = 0; i < shapes.size(); i++)
@@ -199,16 +662,16 @@ namespace QtiGL
             normalizeMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f / dim)) * glm::translate(glm::mat4(1.0f), -center);
         }
 
+        std::vector<std::vector<float>> vertexData(shapes.size());
+        std::vector<std::vector<uint32_t>> indexData(shapes.size());
+        std::vector<std::vector<uint16_t>> shortIndexData(shapes.size());
+        std::vector<std::vector<uint8_t>> packedVertexData(shapes.size());
+        std::vector<MeshCacheEntry> entries(shapes.size());
         for (size_t i = 0; i < shapes.size(); i++)
         {
-            if (!materials.empty())
-                (*pOutGeometry)[i].mMatIndex = shapes[i].mesh.material_ids[0];
-
-            int vertexSize = 0;
-            int nAttribs = 0;
-
-            if (shapes[i].mesh.positions.size() == 0 ||
-                shapes[i].mesh.normals.size() == 0)
+            tinyobj::mesh_t const& mesh = shapes[i].mesh;
+            if (mesh.positions.size() == 0 ||
+                mesh.normals.size() == 0)
             {
                 LOGE("CreateFromObjFile", "OBJ must contain at least positions and normals");
                 *pOutGeometry = nullptr;
@@ -216,69 +679,147 @@ namespace QtiGL
                 return false;
             }
 
-            nAttribs = 3;
-            vertexSize = 8 * sizeof(float);
-
-            attribs[0].index = kPosition;
-            attribs[0].size = 3;
-            attribs[0].type = GL_FLOAT;
-            attribs[0].normalized = false;
-            attribs[0].stride = vertexSize;
-            attribs[0].offset = 0;
-
-            attribs[1].index = kNormal;
-            attribs[1].size = 3;
-            attribs[1].type = GL_FLOAT;
-            attribs[1].normalized = false;
-            attribs[1].stride = vertexSize;
-            attribs[1].offset = 3 * sizeof(float);
-
-            attribs[2].index = kTexcoord0;
-            attribs[2].size = 2;
-            attribs[2].type = GL_FLOAT;
-            attribs[2].normalized = false;
-            attribs[2].stride = vertexSize;
-            attribs[2].offset = 6 * sizeof(float);
-
-            float* pVbData = new float[vertexSize * shapes[i].mesh.positions.size()];
-            int32_t vbIndex = 0;
-
-            for (size_t j = 0; j < shapes[i].mesh.positions.size() / 3; j++)
+            size_t const numVertices = mesh.positions.size() / 3;
+            std::vector<float>& vbData = vertexData[i];
+            vbData.resize(kObjVertexFloats * numVertices);
+
+            glm::vec3 boundsMin(std::numeric_limits<float>::max());
+            glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+            float* pVertex = vbData.data();
+            for (size_t j = 0; j < numVertices; j++)
             {
-                glm::vec4 pos(shapes[i].mesh.positions[3 * j + 0], shapes[i].mesh.positions[3 * j + 1], shapes[i].mesh.positions[3 * j + 2], 1.0f);
+                glm::vec4 pos(mesh.positions[3 * j + 0], mesh.positions[3 * j + 1], mesh.positions[3 * j + 2], 1.0f);
                 pos = normalizeMatrix * pos;
+                boundsMin = glm::min(boundsMin, glm::vec3(pos));
+                boundsMax = glm::max(boundsMax, glm::vec3(pos));
 
-                pVbData[vbIndex++] = pos.x;
-                pVbData[vbIndex++] = pos.y;
-                pVbData[vbIndex++] = pos.z;
+                *pVertex++ = pos.x;
+                *pVertex++ = pos.y;
+                *pVertex++ = pos.z;
 
-                pVbData[vbIndex++] = shapes[i].mesh.normals[3 * j + 0];
-                pVbData[vbIndex++] = shapes[i].mesh.normals[3 * j + 1];
-                pVbData[vbIndex++] = shapes[i].mesh.normals[3 * j + 2];
+                *pVertex++ = mesh.normals[3 * j + 0];
+                *pVertex++ = mesh.normals[3 * j + 1];
+                *pVertex++ = mesh.normals[3 * j + 2];
 
-                if (!shapes[i].mesh.texcoords.empty())
+                if (!mesh.texcoords.empty())
                 {
-                    pVbData[vbIndex++] = shapes[i].mesh.texcoords[2 * j + 0];
-                    pVbData[vbIndex++] = shapes[i].mesh.texcoords[2 * j + 1];
+                    *pVertex++ = mesh.texcoords[2 * j + 0];
+                    *pVertex++ = mesh.texcoords[2 * j + 1];
                 }
                 else
                 {
-                    pVbData[vbIndex++] = 0.0f;
-                    pVbData[vbIndex++] = 0.0f;
+                    *pVertex++ = 0.0f;
+                    *pVertex++ = 0.0f;
                 }
             }
 
-            (*pOutGeometry)[i].Initialize(&attribs[0], nAttribs,
-                &shapes[i].mesh.indices[0], shapes[i].mesh.indices.size(),
-                (const void*)pVbData, vertexSize * shapes[i].mesh.positions.size(), shapes[i].mesh.positions.size());
+            // Reorder once at import, the result is what gets cached
+            std::vector<uint32_t>& ibData = indexData[i];
+            ibData.assign(mesh.indices.begin(), mesh.indices.end());
+            size_t optimizedVertices = numVertices;
+
+            VertexCacheStats const before = MeshOptimizer::AnalyzeVertexCache(ibData.data(), ibData.size(), numVertices, MESH_OPT_CACHE_SIZE);
+            MeshOptimizer::Optimize(vbData.data(), optimizedVertices, kObjVertexSize, ibData.data(), ibData.size());
+            VertexCacheStats const after = MeshOptimizer::AnalyzeVertexCache(ibData.data(), ibData.size(), optimizedVertices, MESH_OPT_CACHE_SIZE);
+            vbData.resize(kObjVertexFloats * optimizedVertices);
 
-            LOGD("CreateFromObjFile", "OBJ Geom Initialized, idx count:%d, pos count:%d", (int32_t)shapes[i].mesh.indices.size(), (int32_t)shapes[i].mesh.positions.size());
-            delete[] pVbData;
+            LOGI("CreateFromObjFile", "Shape %d: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %d vertices",
+                 (int32_t)i, before.acmr, after.acmr, before.atvr, after.atvr, (int32_t)optimizedVertices);
+
+            MeshCacheEntry& entry = entries[i];
+            entry.vertexCount = (uint32_t)optimizedVertices;
+            for (int32_t c = 0; c < 3; c++)
+            {
+                entry.boundsMin[c] = boundsMin[c];
+                entry.boundsMax[c] = boundsMax[c];
+            }
+
+            entry.texcoordMin[0] = entry.texcoordMin[1] = std::numeric_limits<float>::max();
+            entry.texcoordMax[0] = entry.texcoordMax[1] = -std::numeric_limits<float>::max();
+            for (size_t j = 0; j < optimizedVertices; j++)
+            {
+                for (int32_t c = 0; c < 2; c++)
+                {
+                    float const t = vbData[kObjVertexFloats * j + 6 + c];
+                    entry.texcoordMin[c] = std::min(entry.texcoordMin[c], t);
+                    entry.texcoordMax[c] = std::max(entry.texcoordMax[c], t);
+                }
+            }
+
+            // Simplified levels go after the full mesh, in the same index buffer
+            entry.lodCount = 1;
+            entry.lodIndexCount[0] = (uint32_t)ibData.size();
+            entry.lodError[0] = 0.0f;
+            if (ibData.size() / 3 >= MESH_LOD_MIN_TRIANGLES)
+            {
+                size_t const fullCount = ibData.size();
+                std::vector<uint32_t> lodIndices(fullCount);
+                size_t previousCount = fullCount;
+                for (uint32_t l = 1; l < MESH_LOD_MAX_COUNT; l++)
+                {
+                    // Always from the full mesh, so the reported error is against the original surface
+                    size_t const target = (size_t)(previousCount * MESH_LOD_REDUCTION) / 3 * 3;
+                    float error = 0.0f;
+                    size_t const count = MeshSimplifier::Simplify(ibData.data(), fullCount, vbData.data(), optimizedVertices,
+                                                                  kObjVertexSize, target, MESH_LOD_MAX_ERROR,
+                                                                  lodIndices.data(), &error);
+                    if (count == 0 || count > previousCount * MESH_LOD_MIN_REDUCTION)
+                    {
+                        break;
+                    }
+
+                    MeshOptimizer::OptimizeVertexCache(lodIndices.data(), count, optimizedVertices, MESH_OPT_CACHE_SIZE);
+                    ibData.insert(ibData.end(), lodIndices.begin(), lodIndices.begin() + count);
+                    entry.lodIndexCount[l] = (uint32_t)count;
+                    entry.lodError[l] = error;
+                    entry.lodCount++;
+                    previousCount = count;
+
+                    LOGI("CreateFromObjFile", "Shape %d LOD %u: %d triangles, error %.4f",
+                         (int32_t)i, l, (int32_t)(count / 3), error);
+                }
+            }
+            for (uint32_t l = entry.lodCount; l < MESH_LOD_MAX_COUNT; l++)
+            {
+                entry.lodIndexCount[l] = 0;
+                entry.lodError[l] = 0.0f;
+            }
+
+            if (vertexFormat != kVertexFloat)
+            {
+                std::vector<uint8_t>& packed = packedVertexData[i];
+                packed.resize(vertexSize * optimizedVertices);
+                VertexFormat::Encode(vertexFormat, vbData.data(), optimizedVertices, entry.boundsMin, entry.boundsMax,
+                                     entry.texcoordMin, entry.texcoordMax, packed.data());
+                entry.pVertices = packed.data();
+                entry.vertexBytes = (uint32_t)packed.size();
+            }
+            else
+            {
+                entry.pVertices = vbData.data();
+                entry.vertexBytes = (uint32_t)(vbData.size() * sizeof(float));
+            }
+            entry.indexCount = (uint32_t)ibData.size();
+            if (optimizedVertices <= UINT16_MAX)
+            {
+                shortIndexData[i].assign(ibData.begin(), ibData.end());
+                entry.pIndices = shortIndexData[i].data();
+                entry.indexSize = sizeof(uint16_t);
+            }
+            else
+            {
+                entry.pIndices = ibData.data();
+                entry.indexSize = sizeof(uint32_t);
+            }
+            entry.materialIndex = (!materials.empty() && !mesh.material_ids.empty()) ? (uint32_t)mesh.material_ids[0] : UINT_MAX;
         }
 
-        outNumGeometry = shapes.size();
+        if (pCacheFilePath != nullptr)
+        {
+            MeshCache::Write(pCacheFilePath, sourceHash, vertexSize, vertexFormat, entries, texNames);
+        }
 
-        return true;
+        return CreateFromMeshEntries(entries, vertexFormat, pArena, pOutGeometry, outNumGeometry);
     }
 
 }
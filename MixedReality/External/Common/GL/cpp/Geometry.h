@@ -8,6 +8,15 @@
 #include <string>
 #include <cstdint>
 #include <vector>
+#include "DynamicBuffer.h"
+#include "GeometryArena.h"
+#include "MeshSimplifier.h"
+#include "VertexFormat.h"
+
+// Largest on-screen error, in pixels, a simplified level of detail may have
+#define GEOMETRY_LOD_PIXEL_ERROR    1.0f
+// Fraction the error has to move past the limit before the level changes again
+#define GEOMETRY_LOD_HYSTERESIS     0.25f
 
 namespace QtiGL
 {
@@ -21,6 +30,13 @@ namespace QtiGL
         int32_t     offset;
     };
 
+    // Per-view inputs to Geometry::SelectLod()
+    struct LodView
+    {
+        float   eyePosition[3];
+        float   pixelsPerUnit;      // Viewport height over the frustum height at unit distance
+    };
+
     class Geometry
     {
     public:
@@ -29,34 +45,146 @@ namespace QtiGL
         void Initialize(ProgramAttribute const* pAttribs, int32_t const nAttribs,
                         uint32_t const* pIndices, int32_t const nIndices,
                         void const* pVertexData, int32_t const bufferSize, int32_t const nVertices);
+        // indexType is GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+        void Initialize(ProgramAttribute const* pAttribs, int32_t const nAttribs,
+                        void const* pIndices, int32_t const nIndices, uint32_t const indexType,
+                        void const* pVertexData, int32_t const bufferSize, int32_t const nVertices);
+
+        // Places the mesh in the arena's shared buffers instead of buffers of its own
+        void Initialize(GeometryArena& arena, ProgramAttribute const* pAttribs, int32_t const nAttribs,
+                        void const* pIndices, int32_t const nIndices, uint32_t const indexType,
+                        void const* pVertexData, int32_t const bufferSize, int32_t const nVertices);
+
+        // Streams the vertices through vertexBuffer, for geometry rewritten every frame.
+        // Each Update() writes a new copy into the buffer's current region and draws it
+        // with a base vertex, so the GPU can still read the previous frames' copies.
+        // The index buffer is the geometry's own.
+        void Initialize(DynamicBuffer& vertexBuffer, ProgramAttribute const* pAttribs, int32_t const nAttribs,
+                        void const* pIndices, int32_t const nIndices, uint32_t const indexType,
+                        void const* pVertexData, int32_t const bufferSize, int32_t const nVertices);
 
+        // Buffers are rewritten in place while the data fits, and only grow otherwise
         void Update(void const* pVertexData, int32_t const bufferSize, int32_t const nVertices);
         void Update(
                 void const* pVertexData, int32_t const bufferSize, int32_t const nVertices,
                 uint32_t const* pIndices, int32_t const nIndices);
 
         void Destroy();
+        // Draws the level selected with SetLod()
         void Submit();
+        // Draws with another attribute layout; a VAO is created for each layout on first use
         void Submit(ProgramAttribute const* pAttribs, int32_t const nAttribs);
         void SubmitInstanced(uint32_t instanceCount);
 
+        // Between these, Submit() leaves its VAO bound and skips rebinding it,
+        // so consecutive draws of arena geometry share one VAO binding
+        static void BeginBatch();
+        static void EndBatch();
+        // Every VAO bind outside Submit() goes through here so the batch tracker
+        // stays in sync; bind 0 before touching GL_ELEMENT_ARRAY_BUFFER, which
+        // would otherwise rebind the index buffer of whatever VAO is bound
+        static void SetVertexArray(uint32_t const vaoId);
+
+        // Parsed shapes are reordered for vertex cache, overdraw and fetch locality, and
+        // use 16-bit indices when they have few enough vertices.
+        // The parsed mesh is cached in binary form as <objFilePath>.qmesh, or in pCacheDir
+        // when given; later loads map the cache instead of parsing the OBJ again.
+        // vertexQuantization (VertexQuantization flags) selects a compact vertex layout;
+        // shaders then read attributes through the VertexFormat decode functions.
+        // With pArena, the shapes are placed in the arena's shared buffers.
         static bool CreateFromObjFile(std::string const& objFilePath, Geometry** pOutGeometry, int32_t& outNumGeometry,
-                bool normalize = false, std::vector<std::string>* outDiffusePaths = nullptr);
+                bool normalize = false, std::vector<std::string>* outDiffusePaths = nullptr,
+                char const* pCacheDir = nullptr, uint32_t const vertexQuantization = kVertexFloat,
+                GeometryArena* pArena = nullptr);
+        // Parses OBJ text straight out of a (mapped) buffer; .mtl files are looked up relative to materialPath.
+        // pCacheFilePath, if given, is used as the binary mesh cache for this buffer.
+        static bool CreateFromObjBuffer(void const* pObjData, size_t const objSize, std::string const& materialPath,
+                Geometry** pOutGeometry, int32_t& outNumGeometry,
+                bool normalize = false, std::vector<std::string>* outDiffusePaths = nullptr,
+                char const* pCacheFilePath = nullptr, uint32_t const vertexQuantization = kVertexFloat,
+                GeometryArena* pArena = nullptr);
 
         uint32_t GetVbId() { return mVbId; }
         uint32_t GetIbId() { return mIbId; }
         uint32_t GetVaoId() { return mVaoId; }
         int32_t GetVertexCount() { return mVertexCount; }
         int32_t GetIndexCount() { return mIndexCount; }
+        uint32_t GetIndexType() { return mIndexType; }
         uint32_t GetMatIndex() { return mMatIndex; }
+        float const* GetBoundsMin() const { return mBoundsMin; }
+        float const* GetBoundsMax() const { return mBoundsMax; }
+        void SetMeshInfo(uint32_t const matIndex, float const* pBoundsMin, float const* pBoundsMax);
+        uint32_t GetVertexFormat() const { return mVertexFormat; }
+        VertexDecode const& GetVertexDecode() const { return mVertexDecode; }
+        void SetVertexFormat(uint32_t const vertexFormat, VertexDecode const& decode);
+
+        // Level 0 is the full mesh; the others index the same vertices and follow it
+        // in the index buffer.  Errors are relative to the extent of the bounds.
+        void SetLods(uint32_t const lodCount, uint32_t const* pIndexCounts, float const* pErrors);
+        uint32_t GetLodCount() const { return mLodCount; }
+        uint32_t GetLod() const { return mCurrentLod; }
+        void SetLod(uint32_t const lod) { mCurrentLod = (lod < mLodCount) ? lod : mLodCount - 1; }
+        int32_t GetLodIndexCount(uint32_t const lod) const { return (int32_t)mLods[lod].indexCount; }
+
+        // Picks the coarsest level whose error, projected from the distance of the
+        // instance (pModelMatrix is column major), stays under maxPixelError.  Levels
+        // only change once the error is hysteresis past the limit, so an instance
+        // hovering around a switch distance doesn't pop back and forth; keep the
+        // returned level per instance and pass it back in as currentLod.
+        uint32_t SelectLod(LodView const& view, float const* pModelMatrix, uint32_t const currentLod,
+                           float const maxPixelError = GEOMETRY_LOD_PIXEL_ERROR,
+                           float const hysteresis = GEOMETRY_LOD_HYSTERESIS) const;
+        // Angles as in XrFovf, in radians
+        static LodView MakeLodView(float const* pEyePosition, float const angleUp, float const angleDown,
+                                   uint32_t const viewportHeight);
 
     private:
+        struct AttribVao
+        {
+            uint64_t    layoutKey;
+            uint32_t    vaoId;
+        };
+
+        struct Lod
+        {
+            uint32_t    indexOffset;    // In bytes, from the start of the mesh's indices
+            uint32_t    indexCount;
+            float       error;
+        };
+
+        void CreateVertexArray(uint32_t const vaoId, ProgramAttribute const* pAttribs, int32_t const nAttribs);
+        void BindVertexArray(uint32_t const vaoId);
+        void Draw(uint32_t const instanceCount);
+        void UnbindVertexArray();
+        void ResetLods();
+
+        static uint32_t gCurrentBoundVao;
+        static bool     gBatching;
+
         uint32_t    mVbId;
         uint32_t    mIbId;
         uint32_t    mVaoId;
         int32_t     mVertexCount;
         int32_t     mIndexCount;
+        uint32_t    mIndexType;
+        int32_t     mVbSize;
+        int32_t     mIbSize;
+        int32_t     mBaseVertex;        // Arena and dynamic geometry only
+        uint32_t    mIndexOffset;       // In bytes
         uint32_t    mMatIndex;
+        float       mBoundsMin[3];
+        float       mBoundsMax[3];
+        uint32_t    mVertexFormat;
+        VertexDecode mVertexDecode;
+        Lod         mLods[MESH_LOD_MAX_COUNT];
+        uint32_t    mLodCount;
+        uint32_t    mCurrentLod;
+
+        GeometryArena*          mpArena;
+        GeometryArenaAllocation mArenaAllocation;
+        DynamicBuffer*          mpDynamicBuffer;
+        uint32_t                mDynamicStride;
+        std::vector<AttribVao>  mAttribVaos;
     };
 
 }
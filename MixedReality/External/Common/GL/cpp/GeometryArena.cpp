@@ -0,0 +1,324 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <GLES3/gl32.h>
+#include <algorithm>
+#include <cassert>
+
+#include "Geometry.h"
+#include "GeometryArena.h"
+#include "LogUtils.h"
+
+// Index ranges start 4 byte aligned, whatever their index size
+#define ARENA_INDEX_ALIGNMENT   4
+
+namespace QtiGL
+{
+    FreeListAllocator::FreeListAllocator()
+        : mCapacity(0)
+        , mUsed(0)
+    {
+    }
+
+    void FreeListAllocator::Initialize(uint32_t const capacity)
+    {
+        mFreeRanges.clear();
+        if (capacity > 0)
+        {
+            Range range = { 0, capacity };
+            mFreeRanges.push_back(range);
+        }
+        mCapacity = capacity;
+        mUsed = 0;
+    }
+
+    bool FreeListAllocator::Allocate(uint32_t const size, uint32_t const alignment, uint32_t& outOffset)
+    {
+        for (size_t i = 0; i < mFreeRanges.size(); i++)
+        {
+            Range& range = mFreeRanges[i];
+            uint32_t const aligned = (range.offset + alignment - 1) / alignment * alignment;
+            uint32_t const padding = aligned - range.offset;
+            if (range.size < padding + size)
+            {
+                continue;
+            }
+
+            uint32_t const tailOffset = aligned + size;
+            uint32_t const tailSize = range.size - padding - size;
+            if (padding > 0)
+            {
+                // Keep the alignment gap as a free range of its own
+                range.size = padding;
+                if (tailSize > 0)
+                {
+                    Range tail = { tailOffset, tailSize };
+                    mFreeRanges.insert(mFreeRanges.begin() + i + 1, tail);
+                }
+            }
+            else if (tailSize > 0)
+            {
+                range.offset = tailOffset;
+                range.size = tailSize;
+            }
+            else
+            {
+                mFreeRanges.erase(mFreeRanges.begin() + i);
+            }
+
+            mUsed += size;
+            outOffset = aligned;
+            return true;
+        }
+        return false;
+    }
+
+    void FreeListAllocator::Free(uint32_t const offset, uint32_t const size)
+    {
+        if (size == 0)
+        {
+            return;
+        }
+
+        size_t i = 0;
+        while (i < mFreeRanges.size() && mFreeRanges[i].offset < offset)
+        {
+            i++;
+        }
+
+        bool const mergePrev = (i > 0) && (mFreeRanges[i - 1].offset + mFreeRanges[i - 1].size == offset);
+        bool const mergeNext = (i < mFreeRanges.size()) && (offset + size == mFreeRanges[i].offset);
+        if (mergePrev && mergeNext)
+        {
+            mFreeRanges[i - 1].size += size + mFreeRanges[i].size;
+            mFreeRanges.erase(mFreeRanges.begin() + i);
+        }
+        else if (mergePrev)
+        {
+            mFreeRanges[i - 1].size += size;
+        }
+        else if (mergeNext)
+        {
+            mFreeRanges[i].offset = offset;
+            mFreeRanges[i].size += size;
+        }
+        else
+        {
+            Range range = { offset, size };
+            mFreeRanges.insert(mFreeRanges.begin() + i, range);
+        }
+        mUsed -= size;
+    }
+
+    GeometryArena::GeometryArena()
+        : mVertexPoolBytes(0)
+        , mIndexPoolBytes(0)
+    {
+    }
+
+    GeometryArena::~GeometryArena()
+    {
+        Destroy();
+    }
+
+    void GeometryArena::Initialize(uint32_t const vertexPoolBytes, uint32_t const indexPoolBytes)
+    {
+        mVertexPoolBytes = vertexPoolBytes;
+        mIndexPoolBytes = indexPoolBytes;
+    }
+
+    void GeometryArena::Destroy()
+    {
+        for (auto& pool : mPools)
+        {
+            ReleasePool(pool);
+        }
+        mPools.clear();
+    }
+
+    void GeometryArena::ReleasePool(Pool& pool)
+    {
+        if (pool.vaoId == 0)
+        {
+            return;
+        }
+        // Deleting a bound VAO falls back to 0, tell the batch tracker too
+        Geometry::SetVertexArray(0);
+        glDeleteVertexArrays(1, &pool.vaoId);
+        glDeleteBuffers(1, &pool.vbId);
+        glDeleteBuffers(1, &pool.ibId);
+        pool.vaoId = 0;
+        pool.vbId = 0;
+        pool.ibId = 0;
+        pool.vertices.Initialize(0);
+        pool.indices.Initialize(0);
+    }
+
+    uint32_t GeometryArena::GetPoolCount() const
+    {
+        uint32_t count = 0;
+        for (auto const& pool : mPools)
+        {
+            if (pool.vaoId != 0)
+            {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    uint64_t GeometryArena::GetLayoutKey(ProgramAttribute const* pAttribs, int32_t const nAttribs)
+    {
+        uint64_t key = 14695981039346656037ULL;
+        for (int32_t i = 0; i < nAttribs; i++)
+        {
+            uint32_t const fields[6] = { pAttribs[i].index, (uint32_t)pAttribs[i].size, pAttribs[i].type,
+                                         pAttribs[i].normalized ? 1u : 0u, (uint32_t)pAttribs[i].stride,
+                                         (uint32_t)pAttribs[i].offset };
+            for (uint32_t f = 0; f < 6; f++)
+            {
+                key = (key ^ fields[f]) * 1099511628211ULL;
+            }
+        }
+        return key;
+    }
+
+    int32_t GeometryArena::CreatePool(ProgramAttribute const* pAttribs, int32_t const nAttribs,
+                                      uint32_t const vertexCapacity, uint32_t const indexBytes)
+    {
+        Pool pool;
+        pool.layoutKey = GetLayoutKey(pAttribs, nAttribs);
+        pool.stride = (uint32_t)pAttribs[0].stride;
+        pool.vertices.Initialize(vertexCapacity);
+        pool.indices.Initialize(indexBytes);
+
+        glGenBuffers(1, &pool.vbId);
+        glBindBuffer(GL_ARRAY_BUFFER, pool.vbId);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)vertexCapacity * pool.stride, nullptr, GL_STATIC_DRAW);
+
+        glGenBuffers(1, &pool.ibId);
+        glGenVertexArrays(1, &pool.vaoId);
+        assert(pool.vbId != 0 && pool.ibId != 0 && pool.vaoId != 0);
+
+        Geometry::SetVertexArray(pool.vaoId);
+        for (int32_t i = 0; i < nAttribs; i++)
+        {
+            glEnableVertexAttribArray(pAttribs[i].index);
+            glVertexAttribPointer(pAttribs[i].index, pAttribs[i].size,
+                pAttribs[i].type, pAttribs[i].normalized,
+                pAttribs[i].stride, (void*)(uint64_t)(pAttribs[i].offset));
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.ibId);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, nullptr, GL_STATIC_DRAW);
+        Geometry::SetVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // Reuse the slot of a released pool, allocations only hold the index
+        int32_t poolIndex = (int32_t)mPools.size();
+        for (size_t i = 0; i < mPools.size(); i++)
+        {
+            if (mPools[i].vaoId == 0)
+            {
+                poolIndex = (int32_t)i;
+                break;
+            }
+        }
+
+        LOGI("GeometryArena::CreatePool", "Pool %d: %u vertices of %u bytes, %u index bytes",
+             poolIndex, vertexCapacity, pool.stride, indexBytes);
+
+        if (poolIndex == (int32_t)mPools.size())
+        {
+            mPools.push_back(pool);
+        }
+        else
+        {
+            mPools[poolIndex] = pool;
+        }
+        return poolIndex;
+    }
+
+    bool GeometryArena::Allocate(ProgramAttribute const* pAttribs, int32_t const nAttribs,
+                                 void const* pVertexData, int32_t const nVertices,
+                                 void const* pIndices, int32_t const nIndices, uint32_t const indexSize,
+                                 GeometryArenaAllocation& outAllocation)
+    {
+        outAllocation.pool = -1;
+        if (nAttribs <= 0 || pAttribs[0].stride <= 0)
+        {
+            LOGE("GeometryArena::Allocate", "Arena geometry needs interleaved attributes with a stride");
+            return false;
+        }
+
+        uint64_t const layoutKey = GetLayoutKey(pAttribs, nAttribs);
+        uint32_t const stride = (uint32_t)pAttribs[0].stride;
+        uint32_t const indexBytes = (uint32_t)nIndices * indexSize;
+
+        uint32_t vertexOffset = 0;
+        uint32_t indexOffset = 0;
+        int32_t poolIndex = -1;
+        for (size_t i = 0; i < mPools.size() && poolIndex < 0; i++)
+        {
+            Pool& pool = mPools[i];
+            if (pool.vaoId == 0 || pool.layoutKey != layoutKey || !pool.vertices.Allocate((uint32_t)nVertices, 1, vertexOffset))
+            {
+                continue;
+            }
+            if (!pool.indices.Allocate(indexBytes, ARENA_INDEX_ALIGNMENT, indexOffset))
+            {
+                pool.vertices.Free(vertexOffset, (uint32_t)nVertices);
+                continue;
+            }
+            poolIndex = (int32_t)i;
+        }
+
+        if (poolIndex < 0)
+        {
+            uint32_t const vertexCapacity = std::max(mVertexPoolBytes / stride, (uint32_t)nVertices);
+            uint32_t const indexCapacity = std::max(mIndexPoolBytes, indexBytes);
+            poolIndex = CreatePool(pAttribs, nAttribs, vertexCapacity, indexCapacity);
+            Pool& pool = mPools[poolIndex];
+            pool.vertices.Allocate((uint32_t)nVertices, 1, vertexOffset);
+            pool.indices.Allocate(indexBytes, ARENA_INDEX_ALIGNMENT, indexOffset);
+        }
+
+        Pool const& pool = mPools[poolIndex];
+        glBindBuffer(GL_ARRAY_BUFFER, pool.vbId);
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)vertexOffset * stride, (GLsizeiptr)nVertices * stride, pVertexData);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        // The element buffer binding is VAO state, so go through the pool's VAO
+        Geometry::SetVertexArray(pool.vaoId);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexOffset, indexBytes, pIndices);
+        Geometry::SetVertexArray(0);
+
+        outAllocation.pool = poolIndex;
+        outAllocation.baseVertex = (int32_t)vertexOffset;
+        outAllocation.vertexCount = (uint32_t)nVertices;
+        outAllocation.indexOffset = indexOffset;
+        outAllocation.indexCount = (uint32_t)nIndices;
+        outAllocation.indexSize = indexSize;
+        return true;
+    }
+
+    void GeometryArena::Free(GeometryArenaAllocation& allocation)
+    {
+        if (allocation.pool < 0 || allocation.pool >= (int32_t)mPools.size())
+        {
+            return;
+        }
+
+        Pool& pool = mPools[allocation.pool];
+        pool.vertices.Free((uint32_t)allocation.baseVertex, allocation.vertexCount);
+        pool.indices.Free(allocation.indexOffset, allocation.indexCount * allocation.indexSize);
+        allocation.pool = -1;
+
+        if (pool.vertices.GetUsed() == 0 && pool.indices.GetUsed() == 0)
+        {
+            LOGI("GeometryArena::Free", "Pool %d is empty, releasing it", (int32_t)(&pool - mPools.data()));
+            ReleasePool(pool);
+        }
+    }
+}
@@ -0,0 +1,107 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace QtiGL
+{
+    struct ProgramAttribute;
+
+    // First-fit allocator over [0, capacity) that coalesces freed ranges
+    class FreeListAllocator
+    {
+    public:
+        FreeListAllocator();
+
+        void Initialize(uint32_t const capacity);
+        // Returns false if no free range is large enough
+        bool Allocate(uint32_t const size, uint32_t const alignment, uint32_t& outOffset);
+        void Free(uint32_t const offset, uint32_t const size);
+
+        uint32_t GetCapacity() const { return mCapacity; }
+        uint32_t GetUsed() const { return mUsed; }
+
+    private:
+        struct Range
+        {
+            uint32_t    offset;
+            uint32_t    size;
+        };
+
+        std::vector<Range>  mFreeRanges;    // Sorted by offset, never adjacent
+        uint32_t            mCapacity;
+        uint32_t            mUsed;
+    };
+
+    // Location of one mesh inside a GeometryArena
+    struct GeometryArenaAllocation
+    {
+        int32_t     pool;           // -1 when not allocated
+        int32_t     baseVertex;
+        uint32_t    vertexCount;
+        uint32_t    indexOffset;    // In bytes
+        uint32_t    indexCount;
+        uint32_t    indexSize;
+    };
+
+    // Shared vertex/index buffers for many small meshes.
+    //
+    // Meshes with the same vertex layout are packed into a pool: one vertex
+    // buffer, one index buffer and one VAO, sub-allocated with free lists.
+    // Vertex data is placed at a whole multiple of the stride, so meshes keep
+    // their own 0 based indices and are drawn with glDrawElementsBaseVertex.
+    // Consecutive draws from one pool then need no VAO or buffer switch.
+    // A pool that runs out of space gets a sibling; meshes larger than the
+    // pool size get a pool of their own. A pool whose last mesh is freed
+    // gives its buffers back, and its slot is reused by the next new pool.
+    class GeometryArena
+    {
+    public:
+        GeometryArena();
+        ~GeometryArena();
+
+        void Initialize(uint32_t const vertexPoolBytes, uint32_t const indexPoolBytes);
+        void Destroy();
+
+        // All attributes must read from one interleaved buffer with a common stride
+        bool Allocate(ProgramAttribute const* pAttribs, int32_t const nAttribs,
+                      void const* pVertexData, int32_t const nVertices,
+                      void const* pIndices, int32_t const nIndices, uint32_t const indexSize,
+                      GeometryArenaAllocation& outAllocation);
+        void Free(GeometryArenaAllocation& allocation);
+
+        uint32_t GetVaoId(GeometryArenaAllocation const& allocation) const { return mPools[allocation.pool].vaoId; }
+        uint32_t GetVbId(GeometryArenaAllocation const& allocation) const { return mPools[allocation.pool].vbId; }
+        uint32_t GetIbId(GeometryArenaAllocation const& allocation) const { return mPools[allocation.pool].ibId; }
+        // Pools still holding buffers; empty pools are released as they empty
+        uint32_t GetPoolCount() const;
+
+        // Identifies a vertex layout, e.g. to share VAOs between meshes
+        static uint64_t GetLayoutKey(ProgramAttribute const* pAttribs, int32_t const nAttribs);
+
+    private:
+        struct Pool
+        {
+            uint64_t            layoutKey;
+            uint32_t            stride;
+            uint32_t            vbId;
+            uint32_t            ibId;
+            uint32_t            vaoId;
+            FreeListAllocator   vertices;   // In vertices
+            FreeListAllocator   indices;    // In bytes
+        };
+
+        int32_t CreatePool(ProgramAttribute const* pAttribs, int32_t const nAttribs,
+                           uint32_t const vertexCapacity, uint32_t const indexBytes);
+        void ReleasePool(Pool& pool);
+
+        uint32_t            mVertexPoolBytes;
+        uint32_t            mIndexPoolBytes;
+        std::vector<Pool>   mPools;
+    };
+}
@@ -0,0 +1,422 @@
+/*
+-----------------------------------------------------------------------------
+Copyright (c) 2020 - 2022 Qualcomm Technologies, Inc.
+All Rights Reserved.
+Confidential and Proprietary - Qualcomm Technologies, Inc.
+-----------------------------------------------------------------------------
+*/
+#include <atomic>
+#include <cstring>  // For memcpy
+#include <mutex>
+
+#include "basisu_transcoder.h"
+#include "zstd.h"
+
+#include "Ktx2Transcoder.h"
+#include "LogUtils.h"
+#include "Parallel.h"
+
+#define KTX2_SUPERCOMPRESSION_NONE      (0)
+#define KTX2_SUPERCOMPRESSION_ZSTD      (2)
+
+#define KTX2_VK_FORMAT_UNDEFINED        (0)
+
+#ifndef MAX
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+#endif
+#ifndef MIN
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#endif
+
+namespace QtiGL
+{
+
+typedef struct
+{
+    uint32  vkFormat;
+    uint32  nTarget;
+    bool32  bCompressed;
+    GLenum  glInternalFormat;
+    GLenum  glFormat;
+    GLenum  glType;
+} TKTX2RawFormat;
+
+// Pass-through formats: data is uploaded as stored
+static const TKTX2RawFormat s_rawFormats[] =
+{
+    {  37, KTX2_TARGET_RGBA8, 0, GL_RGBA8,                                  GL_RGBA, GL_UNSIGNED_BYTE },
+    {  43, KTX2_TARGET_RGBA8, 0, GL_SRGB8_ALPHA8,                           GL_RGBA, GL_UNSIGNED_BYTE },
+    { 147, KTX2_TARGET_ETC2,  1, GL_COMPRESSED_RGB8_ETC2,                   0,       0 },
+    { 148, KTX2_TARGET_ETC2,  1, GL_COMPRESSED_SRGB8_ETC2,                  0,       0 },
+    { 151, KTX2_TARGET_ETC2,  1, GL_COMPRESSED_RGBA8_ETC2_EAC,              0,       0 },
+    { 152, KTX2_TARGET_ETC2,  1, GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC,       0,       0 },
+    { 157, KTX2_TARGET_ASTC,  1, GL_COMPRESSED_RGBA_ASTC_4x4,               0,       0 },
+    { 158, KTX2_TARGET_ASTC,  1, GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4,       0,       0 },
+};
+
+//-----------------------------------------------------------------------------
+Ktx2Transcoder::Ktx2Transcoder()
+//-----------------------------------------------------------------------------
+{
+    memset(&m_tHeader, 0, sizeof(m_tHeader));
+    m_nLevels           = 0;
+    m_nFaces            = 0;
+    m_nFirstLevel       = 0;
+    m_nEndLevel         = 0;
+    m_bCompressed       = 0;
+    m_glInternalFormat  = 0;
+    m_glFormat          = 0;
+    m_glType            = 0;
+}
+
+//-----------------------------------------------------------------------------
+Ktx2Transcoder::~Ktx2Transcoder()
+//-----------------------------------------------------------------------------
+{
+}
+
+//-----------------------------------------------------------------------------
+bool Ktx2Transcoder::IsKtx2(void const* pBuffer, uint32 nBufferSize)
+//-----------------------------------------------------------------------------
+{
+    uint8 identifierReference[12] = KTX2_IDENTIFIER_REF;
+    return nBufferSize >= KTX2_HEADER_SIZE && memcmp(pBuffer, identifierReference, 12) == 0;
+}
+
+//-----------------------------------------------------------------------------
+TKTXErrorCode Ktx2Transcoder::ParseHeader(void const* pBuffer, uint32 nBufferSize)
+//-----------------------------------------------------------------------------
+{
+    if (!IsKtx2(pBuffer, nBufferSize))
+    {
+        LOGE("Ktx2Transcoder::ParseHeader", "    KTX2 header has incorrect identifier");
+        return KTX_HEADER_ERROR;
+    }
+
+    // KTX2 is always little endian
+    memcpy(&m_tHeader, pBuffer, KTX2_HEADER_SIZE);
+
+    if (m_tHeader.pixelWidth == 0 || m_tHeader.pixelDepth > 0)
+    {
+        LOGE("Ktx2Transcoder::ParseHeader", "    KTX2 has unsupported sizes: Width = %d; Height = %d; Depth = %d", m_tHeader.pixelWidth, m_tHeader.pixelHeight, m_tHeader.pixelDepth);
+        return KTX_UNSUPPORTED_TEXTURE_TYPE;
+    }
+    if (m_tHeader.layerCount > 1)
+    {
+        LOGE("Ktx2Transcoder::ParseHeader", "    KTX2 is a texture array.  No support yet.");
+        return KTX_UNSUPPORTED_TEXTURE_TYPE;
+    }
+    if (m_tHeader.faceCount != 1 && m_tHeader.faceCount != 6)
+    {
+        LOGE("Ktx2Transcoder::ParseHeader", "    KTX2 has invalid number of faces: %d", m_tHeader.faceCount);
+        return KTX_INVALID_VALUE;
+    }
+
+    // 1D textures are loaded as 2D, and a level count of 0 asks for runtime mip generation
+    m_tHeader.pixelHeight = MAX(1, m_tHeader.pixelHeight);
+    m_nLevels = MAX(1, m_tHeader.levelCount);
+    m_nFaces = m_tHeader.faceCount;
+
+    uint64 nIndexEnd = KTX2_HEADER_SIZE + (uint64)m_nLevels * sizeof(TKTX2LevelIndex);
+    if (nIndexEnd > nBufferSize)
+    {
+        return KTX_UNEXPECTED_END_OF_STREAM;
+    }
+    m_levelIndex.resize(m_nLevels);
+    memcpy(&m_levelIndex[0], (uint8 const*)pBuffer + KTX2_HEADER_SIZE, m_nLevels * sizeof(TKTX2LevelIndex));
+
+    for (uint32 nLevel = 0; nLevel < m_nLevels; nLevel++)
+    {
+        if (m_levelIndex[nLevel].byteOffset + m_levelIndex[nLevel].byteLength > nBufferSize)
+        {
+            LOGE("Ktx2Transcoder::ParseHeader", "    KTX2 level %d lies outside the %d byte buffer", nLevel, nBufferSize);
+            return KTX_UNEXPECTED_END_OF_STREAM;
+        }
+    }
+
+    return KTX_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+TKTXErrorCode Ktx2Transcoder::TranscodeBasis(void const* pBuffer, uint32 nBufferSize, uint32 nTargetMask, uint32 nThreads)
+//-----------------------------------------------------------------------------
+{
+    static std::once_flag s_initFlag;
+    std::call_once(s_initFlag, []() { basist::basisu_transcoder_init(); });
+
+    basist::ktx2_transcoder transcoder;
+    if (!transcoder.init(pBuffer, nBufferSize))
+    {
+        LOGE("Ktx2Transcoder::TranscodeBasis", "    Basis Universal payload rejected");
+        return KTX_HEADER_ERROR;
+    }
+    // Unpacks the ETC1S codebooks shared by all levels
+    if (!transcoder.start_transcoding())
+    {
+        return KTX_INVALID_VALUE;
+    }
+
+    bool const bAlpha = transcoder.get_has_alpha();
+    bool const bSrgb  = transcoder.get_dfd_transfer_func() == basist::KTX2_KHR_DF_TRANSFER_SRGB;
+
+    basist::transcoder_texture_format eFormat;
+    if (nTargetMask & KTX2_TARGET_ASTC)
+    {
+        eFormat = basist::transcoder_texture_format::cTFASTC_4x4_RGBA;
+        m_glInternalFormat = bSrgb ? GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4 : GL_COMPRESSED_RGBA_ASTC_4x4;
+    }
+    else if (nTargetMask & KTX2_TARGET_ETC2)
+    {
+        // ETC1 is a subset of ETC2, and half the size of ETC2+EAC for opaque images
+        if (bAlpha)
+        {
+            eFormat = basist::transcoder_texture_format::cTFETC2_RGBA;
+            m_glInternalFormat = bSrgb ? GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC : GL_COMPRESSED_RGBA8_ETC2_EAC;
+        }
+        else
+        {
+            eFormat = basist::transcoder_texture_format::cTFETC1_RGB;
+            m_glInternalFormat = bSrgb ? GL_COMPRESSED_SRGB8_ETC2 : GL_COMPRESSED_RGB8_ETC2;
+        }
+    }
+    else if (nTargetMask & KTX2_TARGET_RGBA8)
+    {
+        eFormat = basist::transcoder_texture_format::cTFRGBA32;
+        m_glInternalFormat = bSrgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    }
+    else
+    {
+        LOGE("Ktx2Transcoder::TranscodeBasis", "    No transcode target in mask 0x%X", nTargetMask);
+        return KTX_UNSUPPORTED_TEXTURE_TYPE;
+    }
+
+    bool const bUncompressed = basist::basis_transcoder_format_is_uncompressed(eFormat);
+    uint32 const nBytesPerUnit = basist::basis_get_bytes_per_block_or_pixel(eFormat);
+    m_bCompressed = bUncompressed ? 0 : 1;
+    m_glFormat    = bUncompressed ? GL_RGBA : 0;
+    m_glType      = bUncompressed ? GL_UNSIGNED_BYTE : 0;
+
+    // Lay out all requested images in one allocation
+    std::vector<uint32> units(m_nLevels * m_nFaces);
+    std::vector<uint32> offsets(m_nLevels * m_nFaces);
+    uint32 nTotalSize = 0;
+    for (uint32 nLevel = m_nFirstLevel; nLevel < m_nEndLevel; nLevel++)
+    {
+        for (uint32 nFace = 0; nFace < m_nFaces; nFace++)
+        {
+            basist::ktx2_image_level_info levelInfo;
+            if (!transcoder.get_image_level_info(levelInfo, nLevel, 0, nFace))
+            {
+                return KTX_INVALID_VALUE;
+            }
+
+            uint32 const nImage = nLevel * m_nFaces + nFace;
+            units[nImage] = bUncompressed ? levelInfo.m_orig_width * levelInfo.m_orig_height : levelInfo.m_total_blocks;
+            offsets[nImage] = nTotalSize;
+
+            TKTXImage& image = m_images[nImage];
+            image.nSize   = units[nImage] * nBytesPerUnit;
+            image.nWidth  = levelInfo.m_orig_width;
+            image.nHeight = levelInfo.m_orig_height;
+            nTotalSize += image.nSize;
+        }
+    }
+    uint32 const nEndImage = m_nEndLevel * m_nFaces;
+    m_output.resize(nTotalSize);
+    for (uint32 nImage = m_nFirstLevel * m_nFaces; nImage < nEndImage; nImage++)
+    {
+        m_images[nImage].pData = &m_output[offsets[nImage]];
+    }
+
+    // Images are indexed largest first, so the longest jobs start early
+    std::atomic<uint32> nNextImage(m_nFirstLevel * m_nFaces);
+    std::atomic<bool>   bFailed(false);
+    RunOnThreads(nThreads, [&]()
+    {
+        basist::ktx2_transcoder_state state;
+        for (;;)
+        {
+            uint32 nImage = nNextImage++;
+            if (nImage >= nEndImage || bFailed)
+            {
+                break;
+            }
+
+            uint32 const nLevel = nImage / m_nFaces;
+            uint32 const nFace  = nImage % m_nFaces;
+            if (!transcoder.transcode_image_level(nLevel, 0, nFace, &m_output[offsets[nImage]], units[nImage], eFormat,
+                                                  0, 0, 0, -1, -1, &state))
+            {
+                LOGE("Ktx2Transcoder::TranscodeBasis", "    Failed to transcode level %d face %d", nLevel, nFace);
+                bFailed = true;
+            }
+        }
+    });
+
+    return bFailed ? KTX_INVALID_VALUE : KTX_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+TKTXErrorCode Ktx2Transcoder::DecodeRaw(void const* pBuffer, uint32 nBufferSize, uint32 nTargetMask, uint32 nThreads)
+//-----------------------------------------------------------------------------
+{
+    TKTX2RawFormat const* pFormat = NULL;
+    for (size_t i = 0; i < sizeof(s_rawFormats) / sizeof(s_rawFormats[0]); i++)
+    {
+        if (s_rawFormats[i].vkFormat == m_tHeader.vkFormat)
+        {
+            pFormat = &s_rawFormats[i];
+            break;
+        }
+    }
+    if (pFormat == NULL)
+    {
+        LOGE("Ktx2Transcoder::DecodeRaw", "    KTX2 vkFormat %d not supported", m_tHeader.vkFormat);
+        return KTX_UNSUPPORTED_TEXTURE_TYPE;
+    }
+    if ((pFormat->nTarget & nTargetMask) == 0 && NeedsMipGeneration())
+    {
+        LOGE("Ktx2Transcoder::DecodeRaw", "    KTX2 vkFormat %d is compressed, so its mips can't be generated at runtime", m_tHeader.vkFormat);
+        return KTX_UNSUPPORTED_TEXTURE_TYPE;
+    }
+    if ((pFormat->nTarget & nTargetMask) == 0)
+    {
+        LOGE("Ktx2Transcoder::DecodeRaw", "    KTX2 vkFormat %d cannot be sampled on this device", m_tHeader.vkFormat);
+        return KTX_UNSUPPORTED_TEXTURE_TYPE;
+    }
+
+    uint32 const nScheme = m_tHeader.supercompressionScheme;
+    if (nScheme != KTX2_SUPERCOMPRESSION_NONE && nScheme != KTX2_SUPERCOMPRESSION_ZSTD)
+    {
+        LOGE("Ktx2Transcoder::DecodeRaw", "    KTX2 supercompression scheme %d not supported", nScheme);
+        return KTX_UNSUPPORTED_TEXTURE_TYPE;
+    }
+
+    m_bCompressed       = pFormat->bCompressed;
+    m_glInternalFormat  = pFormat->glInternalFormat;
+    m_glFormat          = pFormat->glFormat;
+    m_glType            = pFormat->glType;
+
+    // Uncompressed payloads are used in place, supercompressed ones are inflated
+    // into one allocation
+    uint8 const* pSource = (uint8 const*)pBuffer;
+    std::vector<uint32> levelOffsets(m_nLevels);
+    uint32 nTotalSize = 0;
+    for (uint32 nLevel = m_nFirstLevel; nLevel < m_nEndLevel; nLevel++)
+    {
+        levelOffsets[nLevel] = nTotalSize;
+        if (nScheme == KTX2_SUPERCOMPRESSION_ZSTD)
+        {
+            nTotalSize += (uint32)m_levelIndex[nLevel].uncompressedByteLength;
+        }
+        else if (m_levelIndex[nLevel].byteLength != m_levelIndex[nLevel].uncompressedByteLength)
+        {
+            return KTX_INVALID_VALUE;
+        }
+    }
+    m_output.resize(nTotalSize);
+
+    for (uint32 nLevel = m_nFirstLevel; nLevel < m_nEndLevel; nLevel++)
+    {
+        uint8 const* pLevel = (nScheme == KTX2_SUPERCOMPRESSION_ZSTD) ? &m_output[levelOffsets[nLevel]]
+                                                                        : pSource + m_levelIndex[nLevel].byteOffset;
+        uint32 const nFaceSize = (uint32)(m_levelIndex[nLevel].uncompressedByteLength / m_nFaces);
+        for (uint32 nFace = 0; nFace < m_nFaces; nFace++)
+        {
+            TKTXImage& image = m_images[nLevel * m_nFaces + nFace];
+            image.pData   = pLevel + nFace * nFaceSize;
+            image.nSize   = nFaceSize;
+            image.nWidth  = MAX(1, m_tHeader.pixelWidth >> nLevel);
+            image.nHeight = MAX(1, m_tHeader.pixelHeight >> nLevel);
+        }
+    }
+
+    if (nScheme != KTX2_SUPERCOMPRESSION_ZSTD)
+    {
+        return KTX_SUCCESS;
+    }
+
+    // Each level is its own Zstandard frame
+    std::atomic<uint32> nNextLevel(m_nFirstLevel);
+    std::atomic<bool>   bFailed(false);
+    RunOnThreads(MAX(1, MIN(nThreads, m_nEndLevel - m_nFirstLevel)), [&]()
+    {
+        for (;;)
+        {
+            uint32 nLevel = nNextLevel++;
+            if (nLevel >= m_nEndLevel || bFailed)
+            {
+                break;
+            }
+
+            TKTX2LevelIndex const& level = m_levelIndex[nLevel];
+            size_t nResult = ZSTD_decompress(&m_output[levelOffsets[nLevel]], (size_t)level.uncompressedByteLength,
+                                             pSource + level.byteOffset, (size_t)level.byteLength);
+            if (ZSTD_isError(nResult) || nResult != level.uncompressedByteLength)
+            {
+                LOGE("Ktx2Transcoder::DecodeRaw", "    Failed to inflate level %d: %s", nLevel,
+                     ZSTD_isError(nResult) ? ZSTD_getErrorName(nResult) : "size mismatch");
+                bFailed = true;
+            }
+        }
+    });
+
+    return bFailed ? KTX_INVALID_VALUE : KTX_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+TKTXErrorCode Ktx2Transcoder::Transcode(void const* pBuffer, uint32 nBufferSize, uint32 nTargetMask, uint32 nMaxThreads,
+                                        uint32 nFirstLevel, uint32 nEndLevel)
+//-----------------------------------------------------------------------------
+{
+    m_images.clear();
+    m_output.clear();
+
+    TKTXErrorCode nErrorCode = ParseHeader(pBuffer, nBufferSize);
+    if (nErrorCode != KTX_SUCCESS)
+    {
+        return nErrorCode;
+    }
+
+    // glGenerateMipmap needs a color renderable format, so such files are decoded to RGBA8
+    if (NeedsMipGeneration())
+    {
+        nTargetMask &= KTX2_TARGET_RGBA8;
+        if (nTargetMask == 0)
+        {
+            LOGE("Ktx2Transcoder::Transcode", "    KTX2 asks for runtime mip generation, which needs the RGBA8 target");
+            return KTX_UNSUPPORTED_TEXTURE_TYPE;
+        }
+    }
+
+    m_nEndLevel = (nEndLevel == 0) ? m_nLevels : MIN(nEndLevel, m_nLevels);
+    m_nFirstLevel = MIN(nFirstLevel, m_nEndLevel);
+
+    uint32 nThreads = nMaxThreads ? nMaxThreads : GetDefaultThreadCount();
+    nThreads = MAX(1, MIN(nThreads, (m_nEndLevel - m_nFirstLevel) * m_nFaces));
+
+    TKTXImage emptyImage = { NULL, 0, 0, 0 };
+    m_images.assign(m_nLevels * m_nFaces, emptyImage);
+
+    LOGI("Ktx2Transcoder::Transcode", "    KTX2 (%d x %d), levels %d-%d of %d, %d faces, vkFormat %d, supercompression %d, %d threads",
+         m_tHeader.pixelWidth, m_tHeader.pixelHeight, m_nFirstLevel, m_nEndLevel, m_nLevels, m_nFaces, m_tHeader.vkFormat,
+         m_tHeader.supercompressionScheme, nThreads);
+
+    if (m_tHeader.vkFormat == KTX2_VK_FORMAT_UNDEFINED)
+    {
+        // BasisLZ/ETC1S or UASTC; the Basis transcoder handles its own supercompression
+        nErrorCode = TranscodeBasis(pBuffer, nBufferSize, nTargetMask, nThreads);
+    }
+    else
+    {
+        nErrorCode = DecodeRaw(pBuffer, nBufferSize, nTargetMask, nThreads);
+    }
+
+    if (nErrorCode == KTX_SUCCESS)
+    {
+        LOGI("Ktx2Transcoder::Transcode", "    Decoded to format 0x%X, %d bytes written", m_glInternalFormat, (uint32)m_output.size());
+    }
+    return nErrorCode;
+}
+
+}
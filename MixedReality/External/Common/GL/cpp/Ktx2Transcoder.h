@@ -0,0 +1,119 @@
+#pragma once
+/*
+-----------------------------------------------------------------------------
+Copyright (c) 2020 - 2022 Qualcomm Technologies, Inc.
+All Rights Reserved.
+Confidential and Proprietary - Qualcomm Technologies, Inc.
+-----------------------------------------------------------------------------
+*/
+#include <vector>
+
+#include "KtxLoader.h"
+
+#define KTX2_IDENTIFIER_REF { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A }
+#define KTX2_HEADER_SIZE    (80)
+
+namespace QtiGL
+{
+    // GPU format families a KTX2 file may be transcoded to.  Combine into a mask;
+    // the first supported family in this order is picked.
+    enum
+    {
+        KTX2_TARGET_ASTC    = 1 << 0,
+        KTX2_TARGET_ETC2    = 1 << 1,
+        KTX2_TARGET_RGBA8   = 1 << 2,
+    };
+
+    //KTX2 header as defined by Khronos, including the index
+    typedef struct
+    {
+        uint8   identifier[12];
+        uint32  vkFormat;
+        uint32  typeSize;
+        uint32  pixelWidth;
+        uint32  pixelHeight;
+        uint32  pixelDepth;
+        uint32  layerCount;
+        uint32  faceCount;
+        uint32  levelCount;
+        uint32  supercompressionScheme;
+        uint32  dfdByteOffset;
+        uint32  dfdByteLength;
+        uint32  kvdByteOffset;
+        uint32  kvdByteLength;
+        uint64  sgdByteOffset;
+        uint64  sgdByteLength;
+    } TKTX2Header;
+
+    // This will cause compilation to fail if the struct size doesn't match
+    typedef int KTX2_HEADER_SIZE_ASSERT [sizeof(TKTX2Header) == KTX2_HEADER_SIZE];
+
+    typedef struct
+    {
+        uint64  byteOffset;
+        uint64  byteLength;
+        uint64  uncompressedByteLength;
+    } TKTX2LevelIndex;
+
+    // Decodes a KTX2 file into GPU ready images on the CPU.
+    //
+    // Basis Universal payloads (BasisLZ/ETC1S and UASTC, optionally Zstandard
+    // supercompressed) are transcoded to the best family in the target mask.
+    // Other payloads are passed through, after Zstandard decompression if needed.
+    // Mip levels and faces are decoded in parallel.  No GL calls are made, so
+    // this runs (and can be benchmarked) off the render thread or on a host.
+    class Ktx2Transcoder
+    {
+        //constructors
+    public:
+        Ktx2Transcoder();
+        ~Ktx2Transcoder();
+
+        //methods
+    public:
+        static bool     IsKtx2(void const* pBuffer, uint32 nBufferSize);
+
+        // nMaxThreads = 0 uses one thread per core.  Only levels [nFirstLevel, nEndLevel)
+        // are decoded (nEndLevel = 0 for all); images of other levels are left empty.
+        TKTXErrorCode   Transcode(void const* pBuffer, uint32 nBufferSize, uint32 nTargetMask, uint32 nMaxThreads = 0,
+                                  uint32 nFirstLevel = 0, uint32 nEndLevel = 0);
+
+        uint32          GetWidth() { return m_tHeader.pixelWidth; }
+        uint32          GetHeight() { return m_tHeader.pixelHeight; }
+        uint32          GetNumLevels() { return m_nLevels; }
+        uint32          GetNumFaces() { return m_nFaces; }
+
+        // Level count 0: only the base level is stored and the rest are generated by GL
+        bool32          NeedsMipGeneration() { return m_tHeader.levelCount == 0; }
+
+        // GL description of the decoded images
+        bool32          IsCompressed() { return m_bCompressed; }
+        uint32          GetInternalFormat() { return m_glInternalFormat; }
+        uint32          GetFormat() { return m_glFormat; }
+        uint32          GetType() { return m_glType; }
+
+        TKTXImage const& GetImage(uint32 nLevel, uint32 nFace) { return m_images[nLevel * m_nFaces + nFace]; }
+
+    private:
+        TKTXErrorCode   ParseHeader(void const* pBuffer, uint32 nBufferSize);
+        TKTXErrorCode   TranscodeBasis(void const* pBuffer, uint32 nBufferSize, uint32 nTargetMask, uint32 nThreads);
+        TKTXErrorCode   DecodeRaw(void const* pBuffer, uint32 nBufferSize, uint32 nTargetMask, uint32 nThreads);
+
+        //attributes
+    private:
+        TKTX2Header                     m_tHeader;
+        std::vector<TKTX2LevelIndex>    m_levelIndex;
+        uint32                          m_nLevels;
+        uint32                          m_nFaces;
+        uint32                          m_nFirstLevel;
+        uint32                          m_nEndLevel;
+
+        bool32                          m_bCompressed;
+        uint32                          m_glInternalFormat;
+        uint32                          m_glFormat;
+        uint32                          m_glType;
+
+        std::vector<TKTXImage>          m_images;
+        std::vector<uint8>              m_output;
+    };
+}
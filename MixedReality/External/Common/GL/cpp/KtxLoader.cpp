@@ -5,15 +5,33 @@ All Rights Reserved.
 Confidential and Proprietary - Qualcomm Technologies, Inc.
 -----------------------------------------------------------------------------
 */
+#include <cstdint>
 #include <cstring>  // For memcpy
 
 #include "KtxLoader.h"
+#include "Ktx2Transcoder.h"
 #include "LogUtils.h"
 
 #if !defined( GL_TEXTURE_PROTECTED_EXT )
 #define GL_TEXTURE_PROTECTED_EXT    0x8BFA
 #endif 
 
+// Compressed formats whose extensions have no glCompressedTexSubImage2D
+#if !defined( GL_ETC1_RGB8_OES )
+#define GL_ETC1_RGB8_OES                        0x8D64
+#endif
+#if !defined( GL_COMPRESSED_RGB_PVRTC_4BPPV1_IMG )
+#define GL_COMPRESSED_RGB_PVRTC_4BPPV1_IMG      0x8C00
+#define GL_COMPRESSED_RGB_PVRTC_2BPPV1_IMG      0x8C01
+#define GL_COMPRESSED_RGBA_PVRTC_4BPPV1_IMG     0x8C02
+#define GL_COMPRESSED_RGBA_PVRTC_2BPPV1_IMG     0x8C03
+#endif
+#if !defined( GL_ATC_RGB_AMD )
+#define GL_ATC_RGB_AMD                          0x8C92
+#define GL_ATC_RGBA_EXPLICIT_ALPHA_AMD          0x8C93
+#define GL_ATC_RGBA_INTERPOLATED_ALPHA_AMD      0x87EE
+#endif
+
 #ifndef MAX
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 #endif
@@ -21,6 +39,107 @@ Confidential and Proprietary - Qualcomm Technologies, Inc.
 namespace QtiGL
 {
 
+// L_GetSizedInternalFormat: Maps an (unsized) KTX internal format to the sized
+// format glTexStorage2D requires.  Returns 0 if there is no sized equivalent,
+// or if the levels can't be filled with glTex(Compressed)SubImage2D.
+//-----------------------------------------------------------------------------
+static GLenum L_GetSizedInternalFormat(GLenum internalFormat, GLenum type)
+//-----------------------------------------------------------------------------
+{
+    switch (internalFormat)
+    {
+    case GL_RGBA:
+        switch (type)
+        {
+        case GL_UNSIGNED_BYTE:          return GL_RGBA8;
+        case GL_UNSIGNED_SHORT_4_4_4_4: return GL_RGBA4;
+        case GL_UNSIGNED_SHORT_5_5_5_1: return GL_RGB5_A1;
+        case GL_HALF_FLOAT:             return GL_RGBA16F;
+        case GL_FLOAT:                  return GL_RGBA32F;
+        default:                        return 0;
+        }
+    case GL_RGB:
+        switch (type)
+        {
+        case GL_UNSIGNED_BYTE:          return GL_RGB8;
+        case GL_UNSIGNED_SHORT_5_6_5:   return GL_RGB565;
+        case GL_HALF_FLOAT:             return GL_RGB16F;
+        case GL_FLOAT:                  return GL_RGB32F;
+        default:                        return 0;
+        }
+    case GL_RG:
+        switch (type)
+        {
+        case GL_UNSIGNED_BYTE:          return GL_RG8;
+        case GL_HALF_FLOAT:             return GL_RG16F;
+        case GL_FLOAT:                  return GL_RG32F;
+        default:                        return 0;
+        }
+    case GL_RED:
+        switch (type)
+        {
+        case GL_UNSIGNED_BYTE:          return GL_R8;
+        case GL_HALF_FLOAT:             return GL_R16F;
+        case GL_FLOAT:                  return GL_R32F;
+        default:                        return 0;
+        }
+    case GL_LUMINANCE:
+    case GL_LUMINANCE_ALPHA:
+    case GL_ALPHA:
+        // Legacy formats only exist as mutable textures
+        return 0;
+    case GL_ETC1_RGB8_OES:
+    case GL_COMPRESSED_RGB_PVRTC_4BPPV1_IMG:
+    case GL_COMPRESSED_RGB_PVRTC_2BPPV1_IMG:
+    case GL_COMPRESSED_RGBA_PVRTC_4BPPV1_IMG:
+    case GL_COMPRESSED_RGBA_PVRTC_2BPPV1_IMG:
+    case GL_ATC_RGB_AMD:
+    case GL_ATC_RGBA_EXPLICIT_ALPHA_AMD:
+    case GL_ATC_RGBA_INTERPOLATED_ALPHA_AMD:
+        // No sub-image uploads, only glCompressedTexImage2D into a mutable texture
+        return 0;
+    default:
+        // Already sized
+        return internalFormat;
+    }
+}
+
+// L_HasImmutableStorage: True if the texture bound to target already has
+// storage from glTexStorage*, which can't be allocated again
+//-----------------------------------------------------------------------------
+static bool L_HasImmutableStorage(GLenum target)
+//-----------------------------------------------------------------------------
+{
+    GLint immutable = GL_FALSE;
+    glGetTexParameteriv(target, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable);
+    return immutable == GL_TRUE;
+}
+
+// L_LogGLError: Logs a GL error raised while creating a texture
+//-----------------------------------------------------------------------------
+static void L_LogGLError(GLenum error)
+//-----------------------------------------------------------------------------
+{
+    switch(error)
+    {
+    case GL_INVALID_ENUM:       // 0x0500
+        LOGE("KtxTexture::ParseBuffer", "Error (GL_INVALID_ENUM) creating texture");
+        break;
+    case GL_INVALID_VALUE:      // 0x0501
+        LOGE("KtxTexture::ParseBuffer", "Error (GL_INVALID_VALUE) creating texture");
+        break;
+    case GL_INVALID_OPERATION:  // 0x0502
+        LOGE("KtxTexture::ParseBuffer", "Error (GL_INVALID_OPERATION) creating texture");
+        break;
+    case GL_OUT_OF_MEMORY:      // 0x0505
+        LOGE("KtxTexture::ParseBuffer", "Error (GL_OUT_OF_MEMORY) creating texture");
+        break;
+    default:
+        LOGE("KtxTexture::ParseBuffer", "Error (0x%X) creating texture", error);
+        break;
+    }
+}
+
 // L_SwapEndian16: Swaps endianness in an array of 16-bit values
 //-----------------------------------------------------------------------------
 static void L_SwapEndian16(uint16* pData16, uint32 nCount)
@@ -52,6 +171,10 @@ KtxTexture::KtxTexture()
     m_pData                 = NULL;
     m_nDataSize             = 0;
     m_nStreamBufferIndex    = 0;
+    m_eUploadMode           = KTX_UPLOAD_DIRECT;
+    m_nUnpackBuffer         = 0;
+    m_nBytesCopied          = 0;
+    m_nKtx2Targets          = 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -94,6 +217,23 @@ uint32 KtxTexture::StreamSkip(unsigned int nSize)
     return nSize;
 }
 
+//-----------------------------------------------------------------------------
+uint8 const* KtxTexture::StreamMap(unsigned int nSize)
+//-----------------------------------------------------------------------------
+{
+    // Like StreamRead, but hands out a pointer into the stream instead of copying
+    if (m_nStreamBufferIndex + nSize > m_nStreamBufferSize)
+    {
+        LOGE("KtxTexture::StreamMap", "    Stream has %d bytes.  Read index is at %d.  Trying to map %d bytes. Failed!!", m_nStreamBufferSize, m_nStreamBufferIndex, nSize);
+        return NULL;
+    }
+
+    uint8 const* pData = &m_pStreamBuffer[m_nStreamBufferIndex];
+    m_nStreamBufferIndex += nSize;
+
+    return pData;
+}
+
 //-----------------------------------------------------------------------------
 TKTXErrorCode KtxTexture::ParseHeader(TKTXHeader* pHeader, TKTXTextureInfo* pTextureInfo)
 //-----------------------------------------------------------------------------
@@ -257,7 +397,7 @@ TKTXErrorCode KtxTexture::ParseHeader(TKTXHeader* pHeader, TKTXTextureInfo* pTex
 }
 
 //-----------------------------------------------------------------------------
-TKTXErrorCode KtxTexture::ParseBuffer(void* pBuffer, unsigned int nBufferSize, GLuint* pTexture, GLenum* pTarget, TKTXHeader* pOutHeader, bool isProtected)
+TKTXErrorCode KtxTexture::ParseBuffer(void const* pBuffer, unsigned int nBufferSize, GLuint* pTexture, GLenum* pTarget, TKTXHeader* pOutHeader, bool isProtected)
 //-----------------------------------------------------------------------------
 {
     TKTXHeader      tHeader;
@@ -271,7 +411,7 @@ TKTXErrorCode KtxTexture::ParseBuffer(void* pBuffer, unsigned int nBufferSize, G
 
     if(!pOutHeader) pOutHeader = &tHeader;
 
-    m_pStreamBuffer     = (unsigned char*)pBuffer;
+    m_pStreamBuffer     = (unsigned char const*)pBuffer;
     m_nStreamBufferSize = nBufferSize;
     m_nStreamBufferIndex = 0;
 
@@ -301,11 +441,35 @@ TKTXErrorCode KtxTexture::ParseBuffer(void* pBuffer, unsigned int nBufferSize, G
         glGenTextures(1, &nTextureId);
     }
     
+    bool const bSwapEndian = (pOutHeader->endianness == KTX_ENDIAN_REF_REV);
+
+    // Allocate immutable storage once whenever the format has a sized equivalent;
+    // the levels are then filled with glTex(Compressed)SubImage2D.
+    GLenum nSizedFormat = L_GetSizedInternalFormat(pOutHeader->glInternalFormat, pOutHeader->glType);
+    bool const bImmutable = (nSizedFormat != 0);
+    if (isProtected && !bImmutable)
+    {
+        LOGE("KtxTexture::ParseBuffer", "    Protected textures need a sized format (0x%X unsupported)", pOutHeader->glInternalFormat);
+        return KTX_UNSUPPORTED_TEXTURE_TYPE;
+    }
+
     glBindTexture(textureInfo.glTarget, nTextureId);
-    if (isProtected) 
+    // A texture passed in may already have storage of its own; the levels are
+    // then written into it as they are
+    bool const bHasStorage = (*pTexture != 0) && L_HasImmutableStorage(textureInfo.glTarget);
+    if (bHasStorage && !bImmutable)
     {
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_PROTECTED_EXT, GL_TRUE);
-        glTexStorage2D(textureInfo.glTarget, pOutHeader->numberOfMipmapLevels, GL_RGBA8, pOutHeader->pixelWidth,
+        LOGE("KtxTexture::ParseBuffer", "    Texture %u has immutable storage, format 0x%X needs mutable storage",
+             nTextureId, pOutHeader->glInternalFormat);
+        return KTX_UNSUPPORTED_TEXTURE_TYPE;
+    }
+    if (isProtected && !bHasStorage)
+    {
+        glTexParameteri(textureInfo.glTarget, GL_TEXTURE_PROTECTED_EXT, GL_TRUE);
+    }
+    if (bImmutable && !bHasStorage)
+    {
+        glTexStorage2D(textureInfo.glTarget, pOutHeader->numberOfMipmapLevels, nSizedFormat, pOutHeader->pixelWidth,
                        pOutHeader->pixelHeight);
     }
     
@@ -314,6 +478,43 @@ TKTXErrorCode KtxTexture::ParseBuffer(void* pBuffer, unsigned int nBufferSize, G
         textureInfo.glTarget = GL_TEXTURE_CUBE_MAP_POSITIVE_X;
     }
 
+    // In PBO mode the whole remaining payload (image sizes and padding included) is
+    // copied into an unpack buffer up front, and faces are addressed by offset.
+    uint32 nPayloadStart = m_nStreamBufferIndex;
+    bool bUsePbo = (m_eUploadMode == KTX_UPLOAD_PBO);
+    if (bUsePbo && bSwapEndian)
+    {
+        // The payload needs fixing up on the CPU anyway
+        LOGI("KtxTexture::ParseBuffer", "    Byte swapped KTX, not using PBO upload");
+        bUsePbo = false;
+    }
+    if (bUsePbo)
+    {
+        uint32 nPayloadSize = m_nStreamBufferSize - nPayloadStart;
+
+        glGenBuffers(1, &m_nUnpackBuffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_nUnpackBuffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, nPayloadSize, NULL, GL_STREAM_DRAW);
+        void* pMapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, nPayloadSize,
+                                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (pMapped == NULL)
+        {
+            LOGE("KtxTexture::ParseBuffer", "    Could not map %d byte unpack buffer", nPayloadSize);
+            return KTX_GL_ERROR;
+        }
+        memcpy(pMapped, &m_pStreamBuffer[nPayloadStart], nPayloadSize);
+        m_nBytesCopied += nPayloadSize;
+        if (glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) != GL_TRUE)
+        {
+            LOGE("KtxTexture::ParseBuffer", "    Unpack buffer contents were lost");
+            return KTX_GL_ERROR;
+        }
+    }
+    else
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
     LOGI("KtxTexture::ParseBuffer", "    Texture has %d mip levels", pOutHeader->numberOfMipmapLevels);
     for (uint32 nMipLevel = 0; nMipLevel < pOutHeader->numberOfMipmapLevels; nMipLevel++)
     {
@@ -322,7 +523,6 @@ TKTXErrorCode KtxTexture::ParseBuffer(void* pBuffer, unsigned int nBufferSize, G
 
         GLsizei nWidth  = MAX(1, pOutHeader->pixelWidth  >> nMipLevel);
         GLsizei nHeight = MAX(1, pOutHeader->pixelHeight >> nMipLevel);
-        GLsizei nDepth  = MAX(1, pOutHeader->pixelDepth  >> nMipLevel);
         
         LOGI("KtxTexture::ParseBuffer", "       Mip %d: (%d x %d)", nMipLevel, nWidth, nHeight);
 
@@ -330,144 +530,101 @@ TKTXErrorCode KtxTexture::ParseBuffer(void* pBuffer, unsigned int nBufferSize, G
         {
             return KTX_UNEXPECTED_END_OF_STREAM;
         }
-        if (pOutHeader->endianness == KTX_ENDIAN_REF_REV)
+        if (bSwapEndian)
         {
             L_SwapEndian32(&nFaceLodSize, 1);
         }
         nFaceLodSizeRounded = (nFaceLodSize + 3) & ~(uint32)3;
-        if (!m_pData)
-        {
-            // allocate memory sufficient for the first nMipLevel 
-            m_pData = new uint8[nFaceLodSizeRounded];
-            m_nDataSize = nFaceLodSizeRounded;
-        }
-        else if (m_nDataSize < nFaceLodSizeRounded)
-        {
-            // subsequent levels cannot be larger than the first nMipLevel 
-            return KTX_INVALID_VALUE;
-        }
 
         for (uint32 nFace=0; nFace<pOutHeader->numberOfFaces; nFace++)
         {
-            if (StreamRead(m_pData, nFaceLodSizeRounded) != nFaceLodSizeRounded)
-            {
-                return KTX_UNEXPECTED_END_OF_STREAM;
-            }
-
-            // Perform endianness conversion on texture m_pData 
-            if (pOutHeader->endianness == KTX_ENDIAN_REF_REV && pOutHeader->glTypeSize == 2)
-            {
-                L_SwapEndian16((uint16*)m_pData, nFaceLodSize / 2);
-            }
-            else if (pOutHeader->endianness == KTX_ENDIAN_REF_REV && pOutHeader->glTypeSize == 4)
+            uint8 const* pFaceData;
+            if (bUsePbo)
             {
-                L_SwapEndian32((uint32*)m_pData, nFaceLodSize / 4);
-            }
-
-            if (textureInfo.nTextureDimensions == 1)
-            {
-                if (textureInfo.bCompressed)
+                // Offset into the bound unpack buffer
+                pFaceData = (uint8 const*)(uintptr_t)(m_nStreamBufferIndex - nPayloadStart);
+                if (StreamSkip(nFaceLodSizeRounded) != nFaceLodSizeRounded)
                 {
-                    //glCompressedTexImage1D not supported in OpenGLES 2.0
-                    return KTX_UNSUPPORTED_TEXTURE_TYPE;
-                }
-                else
-                {
-                    //glTexImage1D not supported in OpenGLES 2.0
-                    return KTX_UNSUPPORTED_TEXTURE_TYPE;
+                    return KTX_UNEXPECTED_END_OF_STREAM;
                 }
             }
-            else if (textureInfo.nTextureDimensions == 2)
+            else
             {
-                if (pOutHeader->numberOfArrayElements)
+                pFaceData = StreamMap(nFaceLodSizeRounded);
+                if (pFaceData == NULL)
                 {
-                    nHeight = pOutHeader->numberOfArrayElements;
+                    return KTX_UNEXPECTED_END_OF_STREAM;
                 }
-                if (textureInfo.bCompressed)
+
+                // Data in native byte order and suitably aligned for its type can be
+                // uploaded in place.  Otherwise fix it up in the scratch buffer.
+                bool const bAligned = textureInfo.bCompressed || pOutHeader->glTypeSize <= 1 ||
+                                      ((uintptr_t)pFaceData % pOutHeader->glTypeSize) == 0;
+                if (bSwapEndian || !bAligned)
                 {
-                    if (isProtected) 
-                    {
-                        glCompressedTexSubImage2D(textureInfo.glTarget + nFace, nMipLevel,
-                                        0, 0, nWidth, nHeight, pOutHeader->glFormat, 
-                                        nFaceLodSize, m_pData);
-                    } else 
+                    if (m_nDataSize < nFaceLodSizeRounded)
                     {
-                        glCompressedTexImage2D(textureInfo.glTarget + nFace, nMipLevel,
-                                           pOutHeader->glInternalFormat, nWidth, nHeight, 0,
-                                           nFaceLodSize, m_pData);
+                        delete [] m_pData;
+                        m_pData = new uint8[nFaceLodSizeRounded];
+                        m_nDataSize = nFaceLodSizeRounded;
                     }
-                }
-                else
-                {
-                    if (isProtected) 
-                    {
-                        glTexSubImage2D(textureInfo.glTarget + nFace, nMipLevel,
-                                        0, 0, nWidth, nHeight, pOutHeader->glFormat, 
-                                        pOutHeader->glType, m_pData);
-
+                    memcpy(m_pData, pFaceData, nFaceLodSize);
+                    m_nBytesCopied += nFaceLodSize;
 
-                    } else
+                    // Perform endianness conversion on texture m_pData 
+                    if (bSwapEndian && pOutHeader->glTypeSize == 2)
                     {
-                        glTexImage2D(textureInfo.glTarget + nFace, nMipLevel,
-                                     pOutHeader->glBaseInternalFormat, nWidth, nHeight, 0,
-                                     pOutHeader->glFormat, pOutHeader->glType, m_pData);
+                        L_SwapEndian16((uint16*)m_pData, nFaceLodSize / 2);
                     }
+                    else if (bSwapEndian && pOutHeader->glTypeSize == 4)
+                    {
+                        L_SwapEndian32((uint32*)m_pData, nFaceLodSize / 4);
+                    }
+                    pFaceData = m_pData;
                 }
             }
-            else if (textureInfo.nTextureDimensions == 3)
+
+            // 1D textures are loaded as 2D, and 3D/array textures were rejected by ParseHeader
+            if (textureInfo.bCompressed)
             {
-                if (pOutHeader->numberOfArrayElements)
+                if (bImmutable) 
                 {
-                    nDepth = pOutHeader->numberOfArrayElements;
-                }
-                if (textureInfo.bCompressed)
+                    glCompressedTexSubImage2D(textureInfo.glTarget + nFace, nMipLevel,
+                                    0, 0, nWidth, nHeight, pOutHeader->glInternalFormat, 
+                                    nFaceLodSize, pFaceData);
+                } else 
                 {
-                    //glCompressedTexImage3D not supported in OpenGLES 2.0
-                    return KTX_UNSUPPORTED_TEXTURE_TYPE;
+                    glCompressedTexImage2D(textureInfo.glTarget + nFace, nMipLevel,
+                                       pOutHeader->glInternalFormat, nWidth, nHeight, 0,
+                                       nFaceLodSize, pFaceData);
                 }
-                else
+            }
+            else
+            {
+                if (bImmutable) 
+                {
+                    glTexSubImage2D(textureInfo.glTarget + nFace, nMipLevel,
+                                    0, 0, nWidth, nHeight, pOutHeader->glFormat, 
+                                    pOutHeader->glType, pFaceData);
+                } else
                 {
-                    //glTexImage3D not supported in OpenGLES 2.0
-                    return KTX_UNSUPPORTED_TEXTURE_TYPE;
+                    glTexImage2D(textureInfo.glTarget + nFace, nMipLevel,
+                                 pOutHeader->glBaseInternalFormat, nWidth, nHeight, 0,
+                                 pOutHeader->glFormat, pOutHeader->glType, pFaceData);
                 }
             }
 
             GLenum error = glGetError();
             if (error != GL_NO_ERROR)
             {
-                switch(error)
-                {
-                case GL_NO_ERROR:           // 0
-                    LOGE("KtxTexture::ParseBuffer", "Error (GL_NO_ERROR) creating texture");
-                    break;
-                case GL_INVALID_ENUM:       // 0x0500
-                    LOGE("KtxTexture::ParseBuffer", "Error (GL_INVALID_ENUM) creating texture");
-                    break;
-                case GL_INVALID_VALUE:      // 0x0501
-                    LOGE("KtxTexture::ParseBuffer", "Error (GL_INVALID_VALUE) creating texture");
-                    break;
-                case GL_INVALID_OPERATION:  // 0x0502
-                    LOGE("KtxTexture::ParseBuffer", "Error (GL_INVALID_OPERATION) creating texture");
-                    break;
-                //case GL_STACK_OVERFLOW:     // 0x0503
-                //    LOGE("KtxTexture::ParseBuffer", "Error (GL_STACK_OVERFLOW) creating texture");
-                //    break;
-                //case GL_STACK_UNDERFLOW:    // 0x0504
-                //    LOGE("KtxTexture::ParseBuffer", "Error (GL_STACK_UNDERFLOW) creating texture");
-                //    break;
-                case GL_OUT_OF_MEMORY:      // 0x0505
-                    LOGE("KtxTexture::ParseBuffer", "Error (GL_OUT_OF_MEMORY) creating texture");
-                    break;
-
-                default:
-                    LOGE("KtxTexture::ParseBuffer", "Error (0x%X) creating texture", error);
-                    break;
-                }
+                L_LogGLError(error);
                 return KTX_GL_ERROR;
             }
         }
     }
 
+    LOGI("KtxTexture::ParseBuffer", "    Uploaded %s storage, %d bytes copied on the CPU", bImmutable ? "immutable" : "mutable", m_nBytesCopied);
+
     *pTarget  = textureInfo.glTarget;
     *pTexture = nTextureId;
 
@@ -475,20 +632,240 @@ TKTXErrorCode KtxTexture::ParseBuffer(void* pBuffer, unsigned int nBufferSize, G
 }
 
 //-----------------------------------------------------------------------------
-TKTXErrorCode KtxTexture::LoadKtxFromBuffer(void* pBuffer, unsigned int nBufferSize, GLuint* pTexture, GLenum* pTarget, TKTXHeader* pOutHeader, bool isProtected)
+uint32 KtxTexture::GetKtx2Targets()
+//-----------------------------------------------------------------------------
+{
+    // ETC2 and RGBA8 are core in OpenGL ES 3.0
+    uint32 nTargets = KTX2_TARGET_ETC2 | KTX2_TARGET_RGBA8;
+
+    GLint nExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &nExtensions);
+    for (GLint i = 0; i < nExtensions; i++)
+    {
+        char const* pExtension = (char const*)glGetStringi(GL_EXTENSIONS, i);
+        if (pExtension != NULL && strcmp(pExtension, "GL_KHR_texture_compression_astc_ldr") == 0)
+        {
+            nTargets |= KTX2_TARGET_ASTC;
+            break;
+        }
+    }
+    return nTargets;
+}
+
+//-----------------------------------------------------------------------------
+TKTXErrorCode KtxTexture::ParseLevels(void const* pBuffer, uint32 nBufferSize, TKTXHeader* pOutHeader, std::vector<TKTXImage>* pOutImages)
+//-----------------------------------------------------------------------------
+{
+    TKTXTextureInfo textureInfo;
+
+    m_pStreamBuffer     = (unsigned char const*)pBuffer;
+    m_nStreamBufferSize = nBufferSize;
+    m_nStreamBufferIndex = 0;
+
+    TKTXErrorCode nErrorCode = ParseHeader(pOutHeader, &textureInfo);
+    if (nErrorCode != KTX_SUCCESS)
+    {
+        return nErrorCode;
+    }
+
+    GLenum nSizedFormat = L_GetSizedInternalFormat(pOutHeader->glInternalFormat, pOutHeader->glType);
+    if (pOutHeader->endianness == KTX_ENDIAN_REF_REV || nSizedFormat == 0)
+    {
+        return KTX_UNSUPPORTED_TEXTURE_TYPE;
+    }
+    pOutHeader->glInternalFormat = nSizedFormat;
+
+    pOutImages->clear();
+    for (uint32 nMipLevel = 0; nMipLevel < pOutHeader->numberOfMipmapLevels; nMipLevel++)
+    {
+        uint32 nFaceLodSize;
+        if (StreamRead(&nFaceLodSize, sizeof(uint32)) != sizeof(uint32))
+        {
+            return KTX_UNEXPECTED_END_OF_STREAM;
+        }
+        uint32 nFaceLodSizeRounded = (nFaceLodSize + 3) & ~(uint32)3;
+
+        for (uint32 nFace = 0; nFace < pOutHeader->numberOfFaces; nFace++)
+        {
+            TKTXImage image;
+            image.pData   = StreamMap(nFaceLodSizeRounded);
+            image.nSize   = nFaceLodSize;
+            image.nWidth  = MAX(1, pOutHeader->pixelWidth  >> nMipLevel);
+            image.nHeight = MAX(1, pOutHeader->pixelHeight >> nMipLevel);
+            if (image.pData == NULL)
+            {
+                return KTX_UNEXPECTED_END_OF_STREAM;
+            }
+            pOutImages->push_back(image);
+        }
+    }
+
+    return KTX_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+TKTXErrorCode KtxTexture::ParseKtx2Buffer(void const* pBuffer, unsigned int nBufferSize, GLuint* pTexture, GLenum* pTarget, TKTXHeader* pOutHeader, bool isProtected)
+//-----------------------------------------------------------------------------
+{
+    TKTXHeader      tHeader;
+    GLuint          nTextureId;
+
+    // Clear out any GL Errors
+    GLenum error = GL_INVALID_ENUM;
+    while(error != GL_NO_ERROR)
+        error = glGetError();
+
+    if(!pOutHeader) pOutHeader = &tHeader;
+
+    if (pTarget == NULL || pTexture == NULL)
+    {
+        return KTX_INVALID_VALUE;
+    }
+
+    if (m_nKtx2Targets == 0)
+    {
+        m_nKtx2Targets = GetKtx2Targets();
+    }
+
+    // Transcoded images land in memory owned by the transcoder, so they are
+    // always uploaded straight from there
+    Ktx2Transcoder transcoder;
+    TKTXErrorCode nErrorCode = transcoder.Transcode(pBuffer, nBufferSize, m_nKtx2Targets);
+    if (nErrorCode != KTX_SUCCESS)
+    {
+        LOGI("KtxTexture::ParseKtx2Buffer", "    KTX2 transcoding failed: %d", nErrorCode);
+        return nErrorCode;
+    }
+
+    // Describe the result in KTX 1 terms for callers
+    uint8 identifierReference[12] = KTX_IDENTIFIER_REF;
+    memset(pOutHeader, 0, sizeof(TKTXHeader));
+    memcpy(pOutHeader->identifier, identifierReference, 12);
+    pOutHeader->endianness              = KTX_ENDIAN_REF;
+    pOutHeader->glType                  = transcoder.GetType();
+    pOutHeader->glTypeSize              = 1;
+    pOutHeader->glFormat                = transcoder.GetFormat();
+    pOutHeader->glInternalFormat        = transcoder.GetInternalFormat();
+    pOutHeader->glBaseInternalFormat    = transcoder.IsCompressed() ? transcoder.GetInternalFormat() : transcoder.GetFormat();
+    pOutHeader->pixelWidth              = transcoder.GetWidth();
+    pOutHeader->pixelHeight             = transcoder.GetHeight();
+    pOutHeader->numberOfFaces           = transcoder.GetNumFaces();
+    pOutHeader->numberOfMipmapLevels    = transcoder.GetNumLevels();
+
+    // Storage for the whole chain when only the base level is stored
+    if (transcoder.NeedsMipGeneration())
+    {
+        uint32 nMaxDimension = MAX(pOutHeader->pixelWidth, pOutHeader->pixelHeight);
+        while (nMaxDimension >>= 1)
+        {
+            pOutHeader->numberOfMipmapLevels++;
+        }
+    }
+
+    m_nWidth = pOutHeader->pixelWidth;
+    m_nHeight = pOutHeader->pixelHeight;
+
+    GLenum nTarget = (pOutHeader->numberOfFaces == 6) ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+
+    if (*pTexture)
+    {
+        nTextureId = *pTexture;
+    }
+    else
+    {
+        glGenTextures(1, &nTextureId);
+    }
+
+    glBindTexture(nTarget, nTextureId);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    bool const bHasStorage = (*pTexture != 0) && L_HasImmutableStorage(nTarget);
+    if (!bHasStorage)
+    {
+        if (isProtected)
+        {
+            glTexParameteri(nTarget, GL_TEXTURE_PROTECTED_EXT, GL_TRUE);
+        }
+        glTexStorage2D(nTarget, pOutHeader->numberOfMipmapLevels, pOutHeader->glInternalFormat, pOutHeader->pixelWidth,
+                       pOutHeader->pixelHeight);
+    }
+
+    GLenum nFaceTarget = (nTarget == GL_TEXTURE_CUBE_MAP) ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : GL_TEXTURE_2D;
+    for (uint32 nMipLevel = 0; nMipLevel < transcoder.GetNumLevels(); nMipLevel++)
+    {
+        for (uint32 nFace = 0; nFace < pOutHeader->numberOfFaces; nFace++)
+        {
+            TKTXImage const& image = transcoder.GetImage(nMipLevel, nFace);
+            if (transcoder.IsCompressed())
+            {
+                glCompressedTexSubImage2D(nFaceTarget + nFace, nMipLevel, 0, 0, image.nWidth, image.nHeight,
+                                          pOutHeader->glInternalFormat, image.nSize, image.pData);
+            }
+            else
+            {
+                glTexSubImage2D(nFaceTarget + nFace, nMipLevel, 0, 0, image.nWidth, image.nHeight,
+                                pOutHeader->glFormat, pOutHeader->glType, image.pData);
+            }
+
+            GLenum error = glGetError();
+            if (error != GL_NO_ERROR)
+            {
+                L_LogGLError(error);
+                return KTX_GL_ERROR;
+            }
+        }
+    }
+
+    if (transcoder.NeedsMipGeneration())
+    {
+        glGenerateMipmap(nTarget);
+        GLenum error = glGetError();
+        if (error != GL_NO_ERROR)
+        {
+            L_LogGLError(error);
+            return KTX_GL_ERROR;
+        }
+    }
+
+    *pTarget  = nFaceTarget;
+    *pTexture = nTextureId;
+
+    return KTX_SUCCESS;
+}
+
+//-----------------------------------------------------------------------------
+TKTXErrorCode KtxTexture::LoadKtxFromBuffer(void const* pBuffer, unsigned int nBufferSize, GLuint* pTexture, GLenum* pTarget, TKTXHeader* pOutHeader, bool isProtected)
 //-----------------------------------------------------------------------------
 {
     GLint           nPreviousUnpackAlignment = 4;
+    GLint           nPreviousUnpackBuffer = 0;
     TKTXErrorCode   nErrorCode = KTX_SUCCESS;
 
     // KTX files require an unpack alignment of 4 
     glGetIntegerv(GL_UNPACK_ALIGNMENT, &nPreviousUnpackAlignment);
+    glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &nPreviousUnpackBuffer);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-    nErrorCode = ParseBuffer(pBuffer, nBufferSize, pTexture, pTarget, pOutHeader, isProtected);
+    m_nBytesCopied = 0;
+    if (Ktx2Transcoder::IsKtx2(pBuffer, nBufferSize))
+    {
+        nErrorCode = ParseKtx2Buffer(pBuffer, nBufferSize, pTexture, pTarget, pOutHeader, isProtected);
+    }
+    else
+    {
+        nErrorCode = ParseBuffer(pBuffer, nBufferSize, pTexture, pTarget, pOutHeader, isProtected);
+    }
 
     // restore previous GL state 
     glPixelStorei(GL_UNPACK_ALIGNMENT, nPreviousUnpackAlignment);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, nPreviousUnpackBuffer);
+
+    // The texture keeps its own reference to the pending transfer, so the unpack
+    // buffer can be released right away without waiting for the upload.
+    if (m_nUnpackBuffer != 0)
+    {
+        glDeleteBuffers(1, &m_nUnpackBuffer);
+        m_nUnpackBuffer = 0;
+    }
 
     return nErrorCode;
 }
@@ -25,6 +25,7 @@ THE SOFTWARE.
 -----------------------------------------------------------------------------
 */
 #include <cstdlib>
+#include <vector>
 #include <GLES3/gl32.h>
 
 #define KTX_IDENTIFIER_REF  { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A }
@@ -89,6 +90,15 @@ namespace QtiGL
     // This will cause compilation to fail if the struct size doesn't match 
     typedef int KTX_HEADER_SIZE_ASSERT [sizeof(TKTXHeader) == KTX_HEADER_SIZE];
 
+    typedef enum
+    {
+        // Upload each face straight from the source buffer (client memory)
+        KTX_UPLOAD_DIRECT = 0,
+        // Copy the payload once into a pixel unpack buffer and upload from it, so the
+        // driver can perform the transfer asynchronously while rendering continues
+        KTX_UPLOAD_PBO,
+    } TKTXUploadMode;
+
     typedef struct 
     {
 	    uint32  nTextureDimensions;
@@ -96,6 +106,15 @@ namespace QtiGL
 	    bool32  bCompressed;
     } TKTXTextureInfo;
 
+    // One face of one mip level, ready for upload
+    typedef struct
+    {
+        uint8 const*    pData;
+        uint32          nSize;
+        uint32          nWidth;
+        uint32          nHeight;
+    } TKTXImage;
+
     class KtxTexture
     {
         //constructors
@@ -105,7 +124,23 @@ namespace QtiGL
 
         //methods
     public:
-        TKTXErrorCode   LoadKtxFromBuffer(void* pBuffer, uint32 nBufferSize, GLuint* texture, GLenum* target, TKTXHeader* pOutHeader = 0, bool isProtected = false);
+        TKTXErrorCode   LoadKtxFromBuffer(void const* pBuffer, uint32 nBufferSize, GLuint* texture, GLenum* target, TKTXHeader* pOutHeader = 0, bool isProtected = false);
+
+        void            SetUploadMode(TKTXUploadMode eMode) { m_eUploadMode = eMode; }
+
+        // Formats KTX2 files may be transcoded to (KTX2_TARGET_* mask).  0 queries the device.
+        void            SetKtx2Targets(uint32 nTargetMask) { m_nKtx2Targets = nTargetMask; }
+
+        // KTX2_TARGET_* mask of the formats the current context can sample
+        static uint32   GetKtx2Targets();
+
+        // Locates every level/face of a KTX 1 file in place, without touching GL.  On
+        // success glInternalFormat in the header is the sized format for glTexStorage2D.
+        // Files that need CPU fixups (byte swapping) or mutable storage are rejected.
+        TKTXErrorCode   ParseLevels(void const* pBuffer, uint32 nBufferSize, TKTXHeader* pOutHeader, std::vector<TKTXImage>* pOutImages);
+
+        // Bytes of image data copied on the CPU by the last load (0 when uploaded in place)
+        uint32          GetBytesCopied() { return m_nBytesCopied; }
 
         uint32          GetDataSize() { return m_nDataSize; }
         uint8 *         GetData() { return m_pData; }
@@ -114,19 +149,25 @@ namespace QtiGL
 		uint32			GetHeight() { return m_nHeight; }
 
     private:
-        TKTXErrorCode   ParseBuffer(void* pBuffer, unsigned int nBufferSize, GLuint* pTexture, GLenum* pTarget, TKTXHeader* pOutHeader = 0, bool isProtected = false);
+        TKTXErrorCode   ParseBuffer(void const* pBuffer, unsigned int nBufferSize, GLuint* pTexture, GLenum* pTarget, TKTXHeader* pOutHeader = 0, bool isProtected = false);
+        TKTXErrorCode   ParseKtx2Buffer(void const* pBuffer, unsigned int nBufferSize, GLuint* pTexture, GLenum* pTarget, TKTXHeader* pOutHeader, bool isProtected);
         TKTXErrorCode   ParseHeader(TKTXHeader* pHeader, TKTXTextureInfo* pTextureInfo);
         uint32          StreamRead(void* pData, unsigned int nSize);
         uint32          StreamSkip(unsigned int nSize);
+        uint8 const*    StreamMap(unsigned int nSize);
 
         //attributes
     private:
         uint8*  m_pData;
         uint32  m_nDataSize;
-        uint8*  m_pStreamBuffer;
+        uint8 const* m_pStreamBuffer;
         uint32  m_nStreamBufferSize;
         uint32  m_nStreamBufferIndex;
         uint32  m_nWidth, m_nHeight;
+        TKTXUploadMode m_eUploadMode;
+        GLuint  m_nUnpackBuffer;
+        uint32  m_nBytesCopied;
+        uint32  m_nKtx2Targets;
     };
 
 }
@@ -0,0 +1,251 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <cstdio>
+#include <cstring>
+
+#include "LogUtils.h"
+#include "MeshCache.h"
+
+namespace QtiGL
+{
+    static uint64_t AlignUp(uint64_t const value)
+    {
+        return (value + MESH_CACHE_ALIGNMENT - 1) & ~(uint64_t)(MESH_CACHE_ALIGNMENT - 1);
+    }
+
+    static bool WritePadded(FILE* pFile, void const* pData, size_t const size, uint64_t& offset)
+    {
+        static uint8_t const zeros[MESH_CACHE_ALIGNMENT] = {};
+
+        if (size > 0 && fwrite(pData, 1, size, pFile) != size)
+        {
+            return false;
+        }
+        offset += size;
+
+        size_t const padding = (size_t)(AlignUp(offset) - offset);
+        if (padding > 0 && fwrite(zeros, 1, padding, pFile) != padding)
+        {
+            return false;
+        }
+        offset += padding;
+        return true;
+    }
+
+    MeshCache::MeshCache()
+        : mpHeader(nullptr)
+        , mpShapes(nullptr)
+    {
+    }
+
+    uint64_t MeshCache::HashSource(void const* pData, size_t const size, uint32_t const flags)
+    {
+        // FNV-1a, seeded with the format version and load flags so either change
+        // invalidates old caches
+        uint64_t hash = 14695981039346656037ULL;
+        uint32_t const seed[2] = { MESH_CACHE_VERSION, flags };
+        uint8_t const* pSeed = reinterpret_cast<uint8_t const*>(seed);
+        for (size_t i = 0; i < sizeof(seed); ++i)
+        {
+            hash = (hash ^ pSeed[i]) * 1099511628211ULL;
+        }
+
+        uint8_t const* pBytes = static_cast<uint8_t const*>(pData);
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash = (hash ^ pBytes[i]) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    bool MeshCache::Open(char const* pFilePath, uint64_t const sourceHash)
+    {
+        Close();
+
+        if (!mView.OpenFile(pFilePath))
+        {
+            return false;
+        }
+
+        size_t const size = mView.GetSize();
+        uint8_t const* pData = mView.GetData();
+        MeshCacheHeader const* pHeader = reinterpret_cast<MeshCacheHeader const*>(pData);
+        if (size < sizeof(MeshCacheHeader) ||
+            pHeader->magic != MESH_CACHE_MAGIC ||
+            pHeader->version != MESH_CACHE_VERSION ||
+            pHeader->fileSize != size)
+        {
+            LOGI("MeshCache::Open", "%s is not a valid version %d mesh cache", pFilePath, MESH_CACHE_VERSION);
+            Close();
+            return false;
+        }
+        if (pHeader->sourceHash != sourceHash)
+        {
+            LOGI("MeshCache::Open", "%s is stale", pFilePath);
+            Close();
+            return false;
+        }
+        if (pHeader->shapeTableOffset + (uint64_t)pHeader->numShapes * sizeof(MeshCacheShape) > size ||
+            pHeader->materialTableOffset + pHeader->materialTableSize > size)
+        {
+            LOGE("MeshCache::Open", "%s is truncated", pFilePath);
+            Close();
+            return false;
+        }
+
+        MeshCacheShape const* pShapes = reinterpret_cast<MeshCacheShape const*>(pData + pHeader->shapeTableOffset);
+        for (uint32_t i = 0; i < pHeader->numShapes; ++i)
+        {
+            uint64_t lodIndices = 0;
+            for (uint32_t l = 0; l < pShapes[i].lodCount && l < MESH_LOD_MAX_COUNT; ++l)
+            {
+                lodIndices += pShapes[i].lodIndexCount[l];
+            }
+            if (pShapes[i].lodCount == 0 || pShapes[i].lodCount > MESH_LOD_MAX_COUNT ||
+                lodIndices != pShapes[i].indexCount ||
+                pShapes[i].vertexOffset + pShapes[i].vertexBytes > size ||
+                (pShapes[i].indexSize != 2 && pShapes[i].indexSize != 4) ||
+                pShapes[i].indexOffset + (uint64_t)pShapes[i].indexCount * pShapes[i].indexSize > size)
+            {
+                LOGE("MeshCache::Open", "%s shape %u is out of bounds", pFilePath, i);
+                Close();
+                return false;
+            }
+        }
+
+        char const* pNames = reinterpret_cast<char const*>(pData + pHeader->materialTableOffset);
+        char const* pNamesEnd = pNames + pHeader->materialTableSize;
+        for (uint32_t i = 0; i < pHeader->numMaterials; ++i)
+        {
+            size_t const length = strnlen(pNames, pNamesEnd - pNames);
+            if (pNames + length >= pNamesEnd)
+            {
+                LOGE("MeshCache::Open", "%s has a corrupt material table", pFilePath);
+                Close();
+                return false;
+            }
+            mMaterialTexNames.push_back(std::string(pNames, length));
+            pNames += length + 1;
+        }
+
+        mpHeader = pHeader;
+        mpShapes = pShapes;
+        LOGI("MeshCache::Open", "Using %s (%u shapes)", pFilePath, mpHeader->numShapes);
+        return true;
+    }
+
+    void MeshCache::Close()
+    {
+        mView.Close();
+        mpHeader = nullptr;
+        mpShapes = nullptr;
+        mMaterialTexNames.clear();
+    }
+
+    MeshCacheEntry MeshCache::GetShape(uint32_t const index) const
+    {
+        MeshCacheShape const& shape = mpShapes[index];
+        uint8_t const* pData = mView.GetData();
+
+        MeshCacheEntry entry;
+        entry.pVertices = pData + shape.vertexOffset;
+        entry.vertexCount = shape.vertexCount;
+        entry.vertexBytes = shape.vertexBytes;
+        entry.pIndices = pData + shape.indexOffset;
+        entry.indexCount = shape.indexCount;
+        entry.indexSize = shape.indexSize;
+        entry.materialIndex = shape.materialIndex;
+        entry.lodCount = shape.lodCount;
+        memcpy(entry.lodIndexCount, shape.lodIndexCount, sizeof(entry.lodIndexCount));
+        memcpy(entry.lodError, shape.lodError, sizeof(entry.lodError));
+        memcpy(entry.boundsMin, shape.boundsMin, sizeof(entry.boundsMin));
+        memcpy(entry.boundsMax, shape.boundsMax, sizeof(entry.boundsMax));
+        memcpy(entry.texcoordMin, shape.texcoordMin, sizeof(entry.texcoordMin));
+        memcpy(entry.texcoordMax, shape.texcoordMax, sizeof(entry.texcoordMax));
+        return entry;
+    }
+
+    bool MeshCache::Write(char const* pFilePath, uint64_t const sourceHash, uint32_t const vertexStride, uint32_t const vertexFormat,
+                          std::vector<MeshCacheEntry> const& shapes, std::vector<std::string> const& materialTexNames)
+    {
+        // Lay the file out: header, shape table, material names, then data blocks
+        MeshCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = MESH_CACHE_MAGIC;
+        header.version = MESH_CACHE_VERSION;
+        header.sourceHash = sourceHash;
+        header.numShapes = (uint32_t)shapes.size();
+        header.numMaterials = (uint32_t)materialTexNames.size();
+        header.vertexStride = vertexStride;
+        header.vertexFormat = vertexFormat;
+
+        std::string names;
+        for (size_t i = 0; i < materialTexNames.size(); ++i)
+        {
+            names.append(materialTexNames[i].c_str(), materialTexNames[i].size() + 1);
+        }
+
+        header.shapeTableOffset = AlignUp(sizeof(MeshCacheHeader));
+        header.materialTableOffset = AlignUp(header.shapeTableOffset + shapes.size() * sizeof(MeshCacheShape));
+        header.materialTableSize = names.size();
+
+        std::vector<MeshCacheShape> table(shapes.size());
+        uint64_t offset = AlignUp(header.materialTableOffset + header.materialTableSize);
+        for (size_t i = 0; i < shapes.size(); ++i)
+        {
+            MeshCacheShape& shape = table[i];
+            memset(&shape, 0, sizeof(shape));
+            shape.vertexCount = shapes[i].vertexCount;
+            shape.vertexBytes = shapes[i].vertexBytes;
+            shape.indexCount = shapes[i].indexCount;
+            shape.indexSize = shapes[i].indexSize;
+            shape.materialIndex = shapes[i].materialIndex;
+            shape.lodCount = shapes[i].lodCount;
+            memcpy(shape.lodIndexCount, shapes[i].lodIndexCount, sizeof(shape.lodIndexCount));
+            memcpy(shape.lodError, shapes[i].lodError, sizeof(shape.lodError));
+            memcpy(shape.boundsMin, shapes[i].boundsMin, sizeof(shape.boundsMin));
+            memcpy(shape.boundsMax, shapes[i].boundsMax, sizeof(shape.boundsMax));
+            memcpy(shape.texcoordMin, shapes[i].texcoordMin, sizeof(shape.texcoordMin));
+            memcpy(shape.texcoordMax, shapes[i].texcoordMax, sizeof(shape.texcoordMax));
+
+            shape.vertexOffset = offset;
+            offset = AlignUp(offset + shape.vertexBytes);
+            shape.indexOffset = offset;
+            offset = AlignUp(offset + (uint64_t)shape.indexCount * shape.indexSize);
+        }
+        header.fileSize = offset;
+
+        std::string tempPath = std::string(pFilePath) + ".tmp";
+        FILE* pFile = fopen(tempPath.c_str(), "wb");
+        if (pFile == nullptr)
+        {
+            LOGE("MeshCache::Write", "Could not create %s", tempPath.c_str());
+            return false;
+        }
+
+        uint64_t written = 0;
+        bool ok = WritePadded(pFile, &header, sizeof(header), written) &&
+                  WritePadded(pFile, table.data(), table.size() * sizeof(MeshCacheShape), written) &&
+                  WritePadded(pFile, names.data(), names.size(), written);
+        for (size_t i = 0; ok && i < shapes.size(); ++i)
+        {
+            ok = WritePadded(pFile, shapes[i].pVertices, shapes[i].vertexBytes, written) &&
+                 WritePadded(pFile, shapes[i].pIndices, shapes[i].indexCount * shapes[i].indexSize, written);
+        }
+        ok = (fclose(pFile) == 0) && ok && written == header.fileSize;
+
+        if (!ok || rename(tempPath.c_str(), pFilePath) != 0)
+        {
+            LOGE("MeshCache::Write", "Could not write %s", pFilePath);
+            remove(tempPath.c_str());
+            return false;
+        }
+
+        LOGI("MeshCache::Write", "Wrote %s (%u shapes, %llu bytes)", pFilePath, header.numShapes,
+             (unsigned long long)header.fileSize);
+        return true;
+    }
+}
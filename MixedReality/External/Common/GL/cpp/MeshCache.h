@@ -0,0 +1,110 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "AssetView.h"
+#include "MeshSimplifier.h"
+
+#define MESH_CACHE_MAGIC        0x48534D51  // 'QMSH'
+#define MESH_CACHE_VERSION      4
+// Every data block starts on a cache line, so mapped blocks can be handed to
+// glBufferData (or read as float/uint32 arrays) without copying
+#define MESH_CACHE_ALIGNMENT    64
+
+namespace QtiGL
+{
+    struct MeshCacheHeader
+    {
+        uint32_t    magic;
+        uint32_t    version;
+        uint64_t    sourceHash;
+        uint32_t    numShapes;
+        uint32_t    numMaterials;
+        uint32_t    vertexStride;
+        uint32_t    vertexFormat;           // VertexQuantization flags
+        uint64_t    shapeTableOffset;
+        uint64_t    materialTableOffset;   // numMaterials null terminated strings
+        uint64_t    materialTableSize;
+        uint64_t    fileSize;
+    };
+
+    struct MeshCacheShape
+    {
+        uint64_t    vertexOffset;
+        uint64_t    indexOffset;
+        uint32_t    vertexCount;
+        uint32_t    vertexBytes;
+        uint32_t    indexCount;
+        uint32_t    indexSize;      // 2 or 4 bytes
+        uint32_t    materialIndex;
+        uint32_t    lodCount;
+        uint32_t    lodIndexCount[MESH_LOD_MAX_COUNT];  // Levels follow each other in the index block
+        float       lodError[MESH_LOD_MAX_COUNT];       // Relative to the shape extent
+        float       boundsMin[3];
+        float       boundsMax[3];
+        float       texcoordMin[2];
+        float       texcoordMax[2];
+    };
+
+    // Mesh data for one shape, either in memory (when writing) or pointing into
+    // a mapped cache file (when reading)
+    struct MeshCacheEntry
+    {
+        void const*     pVertices;
+        uint32_t        vertexCount;
+        uint32_t        vertexBytes;
+        void const*     pIndices;
+        uint32_t        indexCount;
+        uint32_t        indexSize;
+        uint32_t        materialIndex;
+        uint32_t        lodCount;
+        uint32_t        lodIndexCount[MESH_LOD_MAX_COUNT];
+        float           lodError[MESH_LOD_MAX_COUNT];
+        float           boundsMin[3];
+        float           boundsMax[3];
+        float           texcoordMin[2];
+        float           texcoordMax[2];
+    };
+
+    // Versioned binary mesh cache.
+    //
+    // Holds the interleaved vertices, 16 or 32-bit indices (every level of detail),
+    // material index and bounds of every shape of a parsed mesh, plus its material
+    // texture names.  The
+    // file is keyed by a hash of the source bytes, so a stale cache is simply
+    // ignored and rewritten.
+    class MeshCache
+    {
+    public:
+        MeshCache();
+
+        static uint64_t HashSource(void const* pData, size_t const size, uint32_t const flags);
+
+        // Maps the cache and checks it was built from a source with this hash
+        bool Open(char const* pFilePath, uint64_t const sourceHash);
+        void Close();
+
+        uint32_t GetShapeCount() const { return mpHeader ? mpHeader->numShapes : 0; }
+        uint32_t GetVertexStride() const { return mpHeader ? mpHeader->vertexStride : 0; }
+        uint32_t GetVertexFormat() const { return mpHeader ? mpHeader->vertexFormat : 0; }
+        MeshCacheEntry GetShape(uint32_t const index) const;
+        std::vector<std::string> const& GetMaterialTexNames() const { return mMaterialTexNames; }
+
+        // Written to a temporary file and renamed, so readers never see a partial cache
+        static bool Write(char const* pFilePath, uint64_t const sourceHash, uint32_t const vertexStride, uint32_t const vertexFormat,
+                          std::vector<MeshCacheEntry> const& shapes, std::vector<std::string> const& materialTexNames);
+
+    private:
+        QtiIO::AssetView            mView;
+        MeshCacheHeader const*      mpHeader;
+        MeshCacheShape const*       mpShapes;
+        std::vector<std::string>    mMaterialTexNames;
+    };
+}
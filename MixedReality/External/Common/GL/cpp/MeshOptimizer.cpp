@@ -0,0 +1,376 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "MeshOptimizer.h"
+
+namespace QtiGL
+{
+    // Triangles using each vertex, as offsets into one flat list
+    struct TriangleAdjacency
+    {
+        std::vector<uint32_t>   counts;
+        std::vector<uint32_t>   offsets;
+        std::vector<uint32_t>   triangles;
+    };
+
+    static void BuildAdjacency(uint32_t const* pIndices, size_t const indexCount, size_t const vertexCount,
+                               TriangleAdjacency& adjacency)
+    {
+        adjacency.counts.assign(vertexCount, 0);
+        adjacency.offsets.resize(vertexCount);
+        adjacency.triangles.resize(indexCount);
+
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            adjacency.counts[pIndices[i]]++;
+        }
+
+        uint32_t offset = 0;
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            adjacency.offsets[v] = offset;
+            offset += adjacency.counts[v];
+        }
+
+        std::vector<uint32_t> fill(adjacency.offsets);
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            adjacency.triangles[fill[pIndices[i]]++] = (uint32_t)(i / 3);
+        }
+    }
+
+    void MeshOptimizer::OptimizeVertexCache(uint32_t* pIndices, size_t const indexCount, size_t const vertexCount,
+                                            uint32_t const cacheSize, std::vector<uint32_t>* pOutClusters)
+    {
+        // Tipsify (Sander, Nehab and Barczak 2007): fan around a vertex, then
+        // continue from the candidate that will still be in the cache
+        size_t const triangleCount = indexCount / 3;
+        if (triangleCount == 0)
+        {
+            return;
+        }
+
+        TriangleAdjacency adjacency;
+        BuildAdjacency(pIndices, indexCount, vertexCount, adjacency);
+
+        std::vector<uint32_t> liveTriangles(adjacency.counts);
+        std::vector<uint32_t> cacheTime(vertexCount, 0);
+        std::vector<uint8_t> emitted(triangleCount, 0);
+        std::vector<uint32_t> deadEnd;
+        std::vector<uint32_t> candidates;
+        std::vector<uint32_t> result;
+        result.reserve(indexCount);
+        deadEnd.reserve(indexCount);
+
+        uint32_t timeStamp = cacheSize + 1;
+        size_t cursor = 0;
+        int64_t fanVertex = 0;
+
+        if (pOutClusters)
+        {
+            pOutClusters->clear();
+            pOutClusters->push_back(0);
+        }
+
+        while (fanVertex >= 0)
+        {
+            candidates.clear();
+
+            uint32_t const begin = adjacency.offsets[fanVertex];
+            uint32_t const end = begin + adjacency.counts[fanVertex];
+            for (uint32_t t = begin; t < end; t++)
+            {
+                uint32_t const triangle = adjacency.triangles[t];
+                if (emitted[triangle])
+                {
+                    continue;
+                }
+
+                for (uint32_t k = 0; k < 3; k++)
+                {
+                    uint32_t const v = pIndices[triangle * 3 + k];
+                    result.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    liveTriangles[v]--;
+                    if (timeStamp - cacheTime[v] > cacheSize)
+                    {
+                        cacheTime[v] = timeStamp++;
+                    }
+                }
+                emitted[triangle] = 1;
+            }
+
+            // Prefer the candidate that stays in the cache for its remaining fan
+            int64_t next = -1;
+            int64_t bestPriority = -1;
+            for (size_t c = 0; c < candidates.size(); c++)
+            {
+                uint32_t const v = candidates[c];
+                if (liveTriangles[v] == 0)
+                {
+                    continue;
+                }
+
+                int64_t priority = 0;
+                if (timeStamp - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                {
+                    priority = timeStamp - cacheTime[v];
+                }
+                if (priority > bestPriority)
+                {
+                    bestPriority = priority;
+                    next = v;
+                }
+            }
+
+            if (next < 0)
+            {
+                // Dead end: back up through recently used vertices, then scan
+                while (!deadEnd.empty() && next < 0)
+                {
+                    uint32_t const v = deadEnd.back();
+                    deadEnd.pop_back();
+                    if (liveTriangles[v] > 0)
+                    {
+                        next = v;
+                    }
+                }
+                while (next < 0 && cursor < vertexCount)
+                {
+                    if (liveTriangles[cursor] > 0)
+                    {
+                        next = (int64_t)cursor;
+                    }
+                    cursor++;
+                }
+
+                // The cache is cold after a dead end, so the order can be split here
+                if (pOutClusters && next >= 0 && result.size() / 3 > pOutClusters->back())
+                {
+                    pOutClusters->push_back((uint32_t)(result.size() / 3));
+                }
+            }
+
+            fanVertex = next;
+        }
+
+        memcpy(pIndices, result.data(), indexCount * sizeof(uint32_t));
+    }
+
+    void MeshOptimizer::OptimizeOverdraw(uint32_t* pIndices, size_t const indexCount,
+                                         void const* pVertices, size_t const vertexCount, size_t const vertexStride,
+                                         std::vector<uint32_t> const& clusters, uint32_t const cacheSize, float const threshold)
+    {
+        // Linear-speed overdraw ordering (Sander et al.): split the hard
+        // clusters further while their ACMR stays close to the whole mesh's,
+        // then sort the clusters by how much they face away from the centroid
+        size_t const triangleCount = indexCount / 3;
+        if (triangleCount == 0 || clusters.empty())
+        {
+            return;
+        }
+
+        uint8_t const* pBytes = static_cast<uint8_t const*>(pVertices);
+        auto position = [&](uint32_t const v) -> float const*
+        {
+            return reinterpret_cast<float const*>(pBytes + v * vertexStride);
+        };
+
+        float const meshAcmr = AnalyzeVertexCache(pIndices, indexCount, vertexCount, cacheSize).acmr;
+
+        std::vector<uint32_t> softClusters;
+        std::vector<uint32_t> cacheTime(vertexCount, 0);
+        uint32_t timeStamp = cacheSize + 1;
+        for (size_t c = 0; c < clusters.size(); c++)
+        {
+            uint32_t const begin = clusters[c];
+            uint32_t const end = (c + 1 < clusters.size()) ? clusters[c + 1] : (uint32_t)triangleCount;
+
+            uint32_t clusterStart = begin;
+            uint32_t misses = 0;
+            softClusters.push_back(begin);
+
+            // Start every cluster with a cold cache, as it may be drawn after any other
+            timeStamp += cacheSize + 1;
+            for (uint32_t t = begin; t < end; t++)
+            {
+                for (uint32_t k = 0; k < 3; k++)
+                {
+                    uint32_t const v = pIndices[t * 3 + k];
+                    if (timeStamp - cacheTime[v] > cacheSize)
+                    {
+                        cacheTime[v] = timeStamp++;
+                        misses++;
+                    }
+                }
+
+                uint32_t const clusterTriangles = t + 1 - clusterStart;
+                if (t + 1 < end && (float)misses / clusterTriangles <= meshAcmr * threshold)
+                {
+                    softClusters.push_back(t + 1);
+                    clusterStart = t + 1;
+                    misses = 0;
+                    timeStamp += cacheSize + 1;
+                }
+            }
+        }
+
+        // Area weighted centroid and normal of each cluster
+        size_t const clusterCount = softClusters.size();
+        std::vector<float> centroids(clusterCount * 3, 0.0f);
+        std::vector<float> normals(clusterCount * 3, 0.0f);
+        float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+        float meshArea = 0.0f;
+
+        for (size_t c = 0; c < clusterCount; c++)
+        {
+            uint32_t const begin = softClusters[c];
+            uint32_t const end = (c + 1 < clusterCount) ? softClusters[c + 1] : (uint32_t)triangleCount;
+            float clusterArea = 0.0f;
+            float* pCentroid = &centroids[c * 3];
+            float* pNormal = &normals[c * 3];
+
+            for (uint32_t t = begin; t < end; t++)
+            {
+                float const* p0 = position(pIndices[t * 3 + 0]);
+                float const* p1 = position(pIndices[t * 3 + 1]);
+                float const* p2 = position(pIndices[t * 3 + 2]);
+
+                float const e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+                float const e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+                float const n[3] = { e1[1] * e2[2] - e1[2] * e2[1],
+                                     e1[2] * e2[0] - e1[0] * e2[2],
+                                     e1[0] * e2[1] - e1[1] * e2[0] };
+                float const area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+                for (uint32_t k = 0; k < 3; k++)
+                {
+                    pCentroid[k] += (p0[k] + p1[k] + p2[k]) * (area / 3.0f);
+                    pNormal[k] += n[k];
+                }
+                clusterArea += area;
+            }
+
+            for (uint32_t k = 0; k < 3; k++)
+            {
+                meshCentroid[k] += pCentroid[k];
+                pCentroid[k] = (clusterArea > 0.0f) ? pCentroid[k] / clusterArea : 0.0f;
+            }
+            meshArea += clusterArea;
+        }
+
+        for (uint32_t k = 0; k < 3; k++)
+        {
+            meshCentroid[k] = (meshArea > 0.0f) ? meshCentroid[k] / meshArea : 0.0f;
+        }
+
+        std::vector<float> sortKeys(clusterCount);
+        std::vector<uint32_t> order(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++)
+        {
+            float const* pCentroid = &centroids[c * 3];
+            float const* pNormal = &normals[c * 3];
+            sortKeys[c] = (pCentroid[0] - meshCentroid[0]) * pNormal[0] +
+                          (pCentroid[1] - meshCentroid[1]) * pNormal[1] +
+                          (pCentroid[2] - meshCentroid[2]) * pNormal[2];
+            order[c] = (uint32_t)c;
+        }
+
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t const a, uint32_t const b)
+        {
+            return sortKeys[a] > sortKeys[b];
+        });
+
+        std::vector<uint32_t> result;
+        result.reserve(indexCount);
+        for (size_t i = 0; i < clusterCount; i++)
+        {
+            uint32_t const c = order[i];
+            uint32_t const begin = softClusters[c];
+            uint32_t const end = (c + 1 < clusterCount) ? softClusters[c + 1] : (uint32_t)triangleCount;
+            result.insert(result.end(), pIndices + begin * 3, pIndices + end * 3);
+        }
+
+        memcpy(pIndices, result.data(), triangleCount * 3 * sizeof(uint32_t));
+    }
+
+    size_t MeshOptimizer::OptimizeVertexFetch(void* pVertices, uint32_t* pIndices, size_t const indexCount,
+                                              size_t const vertexCount, size_t const vertexStride)
+    {
+        std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+        uint32_t newCount = 0;
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            uint32_t& target = remap[pIndices[i]];
+            if (target == UINT32_MAX)
+            {
+                target = newCount++;
+            }
+            pIndices[i] = target;
+        }
+
+        std::vector<uint8_t> copy(static_cast<uint8_t*>(pVertices),
+                                  static_cast<uint8_t*>(pVertices) + vertexCount * vertexStride);
+        uint8_t* pDst = static_cast<uint8_t*>(pVertices);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            if (remap[v] != UINT32_MAX)
+            {
+                memcpy(pDst + remap[v] * vertexStride, copy.data() + v * vertexStride, vertexStride);
+            }
+        }
+        return newCount;
+    }
+
+    void MeshOptimizer::Optimize(void* pVertices, size_t& vertexCount, size_t const vertexStride,
+                                 uint32_t* pIndices, size_t const indexCount)
+    {
+        std::vector<uint32_t> clusters;
+        OptimizeVertexCache(pIndices, indexCount, vertexCount, MESH_OPT_CACHE_SIZE, &clusters);
+        OptimizeOverdraw(pIndices, indexCount, pVertices, vertexCount, vertexStride, clusters,
+                         MESH_OPT_CACHE_SIZE, MESH_OPT_OVERDRAW_THRESHOLD);
+        vertexCount = OptimizeVertexFetch(pVertices, pIndices, indexCount, vertexCount, vertexStride);
+    }
+
+    VertexCacheStats MeshOptimizer::AnalyzeVertexCache(uint32_t const* pIndices, size_t const indexCount,
+                                                       size_t const vertexCount, uint32_t const cacheSize)
+    {
+        VertexCacheStats stats = { 0.0f, 0.0f };
+        if (indexCount < 3)
+        {
+            return stats;
+        }
+
+        // FIFO cache: a vertex is resident while fewer than cacheSize misses followed its own
+        std::vector<uint32_t> cacheTime(vertexCount, 0);
+        std::vector<uint8_t> used(vertexCount, 0);
+        uint32_t timeStamp = cacheSize + 1;
+        size_t misses = 0;
+        size_t uniqueVertices = 0;
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            uint32_t const v = pIndices[i];
+            if (timeStamp - cacheTime[v] > cacheSize)
+            {
+                cacheTime[v] = timeStamp++;
+                misses++;
+            }
+            if (!used[v])
+            {
+                used[v] = 1;
+                uniqueVertices++;
+            }
+        }
+
+        stats.acmr = (float)misses / (indexCount / 3);
+        stats.atvr = (float)misses / uniqueVertices;
+        return stats;
+    }
+}
@@ -0,0 +1,60 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// FIFO size the index order is tuned for.  Mobile post-transform caches are
+// small; a smaller target costs little on GPUs with larger caches.
+#define MESH_OPT_CACHE_SIZE         16
+// How much worse than the cache optimized ACMR a cluster may get before the
+// overdraw pass stops splitting it
+#define MESH_OPT_OVERDRAW_THRESHOLD 1.05f
+
+namespace QtiGL
+{
+    struct VertexCacheStats
+    {
+        // Average cache miss ratio: vertex shader runs per triangle (0.5 at best, 3 at worst)
+        float   acmr;
+        // Average transform to vertex ratio: vertex shader runs per unique vertex (1 at best)
+        float   atvr;
+    };
+
+    // Import time index and vertex reordering for triangle lists.
+    //
+    // The passes are meant to run in order: OptimizeVertexCache() (Tipsify),
+    // OptimizeOverdraw() on the clusters it returns, then OptimizeVertexFetch().
+    // Optimize() runs all three.  Nothing here touches GL.
+    class MeshOptimizer
+    {
+    public:
+        // Reorders triangles for post-transform cache hits.  pOutClusters, if
+        // given, receives the first triangle of every cluster the ordering can
+        // be split at without thrashing the cache.
+        static void OptimizeVertexCache(uint32_t* pIndices, size_t const indexCount, size_t const vertexCount,
+                                        uint32_t const cacheSize, std::vector<uint32_t>* pOutClusters = nullptr);
+
+        // Reorders the clusters so the outward facing ones are drawn first.
+        // Positions are three floats at the start of every vertex.
+        static void OptimizeOverdraw(uint32_t* pIndices, size_t const indexCount,
+                                     void const* pVertices, size_t const vertexCount, size_t const vertexStride,
+                                     std::vector<uint32_t> const& clusters, uint32_t const cacheSize, float const threshold);
+
+        // Stores vertices in first use order and drops unreferenced ones.
+        // Returns the new vertex count.
+        static size_t OptimizeVertexFetch(void* pVertices, uint32_t* pIndices, size_t const indexCount,
+                                          size_t const vertexCount, size_t const vertexStride);
+
+        static void Optimize(void* pVertices, size_t& vertexCount, size_t const vertexStride,
+                             uint32_t* pIndices, size_t const indexCount);
+
+        static VertexCacheStats AnalyzeVertexCache(uint32_t const* pIndices, size_t const indexCount,
+                                                   size_t const vertexCount, uint32_t const cacheSize);
+    };
+}
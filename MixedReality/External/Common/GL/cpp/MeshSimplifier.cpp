@@ -0,0 +1,398 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "MeshSimplifier.h"
+
+// Smallest cosine between a triangle's normal before and after a collapse.
+// Applied per collapse, so it has to be strict enough not to drift over many passes.
+#define SIMPLIFY_MIN_NORMAL_COS     0.5f
+
+namespace QtiGL
+{
+    // Sum of area weighted squared distances to a set of planes (Garland and Heckbert 1997)
+    struct Quadric
+    {
+        double  a00, a11, a22, a01, a02, a12;
+        double  b0, b1, b2;
+        double  c;
+        double  weight;
+    };
+
+    static void AddPlane(Quadric& q, double const* pNormal, double const d, double const weight)
+    {
+        double const nx = pNormal[0], ny = pNormal[1], nz = pNormal[2];
+        q.a00 += weight * nx * nx;
+        q.a11 += weight * ny * ny;
+        q.a22 += weight * nz * nz;
+        q.a01 += weight * nx * ny;
+        q.a02 += weight * nx * nz;
+        q.a12 += weight * ny * nz;
+        q.b0 += weight * nx * d;
+        q.b1 += weight * ny * d;
+        q.b2 += weight * nz * d;
+        q.c += weight * d * d;
+        q.weight += weight;
+    }
+
+    static void AddQuadric(Quadric& q, Quadric const& other)
+    {
+        q.a00 += other.a00;
+        q.a11 += other.a11;
+        q.a22 += other.a22;
+        q.a01 += other.a01;
+        q.a02 += other.a02;
+        q.a12 += other.a12;
+        q.b0 += other.b0;
+        q.b1 += other.b1;
+        q.b2 += other.b2;
+        q.c += other.c;
+        q.weight += other.weight;
+    }
+
+    // Mean squared distance of p to the planes of q1 + q2
+    static double EvaluateQuadrics(Quadric const& q1, Quadric const& q2, float const* p)
+    {
+        double const x = p[0], y = p[1], z = p[2];
+        double const a00 = q1.a00 + q2.a00, a11 = q1.a11 + q2.a11, a22 = q1.a22 + q2.a22;
+        double const a01 = q1.a01 + q2.a01, a02 = q1.a02 + q2.a02, a12 = q1.a12 + q2.a12;
+        double const b0 = q1.b0 + q2.b0, b1 = q1.b1 + q2.b1, b2 = q1.b2 + q2.b2;
+        double const weight = q1.weight + q2.weight;
+
+        double const error = a00 * x * x + a11 * y * y + a22 * z * z
+                           + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                           + 2.0 * (b0 * x + b1 * y + b2 * z)
+                           + q1.c + q2.c;
+        return (weight > 0.0) ? std::max(error, 0.0) / weight : 0.0;
+    }
+
+    static void TriangleNormal(float const* p0, float const* p1, float const* p2, float* pOut)
+    {
+        float const e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        float const e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        pOut[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        pOut[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        pOut[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    }
+
+    struct Collapse
+    {
+        double      error;
+        uint32_t    from;       // Position being removed
+        uint32_t    to;         // Vertex (not position) it is replaced with
+    };
+
+    size_t MeshSimplifier::Simplify(uint32_t const* pIndices, size_t const indexCount,
+                                    void const* pVertices, size_t const vertexCount, size_t const vertexStride,
+                                    size_t const targetIndexCount, float const targetError,
+                                    uint32_t* pOutIndices, float* pOutError)
+    {
+        memcpy(pOutIndices, pIndices, indexCount * sizeof(uint32_t));
+        if (pOutError)
+        {
+            *pOutError = 0.0f;
+        }
+        if (indexCount <= targetIndexCount || vertexCount == 0)
+        {
+            return indexCount;
+        }
+
+        // Work on positions scaled to the unit cube, so errors are relative to the extent
+        uint8_t const* pBytes = static_cast<uint8_t const*>(pVertices);
+        float boundsMin[3] = { INFINITY, INFINITY, INFINITY };
+        float boundsMax[3] = { -INFINITY, -INFINITY, -INFINITY };
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            float const* p = reinterpret_cast<float const*>(pBytes + v * vertexStride);
+            for (int32_t c = 0; c < 3; c++)
+            {
+                boundsMin[c] = std::min(boundsMin[c], p[c]);
+                boundsMax[c] = std::max(boundsMax[c], p[c]);
+            }
+        }
+        float const extent = std::max(boundsMax[0] - boundsMin[0],
+                             std::max(boundsMax[1] - boundsMin[1], boundsMax[2] - boundsMin[2]));
+        float const scale = (extent > 0.0f) ? 1.0f / extent : 0.0f;
+
+        std::vector<float> positions(vertexCount * 3);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            float const* p = reinterpret_cast<float const*>(pBytes + v * vertexStride);
+            for (int32_t c = 0; c < 3; c++)
+            {
+                positions[v * 3 + c] = (p[c] - boundsMin[c]) * scale;
+            }
+        }
+
+        // Vertices that only differ in their attributes share a position; topology and
+        // quadrics are tracked per position, the output keeps indexing vertices
+        std::vector<uint32_t> order(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            order[v] = (uint32_t)v;
+        }
+        std::sort(order.begin(), order.end(), [&](uint32_t const a, uint32_t const b)
+        {
+            return memcmp(&positions[a * 3], &positions[b * 3], 3 * sizeof(float)) < 0;
+        });
+
+        std::vector<uint32_t> positionOf(vertexCount);
+        std::vector<uint32_t> wedgeCount(vertexCount, 0);
+        for (size_t i = 0; i < vertexCount; i++)
+        {
+            uint32_t const v = order[i];
+            bool const same = (i > 0) && memcmp(&positions[v * 3], &positions[order[i - 1] * 3], 3 * sizeof(float)) == 0;
+            positionOf[v] = same ? positionOf[order[i - 1]] : v;
+            wedgeCount[positionOf[v]]++;
+        }
+
+        // Seams and borders stay where they are
+        std::vector<uint8_t> locked(vertexCount, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+        {
+            if (wedgeCount[v] > 1)
+            {
+                locked[v] = 1;
+            }
+        }
+
+        std::vector<uint64_t> edges;
+        edges.reserve(indexCount);
+        for (size_t t = 0; t + 2 < indexCount; t += 3)
+        {
+            for (int32_t e = 0; e < 3; e++)
+            {
+                uint32_t const a = positionOf[pIndices[t + e]];
+                uint32_t const b = positionOf[pIndices[t + (e + 1) % 3]];
+                if (a != b)
+                {
+                    edges.push_back(((uint64_t)std::min(a, b) << 32) | std::max(a, b));
+                }
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        for (size_t i = 0; i < edges.size();)
+        {
+            size_t j = i + 1;
+            while (j < edges.size() && edges[j] == edges[i])
+            {
+                j++;
+            }
+            if (j - i != 2)
+            {
+                locked[(uint32_t)(edges[i] >> 32)] = 1;
+                locked[(uint32_t)edges[i]] = 1;
+            }
+            i = j;
+        }
+
+        std::vector<Quadric> quadrics(vertexCount);
+        memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+        for (size_t t = 0; t + 2 < indexCount; t += 3)
+        {
+            uint32_t const a = positionOf[pIndices[t + 0]];
+            uint32_t const b = positionOf[pIndices[t + 1]];
+            uint32_t const c = positionOf[pIndices[t + 2]];
+            float normal[3];
+            TriangleNormal(&positions[a * 3], &positions[b * 3], &positions[c * 3], normal);
+            double const length = sqrt((double)normal[0] * normal[0] + (double)normal[1] * normal[1] + (double)normal[2] * normal[2]);
+            if (length == 0.0)
+            {
+                continue;
+            }
+            double const n[3] = { normal[0] / length, normal[1] / length, normal[2] / length };
+            double const d = -(n[0] * positions[a * 3] + n[1] * positions[a * 3 + 1] + n[2] * positions[a * 3 + 2]);
+            double const area = 0.5 * length;
+            AddPlane(quadrics[a], n, d, area);
+            AddPlane(quadrics[b], n, d, area);
+            AddPlane(quadrics[c], n, d, area);
+        }
+
+        double const maxError = (double)targetError * targetError;
+        double resultError = 0.0;
+        size_t count = indexCount;
+
+        std::vector<uint32_t> triangleCounts;
+        std::vector<uint32_t> triangleOffsets;
+        std::vector<uint32_t> triangles;
+        std::vector<uint32_t> collapseTo(vertexCount, UINT32_MAX);
+        std::vector<uint8_t> touched(vertexCount);
+        std::vector<Collapse> collapses;
+
+        // Each pass collapses an independent set of the cheapest edges, then rebuilds
+        while (count > targetIndexCount)
+        {
+            size_t const triangleCount = count / 3;
+            triangleCounts.assign(vertexCount, 0);
+            for (size_t i = 0; i < count; i++)
+            {
+                triangleCounts[positionOf[pOutIndices[i]]]++;
+            }
+            triangleOffsets.resize(vertexCount);
+            uint32_t offset = 0;
+            for (size_t v = 0; v < vertexCount; v++)
+            {
+                triangleOffsets[v] = offset;
+                offset += triangleCounts[v];
+            }
+            triangles.resize(count);
+            std::vector<uint32_t> fill(triangleOffsets);
+            for (size_t i = 0; i < count; i++)
+            {
+                triangles[fill[positionOf[pOutIndices[i]]]++] = (uint32_t)(i / 3);
+            }
+
+            collapses.clear();
+            for (size_t t = 0; t < triangleCount; t++)
+            {
+                for (int32_t e = 0; e < 3; e++)
+                {
+                    for (int32_t dir = 0; dir < 2; dir++)
+                    {
+                        uint32_t const fromVertex = pOutIndices[t * 3 + (dir == 0 ? e : (e + 1) % 3)];
+                        uint32_t const toVertex = pOutIndices[t * 3 + (dir == 0 ? (e + 1) % 3 : e)];
+                        uint32_t const from = positionOf[fromVertex];
+                        uint32_t const to = positionOf[toVertex];
+                        if (locked[from] || from == to)
+                        {
+                            continue;
+                        }
+                        Collapse collapse = { EvaluateQuadrics(quadrics[from], quadrics[to], &positions[to * 3]), from, toVertex };
+                        if (collapse.error <= maxError)
+                        {
+                            collapses.push_back(collapse);
+                        }
+                    }
+                }
+            }
+            if (collapses.empty())
+            {
+                break;
+            }
+            std::sort(collapses.begin(), collapses.end(), [](Collapse const& a, Collapse const& b)
+            {
+                return a.error < b.error;
+            });
+
+            // Every collapse removes about two triangles
+            size_t const trianglesToRemove = (count - targetIndexCount) / 3;
+            size_t removed = 0;
+            std::fill(touched.begin(), touched.end(), 0);
+            for (size_t i = 0; i < collapses.size() && removed < trianglesToRemove; i++)
+            {
+                Collapse const& collapse = collapses[i];
+                uint32_t const from = collapse.from;
+                uint32_t const to = positionOf[collapse.to];
+                if (touched[from] || touched[to])
+                {
+                    continue;
+                }
+
+                // Reject collapses that fold a remaining triangle over
+                bool flips = false;
+                uint32_t shared = 0;
+                for (uint32_t k = 0; k < triangleCounts[from] && !flips; k++)
+                {
+                    uint32_t const t = triangles[triangleOffsets[from] + k];
+                    uint32_t p[3];
+                    for (int32_t c = 0; c < 3; c++)
+                    {
+                        p[c] = positionOf[pOutIndices[t * 3 + c]];
+                    }
+                    if (p[0] == to || p[1] == to || p[2] == to)
+                    {
+                        shared++;
+                        continue;
+                    }
+
+                    float before[3];
+                    float after[3];
+                    TriangleNormal(&positions[p[0] * 3], &positions[p[1] * 3], &positions[p[2] * 3], before);
+                    float const* q[3];
+                    for (int32_t c = 0; c < 3; c++)
+                    {
+                        q[c] = &positions[(p[c] == from ? to : p[c]) * 3];
+                    }
+                    TriangleNormal(q[0], q[1], q[2], after);
+                    float const dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+                    float const lengths = sqrtf((before[0] * before[0] + before[1] * before[1] + before[2] * before[2]) *
+                                                (after[0] * after[0] + after[1] * after[1] + after[2] * after[2]));
+                    // Also catches triangles collapsing to zero area
+                    flips = (dot <= SIMPLIFY_MIN_NORMAL_COS * lengths);
+                }
+                if (flips)
+                {
+                    continue;
+                }
+
+                // Keep the neighbourhood fixed for the rest of the pass, so the checks above stay valid
+                for (uint32_t k = 0; k < triangleCounts[from]; k++)
+                {
+                    uint32_t const t = triangles[triangleOffsets[from] + k];
+                    for (int32_t c = 0; c < 3; c++)
+                    {
+                        touched[positionOf[pOutIndices[t * 3 + c]]] = 1;
+                    }
+                }
+
+                collapseTo[from] = collapse.to;
+                AddQuadric(quadrics[to], quadrics[from]);
+                resultError = std::max(resultError, collapse.error);
+                removed += shared;
+            }
+            if (removed == 0)
+            {
+                break;
+            }
+
+            // Seams are locked, so a removed position has exactly one vertex to redirect
+            size_t written = 0;
+            for (size_t t = 0; t < triangleCount; t++)
+            {
+                uint32_t v[3];
+                for (int32_t c = 0; c < 3; c++)
+                {
+                    v[c] = pOutIndices[t * 3 + c];
+                    uint32_t const target = collapseTo[positionOf[v[c]]];
+                    if (target != UINT32_MAX)
+                    {
+                        v[c] = target;
+                    }
+                }
+                uint32_t const p0 = positionOf[v[0]];
+                uint32_t const p1 = positionOf[v[1]];
+                uint32_t const p2 = positionOf[v[2]];
+                if (p0 == p1 || p1 == p2 || p0 == p2)
+                {
+                    continue;
+                }
+                pOutIndices[written++] = v[0];
+                pOutIndices[written++] = v[1];
+                pOutIndices[written++] = v[2];
+            }
+            count = written;
+
+            for (size_t v = 0; v < vertexCount; v++)
+            {
+                if (collapseTo[v] != UINT32_MAX)
+                {
+                    // Gone for good
+                    locked[v] = 1;
+                    collapseTo[v] = UINT32_MAX;
+                }
+            }
+        }
+
+        if (pOutError)
+        {
+            *pOutError = (float)sqrt(resultError);
+        }
+        return count;
+    }
+}
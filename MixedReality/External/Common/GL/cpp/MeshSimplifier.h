@@ -0,0 +1,44 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// LOD 0 (the full mesh) plus up to three simplified levels
+#define MESH_LOD_MAX_COUNT          4
+// Each level aims for this fraction of the previous level's triangles
+#define MESH_LOD_REDUCTION          0.5f
+// A level that can't get below this fraction of the previous one isn't worth keeping
+#define MESH_LOD_MIN_REDUCTION      0.8f
+// Largest error a level may have, relative to the mesh extent
+#define MESH_LOD_MAX_ERROR          0.05f
+// Shapes smaller than this are always drawn at full detail
+#define MESH_LOD_MIN_TRIANGLES      256
+
+namespace QtiGL
+{
+    // Quadric error metric simplification of indexed triangle lists.
+    //
+    // Vertices are collapsed onto a neighbouring vertex (half-edge collapse),
+    // so the result indexes the original vertex buffer and every level of
+    // detail can share it.  Attribute seams (positions shared by more than one
+    // vertex) and open or non-manifold borders are kept in place, and collapses
+    // that would flip a triangle are rejected.  Nothing here touches GL.
+    class MeshSimplifier
+    {
+    public:
+        // Positions are three floats at the start of every vertex.  Stops once
+        // the index count reaches targetIndexCount or the next collapse would
+        // move the surface by more than targetError (relative to the mesh extent).
+        // pOutIndices needs room for indexCount indices; returns the count written.
+        // pOutError, if given, receives the error of the result, relative to the extent.
+        static size_t Simplify(uint32_t const* pIndices, size_t const indexCount,
+                               void const* pVertices, size_t const vertexCount, size_t const vertexStride,
+                               size_t const targetIndexCount, float const targetError,
+                               uint32_t* pOutIndices, float* pOutError = nullptr);
+    };
+}
@@ -0,0 +1,695 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <unordered_map>
+
+#include "LogUtils.h"
+#include "ObjParser.h"
+#include "Parallel.h"
+
+// Chunks are at least this large, and there are a few per thread to even out line lengths
+#define OBJ_MIN_CHUNK_SIZE      (256 * 1024)
+#define OBJ_CHUNKS_PER_THREAD   4
+// Same limit as tinyobj's sscanf buffers
+#define OBJ_NAME_BUFFER_SIZE    4096
+
+namespace QtiGL
+{
+    // Face corner as written in the file.  Indices are already zero based;
+    // negative (relative) ones are relative to the chunk until the merge adds
+    // the element counts of the preceding chunks.
+    enum ObjRelativeBits
+    {
+        kObjRelativeV   = 1 << 0,
+        kObjRelativeVt  = 1 << 1,
+        kObjRelativeVn  = 1 << 2
+    };
+
+    struct ObjIndex
+    {
+        int32_t     v;
+        int32_t     vt;
+        int32_t     vn;
+        uint32_t    relative;
+    };
+
+    struct ObjFace
+    {
+        uint32_t    firstIndex;
+        uint32_t    numIndices;
+    };
+
+    enum ObjCommandType
+    {
+        kObjUseMtl = 0,
+        kObjMtlLib,
+        kObjGroup,
+        kObjObject
+    };
+
+    // Statements that affect shape splitting, kept in file order
+    struct ObjCommand
+    {
+        ObjCommandType  type;
+        uint32_t        facePos;    // Faces parsed before it
+        std::string     name;
+    };
+
+    struct ObjChunk
+    {
+        char const*                 pBegin;
+        char const*                 pEnd;
+        std::vector<float>          positions;
+        std::vector<float>          normals;
+        std::vector<float>          texcoords;
+        std::vector<ObjIndex>       indices;
+        std::vector<ObjFace>        faces;
+        std::vector<ObjCommand>     commands;
+
+        // Prefix sums over the preceding chunks
+        uint32_t                    positionBase;
+        uint32_t                    normalBase;
+        uint32_t                    texcoordBase;
+        uint32_t                    indexBase;
+        uint32_t                    faceBase;
+    };
+
+    struct ObjShapeJob
+    {
+        uint32_t        faceBegin;
+        uint32_t        faceEnd;
+        int32_t         materialId;
+        std::string     name;
+    };
+
+    struct ObjIndexKey
+    {
+        int32_t v;
+        int32_t vn;
+        int32_t vt;
+
+        bool operator==(ObjIndexKey const& other) const
+        {
+            return v == other.v && vn == other.vn && vt == other.vt;
+        }
+    };
+
+    struct ObjIndexKeyHash
+    {
+        size_t operator()(ObjIndexKey const& key) const
+        {
+            uint64_t const h = ((uint64_t)(uint32_t)key.v * 0x9E3779B97F4A7C15ULL) ^
+                               ((uint64_t)(uint32_t)key.vn * 0xC2B2AE3D27D4EB4FULL) ^
+                               ((uint64_t)(uint32_t)key.vt * 0x165667B19E3779F9ULL);
+            return (size_t)(h ^ (h >> 29));
+        }
+    };
+
+    static inline bool IsSpace(char const c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    static inline bool IsNewLine(char const c)
+    {
+        return c == '\r' || c == '\n' || c == '\0';
+    }
+
+    // tinyobj's number parser, reproduced step for step so both paths round
+    // identically (it is not strtod)
+    static bool TryParseDouble(char const* s, char const* sEnd, double* pResult)
+    {
+        if (s >= sEnd)
+        {
+            return false;
+        }
+
+        double mantissa = 0.0;
+        int exponent = 0;
+        char sign = '+';
+        char expSign = '+';
+        char const* curr = s;
+        int read = 0;
+        bool endNotReached = false;
+
+        if (*curr == '+' || *curr == '-')
+        {
+            sign = *curr;
+            curr++;
+        }
+        else if (!isdigit(*curr))
+        {
+            return false;
+        }
+
+        // Integer part, which must not be empty
+        while ((endNotReached = (curr != sEnd)) && isdigit(*curr))
+        {
+            mantissa *= 10;
+            mantissa += static_cast<int>(*curr - 0x30);
+            curr++;
+            read++;
+        }
+        if (read == 0)
+        {
+            return false;
+        }
+
+        if (endNotReached)
+        {
+            bool hasExponent = false;
+            if (*curr == '.')
+            {
+                curr++;
+                read = 1;
+                while ((endNotReached = (curr != sEnd)) && isdigit(*curr))
+                {
+                    mantissa += static_cast<int>(*curr - 0x30) * pow(10.0, -read);
+                    read++;
+                    curr++;
+                }
+                hasExponent = endNotReached && (*curr == 'e' || *curr == 'E');
+            }
+            else
+            {
+                hasExponent = (*curr == 'e' || *curr == 'E');
+            }
+
+            if (hasExponent)
+            {
+                curr++;
+                if ((endNotReached = (curr != sEnd)) && (*curr == '+' || *curr == '-'))
+                {
+                    expSign = *curr;
+                    curr++;
+                }
+                else if (!isdigit(*curr))
+                {
+                    return false;
+                }
+
+                read = 0;
+                while ((endNotReached = (curr != sEnd)) && isdigit(*curr))
+                {
+                    exponent *= 10;
+                    exponent += static_cast<int>(*curr - 0x30);
+                    curr++;
+                    read++;
+                }
+                exponent *= (expSign == '+' ? 1 : -1);
+                if (read == 0)
+                {
+                    return false;
+                }
+            }
+        }
+
+        *pResult = (sign == '+' ? 1 : -1) * ldexp(mantissa * pow(5.0, exponent), exponent);
+        return true;
+    }
+
+    static inline float ParseFloat(char const** ppToken)
+    {
+        (*ppToken) += strspn((*ppToken), " \t");
+        char const* pEnd = (*ppToken) + strcspn((*ppToken), " \t\r");
+        double value = 0.0;
+        TryParseDouble((*ppToken), pEnd, &value);
+        (*ppToken) = pEnd;
+        return static_cast<float>(value);
+    }
+
+    static inline void ParseFloats(std::vector<float>& out, uint32_t const count, char const** ppToken)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            out.push_back(ParseFloat(ppToken));
+        }
+    }
+
+    static inline int32_t FixIndex(int32_t const idx, int32_t const n, uint32_t const relativeBit, uint32_t& relative)
+    {
+        if (idx > 0)
+        {
+            return idx - 1;
+        }
+        if (idx == 0)
+        {
+            return 0;
+        }
+        relative |= relativeBit;
+        return n + idx;
+    }
+
+    // v, v/t, v//n or v/t/n
+    static ObjIndex ParseTriple(char const** ppToken, int32_t const vSize, int32_t const vnSize, int32_t const vtSize)
+    {
+        ObjIndex index = { -1, -1, -1, 0 };
+
+        index.v = FixIndex(atoi(*ppToken), vSize, kObjRelativeV, index.relative);
+        (*ppToken) += strcspn((*ppToken), "/ \t\r");
+        if ((*ppToken)[0] != '/')
+        {
+            return index;
+        }
+        (*ppToken)++;
+
+        if ((*ppToken)[0] == '/')
+        {
+            (*ppToken)++;
+            index.vn = FixIndex(atoi(*ppToken), vnSize, kObjRelativeVn, index.relative);
+            (*ppToken) += strcspn((*ppToken), "/ \t\r");
+            return index;
+        }
+
+        index.vt = FixIndex(atoi(*ppToken), vtSize, kObjRelativeVt, index.relative);
+        (*ppToken) += strcspn((*ppToken), "/ \t\r");
+        if ((*ppToken)[0] != '/')
+        {
+            return index;
+        }
+        (*ppToken)++;
+
+        index.vn = FixIndex(atoi(*ppToken), vnSize, kObjRelativeVn, index.relative);
+        (*ppToken) += strcspn((*ppToken), "/ \t\r");
+        return index;
+    }
+
+    static std::string ScanName(char const* pToken)
+    {
+        char name[OBJ_NAME_BUFFER_SIZE];
+        name[0] = '\0';
+        sscanf(pToken, "%4095s", name);
+        return std::string(name);
+    }
+
+    static void AddCommand(ObjChunk& chunk, ObjCommandType const type, std::string const& name)
+    {
+        ObjCommand command;
+        command.type = type;
+        command.facePos = (uint32_t)chunk.faces.size();
+        command.name = name;
+        chunk.commands.push_back(command);
+    }
+
+    static void ParseLine(char const* pLine, ObjChunk& chunk)
+    {
+        char const* token = pLine + strspn(pLine, " \t");
+        if (token[0] == '\0' || token[0] == '#')
+        {
+            return;
+        }
+
+        if (token[0] == 'v' && IsSpace(token[1]))
+        {
+            token += 2;
+            ParseFloats(chunk.positions, 3, &token);
+            return;
+        }
+
+        if (token[0] == 'v' && token[1] == 'n' && IsSpace(token[2]))
+        {
+            token += 3;
+            ParseFloats(chunk.normals, 3, &token);
+            return;
+        }
+
+        if (token[0] == 'v' && token[1] == 't' && IsSpace(token[2]))
+        {
+            token += 3;
+            ParseFloats(chunk.texcoords, 2, &token);
+            return;
+        }
+
+        if (token[0] == 'f' && IsSpace(token[1]))
+        {
+            token += 2;
+            token += strspn(token, " \t");
+
+            int32_t const vSize = (int32_t)(chunk.positions.size() / 3);
+            int32_t const vnSize = (int32_t)(chunk.normals.size() / 3);
+            int32_t const vtSize = (int32_t)(chunk.texcoords.size() / 2);
+
+            ObjFace face;
+            face.firstIndex = (uint32_t)chunk.indices.size();
+            while (!IsNewLine(token[0]))
+            {
+                chunk.indices.push_back(ParseTriple(&token, vSize, vnSize, vtSize));
+                token += strspn(token, " \t\r");
+            }
+            face.numIndices = (uint32_t)chunk.indices.size() - face.firstIndex;
+            chunk.faces.push_back(face);
+            return;
+        }
+
+        if ((0 == strncmp(token, "usemtl", 6)) && IsSpace(token[6]))
+        {
+            AddCommand(chunk, kObjUseMtl, ScanName(token + 7));
+            return;
+        }
+
+        if ((0 == strncmp(token, "mtllib", 6)) && IsSpace(token[6]))
+        {
+            AddCommand(chunk, kObjMtlLib, ScanName(token + 7));
+            return;
+        }
+
+        if (token[0] == 'g' && IsSpace(token[1]))
+        {
+            // "g name1 name2 ..." names the group after its first name
+            token += 1;
+            token += strspn(token, " \t");
+            size_t const length = strcspn(token, " \t\r");
+            AddCommand(chunk, kObjGroup, std::string(token, length));
+            return;
+        }
+
+        if (token[0] == 'o' && IsSpace(token[1]))
+        {
+            AddCommand(chunk, kObjObject, ScanName(token + 2));
+            return;
+        }
+    }
+
+    static void ParseChunk(ObjChunk& chunk)
+    {
+        // Lines are copied out so the parsing helpers can rely on a terminator,
+        // like they do in tinyobj.  '\r', '\n' and "\r\n" all end a line; the
+        // empty lines this produces are skipped anyway.
+        std::string line;
+        char const* p = chunk.pBegin;
+        while (p < chunk.pEnd)
+        {
+            char const* pLineEnd = p;
+            while (pLineEnd < chunk.pEnd && *pLineEnd != '\n' && *pLineEnd != '\r')
+            {
+                pLineEnd++;
+            }
+            if (pLineEnd > p)
+            {
+                line.assign(p, pLineEnd);
+                ParseLine(line.c_str(), chunk);
+            }
+            p = pLineEnd + 1;
+        }
+    }
+
+    static void SplitChunks(char const* pData, size_t const size, uint32_t const numThreads, std::vector<ObjChunk>& chunks)
+    {
+        size_t numChunks = (size_t)numThreads * OBJ_CHUNKS_PER_THREAD;
+        if (numChunks > size / OBJ_MIN_CHUNK_SIZE)
+        {
+            numChunks = size / OBJ_MIN_CHUNK_SIZE;
+        }
+        if (numChunks == 0)
+        {
+            numChunks = 1;
+        }
+
+        // Every chunk starts right after a line break
+        char const* pEnd = pData + size;
+        char const* pBegin = pData;
+        for (size_t i = 1; i <= numChunks && pBegin < pEnd; i++)
+        {
+            char const* pSplit = (i == numChunks) ? pEnd : pData + size * i / numChunks;
+            if (pSplit < pBegin)
+            {
+                pSplit = pBegin;
+            }
+            while (pSplit < pEnd && *pSplit != '\n' && *pSplit != '\r')
+            {
+                pSplit++;
+            }
+            if (pSplit < pEnd)
+            {
+                pSplit++;
+            }
+
+            chunks.push_back(ObjChunk());
+            chunks.back().pBegin = pBegin;
+            chunks.back().pEnd = pSplit;
+            pBegin = pSplit;
+        }
+    }
+
+    static void MergeChunk(ObjChunk const& chunk, std::vector<float>& positions, std::vector<float>& normals,
+                           std::vector<float>& texcoords, std::vector<ObjIndex>& indices, std::vector<ObjFace>& faces)
+    {
+        std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + chunk.positionBase * 3);
+        std::copy(chunk.normals.begin(), chunk.normals.end(), normals.begin() + chunk.normalBase * 3);
+        std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), texcoords.begin() + chunk.texcoordBase * 2);
+
+        ObjIndex* pIndices = indices.data() + chunk.indexBase;
+        for (size_t i = 0; i < chunk.indices.size(); i++)
+        {
+            ObjIndex index = chunk.indices[i];
+            if (index.relative & kObjRelativeV)
+                index.v += (int32_t)chunk.positionBase;
+            if (index.relative & kObjRelativeVt)
+                index.vt += (int32_t)chunk.texcoordBase;
+            if (index.relative & kObjRelativeVn)
+                index.vn += (int32_t)chunk.normalBase;
+            pIndices[i] = index;
+        }
+
+        ObjFace* pFaces = faces.data() + chunk.faceBase;
+        for (size_t i = 0; i < chunk.faces.size(); i++)
+        {
+            pFaces[i].firstIndex = chunk.faces[i].firstIndex + chunk.indexBase;
+            pFaces[i].numIndices = chunk.faces[i].numIndices;
+        }
+    }
+
+    static uint32_t AddVertex(std::unordered_map<ObjIndexKey, uint32_t, ObjIndexKeyHash>& vertexCache,
+                              tinyobj::mesh_t& mesh, std::vector<float> const& positions,
+                              std::vector<float> const& normals, std::vector<float> const& texcoords,
+                              ObjIndex const& index, bool& outOfRange)
+    {
+        ObjIndexKey const key = { index.v, index.vn, index.vt };
+        auto it = vertexCache.find(key);
+        if (it != vertexCache.end())
+        {
+            return it->second;
+        }
+
+        if (index.v < 0 || (size_t)index.v * 3 + 2 >= positions.size())
+        {
+            outOfRange = true;
+            return 0;
+        }
+
+        mesh.positions.push_back(positions[3 * index.v + 0]);
+        mesh.positions.push_back(positions[3 * index.v + 1]);
+        mesh.positions.push_back(positions[3 * index.v + 2]);
+
+        // Out of range normals and texcoords are dropped, not an error
+        if (index.vn >= 0 && (size_t)index.vn * 3 + 2 < normals.size())
+        {
+            mesh.normals.push_back(normals[3 * index.vn + 0]);
+            mesh.normals.push_back(normals[3 * index.vn + 1]);
+            mesh.normals.push_back(normals[3 * index.vn + 2]);
+        }
+
+        if (index.vt >= 0 && (size_t)index.vt * 2 + 1 < texcoords.size())
+        {
+            mesh.texcoords.push_back(texcoords[2 * index.vt + 0]);
+            mesh.texcoords.push_back(texcoords[2 * index.vt + 1]);
+        }
+
+        uint32_t const vertex = (uint32_t)(mesh.positions.size() / 3 - 1);
+        vertexCache[key] = vertex;
+        return vertex;
+    }
+
+    // Polygons become triangle fans; vertices are shared within a shape only
+    static bool BuildShape(ObjShapeJob const& job, std::vector<float> const& positions, std::vector<float> const& normals,
+                           std::vector<float> const& texcoords, std::vector<ObjIndex> const& indices,
+                           std::vector<ObjFace> const& faces, tinyobj::shape_t& shape)
+    {
+        std::unordered_map<ObjIndexKey, uint32_t, ObjIndexKeyHash> vertexCache;
+        bool outOfRange = false;
+
+        shape.name = job.name;
+        for (uint32_t i = job.faceBegin; i < job.faceEnd; i++)
+        {
+            ObjFace const& face = faces[i];
+            if (face.numIndices < 3)
+            {
+                continue;
+            }
+
+            ObjIndex const* pFace = indices.data() + face.firstIndex;
+            ObjIndex const& i0 = pFace[0];
+            ObjIndex const* i2 = &pFace[1];
+            for (uint32_t k = 2; k < face.numIndices; k++)
+            {
+                ObjIndex const* i1 = i2;
+                i2 = &pFace[k];
+
+                uint32_t const v0 = AddVertex(vertexCache, shape.mesh, positions, normals, texcoords, i0, outOfRange);
+                uint32_t const v1 = AddVertex(vertexCache, shape.mesh, positions, normals, texcoords, *i1, outOfRange);
+                uint32_t const v2 = AddVertex(vertexCache, shape.mesh, positions, normals, texcoords, *i2, outOfRange);
+                if (outOfRange)
+                {
+                    return false;
+                }
+
+                shape.mesh.indices.push_back(v0);
+                shape.mesh.indices.push_back(v1);
+                shape.mesh.indices.push_back(v2);
+                shape.mesh.num_vertices.push_back(3);
+                shape.mesh.material_ids.push_back(job.materialId);
+            }
+        }
+        return true;
+    }
+
+    bool ObjParser::Parse(void const* pData, size_t const size, tinyobj::MaterialReader& materialReader,
+                          std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& materials,
+                          std::string& err, uint32_t const numThreads)
+    {
+        auto const startTime = std::chrono::steady_clock::now();
+        uint32_t const threadCount = numThreads ? numThreads : GetDefaultThreadCount();
+
+        // Parse the chunks
+        std::vector<ObjChunk> chunks;
+        SplitChunks(static_cast<char const*>(pData), size, threadCount, chunks);
+
+        std::atomic<uint32_t> nextChunk(0);
+        RunOnThreads(std::min(threadCount, (uint32_t)chunks.size()), [&]()
+        {
+            for (uint32_t i = nextChunk++; i < chunks.size(); i = nextChunk++)
+            {
+                ParseChunk(chunks[i]);
+            }
+        });
+
+        // Prefix sums, then merge into flat arrays
+        uint32_t numPositions = 0, numNormals = 0, numTexcoords = 0, numIndices = 0, numFaces = 0;
+        for (auto& chunk : chunks)
+        {
+            chunk.positionBase = numPositions;
+            chunk.normalBase = numNormals;
+            chunk.texcoordBase = numTexcoords;
+            chunk.indexBase = numIndices;
+            chunk.faceBase = numFaces;
+            numPositions += (uint32_t)(chunk.positions.size() / 3);
+            numNormals += (uint32_t)(chunk.normals.size() / 3);
+            numTexcoords += (uint32_t)(chunk.texcoords.size() / 2);
+            numIndices += (uint32_t)chunk.indices.size();
+            numFaces += (uint32_t)chunk.faces.size();
+        }
+
+        std::vector<float> positions(numPositions * 3);
+        std::vector<float> normals(numNormals * 3);
+        std::vector<float> texcoords(numTexcoords * 2);
+        std::vector<ObjIndex> indices(numIndices);
+        std::vector<ObjFace> faces(numFaces);
+
+        nextChunk = 0;
+        RunOnThreads(std::min(threadCount, (uint32_t)chunks.size()), [&]()
+        {
+            for (uint32_t i = nextChunk++; i < chunks.size(); i = nextChunk++)
+            {
+                MergeChunk(chunks[i], positions, normals, texcoords, indices, faces);
+                std::vector<ObjIndex>().swap(chunks[i].indices);
+                std::vector<ObjFace>().swap(chunks[i].faces);
+            }
+        });
+
+        // Walk the statements in file order to find the shapes.  A new group,
+        // object or material ends the current shape; a shape with no faces is dropped.
+        std::vector<ObjShapeJob> jobs;
+        std::map<std::string, int> materialMap;
+        uint32_t groupStart = 0;
+        int32_t materialId = -1;
+        std::string name;
+
+        auto flushGroup = [&](uint32_t const groupEnd)
+        {
+            if (groupEnd > groupStart)
+            {
+                ObjShapeJob job;
+                job.faceBegin = groupStart;
+                job.faceEnd = groupEnd;
+                job.materialId = materialId;
+                job.name = name;
+                jobs.push_back(job);
+            }
+            groupStart = groupEnd;
+        };
+
+        for (auto const& chunk : chunks)
+        {
+            for (auto const& command : chunk.commands)
+            {
+                uint32_t const facePos = chunk.faceBase + command.facePos;
+                switch (command.type)
+                {
+                case kObjUseMtl:
+                {
+                    flushGroup(facePos);
+                    auto it = materialMap.find(command.name);
+                    materialId = (it != materialMap.end()) ? it->second : -1;
+                    break;
+                }
+                case kObjMtlLib:
+                {
+                    std::string mtlErr;
+                    bool ok = materialReader(command.name, materials, materialMap, mtlErr);
+                    err += mtlErr;
+                    if (!ok)
+                    {
+                        return false;
+                    }
+                    break;
+                }
+                case kObjGroup:
+                case kObjObject:
+                    flushGroup(facePos);
+                    name = command.name;
+                    break;
+                }
+            }
+        }
+        flushGroup(numFaces);
+        std::vector<ObjChunk>().swap(chunks);
+
+        // Build the shapes
+        shapes.resize(jobs.size());
+        std::atomic<uint32_t> nextJob(0);
+        std::atomic<bool> failed(false);
+        RunOnThreads(std::max(1u, std::min(threadCount, (uint32_t)jobs.size())), [&]()
+        {
+            for (uint32_t i = nextJob++; i < jobs.size(); i = nextJob++)
+            {
+                if (!BuildShape(jobs[i], positions, normals, texcoords, indices, faces, shapes[i]))
+                {
+                    failed = true;
+                }
+            }
+        });
+
+        if (failed)
+        {
+            err += "Face references a vertex position that does not exist\n";
+            shapes.clear();
+            return false;
+        }
+
+        auto const elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime);
+        LOGI("ObjParser::Parse", "Parsed %u KB, %u faces, %u shapes on %u threads in %.2f ms",
+             (uint32_t)(size / 1024), numFaces, (uint32_t)shapes.size(), threadCount, elapsed.count() / 1000.0);
+        return true;
+    }
+}
@@ -0,0 +1,35 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "tiny_obj_loader.h"
+
+namespace QtiGL
+{
+    // Multi-threaded Wavefront OBJ parser.
+    //
+    // Produces the same shapes as tinyobj::LoadObj (triangulated, with the
+    // same float parsing, shape splitting and vertex de-duplication), so it is
+    // a drop-in replacement for large meshes.  The buffer is split into
+    // line-aligned chunks that are parsed in parallel; the chunks are merged
+    // with prefix sums over their element counts (which also resolves
+    // negative indices), and the shapes are then built in parallel.
+    // Materials still go through the tinyobj material reader.
+    //
+    // Mesh tags ('t' lines) are not supported.  No GL calls are made.
+    class ObjParser
+    {
+    public:
+        // numThreads = 0 uses one thread per core
+        static bool Parse(void const* pData, size_t const size, tinyobj::MaterialReader& materialReader,
+                          std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& materials,
+                          std::string& err, uint32_t const numThreads = 0);
+    };
+}
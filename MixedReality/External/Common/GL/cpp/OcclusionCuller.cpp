@@ -0,0 +1,479 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "OcclusionCuller.h"
+#include "Parallel.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define OCCLUSION_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OCCLUSION_SSE2 1
+#endif
+
+namespace QtiGL
+{
+    // Four lanes of floats and lane masks, on whatever SIMD the target has
+#if defined(OCCLUSION_NEON)
+    typedef float32x4_t Float4;
+    typedef uint32x4_t  Mask4;
+
+    static inline Float4 Splat4(float const v)                              { return vdupq_n_f32(v); }
+    static inline Float4 Set4(float const a, float const b, float const c, float const d)
+    {
+        float const v[4] = { a, b, c, d };
+        return vld1q_f32(v);
+    }
+    static inline Float4 Load4(float const* p)                              { return vld1q_f32(p); }
+    static inline void Store4(float* p, Float4 const v)                     { vst1q_f32(p, v); }
+    static inline Float4 Add4(Float4 const a, Float4 const b)               { return vaddq_f32(a, b); }
+    static inline Float4 Mul4(Float4 const a, Float4 const b)               { return vmulq_f32(a, b); }
+    static inline Float4 Max4(Float4 const a, Float4 const b)               { return vmaxq_f32(a, b); }
+    static inline Mask4 Greater4(Float4 const a, Float4 const b)            { return vcgtq_f32(a, b); }
+    static inline Mask4 GreaterEqual4(Float4 const a, Float4 const b)       { return vcgeq_f32(a, b); }
+    static inline Mask4 And4(Mask4 const a, Mask4 const b)                  { return vandq_u32(a, b); }
+    static inline Float4 Select4(Mask4 const m, Float4 const a, Float4 const b) { return vbslq_f32(m, a, b); }
+    static inline bool Any4(Mask4 const m)
+    {
+#if defined(__aarch64__)
+        return vmaxvq_u32(m) != 0;
+#else
+        uint32x2_t const halves = vorr_u32(vget_low_u32(m), vget_high_u32(m));
+        return (vget_lane_u32(halves, 0) | vget_lane_u32(halves, 1)) != 0;
+#endif
+    }
+#elif defined(OCCLUSION_SSE2)
+    typedef __m128 Float4;
+    typedef __m128 Mask4;
+
+    static inline Float4 Splat4(float const v)                              { return _mm_set1_ps(v); }
+    static inline Float4 Set4(float const a, float const b, float const c, float const d) { return _mm_setr_ps(a, b, c, d); }
+    static inline Float4 Load4(float const* p)                              { return _mm_loadu_ps(p); }
+    static inline void Store4(float* p, Float4 const v)                     { _mm_storeu_ps(p, v); }
+    static inline Float4 Add4(Float4 const a, Float4 const b)               { return _mm_add_ps(a, b); }
+    static inline Float4 Mul4(Float4 const a, Float4 const b)               { return _mm_mul_ps(a, b); }
+    static inline Float4 Max4(Float4 const a, Float4 const b)               { return _mm_max_ps(a, b); }
+    static inline Mask4 Greater4(Float4 const a, Float4 const b)            { return _mm_cmpgt_ps(a, b); }
+    static inline Mask4 GreaterEqual4(Float4 const a, Float4 const b)       { return _mm_cmpge_ps(a, b); }
+    static inline Mask4 And4(Mask4 const a, Mask4 const b)                  { return _mm_and_ps(a, b); }
+    static inline Float4 Select4(Mask4 const m, Float4 const a, Float4 const b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+    static inline bool Any4(Mask4 const m)                                  { return _mm_movemask_ps(m) != 0; }
+#else
+    struct Float4 { float v[4]; };
+    struct Mask4 { bool v[4]; };
+
+    static inline Float4 Splat4(float const v)                              { Float4 r = {{ v, v, v, v }}; return r; }
+    static inline Float4 Set4(float const a, float const b, float const c, float const d) { Float4 r = {{ a, b, c, d }}; return r; }
+    static inline Float4 Load4(float const* p)                              { Float4 r = {{ p[0], p[1], p[2], p[3] }}; return r; }
+    static inline void Store4(float* p, Float4 const v)                     { memcpy(p, v.v, sizeof(v.v)); }
+    static inline Float4 Add4(Float4 const a, Float4 const b)               { Float4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] + b.v[i]; return r; }
+    static inline Float4 Mul4(Float4 const a, Float4 const b)               { Float4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] * b.v[i]; return r; }
+    static inline Float4 Max4(Float4 const a, Float4 const b)               { Float4 r; for (int i = 0; i < 4; i++) r.v[i] = std::max(a.v[i], b.v[i]); return r; }
+    static inline Mask4 Greater4(Float4 const a, Float4 const b)            { Mask4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] > b.v[i]; return r; }
+    static inline Mask4 GreaterEqual4(Float4 const a, Float4 const b)       { Mask4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] >= b.v[i]; return r; }
+    static inline Mask4 And4(Mask4 const a, Mask4 const b)                  { Mask4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] && b.v[i]; return r; }
+    static inline Float4 Select4(Mask4 const m, Float4 const a, Float4 const b) { Float4 r; for (int i = 0; i < 4; i++) r.v[i] = m.v[i] ? a.v[i] : b.v[i]; return r; }
+    static inline bool Any4(Mask4 const m)                                  { return m.v[0] || m.v[1] || m.v[2] || m.v[3]; }
+#endif
+
+    // Pixels exactly on an edge belong to the triangle for which it is a top-left edge,
+    // so triangles sharing an edge leave no crack along it
+    static inline Mask4 InsideEdge(Float4 const e, bool const inclusive)
+    {
+        Float4 const zero = Splat4(0.0f);
+        return inclusive ? GreaterEqual4(e, zero) : Greater4(e, zero);
+    }
+
+    // Pixel column/row containing v, clamped to [0, limit] first so far off-screen
+    // coordinates can't overflow the conversion
+    static inline int32_t ClampedFloor(float const v, int32_t const limit)
+    {
+        return (int32_t)floorf(std::min(std::max(v, 0.0f), (float)limit));
+    }
+
+    static inline int32_t ClampedCeil(float const v, int32_t const limit)
+    {
+        return (int32_t)ceilf(std::min(std::max(v, 0.0f), (float)limit));
+    }
+
+    static void TransformPoint(float const* m, float const* p, float* pOut)
+    {
+        for (int32_t r = 0; r < 4; r++)
+        {
+            pOut[r] = m[r] * p[0] + m[4 + r] * p[1] + m[8 + r] * p[2] + m[12 + r];
+        }
+    }
+
+    OcclusionCuller::OcclusionCuller()
+        : mWidth(0)
+        , mHeight(0)
+        , mTilesX(0)
+        , mTilesY(0)
+        , mNumThreads(1)
+        , mGeneration(0)
+        , mBusyWorkers(0)
+        , mStopping(false)
+        , mNextTile(0)
+    {
+        memset(&mStats, 0, sizeof(mStats));
+    }
+
+    OcclusionCuller::~OcclusionCuller()
+    {
+        Destroy();
+    }
+
+    void OcclusionCuller::Destroy()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mWorkMutex);
+            mStopping = true;
+        }
+        mWorkCondition.notify_all();
+        for (size_t i = 0; i < mWorkers.size(); ++i)
+        {
+            mWorkers[i].join();
+        }
+        mWorkers.clear();
+        mStopping = false;
+    }
+
+    void OcclusionCuller::WorkerMain(uint32_t generation)
+    {
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mWorkMutex);
+                mWorkCondition.wait(lock, [&]() { return mStopping || mGeneration != generation; });
+                if (mStopping)
+                {
+                    return;
+                }
+                generation = mGeneration;
+            }
+
+            RasterizeTiles();
+
+            std::lock_guard<std::mutex> lock(mWorkMutex);
+            if (--mBusyWorkers == 0)
+            {
+                mDoneCondition.notify_one();
+            }
+        }
+    }
+
+    void OcclusionCuller::Initialize(uint32_t const width, uint32_t const height, uint32_t const numThreads)
+    {
+        assert(width % OCCLUSION_TILE_WIDTH == 0 && height % OCCLUSION_TILE_HEIGHT == 0);
+        static_assert(OCCLUSION_TILE_WIDTH % OCCLUSION_BLOCK_SIZE == 0 && OCCLUSION_TILE_HEIGHT % OCCLUSION_BLOCK_SIZE == 0,
+                      "Tiles must hold whole blocks");
+        static_assert(OCCLUSION_TILE_WIDTH % 4 == 0, "Tiles must hold whole SIMD groups");
+
+        mWidth = width;
+        mHeight = height;
+        mTilesX = width / OCCLUSION_TILE_WIDTH;
+        mTilesY = height / OCCLUSION_TILE_HEIGHT;
+        mNumThreads = std::min((numThreads > 0) ? numThreads : GetDefaultThreadCount(), mTilesX * mTilesY);
+        mDepth.assign(width * height, 0.0f);
+        mBlockMinDepth.assign((width / OCCLUSION_BLOCK_SIZE) * (height / OCCLUSION_BLOCK_SIZE), 0.0f);
+        mTileBins.resize(mTilesX * mTilesY);
+        BeginFrame();
+
+        // The calling thread rasterizes too.  Workers start from the current
+        // generation, so a Rasterize() before they get scheduled isn't missed.
+        Destroy();
+        for (uint32_t i = 1; i < mNumThreads; ++i)
+        {
+            mWorkers.emplace_back(&OcclusionCuller::WorkerMain, this, mGeneration);
+        }
+    }
+
+    void OcclusionCuller::BeginFrame()
+    {
+        std::fill(mDepth.begin(), mDepth.end(), 0.0f);
+        std::fill(mBlockMinDepth.begin(), mBlockMinDepth.end(), 0.0f);
+        mTriangles.clear();
+        memset(&mStats, 0, sizeof(mStats));
+    }
+
+    void OcclusionCuller::AddOccluder(void const* pVertices, size_t const vertexStride,
+                                      uint32_t const* pIndices, size_t const indexCount, float const* pModelViewProjection)
+    {
+        uint8_t const* pBytes = static_cast<uint8_t const*>(pVertices);
+        float const width = (float)mWidth;
+        float const height = (float)mHeight;
+
+        for (size_t t = 0; t + 2 < indexCount; t += 3)
+        {
+            Triangle triangle;
+            bool clipped = false;
+            for (int32_t v = 0; v < 3 && !clipped; v++)
+            {
+                float const* p = reinterpret_cast<float const*>(pBytes + pIndices[t + v] * vertexStride);
+                float clip[4];
+                TransformPoint(pModelViewProjection, p, clip);
+                if (clip[3] < OCCLUSION_NEAR_W)
+                {
+                    // Dropping it can only make the buffer occlude less
+                    clipped = true;
+                    break;
+                }
+                float const invW = 1.0f / clip[3];
+                triangle.x[v] = (clip[0] * invW * 0.5f + 0.5f) * width;
+                triangle.y[v] = (clip[1] * invW * 0.5f + 0.5f) * height;
+                triangle.invW[v] = invW;
+            }
+            if (clipped)
+            {
+                continue;
+            }
+
+            float const minX = std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2]));
+            float const maxX = std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2]));
+            float const minY = std::min(triangle.y[0], std::min(triangle.y[1], triangle.y[2]));
+            float const maxY = std::max(triangle.y[0], std::max(triangle.y[1], triangle.y[2]));
+            if (maxX <= 0.0f || maxY <= 0.0f || minX >= width || minY >= height)
+            {
+                continue;
+            }
+            float const area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+                               (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+            if (area == 0.0f)
+            {
+                continue;
+            }
+            if (area < 0.0f)
+            {
+                // Both windings occlude; make every triangle counter-clockwise
+                std::swap(triangle.x[1], triangle.x[2]);
+                std::swap(triangle.y[1], triangle.y[2]);
+                std::swap(triangle.invW[1], triangle.invW[2]);
+            }
+            mTriangles.push_back(triangle);
+        }
+    }
+
+    void OcclusionCuller::Rasterize()
+    {
+        mStats.occluderTriangles = (uint32_t)mTriangles.size();
+        for (auto& bin : mTileBins)
+        {
+            bin.clear();
+        }
+
+        for (size_t i = 0; i < mTriangles.size(); i++)
+        {
+            Triangle const& triangle = mTriangles[i];
+            float const minX = std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2]));
+            float const maxX = std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2]));
+            float const minY = std::min(triangle.y[0], std::min(triangle.y[1], triangle.y[2]));
+            float const maxY = std::max(triangle.y[0], std::max(triangle.y[1], triangle.y[2]));
+            int32_t const tx0 = ClampedFloor(minX, mWidth) / OCCLUSION_TILE_WIDTH;
+            int32_t const ty0 = ClampedFloor(minY, mHeight) / OCCLUSION_TILE_HEIGHT;
+            int32_t const tx1 = std::min(ClampedCeil(maxX, mWidth) / OCCLUSION_TILE_WIDTH, (int32_t)mTilesX - 1);
+            int32_t const ty1 = std::min(ClampedCeil(maxY, mHeight) / OCCLUSION_TILE_HEIGHT, (int32_t)mTilesY - 1);
+            for (int32_t ty = ty0; ty <= ty1; ty++)
+            {
+                for (int32_t tx = tx0; tx <= tx1; tx++)
+                {
+                    mTileBins[ty * mTilesX + tx].push_back((uint32_t)i);
+                }
+            }
+        }
+
+        // Tiles own disjoint pixels and blocks, so they need no locking.  The
+        // bins are published to the workers by the mutex.
+        mNextTile.store(0);
+        if (!mWorkers.empty())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mWorkMutex);
+                mBusyWorkers = (uint32_t)mWorkers.size();
+                mGeneration++;
+            }
+            mWorkCondition.notify_all();
+        }
+
+        RasterizeTiles();
+
+        if (!mWorkers.empty())
+        {
+            std::unique_lock<std::mutex> lock(mWorkMutex);
+            mDoneCondition.wait(lock, [&]() { return mBusyWorkers == 0; });
+        }
+    }
+
+    void OcclusionCuller::RasterizeTiles()
+    {
+        uint32_t const tileCount = mTilesX * mTilesY;
+        uint32_t tile;
+        while ((tile = mNextTile.fetch_add(1)) < tileCount)
+        {
+            RasterizeTile(tile);
+        }
+    }
+
+    void OcclusionCuller::RasterizeTile(uint32_t const tile)
+    {
+        int32_t const tileX0 = (int32_t)(tile % mTilesX) * OCCLUSION_TILE_WIDTH;
+        int32_t const tileY0 = (int32_t)(tile / mTilesX) * OCCLUSION_TILE_HEIGHT;
+        int32_t const tileX1 = tileX0 + OCCLUSION_TILE_WIDTH;
+        int32_t const tileY1 = tileY0 + OCCLUSION_TILE_HEIGHT;
+        Float4 const laneOffsets = Set4(0.5f, 1.5f, 2.5f, 3.5f);
+
+        for (uint32_t index : mTileBins[tile])
+        {
+            Triangle const& tri = mTriangles[index];
+
+            // Edge functions e(x, y) = a * x + b * y + c, positive inside
+            float a[3], b[3], c[3];
+            bool inclusive[3];
+            for (int32_t e = 0; e < 3; e++)
+            {
+                int32_t const n = (e + 1) % 3;
+                a[e] = tri.y[e] - tri.y[n];
+                b[e] = tri.x[n] - tri.x[e];
+                c[e] = tri.x[e] * tri.y[n] - tri.x[n] * tri.y[e];
+                inclusive[e] = (a[e] > 0.0f) || (a[e] == 0.0f && b[e] > 0.0f);
+            }
+
+            // 1/w is linear in screen space
+            float const area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+            float const dzdx = ((tri.invW[1] - tri.invW[0]) * (tri.y[2] - tri.y[0]) - (tri.invW[2] - tri.invW[0]) * (tri.y[1] - tri.y[0])) / area;
+            float const dzdy = ((tri.invW[2] - tri.invW[0]) * (tri.x[1] - tri.x[0]) - (tri.invW[1] - tri.invW[0]) * (tri.x[2] - tri.x[0])) / area;
+            float const z0 = tri.invW[0] - dzdx * tri.x[0] - dzdy * tri.y[0];
+
+            float const minX = std::min(tri.x[0], std::min(tri.x[1], tri.x[2]));
+            float const maxX = std::max(tri.x[0], std::max(tri.x[1], tri.x[2]));
+            float const minY = std::min(tri.y[0], std::min(tri.y[1], tri.y[2]));
+            float const maxY = std::max(tri.y[0], std::max(tri.y[1], tri.y[2]));
+            int32_t const x0 = std::max(ClampedFloor(minX, mWidth), tileX0) & ~3;
+            int32_t const x1 = std::min(ClampedCeil(maxX, mWidth), tileX1);
+            int32_t const y0 = std::max(ClampedFloor(minY, mHeight), tileY0);
+            int32_t const y1 = std::min(ClampedCeil(maxY, mHeight), tileY1);
+
+            Float4 const a0 = Splat4(a[0]), a1 = Splat4(a[1]), a2 = Splat4(a[2]);
+            Float4 const zx = Splat4(dzdx);
+            for (int32_t y = y0; y < y1; y++)
+            {
+                float const py = (float)y + 0.5f;
+                Float4 const r0 = Splat4(b[0] * py + c[0]);
+                Float4 const r1 = Splat4(b[1] * py + c[1]);
+                Float4 const r2 = Splat4(b[2] * py + c[2]);
+                Float4 const rz = Splat4(dzdy * py + z0);
+                float* pRow = &mDepth[y * mWidth];
+                for (int32_t x = x0; x < x1; x += 4)
+                {
+                    Float4 const px = Add4(Splat4((float)x), laneOffsets);
+                    Mask4 const inside = And4(And4(InsideEdge(Add4(Mul4(a0, px), r0), inclusive[0]),
+                                                   InsideEdge(Add4(Mul4(a1, px), r1), inclusive[1])),
+                                              InsideEdge(Add4(Mul4(a2, px), r2), inclusive[2]));
+                    if (!Any4(inside))
+                    {
+                        continue;
+                    }
+                    Float4 const depth = Load4(pRow + x);
+                    Float4 const z = Add4(Mul4(zx, px), rz);
+                    Store4(pRow + x, Select4(inside, Max4(depth, z), depth));
+                }
+            }
+        }
+
+        // Coarse level: the farthest value of every block
+        uint32_t const blocksX = mWidth / OCCLUSION_BLOCK_SIZE;
+        for (int32_t by = tileY0; by < tileY1; by += OCCLUSION_BLOCK_SIZE)
+        {
+            for (int32_t bx = tileX0; bx < tileX1; bx += OCCLUSION_BLOCK_SIZE)
+            {
+                float minDepth = INFINITY;
+                for (int32_t y = by; y < by + OCCLUSION_BLOCK_SIZE; y++)
+                {
+                    float const* pRow = &mDepth[y * mWidth + bx];
+                    for (int32_t x = 0; x < OCCLUSION_BLOCK_SIZE; x++)
+                    {
+                        minDepth = std::min(minDepth, pRow[x]);
+                    }
+                }
+                mBlockMinDepth[(by / OCCLUSION_BLOCK_SIZE) * blocksX + bx / OCCLUSION_BLOCK_SIZE] = minDepth;
+            }
+        }
+    }
+
+    bool OcclusionCuller::IsVisible(float const* pBoundsMin, float const* pBoundsMax, float const* pModelViewProjection)
+    {
+        mStats.tested++;
+
+        float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+        float maxInvW = 0.0f;
+        for (int32_t corner = 0; corner < 8; corner++)
+        {
+            float const p[3] = { (corner & 1) ? pBoundsMax[0] : pBoundsMin[0],
+                                 (corner & 2) ? pBoundsMax[1] : pBoundsMin[1],
+                                 (corner & 4) ? pBoundsMax[2] : pBoundsMin[2] };
+            float clip[4];
+            TransformPoint(pModelViewProjection, p, clip);
+            if (clip[3] < OCCLUSION_NEAR_W)
+            {
+                return true;
+            }
+            float const invW = 1.0f / clip[3];
+            float const x = (clip[0] * invW * 0.5f + 0.5f) * (float)mWidth;
+            float const y = (clip[1] * invW * 0.5f + 0.5f) * (float)mHeight;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+            minY = std::min(minY, y);
+            maxY = std::max(maxY, y);
+            maxInvW = std::max(maxInvW, invW);
+        }
+
+        int32_t const x0 = ClampedFloor(minX, mWidth);
+        int32_t const y0 = ClampedFloor(minY, mHeight);
+        int32_t const x1 = ClampedCeil(maxX, mWidth);
+        int32_t const y1 = ClampedCeil(maxY, mHeight);
+        if (x0 >= x1 || y0 >= y1)
+        {
+            return false;
+        }
+
+        // The nearest point of the box must be behind every covered pixel
+        uint32_t const blocksX = mWidth / OCCLUSION_BLOCK_SIZE;
+        for (int32_t by = y0 / OCCLUSION_BLOCK_SIZE; by <= (y1 - 1) / OCCLUSION_BLOCK_SIZE; by++)
+        {
+            for (int32_t bx = x0 / OCCLUSION_BLOCK_SIZE; bx <= (x1 - 1) / OCCLUSION_BLOCK_SIZE; bx++)
+            {
+                if (maxInvW < mBlockMinDepth[by * blocksX + bx])
+                {
+                    continue;
+                }
+
+                int32_t const px0 = std::max(x0, bx * OCCLUSION_BLOCK_SIZE);
+                int32_t const px1 = std::min(x1, (bx + 1) * OCCLUSION_BLOCK_SIZE);
+                int32_t const py0 = std::max(y0, by * OCCLUSION_BLOCK_SIZE);
+                int32_t const py1 = std::min(y1, (by + 1) * OCCLUSION_BLOCK_SIZE);
+                for (int32_t y = py0; y < py1; y++)
+                {
+                    float const* pRow = &mDepth[y * mWidth];
+                    for (int32_t x = px0; x < px1; x++)
+                    {
+                        if (pRow[x] <= maxInvW)
+                        {
+                            return true;
+                        }
+                    }
+                }
+            }
+        }
+
+        mStats.occluded++;
+        return false;
+    }
+}
@@ -0,0 +1,115 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define OCCLUSION_DEFAULT_WIDTH     256
+#define OCCLUSION_DEFAULT_HEIGHT    128
+// Unit of work for the rasterizer threads
+#define OCCLUSION_TILE_WIDTH        64
+#define OCCLUSION_TILE_HEIGHT       32
+// Cell of the coarse level of the depth buffer
+#define OCCLUSION_BLOCK_SIZE        8
+// Clip space w below which geometry counts as crossing the near plane
+#define OCCLUSION_NEAR_W            1e-3f
+
+namespace QtiGL
+{
+    struct OcclusionStats
+    {
+        uint32_t    occluderTriangles;      // Rasterized, after near plane and off-screen rejection
+        uint32_t    tested;
+        uint32_t    occluded;
+    };
+
+    // Software occlusion culling on the CPU.
+    //
+    // Every frame, a few designated occluder meshes are rasterized into a small
+    // depth buffer holding 1/w (so larger is nearer, and 0 is empty), four
+    // pixels at a time with NEON or SSE2.  Triangles are binned to screen
+    // tiles and the tiles are rasterized by the calling thread together with
+    // workers started once in Initialize() and woken for every Rasterize(),
+    // so a frame pays no thread creation.  Each tile then
+    // records the farthest depth of every 8x8 block, and IsVisible() tests an
+    // instance's projected bounds against those blocks first, only looking at
+    // pixels where a block alone can't decide.
+    //
+    // Occluders only ever make the buffer less occluding than the real scene:
+    // triangles crossing the near plane are dropped, and pixels are covered by
+    // the same top-left rule the GPU uses.  Bounds that cross the near plane
+    // always count as visible.
+    // Matrices are column major (as glm::value_ptr() gives them).  Nothing here
+    // touches GL.
+    class OcclusionCuller
+    {
+    public:
+        OcclusionCuller();
+        ~OcclusionCuller();
+
+        // Width and height must be multiples of the tile size; numThreads = 0 uses every core
+        void Initialize(uint32_t const width = OCCLUSION_DEFAULT_WIDTH, uint32_t const height = OCCLUSION_DEFAULT_HEIGHT,
+                        uint32_t const numThreads = 0);
+        // Stops and joins the worker threads
+        void Destroy();
+
+        // Clears the depth buffer and the occluder list
+        void BeginFrame();
+        // Positions are three floats at the start of every vertex
+        void AddOccluder(void const* pVertices, size_t const vertexStride,
+                         uint32_t const* pIndices, size_t const indexCount, float const* pModelViewProjection);
+        // Rasterizes the occluders added since BeginFrame()
+        void Rasterize();
+
+        // False if the box is hidden behind the occluders, or entirely off-screen
+        bool IsVisible(float const* pBoundsMin, float const* pBoundsMax, float const* pModelViewProjection);
+
+        OcclusionStats const& GetStats() const { return mStats; }
+        uint32_t GetWidth() const { return mWidth; }
+        uint32_t GetHeight() const { return mHeight; }
+        // Row major 1/w values, row 0 at the bottom
+        float const* GetDepth() const { return mDepth.data(); }
+
+    private:
+        struct Triangle
+        {
+            float       x[3];
+            float       y[3];
+            float       invW[3];
+        };
+
+        void WorkerMain(uint32_t generation);
+        // Pulls tiles until none are left
+        void RasterizeTiles();
+        void RasterizeTile(uint32_t const tile);
+
+        uint32_t                            mWidth;
+        uint32_t                            mHeight;
+        uint32_t                            mTilesX;
+        uint32_t                            mTilesY;
+        uint32_t                            mNumThreads;
+        std::vector<float>                  mDepth;
+        std::vector<float>                  mBlockMinDepth;     // Farthest 1/w of every block
+        std::vector<Triangle>               mTriangles;
+        std::vector<std::vector<uint32_t>>  mTileBins;          // Triangles touching every tile
+        OcclusionStats                      mStats;
+
+        std::vector<std::thread>            mWorkers;
+        std::mutex                          mWorkMutex;
+        std::condition_variable             mWorkCondition;     // Workers wait for a new generation
+        std::condition_variable             mDoneCondition;     // Rasterize() waits for mBusyWorkers to drop to 0
+        uint32_t                            mGeneration;        // Bumped for every Rasterize()
+        uint32_t                            mBusyWorkers;
+        bool                                mStopping;
+        std::atomic<uint32_t>               mNextTile;
+    };
+}
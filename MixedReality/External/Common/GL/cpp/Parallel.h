@@ -0,0 +1,37 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+namespace QtiGL
+{
+    // Thread count to use for numThreads = 0 requests
+    inline uint32_t GetDefaultThreadCount()
+    {
+        uint32_t const count = std::thread::hardware_concurrency();
+        return count > 0 ? count : 1;
+    }
+
+    // Runs func on numThreads threads, the calling thread included, and waits
+    // for all of them.  func is expected to pull work from a shared atomic counter.
+    template <typename ThreadFunc>
+    void RunOnThreads(uint32_t const numThreads, ThreadFunc const& func)
+    {
+        std::vector<std::thread> threads;
+        for (uint32_t i = 1; i < numThreads; ++i)
+        {
+            threads.emplace_back(func);
+        }
+        func();
+        for (size_t i = 0; i < threads.size(); ++i)
+        {
+            threads[i].join();
+        }
+    }
+}
@@ -0,0 +1,226 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <GLES3/gl32.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "LogUtils.h"
+#include "RenderPass.h"
+#include "RenderTarget.h"
+
+namespace QtiGL
+{
+    static RenderPassStats gFrameStats = {};
+
+    // Size of a pixel in memory; formats we don't know count as 4 bytes
+    static uint32_t GetBytesPerPixel(GLenum const sizedFormat)
+    {
+        switch (sizedFormat)
+        {
+        case GL_R8:
+        case GL_R8UI:
+        case GL_R8I:
+            return 1;
+        case GL_RG8:
+        case GL_R16F:
+        case GL_R16UI:
+        case GL_R16I:
+        case GL_RGB565:
+        case GL_RGBA4:
+        case GL_RGB5_A1:
+        case GL_DEPTH_COMPONENT16:
+            return 2;
+        case GL_RGBA16F:
+        case GL_RG32F:
+        case GL_RGBA16UI:
+        case GL_RGBA16I:
+        case GL_DEPTH32F_STENCIL8:
+            return 8;
+        case GL_RGBA32F:
+        case GL_RGBA32UI:
+        case GL_RGBA32I:
+            return 16;
+        default:
+            return 4;
+        }
+    }
+
+    // Memory behind an attachment, counting every sample that is really stored
+    static uint64_t GetAttachmentBytes(RenderTarget const& target, GLenum const sizedFormat, bool const singleSampled)
+    {
+        uint64_t const samples = singleSampled ? 1 : (uint64_t)std::max(target.GetSamples(), 1);
+        return (uint64_t)target.GetWidth() * (uint64_t)target.GetHeight() * GetBytesPerPixel(sizedFormat) * samples;
+    }
+
+    RenderPass::RenderPass()
+        : mColorLoadOp(kLoadOpLoad)
+        , mColorStoreOp(kStoreOpStore)
+        , mDepthLoadOp(kLoadOpLoad)
+        , mDepthStoreOp(kStoreOpStore)
+        , mClearDepth(1.0f)
+        , mpResolveTarget(nullptr)
+        , mpTarget(nullptr)
+    {
+        memset(mClearColor, 0, sizeof(mClearColor));
+    }
+
+    void RenderPass::SetColorOps(LoadOp const loadOp, StoreOp const storeOp, float const r, float const g, float const b, float const a)
+    {
+        mColorLoadOp = loadOp;
+        mColorStoreOp = storeOp;
+        mClearColor[0] = r;
+        mClearColor[1] = g;
+        mClearColor[2] = b;
+        mClearColor[3] = a;
+    }
+
+    void RenderPass::SetDepthOps(LoadOp const loadOp, StoreOp const storeOp, float const clearDepth)
+    {
+        mDepthLoadOp = loadOp;
+        mDepthStoreOp = storeOp;
+        mClearDepth = clearDepth;
+    }
+
+    void RenderPass::SetResolveTarget(RenderTarget* pResolveTarget)
+    {
+        mpResolveTarget = pResolveTarget;
+    }
+
+    void RenderPass::Begin(RenderTarget& target)
+    {
+        assert(mpTarget == nullptr);
+        mpTarget = &target;
+        target.Bind();
+        glViewport(0, 0, target.GetWidth(), target.GetHeight());
+
+        uint32_t const numColor = std::min<uint32_t>(target.GetNumColorAttachs(), RENDER_PASS_MAX_COLOR_ATTACHMENTS);
+        bool const hasDepth = target.GetDepthAttachment() != 0;
+
+        GLenum attachments[RENDER_PASS_MAX_COLOR_ATTACHMENTS + 2];
+        GLsizei numAttachments = 0;
+        if (mColorLoadOp == kLoadOpDontCare)
+        {
+            for (uint32_t i = 0; i < numColor; i++)
+            {
+                attachments[numAttachments++] = GL_COLOR_ATTACHMENT0 + i;
+            }
+        }
+        if (hasDepth && mDepthLoadOp == kLoadOpDontCare)
+        {
+            attachments[numAttachments++] = GL_DEPTH_ATTACHMENT;
+            attachments[numAttachments++] = GL_STENCIL_ATTACHMENT;
+        }
+        if (numAttachments > 0)
+        {
+            glInvalidateFramebuffer(GL_FRAMEBUFFER, numAttachments, attachments);
+            gFrameStats.invalidates++;
+        }
+
+        GLbitfield clearMask = 0;
+        if (mColorLoadOp == kLoadOpClear)
+        {
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glClearColor(mClearColor[0], mClearColor[1], mClearColor[2], mClearColor[3]);
+            clearMask |= GL_COLOR_BUFFER_BIT;
+        }
+        if (hasDepth && mDepthLoadOp == kLoadOpClear)
+        {
+            glDepthMask(GL_TRUE);
+            glStencilMask(0xFF);
+            glClearDepthf(mClearDepth);
+            glClearStencil(0);
+            clearMask |= GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT;
+        }
+        if (clearMask != 0)
+        {
+            // A scissored clear is a draw; a full one is free on a tiler
+            GLboolean const scissor = glIsEnabled(GL_SCISSOR_TEST);
+            if (scissor)
+            {
+                glDisable(GL_SCISSOR_TEST);
+            }
+            glClear(clearMask);
+            if (scissor)
+            {
+                glEnable(GL_SCISSOR_TEST);
+            }
+            gFrameStats.clears++;
+        }
+    }
+
+    void RenderPass::End()
+    {
+        assert(mpTarget != nullptr);
+        RenderTarget& target = *mpTarget;
+
+        uint32_t const numColor = std::min<uint32_t>(target.GetNumColorAttachs(), RENDER_PASS_MAX_COLOR_ATTACHMENTS);
+        bool const hasDepth = target.GetDepthAttachment() != 0;
+        bool const explicitMultisample = target.GetSamples() > 1 && !target.IsImplicitResolve();
+
+        GLenum attachments[RENDER_PASS_MAX_COLOR_ATTACHMENTS + 2];
+        GLsizei numAttachments = 0;
+
+        bool discardColor = (mColorStoreOp == kStoreOpDiscard);
+        if (mColorStoreOp == kStoreOpResolve && explicitMultisample)
+        {
+            if (mpResolveTarget != nullptr)
+            {
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, target.GetFrameBufferId());
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mpResolveTarget->GetFrameBufferId());
+                glBlitFramebuffer(0, 0, target.GetWidth(), target.GetHeight(),
+                                  0, 0, mpResolveTarget->GetWidth(), mpResolveTarget->GetHeight(),
+                                  GL_COLOR_BUFFER_BIT, GL_NEAREST);
+                glBindFramebuffer(GL_FRAMEBUFFER, target.GetFrameBufferId());
+                gFrameStats.resolves++;
+                // Only the resolved copy is needed from here on
+                discardColor = true;
+            }
+            else
+            {
+                LOGW("RenderPass::End", "Resolve requested without a resolve target, storing samples instead");
+            }
+        }
+
+        if (discardColor)
+        {
+            for (uint32_t i = 0; i < numColor; i++)
+            {
+                attachments[numAttachments++] = GL_COLOR_ATTACHMENT0 + i;
+                gFrameStats.writeBackBytesAvoided += GetAttachmentBytes(target, target.GetColorFormat(), target.IsImplicitResolve());
+            }
+        }
+        if (hasDepth && mDepthStoreOp != kStoreOpStore)
+        {
+            // Depth is never resolved by a blit; resolve means keeping the implicitly resolved copy
+            if (mDepthStoreOp == kStoreOpDiscard || explicitMultisample || !target.IsDepthResolved())
+            {
+                attachments[numAttachments++] = GL_DEPTH_ATTACHMENT;
+                attachments[numAttachments++] = GL_STENCIL_ATTACHMENT;
+                gFrameStats.writeBackBytesAvoided += GetAttachmentBytes(target, target.GetDepthFormat(), target.IsDepthResolved());
+            }
+        }
+        if (numAttachments > 0)
+        {
+            glInvalidateFramebuffer(GL_FRAMEBUFFER, numAttachments, attachments);
+            gFrameStats.invalidates++;
+        }
+
+        target.Unbind();
+        mpTarget = nullptr;
+        gFrameStats.passes++;
+    }
+
+    RenderPassStats const& RenderPass::GetFrameStats()
+    {
+        return gFrameStats;
+    }
+
+    void RenderPass::ResetFrameStats()
+    {
+        memset(&gFrameStats, 0, sizeof(gFrameStats));
+    }
+}
@@ -0,0 +1,88 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <GLES3/gl32.h>
+
+// Upper bound on the color attachments a pass invalidates
+#define RENDER_PASS_MAX_COLOR_ATTACHMENTS   8
+
+namespace QtiGL
+{
+    class RenderTarget;
+
+    struct RenderPassStats
+    {
+        uint32_t    passes;
+        uint32_t    clears;
+        uint32_t    invalidates;            // glInvalidateFramebuffer() calls
+        uint32_t    resolves;               // Explicit resolve blits
+        uint64_t    writeBackBytesAvoided;  // Attachment memory that didn't have to be stored from tile memory
+    };
+
+    // Declares what happens to a RenderTarget's attachments at the start and
+    // the end of a pass, the way tiled GPUs want to be told.
+    //
+    // Load ops say how tile memory starts out: kLoadOpLoad reads the
+    // attachment back in, kLoadOpClear clears it (with scissoring off, so it is
+    // a full clear the driver can turn into a tile fill), and kLoadOpDontCare
+    // invalidates it up front.  Store ops say what is written back at the end:
+    // kStoreOpStore keeps it, kStoreOpDiscard invalidates it before the
+    // framebuffer is unbound so tiles are never written out, and
+    // kStoreOpResolve keeps only the single sampled result.  Implicit resolve
+    // targets resolve on their own; explicit multisample ones are blitted into
+    // the resolve target, and their samples are discarded afterwards.
+    //
+    // Color ops apply to every color attachment, depth ops to depth and
+    // stencil.  Every discarded attachment adds its size to the frame's
+    // writeBackBytesAvoided; ResetFrameStats() starts a new frame.
+    class RenderPass
+    {
+    public:
+        enum LoadOp
+        {
+            kLoadOpLoad = 0,
+            kLoadOpClear,
+            kLoadOpDontCare
+        };
+
+        enum StoreOp
+        {
+            kStoreOpStore = 0,
+            kStoreOpResolve,
+            kStoreOpDiscard
+        };
+
+        RenderPass();
+
+        void SetColorOps(LoadOp const loadOp, StoreOp const storeOp, float const r = 0.0f, float const g = 0.0f,
+                         float const b = 0.0f, float const a = 0.0f);
+        void SetDepthOps(LoadOp const loadOp, StoreOp const storeOp, float const clearDepth = 1.0f);
+        // Destination of kStoreOpResolve for explicit multisample targets
+        void SetResolveTarget(RenderTarget* pResolveTarget);
+
+        // Binds the target, sets the viewport to cover it and applies the load ops
+        void Begin(RenderTarget& target);
+        // Applies the store ops and unbinds the target
+        void End();
+
+        bool IsActive() const { return mpTarget != nullptr; }
+
+        static RenderPassStats const& GetFrameStats();
+        static void ResetFrameStats();
+
+    private:
+        LoadOp          mColorLoadOp;
+        StoreOp         mColorStoreOp;
+        LoadOp          mDepthLoadOp;
+        StoreOp         mDepthStoreOp;
+        float           mClearColor[4];
+        float           mClearDepth;
+        RenderTarget*   mpResolveTarget;
+        RenderTarget*   mpTarget;
+    };
+}
@@ -0,0 +1,216 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <GLES3/gl32.h>
+#include <algorithm>
+#include <cstring>
+
+#include "Geometry.h"
+#include "RenderQueue.h"
+#include "Shader.h"
+#include "VertexFormat.h"
+
+#define RENDER_QUEUE_DEPTH_MASK     0xFFFFFFULL
+
+namespace QtiGL
+{
+    // Stable LSD radix sort of pOrder by pKeys[pOrder[i]], one byte per pass.
+    // Passes over a byte every key shares are skipped, which is most of them
+    // when only a few layers, programs and textures are in use.
+    static void RadixSort(uint64_t const* pKeys, uint32_t* pOrder, uint32_t* pScratch, size_t const count)
+    {
+        uint32_t* pSrc = pOrder;
+        uint32_t* pDst = pScratch;
+        for (uint32_t shift = 0; shift < 64; shift += 8)
+        {
+            uint32_t histogram[256];
+            memset(histogram, 0, sizeof(histogram));
+            for (size_t i = 0; i < count; i++)
+            {
+                histogram[(pKeys[pSrc[i]] >> shift) & 0xFF]++;
+            }
+            if (histogram[(pKeys[pSrc[0]] >> shift) & 0xFF] == count)
+            {
+                continue;
+            }
+
+            uint32_t offset = 0;
+            for (uint32_t b = 0; b < 256; b++)
+            {
+                uint32_t const bucketCount = histogram[b];
+                histogram[b] = offset;
+                offset += bucketCount;
+            }
+            for (size_t i = 0; i < count; i++)
+            {
+                pDst[histogram[(pKeys[pSrc[i]] >> shift) & 0xFF]++] = pSrc[i];
+            }
+            std::swap(pSrc, pDst);
+        }
+
+        if (pSrc != pOrder)
+        {
+            memcpy(pOrder, pSrc, count * sizeof(uint32_t));
+        }
+    }
+
+    RenderQueue::RenderQueue()
+        : mProjectionMatrix(1.0f)
+        , mViewMatrix(1.0f)
+        , mEyePosition(0.0f)
+    {
+        memset(&mStats, 0, sizeof(mStats));
+    }
+
+    void RenderQueue::Begin(glm::mat4 const& projectionMatrix, glm::mat4 const& viewMatrix)
+    {
+        mProjectionMatrix = projectionMatrix;
+        mViewMatrix = viewMatrix;
+        mEyePosition = glm::vec3(glm::inverse(viewMatrix)[3]);
+        mPackets.clear();
+        mKeys.clear();
+    }
+
+    uint64_t RenderQueue::MakeSortKey(DrawPacket const& packet, float const viewDepth)
+    {
+        float const depth = std::min(std::max(viewDepth / RENDER_QUEUE_MAX_DEPTH, 0.0f), 1.0f);
+        uint64_t const quantizedDepth = (uint64_t)(depth * (float)RENDER_QUEUE_DEPTH_MASK);
+        uint64_t const shader = packet.pShader->GetShaderId() & 0x7FF;
+        uint64_t const texture = packet.texture & 0xFFFF;
+        uint64_t const material = packet.material & 0xFF;
+
+        uint64_t key = ((uint64_t)(packet.layer & 0xF) << 60);
+        if (packet.translucent)
+        {
+            key |= 1ULL << 59;
+            key |= (~quantizedDepth & RENDER_QUEUE_DEPTH_MASK) << 35;
+            key |= shader << 24;
+            key |= texture << 8;
+            key |= material;
+        }
+        else
+        {
+            key |= shader << 48;
+            key |= texture << 32;
+            key |= material << 24;
+            key |= quantizedDepth;
+        }
+        return key;
+    }
+
+    void RenderQueue::Add(DrawPacket const& packet)
+    {
+        // Depth of the bounds center along the view direction
+        float const* pMin = packet.pGeometry->GetBoundsMin();
+        float const* pMax = packet.pGeometry->GetBoundsMax();
+        glm::vec4 const center(0.5f * (pMin[0] + pMax[0]), 0.5f * (pMin[1] + pMax[1]), 0.5f * (pMin[2] + pMax[2]), 1.0f);
+        glm::vec4 const viewPosition = mViewMatrix * (packet.modelMatrix * center);
+
+        mPackets.push_back(packet);
+        mPackets.back().sortKey = MakeSortKey(packet, -viewPosition.z);
+        mKeys.push_back(mPackets.back().sortKey);
+    }
+
+    void RenderQueue::Flush()
+    {
+        memset(&mStats, 0, sizeof(mStats));
+        size_t const count = mPackets.size();
+        if (count == 0)
+        {
+            return;
+        }
+
+        mOrder.resize(count);
+        mScratch.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            mOrder[i] = (uint32_t)i;
+        }
+        RadixSort(mKeys.data(), mOrder.data(), mScratch.data(), count);
+
+        Shader* pShader = nullptr;
+        uint32_t boundTexture = 0;
+        uint32_t boundVao = 0;
+        bool blending = false;
+
+        Geometry::BeginBatch();
+        for (size_t i = 0; i < count; i++)
+        {
+            DrawPacket& packet = mPackets[mOrder[i]];
+
+            if (packet.pShader != pShader)
+            {
+                if (pShader != nullptr)
+                {
+                    pShader->Unbind();
+                }
+                pShader = packet.pShader;
+                pShader->Bind();
+                pShader->SetUniformMat4(RENDER_QUEUE_PROJECTION_UNIFORM, mProjectionMatrix);
+                pShader->SetUniformMat4(RENDER_QUEUE_VIEW_UNIFORM, mViewMatrix);
+                pShader->SetUniformVec3(RENDER_QUEUE_EYE_UNIFORM, mEyePosition);
+                mStats.programSwitches++;
+
+                // The new program's samplers may use other texture units
+                boundTexture = 0;
+            }
+
+            if (packet.translucent != blending)
+            {
+                blending = packet.translucent;
+                if (blending)
+                {
+                    glEnable(GL_BLEND);
+                    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                    glDepthMask(GL_FALSE);
+                }
+                else
+                {
+                    glDisable(GL_BLEND);
+                    glDepthMask(GL_TRUE);
+                }
+            }
+
+            if (packet.texture != 0 && packet.pTextureUniform != nullptr && packet.texture != boundTexture)
+            {
+                pShader->SetUniformSampler(packet.pTextureUniform, packet.texture, GL_TEXTURE_2D, 0);
+                boundTexture = packet.texture;
+                mStats.textureSwitches++;
+            }
+
+            Geometry& geometry = *packet.pGeometry;
+            pShader->SetUniformMat4(RENDER_QUEUE_MODEL_UNIFORM, packet.modelMatrix);
+            VertexFormat::SetDecodeUniforms(*pShader, geometry.GetVertexFormat(), geometry.GetVertexDecode());
+
+            if (geometry.GetVaoId() != boundVao)
+            {
+                boundVao = geometry.GetVaoId();
+                mStats.vaoSwitches++;
+            }
+
+            geometry.SetLod(packet.lod);
+            if (packet.instanceCount > 1)
+            {
+                geometry.SubmitInstanced(packet.instanceCount);
+            }
+            else
+            {
+                geometry.Submit();
+            }
+            mStats.draws++;
+        }
+        Geometry::EndBatch();
+
+        if (pShader != nullptr)
+        {
+            pShader->Unbind();
+        }
+        if (blending)
+        {
+            glDisable(GL_BLEND);
+            glDepthMask(GL_TRUE);
+        }
+    }
+}
@@ -0,0 +1,91 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Distance (in meters) mapped onto the depth bits of a sort key; farther draws share the last value
+#define RENDER_QUEUE_MAX_DEPTH          100.0f
+
+// Uniforms the queue sets; shaders that don't declare one simply ignore it
+#define RENDER_QUEUE_PROJECTION_UNIFORM "projectionMatrix"
+#define RENDER_QUEUE_VIEW_UNIFORM       "viewMatrix"
+#define RENDER_QUEUE_EYE_UNIFORM        "eyePos"
+#define RENDER_QUEUE_MODEL_UNIFORM      "modelMatrix"
+
+namespace QtiGL
+{
+    class Geometry;
+    class Shader;
+
+    // One draw.  The queue fills in the sort key.
+    struct DrawPacket
+    {
+        Shader*         pShader;
+        Geometry*       pGeometry;
+        glm::mat4       modelMatrix;
+        uint32_t        texture;            // GL_TEXTURE_2D, 0 for none
+        char const*     pTextureUniform;    // Sampler the texture is bound to
+        uint32_t        material;           // Optional, breaks ties between draws with the same texture
+        uint32_t        layer;              // 0-15, lower layers draw first
+        bool            translucent;        // Alpha blended, drawn after the opaques of its layer
+        uint32_t        lod;
+        uint32_t        instanceCount;
+        uint64_t        sortKey;
+    };
+
+    struct RenderQueueStats
+    {
+        uint32_t    draws;
+        uint32_t    programSwitches;
+        uint32_t    textureSwitches;
+        uint32_t    vaoSwitches;
+    };
+
+    // Collects a frame's draws and submits them in an order that keeps state
+    // changes down.
+    //
+    // Sort keys, most significant bits first:
+    //   opaque:       layer(4) 0(1) shader(11) texture(16) material(8) depth(24)
+    //   translucent:  layer(4) 1(1) ~depth(24) shader(11) texture(16) material(8)
+    // so opaques are grouped by program and texture and drawn front to back
+    // inside a group (early-Z), and translucents are drawn back to front.
+    // Keys are sorted with an LSD radix sort that skips bytes all keys share.
+    //
+    // Submission goes through Shader::Bind() and Geometry::Submit(), and the
+    // program, texture and VAO are only changed when they differ from the
+    // previous draw's.
+    class RenderQueue
+    {
+    public:
+        RenderQueue();
+
+        // Starts a new view; packets from the previous one are dropped
+        void Begin(glm::mat4 const& projectionMatrix, glm::mat4 const& viewMatrix);
+        void Add(DrawPacket const& packet);
+        // Sorts and draws the packets.  They stay queued, so the same view can be
+        // flushed again into another target; the next Begin() drops them, and each
+        // view adds its own packets.  Stats are for this flush only.
+        void Flush();
+
+        uint32_t GetPacketCount() const { return (uint32_t)mPackets.size(); }
+        RenderQueueStats const& GetStats() const { return mStats; }
+
+        static uint64_t MakeSortKey(DrawPacket const& packet, float const viewDepth);
+
+    private:
+        glm::mat4                   mProjectionMatrix;
+        glm::mat4                   mViewMatrix;
+        glm::vec3                   mEyePosition;
+        std::vector<DrawPacket>     mPackets;
+        std::vector<uint64_t>       mKeys;
+        std::vector<uint32_t>       mOrder;
+        std::vector<uint32_t>       mScratch;
+        RenderQueueStats            mStats;
+    };
+}
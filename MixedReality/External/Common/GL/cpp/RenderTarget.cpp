@@ -4,7 +4,9 @@
  * Confidential and Proprietary - Qualcomm Technologies, Inc.
  ****************************************************************/
 #include <GLES3/gl32.h>
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include "LogUtils.h"
 #include "Extensions.h"
 #include "RenderTarget.h"
@@ -225,6 +227,49 @@ namespace QtiGL
         return true;
     }
 
+    static PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC gFramebufferTexture2DMultisampleEXT = nullptr;
+    static PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC gRenderbufferStorageMultisampleEXT = nullptr;
+    static bool gHasMultisampledRenderToTexture2 = false;
+    static DepthAttachmentPool gTransientDepthPool;
+
+    static bool LoadMultisampledRenderToTexture()
+    {
+        static bool checked = false;
+        if (checked)
+        {
+            return gFramebufferTexture2DMultisampleEXT != nullptr && gRenderbufferStorageMultisampleEXT != nullptr;
+        }
+        checked = true;
+
+        bool hasExtension = false;
+        GLint nExtensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &nExtensions);
+        for (GLint i = 0; i < nExtensions; i++)
+        {
+            char const* pExtension = (char const*)glGetStringi(GL_EXTENSIONS, i);
+            if (pExtension == nullptr)
+            {
+                continue;
+            }
+            if (strcmp(pExtension, "GL_EXT_multisampled_render_to_texture") == 0)
+            {
+                hasExtension = true;
+            }
+            else if (strcmp(pExtension, "GL_EXT_multisampled_render_to_texture2") == 0)
+            {
+                gHasMultisampledRenderToTexture2 = true;
+            }
+        }
+        if (!hasExtension)
+        {
+            return false;
+        }
+
+        gFramebufferTexture2DMultisampleEXT = (PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC)eglGetProcAddress("glFramebufferTexture2DMultisampleEXT");
+        gRenderbufferStorageMultisampleEXT = (PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC)eglGetProcAddress("glRenderbufferStorageMultisampleEXT");
+        return gFramebufferTexture2DMultisampleEXT != nullptr && gRenderbufferStorageMultisampleEXT != nullptr;
+    }
+
     RenderTarget::RenderTarget()
         : mWidth(0)
         , mHeight(0)
@@ -233,6 +278,13 @@ namespace QtiGL
         , mFramebufferId(0)
         , mColorAttachmentLeftEyeId(0)
         , mColorAttachmentRightEyeId(0)
+        , mColorSizedFormat(0)
+        , mDepthSizedFormat(0)
+        , mImplicitResolve(false)
+        , mOwnsColorAttachments(true)
+        , mDepthIsRenderbuffer(false)
+        , mDepthIsPooled(false)
+        , mOwnsDepthAttachment(true)
     {
         mColorAttachmentIds.resize(0);
         mNumColorAttach = 0;
@@ -267,6 +319,8 @@ namespace QtiGL
         mSamples = 1;
         mIsProtectedContent = isProtectedContent;
         mNumColorAttach = 1;
+        mColorSizedFormat = colorSizedFormat;
+        mDepthSizedFormat = 0;
 
         int32_t format, type;
         GetFormatTypeFromSizedFormat( colorSizedFormat, format, type);
@@ -486,6 +540,17 @@ namespace QtiGL
     void RenderTarget::Initialize(int32_t const width, int32_t const height, int32_t const samples, int32_t const colorSizedFormat, bool const requiresDepth, bool const isProtectedContent, uint8_t const  numColorAttach)
     {
         assert(numColorAttach >= 1);
+        mImplicitResolve = false;
+        mOwnsColorAttachments = true;
+        mDepthIsRenderbuffer = (samples > 1);
+        mDepthIsPooled = false;
+        mColorSizedFormat = colorSizedFormat;
+        mDepthSizedFormat = 0;
+        if (requiresDepth)
+        {
+            // Matches what the Initialize*() variants below allocate
+            mDepthSizedFormat = (samples > 1) ? GL_DEPTH24_STENCIL8 : (isProtectedContent ? GL_DEPTH_COMPONENT32F : GL_DEPTH_COMPONENT24);
+        }
         mWidth = width;
         mHeight = height;
         mSamples = samples;
@@ -541,6 +606,8 @@ namespace QtiGL
         mHeight = height;
         mSamples = 1;
         mNumColorAttach = 1;
+        mColorSizedFormat = 0;
+        mDepthSizedFormat = 0;
 
         mColorAttachmentIds.resize(1);
         glGenTextures(1, &(mColorAttachmentIds[0]));
@@ -578,6 +645,8 @@ namespace QtiGL
         mHeight = height;
         mSamples = 1;
         mNumColorAttach = 1;
+        mColorSizedFormat = 0;
+        mDepthSizedFormat = 0;
 
         //Create the framebuffer
         glGenFramebuffers(1, &mFramebufferId);
@@ -596,47 +665,206 @@ namespace QtiGL
         glBindFramebuffer( GL_FRAMEBUFFER, 0 );
     }
 
-    void RenderTarget::Destroy()
+    bool RenderTarget::IsImplicitResolveSupported(bool const resolveDepth)
     {
-        glDeleteFramebuffers( 1, &mFramebufferId);
+        if (!LoadMultisampledRenderToTexture())
+        {
+            return false;
+        }
+        return !resolveDepth || gHasMultisampledRenderToTexture2;
+    }
 
-        if (mSamples > 1)
+    int32_t RenderTarget::GetMaxImplicitResolveSamples()
+    {
+        if (!LoadMultisampledRenderToTexture())
         {
-            for (auto itr = mColorAttachmentIds.begin(); itr != mColorAttachmentIds.end(); ++itr)
+            return 1;
+        }
+        GLint maxSamples = 1;
+        glGetIntegerv(GL_MAX_SAMPLES_EXT, &maxSamples);
+        return maxSamples;
+    }
+
+    DepthAttachmentPool& RenderTarget::GetTransientDepthPool()
+    {
+        return gTransientDepthPool;
+    }
+
+    bool RenderTarget::InitializeImplicitResolveAttachments(int32_t const width, int32_t const height, int32_t const samples, bool const requiresDepth, bool const resolveDepth, GLenum const depthSizedFormat)
+    {
+        // The color texture is in mColorAttachmentIds[0] already
+        mDepthSizedFormat = requiresDepth ? depthSizedFormat : 0;
+        glGenFramebuffers(1, &mFramebufferId);
+        glBindFramebuffer(GL_FRAMEBUFFER, mFramebufferId);
+        gFramebufferTexture2DMultisampleEXT(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mColorAttachmentIds[0], 0, samples);
+
+        if (requiresDepth)
+        {
+            if (resolveDepth)
             {
-                uint32_t colorAttachmentId = *itr;
-                if (colorAttachmentId != 0)
+                glGenTextures(1, &mDepthAttachmentId);
+                glBindTexture(GL_TEXTURE_2D, mDepthAttachmentId);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+                if (mIsProtectedContent)
                 {
-                    glDeleteRenderbuffers(1, &colorAttachmentId);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_PROTECTED_EXT, GL_TRUE);
                 }
+                glTexStorage2D(GL_TEXTURE_2D, 1, depthSizedFormat, width, height);
+                glBindTexture(GL_TEXTURE_2D, 0);
+                gFramebufferTexture2DMultisampleEXT(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, mDepthAttachmentId, 0, samples);
+                mDepthIsRenderbuffer = false;
             }
-            if (mDepthAttachmentId != 0)
+            else
             {
-                glDeleteRenderbuffers(1, &mDepthAttachmentId);
+                // Renderbuffers allocated through the EXT entry point are implicitly multisampled alongside
+                // the color texture; their samples are dropped at the end of the tile instead of stored
+                mDepthAttachmentId = gTransientDepthPool.Acquire(width, height, samples, depthSizedFormat);
+                if (mDepthAttachmentId == 0)
+                {
+                    LOGE("RenderTarget::InitializeImplicitResolve", "No transient %dx%d depth buffer with %d samples", width, height, samples);
+                    glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+                    return false;
+                }
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepthAttachmentId);
+                mDepthIsRenderbuffer = true;
+                mDepthIsPooled = true;
             }
         }
-        else
+
+        bool checkRes = CheckFrameBuffer();
+        if (!checkRes)
+        {
+            LOGE("RenderTarget::InitializeImplicitResolve", "Framebuffer incomplete with %d samples", samples);
+        }
+        assert(checkRes);
+
+        glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+        return checkRes;
+    }
+
+    bool RenderTarget::InitializeImplicitResolve(int32_t const width, int32_t const height, int32_t const samples, int32_t const colorSizedFormat,
+                                                 bool const requiresDepth, bool const resolveDepth, bool const isProtectedContent,
+                                                 GLenum const depthSizedFormat)
+    {
+        if (samples <= 1 || !IsImplicitResolveSupported())
+        {
+            if (samples > 1)
+            {
+                LOGW("RenderTarget::InitializeImplicitResolve", "EXT_multisampled_render_to_texture isn't supported, rendering single sampled");
+            }
+            Initialize(width, height, 1, colorSizedFormat, requiresDepth, isProtectedContent);
+            return true;
+        }
+
+        bool depthResolved = resolveDepth;
+        if (requiresDepth && resolveDepth && !IsImplicitResolveSupported(true))
+        {
+            LOGW("RenderTarget::InitializeImplicitResolve", "EXT_multisampled_render_to_texture2 isn't supported, depth won't be resolved");
+            depthResolved = false;
+        }
+
+        int32_t const clampedSamples = std::max(std::min(samples, GetMaxImplicitResolveSamples()), 1);
+        mWidth = width;
+        mHeight = height;
+        mSamples = clampedSamples;
+        mIsProtectedContent = isProtectedContent;
+        mNumColorAttach = 1;
+        mImplicitResolve = true;
+        mOwnsColorAttachments = true;
+        mDepthIsRenderbuffer = false;
+        mDepthIsPooled = false;
+        mColorSizedFormat = colorSizedFormat;
+
+        mColorAttachmentIds.clear();
+        mColorAttachmentIds.resize(1);
+        glGenTextures(1, &(mColorAttachmentIds[0]));
+        glBindTexture(GL_TEXTURE_2D, mColorAttachmentIds[0]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        if (mIsProtectedContent)
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_PROTECTED_EXT, GL_TRUE);
+        }
+        glTexStorage2D(GL_TEXTURE_2D, 1, colorSizedFormat, width, height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        return InitializeImplicitResolveAttachments(width, height, clampedSamples, requiresDepth, depthResolved, depthSizedFormat);
+    }
+
+    bool RenderTarget::InitializeImplicitResolveExternal(int32_t const width, int32_t const height, int32_t const samples, GLuint const colorTexture,
+                                                         bool const requiresDepth, bool const resolveDepth, GLenum const depthSizedFormat)
+    {
+        assert(colorTexture);
+        if (!IsImplicitResolveSupported())
+        {
+            LOGE("RenderTarget::InitializeImplicitResolveExternal", "EXT_multisampled_render_to_texture isn't supported!");
+            return false;
+        }
+
+        bool depthResolved = resolveDepth;
+        if (requiresDepth && resolveDepth && !IsImplicitResolveSupported(true))
+        {
+            LOGW("RenderTarget::InitializeImplicitResolveExternal", "EXT_multisampled_render_to_texture2 isn't supported, depth won't be resolved");
+            depthResolved = false;
+        }
+
+        int32_t const clampedSamples = std::max(std::min(samples, GetMaxImplicitResolveSamples()), 1);
+        mWidth = width;
+        mHeight = height;
+        mSamples = clampedSamples;
+        mIsProtectedContent = false;
+        mNumColorAttach = 1;
+        mImplicitResolve = true;
+        mOwnsColorAttachments = false;
+        mDepthIsRenderbuffer = false;
+        mDepthIsPooled = false;
+        mColorSizedFormat = 0;
+
+        mColorAttachmentIds.clear();
+        mColorAttachmentIds.resize(1);
+        mColorAttachmentIds[0] = colorTexture;
+
+        return InitializeImplicitResolveAttachments(width, height, clampedSamples, requiresDepth, depthResolved, depthSizedFormat);
+    }
+
+    void RenderTarget::Destroy()
+    {
+        glDeleteFramebuffers( 1, &mFramebufferId);
+
+        // Explicit multisample targets are all renderbuffers; implicit resolve ones
+        // only have a renderbuffer for a transient depth
+        bool const colorIsRenderbuffer = (mSamples > 1) && !mImplicitResolve;
+        if (mOwnsColorAttachments)
         {
             for (auto itr = mColorAttachmentIds.begin(); itr != mColorAttachmentIds.end(); ++itr)
             {
                 uint32_t colorAttachmentId = *itr;
                 if (colorAttachmentId != 0)
                 {
-                    glDeleteTextures(1, &colorAttachmentId);
+                    if (colorIsRenderbuffer)
+                    {
+                        glDeleteRenderbuffers(1, &colorAttachmentId);
+                    }
+                    else
+                    {
+                        glDeleteTextures(1, &colorAttachmentId);
+                    }
                 }
             }
-            if (mDepthAttachmentId != 0)
-            {
-                glDeleteTextures(1, &mDepthAttachmentId);
-            }
-            if (mColorAttachmentLeftEyeId != 0)
-            {
-                glDeleteTextures(1, &mColorAttachmentLeftEyeId);
-            }
-            if (mColorAttachmentRightEyeId != 0)
-            {
-                glDeleteTextures(1, &mColorAttachmentRightEyeId);
-            }
+        }
+        ReleaseDepthAttachment();
+        if (mColorAttachmentLeftEyeId != 0)
+        {
+            glDeleteTextures(1, &mColorAttachmentLeftEyeId);
+        }
+        if (mColorAttachmentRightEyeId != 0)
+        {
+            glDeleteTextures(1, &mColorAttachmentRightEyeId);
         }
 
         mFramebufferId = 0;
@@ -645,6 +873,73 @@ namespace QtiGL
         mDepthAttachmentId = 0;
         mColorAttachmentLeftEyeId = 0;
         mColorAttachmentRightEyeId = 0;
+        mColorSizedFormat = 0;
+        mDepthSizedFormat = 0;
+        mImplicitResolve = false;
+        mOwnsColorAttachments = true;
+        mDepthIsRenderbuffer = false;
+        mDepthIsPooled = false;
+        mOwnsDepthAttachment = true;
+    }
+
+    void RenderTarget::ReleaseDepthAttachment()
+    {
+        if (mDepthAttachmentId != 0)
+        {
+            if (mDepthIsPooled)
+            {
+                gTransientDepthPool.Release(mDepthAttachmentId);
+            }
+            else if (!mOwnsDepthAttachment)
+            {
+                // Belongs to the caller
+            }
+            else if (mDepthIsRenderbuffer)
+            {
+                glDeleteRenderbuffers(1, &mDepthAttachmentId);
+            }
+            else
+            {
+                glDeleteTextures(1, &mDepthAttachmentId);
+            }
+        }
+        mDepthAttachmentId = 0;
+        mDepthIsRenderbuffer = false;
+        mDepthIsPooled = false;
+        mOwnsDepthAttachment = true;
+    }
+
+    bool RenderTarget::ResolveDepthInto(GLuint const depthTexture, GLenum const depthSizedFormat)
+    {
+        assert(mImplicitResolve && depthTexture != 0);
+        if (mSamples > 1 && !IsImplicitResolveSupported(true))
+        {
+            LOGE("RenderTarget::ResolveDepthInto", "EXT_multisampled_render_to_texture2 isn't supported!");
+            return false;
+        }
+
+        ReleaseDepthAttachment();
+        mDepthAttachmentId = depthTexture;
+        mDepthSizedFormat = depthSizedFormat;
+        mOwnsDepthAttachment = false;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, mFramebufferId);
+        if (mSamples > 1)
+        {
+            gFramebufferTexture2DMultisampleEXT(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0, mSamples);
+        }
+        else
+        {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        }
+
+        bool checkRes = CheckFrameBuffer();
+        if (!checkRes)
+        {
+            LOGE("RenderTarget::ResolveDepthInto", "Framebuffer incomplete with %d samples", mSamples);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return checkRes;
     }
 
     void RenderTarget::Bind()
@@ -714,4 +1009,29 @@ namespace QtiGL
     {
         return mSamples;
     }
+
+    uint8_t RenderTarget::GetNumColorAttachs() const
+    {
+        return mNumColorAttach;
+    }
+
+    GLenum RenderTarget::GetColorFormat() const
+    {
+        return mColorSizedFormat;
+    }
+
+    GLenum RenderTarget::GetDepthFormat() const
+    {
+        return mDepthSizedFormat;
+    }
+
+    bool RenderTarget::IsImplicitResolve() const
+    {
+        return mImplicitResolve;
+    }
+
+    bool RenderTarget::IsDepthResolved() const
+    {
+        return mDepthAttachmentId != 0 && !mDepthIsRenderbuffer;
+    }
 }
@@ -7,21 +7,57 @@
 
 #include <cstdint>
 #include <vector>
+#include "DepthAttachmentPool.h"
 #include "Extensions.h"
 
+// Default depth format of implicit resolve targets
+#define RENDER_TARGET_IMPLICIT_DEPTH_FORMAT     GL_DEPTH24_STENCIL8
+
 namespace QtiGL
 {
+    // A framebuffer and its attachments.
+    //
+    // Multisampled targets come in two flavors.  Initialize() with samples > 1
+    // allocates multisampled renderbuffers, which keep every sample in memory
+    // and need a blit to resolve.  InitializeImplicitResolve() uses
+    // EXT_multisampled_render_to_texture instead: the samples only ever live
+    // in tile memory and are resolved into single sampled textures as the tiles
+    // are written out, so there is no resolve pass and no multisampled storage
+    // to load or store.  Depth is a transient multisampled renderbuffer there,
+    // unless it has to be resolved too (to be sampled or handed to the
+    // compositor).  Transient depth is shared through GetTransientDepthPool()
+    // by every target of the same size, sample count and format, so its
+    // contents never survive a pass: clear it or don't care about it on load.
     class RenderTarget
     {
     public:
         RenderTarget();
 
+        // True if InitializeImplicitResolve() can be used; resolveDepth also needs EXT_multisampled_render_to_texture2
+        static bool IsImplicitResolveSupported(bool const resolveDepth = false);
+        // Clamped to GL_MAX_SAMPLES_EXT
+        static int32_t GetMaxImplicitResolveSamples();
+        static DepthAttachmentPool& GetTransientDepthPool();
+
         void Initialize(int32_t const width, int32_t const height, int32_t const samples, int32_t const colorSizedFormat, bool const requiresDepth, bool const isProtectedContent = false, uint8_t const  numColorAttach = 1);
         void InitializeMultiView(int32_t const width, int32_t const height, int32_t const colorSizedFormat, bool const isProtectedContent = false);
         void InitializeImageTargetRenderbuffer(int32_t const width, int32_t const height, EGLImageKHR const image, bool const isProtectedContent, GLenum targetType = GL_TEXTURE_2D, int32_t layer = 0);
         // The GLuint texture that is passed to this function will have its ownership transferred
         // to this RenderTarget. The Destroy() function will free the texture for you.
         void InitializeImageTargetRenderbuffer(int32_t const width, int32_t const height, GLuint const image, bool const isProtectedContent, GLenum targetType = GL_TEXTURE_2D, int32_t layer = 0);
+        // Implicit resolve target with its own color texture
+        bool InitializeImplicitResolve(int32_t const width, int32_t const height, int32_t const samples, int32_t const colorSizedFormat,
+                                       bool const requiresDepth, bool const resolveDepth = false, bool const isProtectedContent = false,
+                                       GLenum const depthSizedFormat = RENDER_TARGET_IMPLICIT_DEPTH_FORMAT);
+        // Implicit resolve target rendering into a texture owned by the caller (e.g. a swapchain image);
+        // Destroy() leaves the texture alone.
+        bool InitializeImplicitResolveExternal(int32_t const width, int32_t const height, int32_t const samples, GLuint const colorTexture,
+                                               bool const requiresDepth, bool const resolveDepth = false,
+                                               GLenum const depthSizedFormat = RENDER_TARGET_IMPLICIT_DEPTH_FORMAT);
+        // Replaces the depth of an implicit resolve target with a texture owned by the caller (e.g. a depth
+        // swapchain image) that depth gets resolved into.  Needs EXT_multisampled_render_to_texture2 when
+        // multisampled.
+        bool ResolveDepthInto(GLuint const depthTexture, GLenum const depthSizedFormat);
         void Destroy();
         void Bind();
         void Unbind();
@@ -36,12 +72,20 @@ namespace QtiGL
         int32_t GetHeight() const;
         int32_t GetSamples() const;
         uint8_t GetNumColorAttachs() const;
+        // Sized formats of the attachments, 0 when unknown (external images) or absent
+        GLenum GetColorFormat() const;
+        GLenum GetDepthFormat() const;
+        bool IsImplicitResolve() const;
+        // False when depth is a transient renderbuffer whose contents are never written out
+        bool IsDepthResolved() const;
 
     private:
         void InitializeSingleSample(int32_t const width, int32_t const height, int32_t const samples, int32_t const colorSizedFormat, int32_t const format, int32_t const type, bool const requiresDepth);
         void InitializeMultiSample(int32_t const width, int32_t const height, int32_t const samples, int32_t const colorSizedFormat, int32_t const format, bool const requiresDepth);
         void InitializeSingleSampleMultiAttach(int32_t const width, int32_t const height, int32_t const samples, int32_t const colorSizedFormat, int32_t const format, int32_t const type, bool const requiresDepth);
         void InitializeMultiSampleMultiAttach(int32_t const width, int32_t const height, int32_t const samples, int32_t const colorSizedFormat, int32_t const format, bool const requiresDepth);
+        void ReleaseDepthAttachment();
+        bool InitializeImplicitResolveAttachments(int32_t const width, int32_t const height, int32_t const samples, bool const requiresDepth, bool const resolveDepth, GLenum const depthSizedFormat);
 
         int32_t     mWidth;
         int32_t     mHeight;
@@ -56,5 +100,12 @@ namespace QtiGL
         uint32_t mFramebufferId;
         bool     mIsProtectedContent;
         uint8_t  mNumColorAttach;
+        GLenum   mColorSizedFormat;
+        GLenum   mDepthSizedFormat;
+        bool     mImplicitResolve;
+        bool     mOwnsColorAttachments;
+        bool     mDepthIsRenderbuffer;
+        bool     mDepthIsPooled;
+        bool     mOwnsDepthAttachment;
     };
 }
@@ -50,12 +50,21 @@ namespace QtiGL
         : mShaderId(0)
         , mVsId(0)
         , mFsId(0)
+        , mGsId(0)
     {
         mRefCount = 0;
         mUniformMap.Init(32);
     }
 
     bool Shader::Initialize(int32_t const numVertStrings, char const** pVertSrc, int32_t const numFragStrings, char const** pFragSrc, char const* pVertDbgName, char const* pFragDbgName)
+    {
+        return Initialize(numVertStrings, pVertSrc, nullptr, numFragStrings, pFragSrc, nullptr, 0, nullptr, nullptr, pVertDbgName, pFragDbgName);
+    }
+
+    bool Shader::Initialize(int32_t const numVertStrings, char const** pVertSrc, int32_t const* pVertLengths,
+                            int32_t const numFragStrings, char const** pFragSrc, int32_t const* pFragLengths,
+                            int32_t const numGeomStrings, char const** pGeomSrc, int32_t const* pGeomLengths,
+                            char const* pVertDbgName, char const* pFragDbgName)
     {
         static char errMsg[4096];
         int32_t result;
@@ -68,7 +77,7 @@ namespace QtiGL
         mVsId = glCreateShader( GL_VERTEX_SHADER );
         if (0 == mVsId)
             return false;
-        glShaderSource(mVsId, numVertStrings, pVertSrc, 0);
+        glShaderSource(mVsId, numVertStrings, pVertSrc, pVertLengths);
         glCompileShader( mVsId );
         glGetShaderiv( mVsId, GL_COMPILE_STATUS, &result );
         if ( result == GL_FALSE )
@@ -85,7 +94,7 @@ namespace QtiGL
         mFsId = glCreateShader( GL_FRAGMENT_SHADER );
         if (0 == mFsId)
             return false;
-        glShaderSource(mFsId, numFragStrings, pFragSrc, 0);
+        glShaderSource(mFsId, numFragStrings, pFragSrc, pFragLengths);
         glCompileShader( mFsId );
         glGetShaderiv( mFsId, GL_COMPILE_STATUS, &result );
         if( result == GL_FALSE )
@@ -99,9 +108,30 @@ namespace QtiGL
             return false;
         }
 
+        if (numGeomStrings > 0)
+        {
+            mGsId = glCreateShader( GL_GEOMETRY_SHADER );
+            if (0 == mGsId)
+                return false;
+            glShaderSource(mGsId, numGeomStrings, pGeomSrc, pGeomLengths);
+            glCompileShader( mGsId );
+            glGetShaderiv( mGsId, GL_COMPILE_STATUS, &result );
+            if( result == GL_FALSE )
+            {
+                errMsg[0] = 0;
+                glGetShaderInfoLog( mGsId, sizeof(errMsg), 0, errMsg);
+                LOGE("Shader::Initialize", "Geometry Compile Error : %s\n", errMsg);
+                return false;
+            }
+        }
+
         mShaderId = glCreateProgram();
         glAttachShader( mShaderId, mVsId );
         glAttachShader( mShaderId, mFsId );
+        if (mGsId != 0)
+        {
+            glAttachShader( mShaderId, mGsId );
+        }
 
         for ( uint32_t i = 0; i < sizeof( gDefaultAttributes ) / sizeof( gDefaultAttributes[0] ); i++ )
         {
@@ -229,9 +259,15 @@ namespace QtiGL
             glDeleteShader(mFsId);
         }
 
+        if (mGsId != 0)
+        {
+            glDeleteShader(mGsId);
+        }
+
         mShaderId = 0;
         mVsId = 0;
         mFsId = 0;
+        mGsId = 0;
     }
 
     void Shader::Bind()
@@ -45,6 +45,12 @@ namespace QtiGL
         Shader();
 
         bool Initialize(int32_t const numVertStrings, char const** pVertSrc, int32_t const numFragStrings, char const** pFragSrc, char const* pVertDbgName = nullptr, char const* pFragDbgName = nullptr);
+        // Source strings need not be null terminated when lengths are given (e.g. mapped asset files).
+        // The geometry stage is optional; pass numGeomStrings = 0 to skip it.
+        bool Initialize(int32_t const numVertStrings, char const** pVertSrc, int32_t const* pVertLengths,
+                        int32_t const numFragStrings, char const** pFragSrc, int32_t const* pFragLengths,
+                        int32_t const numGeomStrings, char const** pGeomSrc, int32_t const* pGeomLengths,
+                        char const* pVertDbgName = nullptr, char const* pFragDbgName = nullptr);
         void Destroy();
         void Bind();
         void Unbind();
@@ -90,6 +96,7 @@ namespace QtiGL
         uint32_t    mShaderId;
         uint32_t    mVsId;
         uint32_t    mFsId;
+        uint32_t    mGsId;
         UniformMap  mUniformMap;
     };
 }
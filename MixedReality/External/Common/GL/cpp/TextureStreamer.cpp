@@ -0,0 +1,536 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <algorithm>
+#include <cstring>
+#include "LogUtils.h"
+#include "TextureStreamer.h"
+
+namespace QtiGL
+{
+    // Block footprint of a compressed format; false if it isn't known, in which
+    // case levels can't be split into row strips
+    static bool GetBlockSize(GLenum const format, uint32_t& blockWidth, uint32_t& blockHeight, uint32_t& blockBytes)
+    {
+        // ASTC LDR (0x93B0..) and sRGB (0x93D0..) share the order of block sizes
+        static uint8_t const astcBlocks[14][2] =
+        {
+            { 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 },
+            { 8, 8 }, { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 },
+        };
+        if ((format >= 0x93B0 && format <= 0x93BD) || (format >= 0x93D0 && format <= 0x93DD))
+        {
+            uint32_t const index = format & 0xF;
+            blockWidth = astcBlocks[index][0];
+            blockHeight = astcBlocks[index][1];
+            blockBytes = 16;
+            return true;
+        }
+
+        blockWidth = 4;
+        blockHeight = 4;
+        switch (format)
+        {
+        case 0x9270:    // GL_COMPRESSED_R11_EAC
+        case 0x9271:    // GL_COMPRESSED_SIGNED_R11_EAC
+        case 0x9274:    // GL_COMPRESSED_RGB8_ETC2
+        case 0x9275:    // GL_COMPRESSED_SRGB8_ETC2
+        case 0x9276:    // GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2
+        case 0x9277:    // GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2
+        case 0x8D64:    // GL_ETC1_RGB8_OES
+        case 0x83F0:    // GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+        case 0x83F1:    // GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+        case 0x8DBB:    // GL_COMPRESSED_RED_RGTC1_EXT
+        case 0x8DBC:    // GL_COMPRESSED_SIGNED_RED_RGTC1_EXT
+            blockBytes = 8;
+            return true;
+        case 0x9272:    // GL_COMPRESSED_RG11_EAC
+        case 0x9273:    // GL_COMPRESSED_SIGNED_RG11_EAC
+        case 0x9278:    // GL_COMPRESSED_RGBA8_ETC2_EAC
+        case 0x9279:    // GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC
+        case 0x83F2:    // GL_COMPRESSED_RGBA_S3TC_DXT3_EXT
+        case 0x83F3:    // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+        case 0x8DBD:    // GL_COMPRESSED_RED_GREEN_RGTC2_EXT
+        case 0x8DBE:    // GL_COMPRESSED_SIGNED_RED_GREEN_RGTC2_EXT
+        case 0x8E8C:    // GL_COMPRESSED_RGBA_BPTC_UNORM_EXT
+        case 0x8E8D:    // GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_EXT
+        case 0x8E8E:    // GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT_EXT
+        case 0x8E8F:    // GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT_EXT
+            blockBytes = 16;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    TextureStreamer::TextureStreamer()
+        : mUploadBudget(0)
+        , mTailSize(0)
+        , mKtx2Targets(0)
+        , mUnpackBuffer(0)
+        , mBytesStreamed(0)
+        , mStopping(false)
+    {
+    }
+
+    TextureStreamer::~TextureStreamer()
+    {
+        Destroy();
+    }
+
+    void TextureStreamer::Initialize(uint32_t const numWorkers, uint32_t const uploadBudgetBytes, uint32_t const tailSize)
+    {
+        mUploadBudget = uploadBudgetBytes;
+        mTailSize = tailSize;
+        mKtx2Targets = KtxTexture::GetKtx2Targets();
+        mStopping = false;
+
+        glGenBuffers(1, &mUnpackBuffer);
+
+        for (uint32_t i = 0; i < std::max(1u, numWorkers); ++i)
+        {
+            mWorkers.emplace_back(&TextureStreamer::WorkerMain, this);
+        }
+    }
+
+    void TextureStreamer::Destroy()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mQueueMutex);
+            mStopping = true;
+            mDecodeQueue.clear();
+        }
+        mQueueCondition.notify_all();
+        for (size_t i = 0; i < mWorkers.size(); ++i)
+        {
+            mWorkers[i].join();
+        }
+        mWorkers.clear();
+
+        for (size_t i = 0; i < mActiveJobs.size(); ++i)
+        {
+            mActiveJobs[i]->state = kCancelled;
+        }
+        mActiveJobs.clear();
+
+        if (mUnpackBuffer != 0)
+        {
+            glDeleteBuffers(1, &mUnpackBuffer);
+            mUnpackBuffer = 0;
+        }
+    }
+
+    void TextureStreamer::WorkerMain()
+    {
+        for (;;)
+        {
+            std::shared_ptr<Job> job;
+            {
+                std::unique_lock<std::mutex> lock(mQueueMutex);
+                mQueueCondition.wait(lock, [this]() { return mStopping || !mDecodeQueue.empty(); });
+                if (mStopping)
+                {
+                    return;
+                }
+                job = mDecodeQueue.front();
+                mDecodeQueue.pop_front();
+            }
+
+            if (job->state == kCancelled)
+            {
+                continue;
+            }
+            Decode(*job);
+        }
+    }
+
+    void TextureStreamer::Decode(Job& job)
+    {
+        int newState = kDecoded;
+        uint32_t const numImages = job.residentLevel * job.numFaces;
+
+        if (job.isKtx2)
+        {
+            // Parallelism comes from decoding several textures at once
+            TKTXErrorCode result = job.transcoder.Transcode(job.source.GetData(), (uint32)job.source.GetSize(), mKtx2Targets,
+                                                            1, 0, job.residentLevel);
+            if (result == KTX_SUCCESS)
+            {
+                for (uint32_t i = 0; i < numImages; ++i)
+                {
+                    job.images[i] = job.transcoder.GetImage(i / job.numFaces, i % job.numFaces);
+                }
+            }
+            else
+            {
+                newState = kFailed;
+            }
+        }
+        else
+        {
+            // KTX 1 levels are uploaded in place; fault the pages in here rather
+            // than in the middle of a frame on the GL thread
+            uint8_t volatile sink = 0;
+            for (uint32_t i = 0; i < numImages; ++i)
+            {
+                for (uint32_t offset = 0; offset < job.images[i].nSize; offset += 4096)
+                {
+                    sink = sink + job.images[i].pData[offset];
+                }
+            }
+        }
+
+        int expected = kDecoding;
+        job.state.compare_exchange_strong(expected, newState);
+    }
+
+    void TextureStreamer::UploadLevels(Job& job, uint32_t const firstLevel, uint32_t const endLevel)
+    {
+        for (uint32_t level = firstLevel; level < endLevel; ++level)
+        {
+            for (uint32_t face = 0; face < job.numFaces; ++face)
+            {
+                TKTXImage const& image = job.images[level * job.numFaces + face];
+                GLenum faceTarget = (job.target == GL_TEXTURE_CUBE_MAP) ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : job.target;
+                if (job.isCompressed)
+                {
+                    glCompressedTexSubImage2D(faceTarget, level, 0, 0, image.nWidth, image.nHeight, job.internalFormat,
+                                              image.nSize, image.pData);
+                }
+                else
+                {
+                    glTexSubImage2D(faceTarget, level, 0, 0, image.nWidth, image.nHeight, job.format, job.type, image.pData);
+                }
+            }
+        }
+    }
+
+    // Fallback for files that can't be split into levels
+    static GLuint LoadSynchronously(uint8_t const* pData, uint32_t const size, GLenum* pOutTarget)
+    {
+        GLuint texture = 0;
+        GLenum target;
+        KtxTexture loader;
+        if (loader.LoadKtxFromBuffer(pData, size, &texture, &target) != KTX_SUCCESS)
+        {
+            return 0;
+        }
+        if (pOutTarget)
+        {
+            *pOutTarget = target;
+        }
+        return texture;
+    }
+
+    GLuint TextureStreamer::Request(QtiIO::AssetView&& source, GLenum* pOutTarget)
+    {
+        std::shared_ptr<Job> job = std::make_shared<Job>();
+        job->source = std::move(source);
+        job->nextFace = 0;
+        job->nextRow = 0;
+        job->state = kDecoding;
+
+        uint8_t const* pData = job->source.GetData();
+        uint32_t const size = (uint32_t)job->source.GetSize();
+
+        uint32_t width, height, numLevels;
+        Ktx2Transcoder tailTranscoder;
+        job->isKtx2 = Ktx2Transcoder::IsKtx2(pData, size);
+        if (job->isKtx2)
+        {
+            TKTX2Header header;
+            memcpy(&header, pData, sizeof(header));
+            if (header.levelCount == 0)
+            {
+                // Only the base level is stored; the rest are generated once it's uploaded
+                LOGI("TextureStreamer::Request", "KTX2 texture needs runtime mips, loading synchronously");
+                return LoadSynchronously(pData, size, pOutTarget);
+            }
+            width = header.pixelWidth;
+            height = std::max(1u, header.pixelHeight);
+            numLevels = header.levelCount;
+        }
+        else
+        {
+            KtxTexture parser;
+            TKTXHeader header;
+            TKTXErrorCode result = parser.ParseLevels(pData, size, &header, &job->images);
+            if (result != KTX_SUCCESS)
+            {
+                // Byte swapped or legacy format; load it the slow way
+                LOGI("TextureStreamer::Request", "Texture can't be streamed (%d), loading synchronously", result);
+                return LoadSynchronously(pData, size, pOutTarget);
+            }
+
+            width = header.pixelWidth;
+            height = header.pixelHeight;
+            numLevels = header.numberOfMipmapLevels;
+            job->numFaces = header.numberOfFaces;
+            job->isCompressed = header.glType == 0;
+            job->internalFormat = header.glInternalFormat;
+            job->format = header.glFormat;
+            job->type = header.glType;
+        }
+
+        // The tail starts at the first level no larger than mTailSize.  A large
+        // texture without mips has no tail and stays incomplete until level 0 arrives.
+        uint32_t tailLevel = 0;
+        while (tailLevel + 1 < numLevels && std::max(width >> tailLevel, height >> tailLevel) > mTailSize)
+        {
+            ++tailLevel;
+        }
+        if (numLevels == 1 && std::max(width, height) > mTailSize)
+        {
+            tailLevel = 1;
+        }
+
+        if (job->isKtx2)
+        {
+            TKTXErrorCode result = tailTranscoder.Transcode(pData, size, mKtx2Targets, 1, tailLevel, 0);
+            if (result != KTX_SUCCESS)
+            {
+                return 0;
+            }
+            job->numFaces = tailTranscoder.GetNumFaces();
+            job->isCompressed = tailTranscoder.IsCompressed() != 0;
+            job->internalFormat = tailTranscoder.GetInternalFormat();
+            job->format = tailTranscoder.GetFormat();
+            job->type = tailTranscoder.GetType();
+
+            job->images.resize(numLevels * job->numFaces);
+            for (uint32_t level = tailLevel; level < numLevels; ++level)
+            {
+                for (uint32_t face = 0; face < job->numFaces; ++face)
+                {
+                    job->images[level * job->numFaces + face] = tailTranscoder.GetImage(level, face);
+                }
+            }
+        }
+
+        job->target = (job->numFaces == 6) ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+        job->residentLevel = std::min(tailLevel, numLevels);
+
+        GLint previousUnpackAlignment = 4;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousUnpackAlignment);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        glGenTextures(1, &job->texture);
+        glBindTexture(job->target, job->texture);
+        glTexStorage2D(job->target, numLevels, job->internalFormat, width, height);
+        UploadLevels(*job, tailLevel, numLevels);
+        if (tailLevel < numLevels)
+        {
+            glTexParameteri(job->target, GL_TEXTURE_BASE_LEVEL, tailLevel);
+        }
+
+        glPixelStorei(GL_UNPACK_ALIGNMENT, previousUnpackAlignment);
+
+        GLenum error = glGetError();
+        if (error != GL_NO_ERROR)
+        {
+            LOGE("TextureStreamer::Request", "GL error 0x%X creating texture", error);
+            glDeleteTextures(1, &job->texture);
+            return 0;
+        }
+
+        LOGI("TextureStreamer::Request", "Texture %u (%u x %u): levels %u-%u resident, %u to stream",
+             job->texture, width, height, tailLevel, numLevels - 1, tailLevel);
+
+        if (pOutTarget)
+        {
+            *pOutTarget = job->target;
+        }
+        GLuint texture = job->texture;
+
+        if (tailLevel > 0)
+        {
+            mActiveJobs.push_back(job);
+            {
+                std::lock_guard<std::mutex> lock(mQueueMutex);
+                mDecodeQueue.push_back(job);
+            }
+            mQueueCondition.notify_one();
+        }
+        return texture;
+    }
+
+    void TextureStreamer::Cancel(GLuint const texture)
+    {
+        for (size_t i = 0; i < mActiveJobs.size(); ++i)
+        {
+            if (mActiveJobs[i]->texture == texture)
+            {
+                mActiveJobs[i]->state = kCancelled;
+                mActiveJobs.erase(mActiveJobs.begin() + i);
+                return;
+            }
+        }
+    }
+
+    void TextureStreamer::Update()
+    {
+        if (mActiveJobs.empty())
+        {
+            return;
+        }
+
+        // Gather row strips, oldest request first, until the budget is spent.  At
+        // least one row always goes so oversized rows still make progress.
+        mStrips.clear();
+        uint32_t totalBytes = 0;
+        bool budgetSpent = false;
+        for (size_t i = 0; i < mActiveJobs.size() && !budgetSpent; ++i)
+        {
+            Job& job = *mActiveJobs[i];
+            if (job.state != kDecoded)
+            {
+                continue;
+            }
+
+            while (job.residentLevel > 0)
+            {
+                uint32_t const level = job.residentLevel - 1;
+                TKTXImage const& image = job.images[level * job.numFaces + job.nextFace];
+
+                // A row is one row of pixels, or of blocks; unknown block sizes go as one row
+                uint32_t rowHeight = 1;
+                uint32_t numRows = image.nHeight;
+                uint32_t rowBytes = image.nSize / std::max(image.nHeight, 1u);
+                uint32_t blockWidth, blockHeight, blockBytes;
+                if (job.isCompressed)
+                {
+                    bool const known = GetBlockSize(job.internalFormat, blockWidth, blockHeight, blockBytes);
+                    if (known)
+                    {
+                        rowHeight = blockHeight;
+                        numRows = (image.nHeight + blockHeight - 1) / blockHeight;
+                        rowBytes = (image.nWidth + blockWidth - 1) / blockWidth * blockBytes;
+                    }
+                    if (!known || rowBytes * numRows != image.nSize)
+                    {
+                        rowHeight = image.nHeight;
+                        numRows = 1;
+                        rowBytes = image.nSize;
+                    }
+                }
+
+                uint32_t rowsFit = (mUploadBudget > totalBytes) ? (mUploadBudget - totalBytes) / rowBytes : 0;
+                if (rowsFit == 0)
+                {
+                    if (totalBytes > 0)
+                    {
+                        budgetSpent = true;
+                        break;
+                    }
+                    rowsFit = 1;
+                }
+                uint32_t const rows = std::min(numRows - job.nextRow, rowsFit);
+
+                Strip strip;
+                strip.pJob = &job;
+                strip.level = level;
+                strip.face = job.nextFace;
+                strip.y = job.nextRow * rowHeight;
+                strip.height = std::min(rows * rowHeight, image.nHeight - strip.y);
+                strip.pSrc = image.pData + job.nextRow * rowBytes;
+                strip.size = rows * rowBytes;
+                strip.offset = totalBytes;
+                strip.completesLevel = false;
+                totalBytes += strip.size;
+
+                job.nextRow += rows;
+                if (job.nextRow == numRows)
+                {
+                    job.nextRow = 0;
+                    if (++job.nextFace == job.numFaces)
+                    {
+                        job.nextFace = 0;
+                        job.residentLevel--;
+                        strip.completesLevel = true;
+                    }
+                }
+                mStrips.push_back(strip);
+            }
+        }
+
+        if (!mStrips.empty())
+        {
+            // Orphan last frame's storage so the copy never waits on the GPU
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mUnpackBuffer);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, totalBytes, nullptr, GL_STREAM_DRAW);
+            uint8_t* pMapped = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, totalBytes,
+                                                          GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (pMapped == nullptr)
+            {
+                LOGE("TextureStreamer::Update", "Could not map %u byte unpack buffer", totalBytes);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                return;
+            }
+            for (size_t i = 0; i < mStrips.size(); ++i)
+            {
+                memcpy(pMapped + mStrips[i].offset, mStrips[i].pSrc, mStrips[i].size);
+            }
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+            GLint previousUnpackAlignment = 4;
+            GLint previousTexture2D = 0;
+            GLint previousTextureCube = 0;
+            glGetIntegerv(GL_UNPACK_ALIGNMENT, &previousUnpackAlignment);
+            glGetIntegerv(GL_TEXTURE_BINDING_2D, &previousTexture2D);
+            glGetIntegerv(GL_TEXTURE_BINDING_CUBE_MAP, &previousTextureCube);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+            for (size_t i = 0; i < mStrips.size(); ++i)
+            {
+                Strip const& strip = mStrips[i];
+                Job const& job = *strip.pJob;
+                TKTXImage const& image = job.images[strip.level * job.numFaces + strip.face];
+                GLenum faceTarget = (job.target == GL_TEXTURE_CUBE_MAP) ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + strip.face : job.target;
+                void const* pOffset = (void const*)(uintptr_t)strip.offset;
+
+                glBindTexture(job.target, job.texture);
+                if (job.isCompressed)
+                {
+                    glCompressedTexSubImage2D(faceTarget, strip.level, 0, strip.y, image.nWidth, strip.height,
+                                              job.internalFormat, strip.size, pOffset);
+                }
+                else
+                {
+                    glTexSubImage2D(faceTarget, strip.level, 0, strip.y, image.nWidth, strip.height,
+                                    job.format, job.type, pOffset);
+                }
+                if (strip.completesLevel)
+                {
+                    glTexParameteri(job.target, GL_TEXTURE_BASE_LEVEL, strip.level);
+                }
+            }
+
+            glBindTexture(GL_TEXTURE_2D, previousTexture2D);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, previousTextureCube);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, previousUnpackAlignment);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            mBytesStreamed += totalBytes;
+        }
+
+        // Retire finished and failed jobs, releasing their source data
+        for (size_t i = 0; i < mActiveJobs.size();)
+        {
+            Job const& job = *mActiveJobs[i];
+            if (job.state == kFailed)
+            {
+                LOGE("TextureStreamer::Update", "Decoding texture %u failed, keeping level %u", job.texture, job.residentLevel);
+            }
+            if (job.state == kFailed || job.residentLevel == 0)
+            {
+                mActiveJobs.erase(mActiveJobs.begin() + i);
+            }
+            else
+            {
+                ++i;
+            }
+        }
+    }
+}
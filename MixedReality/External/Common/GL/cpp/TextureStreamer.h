@@ -0,0 +1,119 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <GLES3/gl32.h>
+#include "AssetView.h"
+#include "KtxLoader.h"
+#include "Ktx2Transcoder.h"
+
+namespace QtiGL
+{
+    // Loads KTX/KTX2 textures progressively.
+    //
+    // Request() allocates the texture's immutable storage right away but only
+    // uploads the mip tail (levels no larger than tailSize), so the texture can
+    // be sampled on the next frame.  Worker threads decode the finer levels,
+    // and Update() uploads them through a pixel unpack buffer, at most
+    // uploadBudgetBytes per frame, split into row strips where needed.
+    // GL_TEXTURE_BASE_LEVEL follows the finest resident level, so textures
+    // sharpen over a few frames instead of stalling startup.
+    //
+    // Request(), Cancel() and Update() must be called on the GL thread.
+    class TextureStreamer
+    {
+    public:
+        TextureStreamer();
+        ~TextureStreamer();
+
+        void Initialize(uint32_t const numWorkers, uint32_t const uploadBudgetBytes, uint32_t const tailSize = 64);
+        void Destroy();
+
+        // The view is kept alive until every level is resident. Returns 0 on failure.
+        GLuint Request(QtiIO::AssetView&& source, GLenum* pOutTarget = nullptr);
+        // Stops streaming into a texture (e.g. before deleting it)
+        void Cancel(GLuint const texture);
+
+        // Call once per frame
+        void Update();
+
+        bool IsIdle() const { return mActiveJobs.empty(); }
+        uint64_t GetBytesStreamed() const { return mBytesStreamed; }
+
+    private:
+        enum JobState
+        {
+            kDecoding = 0,
+            kDecoded,
+            kFailed,
+            kCancelled
+        };
+
+        struct Job
+        {
+            GLuint                  texture;
+            GLenum                  target;
+            QtiIO::AssetView        source;
+            bool                    isKtx2;
+            Ktx2Transcoder          transcoder;
+
+            // Level-major, numFaces images per level
+            std::vector<TKTXImage>  images;
+            uint32_t                numFaces;
+            bool                    isCompressed;
+            GLenum                  internalFormat;
+            GLenum                  format;
+            GLenum                  type;
+
+            // Finest resident level; the upload cursor is in the level above it
+            uint32_t                residentLevel;
+            uint32_t                nextFace;
+            uint32_t                nextRow;
+
+            std::atomic<int>        state;
+        };
+
+        struct Strip
+        {
+            Job*        pJob;
+            uint32_t    level;
+            uint32_t    face;
+            uint32_t    y;
+            uint32_t    height;
+            uint8_t const* pSrc;
+            uint32_t    size;
+            uint32_t    offset;
+            bool        completesLevel;
+        };
+
+        void WorkerMain();
+        void Decode(Job& job);
+        void UploadLevels(Job& job, uint32_t const firstLevel, uint32_t const endLevel);
+
+        uint32_t    mUploadBudget;
+        uint32_t    mTailSize;
+        uint32_t    mKtx2Targets;
+        GLuint      mUnpackBuffer;
+        uint64_t    mBytesStreamed;
+
+        std::vector<std::shared_ptr<Job>> mActiveJobs;
+        std::vector<Strip> mStrips;
+
+        std::vector<std::thread> mWorkers;
+        std::deque<std::shared_ptr<Job>> mDecodeQueue;
+        std::mutex mQueueMutex;
+        std::condition_variable mQueueCondition;
+        bool mStopping;
+    };
+}
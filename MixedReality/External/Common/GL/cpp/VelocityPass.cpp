@@ -0,0 +1,130 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <GLES3/gl32.h>
+
+#include "VelocityPass.h"
+#include "LogUtils.h"
+
+namespace QtiGL
+{
+    // Both clip positions are interpolated and divided per fragment, a per
+    // vertex NDC offset would be wrong across the triangle
+    static char const* gVelocityVertSrc =
+        "#version 320 es\n"
+        "layout(location = 0) in vec3 position;\n"
+        "uniform mat4 viewProjectionMatrix;\n"
+        "uniform mat4 modelMatrix;\n"
+        "uniform mat4 previousModelMatrix;\n"
+        "out vec4 currentPosition;\n"
+        "out vec4 previousPosition;\n"
+        "void main()\n"
+        "{\n"
+        "    currentPosition = viewProjectionMatrix * modelMatrix * vec4(position, 1.0);\n"
+        "    previousPosition = viewProjectionMatrix * previousModelMatrix * vec4(position, 1.0);\n"
+        "    gl_Position = currentPosition;\n"
+        "}\n";
+
+    static char const* gVelocityFragSrc =
+        "#version 320 es\n"
+        "precision highp float;\n"
+        "in vec4 currentPosition;\n"
+        "in vec4 previousPosition;\n"
+        "out vec4 outMotion;\n"
+        "void main()\n"
+        "{\n"
+        "    outMotion = vec4(currentPosition.xyz / currentPosition.w - previousPosition.xyz / previousPosition.w, 0.0);\n"
+        "}\n";
+
+    static glm::mat4 const gIdentity(1.0f);
+
+    VelocityPass::VelocityPass()
+        : mInitialized(false)
+        , mFrame(0)
+    {
+    }
+
+    bool VelocityPass::Initialize()
+    {
+        if (!mShader.Initialize(1, &gVelocityVertSrc, 1, &gVelocityFragSrc, "velocity_v", "velocity_f"))
+        {
+            LOGE("VelocityPass::Initialize", "Velocity shader failed");
+            return false;
+        }
+        mInitialized = true;
+        mFrame = 0;
+        mObjects.clear();
+        return true;
+    }
+
+    void VelocityPass::Destroy()
+    {
+        if (mInitialized)
+        {
+            mShader.Destroy();
+            mInitialized = false;
+        }
+        mObjects.clear();
+    }
+
+    void VelocityPass::BeginFrame()
+    {
+        mFrame++;
+        for (auto it = mObjects.begin(); it != mObjects.end();)
+        {
+            if (mFrame - it->second.lastFrame > VELOCITY_MAX_IDLE_FRAMES)
+            {
+                it = mObjects.erase(it);
+                continue;
+            }
+            it->second.previous = it->second.current;
+            ++it;
+        }
+    }
+
+    void VelocityPass::SetTransform(uint32_t const objectId, glm::mat4 const& model)
+    {
+        auto it = mObjects.find(objectId);
+        if (it == mObjects.end())
+        {
+            mObjects[objectId] = { model, model, mFrame };
+            return;
+        }
+        it->second.current = model;
+        it->second.lastFrame = mFrame;
+    }
+
+    glm::mat4 const& VelocityPass::GetTransform(uint32_t const objectId) const
+    {
+        auto it = mObjects.find(objectId);
+        return it != mObjects.end() ? it->second.current : gIdentity;
+    }
+
+    glm::mat4 const& VelocityPass::GetPreviousTransform(uint32_t const objectId) const
+    {
+        auto it = mObjects.find(objectId);
+        return it != mObjects.end() ? it->second.previous : gIdentity;
+    }
+
+    void VelocityPass::Bind(glm::mat4 const& viewProjection)
+    {
+        glm::mat4 matrix = viewProjection;
+        mShader.Bind();
+        mShader.SetUniformMat4("viewProjectionMatrix", matrix);
+    }
+
+    void VelocityPass::SetObject(uint32_t const objectId)
+    {
+        glm::mat4 current = GetTransform(objectId);
+        glm::mat4 previous = GetPreviousTransform(objectId);
+        mShader.SetUniformMat4("modelMatrix", current);
+        mShader.SetUniformMat4("previousModelMatrix", previous);
+    }
+
+    void VelocityPass::Unbind()
+    {
+        mShader.Unbind();
+    }
+}
@@ -0,0 +1,69 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <glm/glm.hpp>
+#include "Shader.h"
+
+// Objects not given a transform for this many rendered frames are forgotten
+#define VELOCITY_MAX_IDLE_FRAMES    60
+
+namespace QtiGL
+{
+    // Per pixel motion vectors for application spacewarp.
+    //
+    // Every rendered frame starts with BeginFrame(), after which each moving
+    // object reports its model matrix with SetTransform().  The matrix it had
+    // in the previous rendered frame is kept, so an object drawn with
+    // SetObject() writes the NDC offset from where it was to where it is:
+    // current minus previous, in xyz, into an RGBA16F target along with
+    // depth.  Objects seen for the first time have no motion.
+    //
+    // Both positions use the current view and projection.  Head motion is
+    // left out on purpose, the runtime reprojects that itself from the
+    // tracked poses; only motion relative to the app space belongs here.
+    //
+    // The caller binds the target, clears it (motion to 0, depth to 1) and
+    // sets up vertex attribute 0 with the positions; Bind() only switches
+    // the program.
+    class VelocityPass
+    {
+    public:
+        VelocityPass();
+
+        bool Initialize();
+        void Destroy();
+
+        // Call once per rendered frame (not per view), before SetTransform()
+        void BeginFrame();
+        void SetTransform(uint32_t const objectId, glm::mat4 const& model);
+        // Identity for objects without a transform
+        glm::mat4 const& GetTransform(uint32_t const objectId) const;
+        glm::mat4 const& GetPreviousTransform(uint32_t const objectId) const;
+
+        void Bind(glm::mat4 const& viewProjection);
+        // Loads the object's current and previous model matrices
+        void SetObject(uint32_t const objectId);
+        void Unbind();
+
+        uint32_t GetObjectCount() const { return (uint32_t)mObjects.size(); }
+
+    private:
+        struct Object
+        {
+            glm::mat4   current;
+            glm::mat4   previous;
+            uint32_t    lastFrame;
+        };
+
+        Shader                                  mShader;
+        bool                                    mInitialized;
+        uint32_t                                mFrame;
+        std::unordered_map<uint32_t, Object>    mObjects;
+    };
+}
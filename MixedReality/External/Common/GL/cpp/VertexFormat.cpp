@@ -0,0 +1,358 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include "Geometry.h"
+#include "Shader.h"
+#include "VertexFormat.h"
+
+namespace QtiGL
+{
+    static uint16_t FloatToHalf(float const value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+
+        uint32_t const sign = (bits >> 16) & 0x8000;
+        int32_t const exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+        uint32_t mantissa = bits & 0x7FFFFF;
+
+        if (((bits >> 23) & 0xFF) == 0xFF)
+        {
+            // Inf stays Inf, NaN stays NaN
+            return (uint16_t)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+        }
+        if (exponent >= 31)
+        {
+            return (uint16_t)(sign | 0x7C00);
+        }
+        if (exponent <= 0)
+        {
+            if (exponent < -10)
+            {
+                return (uint16_t)sign;
+            }
+            // Denormal, round to nearest even
+            mantissa |= 0x800000;
+            uint32_t const shift = (uint32_t)(14 - exponent);
+            uint32_t half = mantissa >> shift;
+            uint32_t const rest = mantissa & ((1u << shift) - 1);
+            uint32_t const halfway = 1u << (shift - 1);
+            if (rest > halfway || (rest == halfway && (half & 1)))
+            {
+                half++;
+            }
+            return (uint16_t)(sign | half);
+        }
+
+        uint32_t half = ((uint32_t)exponent << 10) | (mantissa >> 13);
+        uint32_t const rest = mantissa & 0x1FFF;
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        {
+            // May carry into the exponent, which rounds up to the next power of two (or Inf)
+            half++;
+        }
+        return (uint16_t)(sign | half);
+    }
+
+    static uint16_t ToUnorm16(float const value, float const offset, float const scale)
+    {
+        float const t = (scale > 0.0f) ? (value - offset) / scale : 0.0f;
+        float const clamped = fminf(fmaxf(t, 0.0f), 1.0f);
+        return (uint16_t)lroundf(clamped * 65535.0f);
+    }
+
+    static int32_t ToSnorm(float const value, int32_t const maxValue)
+    {
+        float const clamped = fminf(fmaxf(value, -1.0f), 1.0f);
+        return (int32_t)lroundf(clamped * (float)maxValue);
+    }
+
+    static uint32_t PackNormal1010102(float const* pNormal)
+    {
+        uint32_t const x = (uint32_t)ToSnorm(pNormal[0], 511) & 0x3FF;
+        uint32_t const y = (uint32_t)ToSnorm(pNormal[1], 511) & 0x3FF;
+        uint32_t const z = (uint32_t)ToSnorm(pNormal[2], 511) & 0x3FF;
+        return x | (y << 10) | (z << 20);
+    }
+
+    static void PackNormalOctahedral(float const* pNormal, int16_t* pOut)
+    {
+        float const l1 = fabsf(pNormal[0]) + fabsf(pNormal[1]) + fabsf(pNormal[2]);
+        float x = (l1 > 0.0f) ? pNormal[0] / l1 : 0.0f;
+        float y = (l1 > 0.0f) ? pNormal[1] / l1 : 0.0f;
+        if (pNormal[2] < 0.0f)
+        {
+            // Fold the lower hemisphere over the diagonals
+            float const fx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            float const fy = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = fx;
+            y = fy;
+        }
+        pOut[0] = (int16_t)ToSnorm(x, 32767);
+        pOut[1] = (int16_t)ToSnorm(y, 32767);
+    }
+
+    uint32_t VertexFormat::Sanitize(uint32_t const flags)
+    {
+        uint32_t result = flags & (kVertexPositionHalf | kVertexPositionUnorm16 |
+                                   kVertexNormal1010102 | kVertexNormalOctahedral | kVertexTexcoordUnorm16);
+        if (result & kVertexPositionUnorm16)
+            result &= ~kVertexPositionHalf;
+        if (result & kVertexNormalOctahedral)
+            result &= ~kVertexNormal1010102;
+        return result;
+    }
+
+    uint32_t VertexFormat::GetVertexSize(uint32_t const flags)
+    {
+        uint32_t const positionSize = (flags & (kVertexPositionHalf | kVertexPositionUnorm16)) ? 4 * sizeof(uint16_t) : 3 * sizeof(float);
+        uint32_t const normalSize = (flags & (kVertexNormal1010102 | kVertexNormalOctahedral)) ? sizeof(uint32_t) : 3 * sizeof(float);
+        uint32_t const texcoordSize = (flags & kVertexTexcoordUnorm16) ? 2 * sizeof(uint16_t) : 2 * sizeof(float);
+        return positionSize + normalSize + texcoordSize;
+    }
+
+    int32_t VertexFormat::GetAttributes(uint32_t const flags, ProgramAttribute* pAttribs)
+    {
+        int32_t const stride = (int32_t)GetVertexSize(flags);
+        int32_t offset = 0;
+
+        pAttribs[0].index = kPosition;
+        pAttribs[0].stride = stride;
+        pAttribs[0].offset = offset;
+        if (flags & kVertexPositionUnorm16)
+        {
+            pAttribs[0].size = 4;
+            pAttribs[0].type = GL_UNSIGNED_SHORT;
+            pAttribs[0].normalized = true;
+            offset += 4 * sizeof(uint16_t);
+        }
+        else if (flags & kVertexPositionHalf)
+        {
+            pAttribs[0].size = 4;
+            pAttribs[0].type = GL_HALF_FLOAT;
+            pAttribs[0].normalized = false;
+            offset += 4 * sizeof(uint16_t);
+        }
+        else
+        {
+            pAttribs[0].size = 3;
+            pAttribs[0].type = GL_FLOAT;
+            pAttribs[0].normalized = false;
+            offset += 3 * sizeof(float);
+        }
+
+        pAttribs[1].index = kNormal;
+        pAttribs[1].stride = stride;
+        pAttribs[1].offset = offset;
+        if (flags & kVertexNormalOctahedral)
+        {
+            pAttribs[1].size = 2;
+            pAttribs[1].type = GL_SHORT;
+            pAttribs[1].normalized = true;
+            offset += 2 * sizeof(int16_t);
+        }
+        else if (flags & kVertexNormal1010102)
+        {
+            pAttribs[1].size = 4;
+            pAttribs[1].type = GL_INT_2_10_10_10_REV;
+            pAttribs[1].normalized = true;
+            offset += sizeof(uint32_t);
+        }
+        else
+        {
+            pAttribs[1].size = 3;
+            pAttribs[1].type = GL_FLOAT;
+            pAttribs[1].normalized = false;
+            offset += 3 * sizeof(float);
+        }
+
+        pAttribs[2].index = kTexcoord0;
+        pAttribs[2].size = 2;
+        pAttribs[2].stride = stride;
+        pAttribs[2].offset = offset;
+        if (flags & kVertexTexcoordUnorm16)
+        {
+            pAttribs[2].type = GL_UNSIGNED_SHORT;
+            pAttribs[2].normalized = true;
+        }
+        else
+        {
+            pAttribs[2].type = GL_FLOAT;
+            pAttribs[2].normalized = false;
+        }
+
+        return 3;
+    }
+
+    void VertexFormat::Encode(uint32_t const flags, float const* pSrc, size_t const vertexCount,
+                              float const* pBoundsMin, float const* pBoundsMax,
+                              float const* pTexcoordMin, float const* pTexcoordMax, void* pDst)
+    {
+        VertexDecode const decode = GetDecode(flags, pBoundsMin, pBoundsMax, pTexcoordMin, pTexcoordMax);
+        uint8_t* pOut = static_cast<uint8_t*>(pDst);
+
+        for (size_t i = 0; i < vertexCount; i++, pSrc += 8)
+        {
+            float const* pPosition = pSrc;
+            float const* pNormal = pSrc + 3;
+            float const* pTexcoord = pSrc + 6;
+
+            if (flags & kVertexPositionUnorm16)
+            {
+                uint16_t const position[4] = { ToUnorm16(pPosition[0], decode.positionOffset[0], decode.positionScale[0]),
+                                               ToUnorm16(pPosition[1], decode.positionOffset[1], decode.positionScale[1]),
+                                               ToUnorm16(pPosition[2], decode.positionOffset[2], decode.positionScale[2]),
+                                               65535 };
+                memcpy(pOut, position, sizeof(position));
+                pOut += sizeof(position);
+            }
+            else if (flags & kVertexPositionHalf)
+            {
+                uint16_t const position[4] = { FloatToHalf(pPosition[0]), FloatToHalf(pPosition[1]),
+                                               FloatToHalf(pPosition[2]), FloatToHalf(1.0f) };
+                memcpy(pOut, position, sizeof(position));
+                pOut += sizeof(position);
+            }
+            else
+            {
+                memcpy(pOut, pPosition, 3 * sizeof(float));
+                pOut += 3 * sizeof(float);
+            }
+
+            if (flags & kVertexNormalOctahedral)
+            {
+                int16_t normal[2];
+                PackNormalOctahedral(pNormal, normal);
+                memcpy(pOut, normal, sizeof(normal));
+                pOut += sizeof(normal);
+            }
+            else if (flags & kVertexNormal1010102)
+            {
+                uint32_t const normal = PackNormal1010102(pNormal);
+                memcpy(pOut, &normal, sizeof(normal));
+                pOut += sizeof(normal);
+            }
+            else
+            {
+                memcpy(pOut, pNormal, 3 * sizeof(float));
+                pOut += 3 * sizeof(float);
+            }
+
+            if (flags & kVertexTexcoordUnorm16)
+            {
+                uint16_t const texcoord[2] = { ToUnorm16(pTexcoord[0], decode.texcoordOffset[0], decode.texcoordScale[0]),
+                                               ToUnorm16(pTexcoord[1], decode.texcoordOffset[1], decode.texcoordScale[1]) };
+                memcpy(pOut, texcoord, sizeof(texcoord));
+                pOut += sizeof(texcoord);
+            }
+            else
+            {
+                memcpy(pOut, pTexcoord, 2 * sizeof(float));
+                pOut += 2 * sizeof(float);
+            }
+        }
+    }
+
+    VertexDecode VertexFormat::GetDecode(uint32_t const flags, float const* pBoundsMin, float const* pBoundsMax,
+                                         float const* pTexcoordMin, float const* pTexcoordMax)
+    {
+        VertexDecode decode;
+        for (int32_t i = 0; i < 3; i++)
+        {
+            bool const scaled = (flags & kVertexPositionUnorm16) != 0;
+            decode.positionScale[i] = scaled ? pBoundsMax[i] - pBoundsMin[i] : 1.0f;
+            decode.positionOffset[i] = scaled ? pBoundsMin[i] : 0.0f;
+        }
+        for (int32_t i = 0; i < 2; i++)
+        {
+            bool const scaled = (flags & kVertexTexcoordUnorm16) != 0;
+            decode.texcoordScale[i] = scaled ? pTexcoordMax[i] - pTexcoordMin[i] : 1.0f;
+            decode.texcoordOffset[i] = scaled ? pTexcoordMin[i] : 0.0f;
+        }
+        return decode;
+    }
+
+    std::string VertexFormat::GetDecodeSource(uint32_t const flags)
+    {
+        char header[64];
+        snprintf(header, sizeof(header), "#define QXR_VERTEX_FORMAT %u\n", flags);
+        std::string source(header);
+
+        if (flags & kVertexPositionUnorm16)
+        {
+            source += "uniform highp vec3 qxrPositionScale;\n"
+                      "uniform highp vec3 qxrPositionOffset;\n"
+                      "vec3 DecodePosition(vec3 p) { return p * qxrPositionScale + qxrPositionOffset; }\n";
+        }
+        else
+        {
+            source += "vec3 DecodePosition(vec3 p) { return p; }\n";
+        }
+
+        if (flags & kVertexNormalOctahedral)
+        {
+            source += "vec3 DecodeNormal(vec3 e)\n"
+                      "{\n"
+                      "    vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));\n"
+                      "    float t = max(-n.z, 0.0);\n"
+                      "    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);\n"
+                      "    return normalize(n);\n"
+                      "}\n";
+        }
+        else if (flags & kVertexNormal1010102)
+        {
+            source += "vec3 DecodeNormal(vec3 n) { return normalize(n); }\n";
+        }
+        else
+        {
+            source += "vec3 DecodeNormal(vec3 n) { return n; }\n";
+        }
+
+        if (flags & kVertexTexcoordUnorm16)
+        {
+            source += "uniform highp vec4 qxrTexcoordScaleOffset;\n"
+                      "vec2 DecodeTexcoord(vec2 t) { return t * qxrTexcoordScaleOffset.xy + qxrTexcoordScaleOffset.zw; }\n";
+        }
+        else
+        {
+            source += "vec2 DecodeTexcoord(vec2 t) { return t; }\n";
+        }
+
+        return source;
+    }
+
+    size_t VertexFormat::GetVersionLineLength(char const* pSource, size_t const length)
+    {
+        static char const kVersion[] = "#version";
+        if (length < sizeof(kVersion) - 1 || strncmp(pSource, kVersion, sizeof(kVersion) - 1) != 0)
+        {
+            return 0;
+        }
+
+        char const* pNewLine = static_cast<char const*>(memchr(pSource, '\n', length));
+        return pNewLine ? (size_t)(pNewLine - pSource) + 1 : length;
+    }
+
+    void VertexFormat::SetDecodeUniforms(Shader& shader, uint32_t const flags, VertexDecode const& decode)
+    {
+        if (flags & kVertexPositionUnorm16)
+        {
+            glm::vec3 scale(decode.positionScale[0], decode.positionScale[1], decode.positionScale[2]);
+            glm::vec3 offset(decode.positionOffset[0], decode.positionOffset[1], decode.positionOffset[2]);
+            shader.SetUniformVec3("qxrPositionScale", scale);
+            shader.SetUniformVec3("qxrPositionOffset", offset);
+        }
+        if (flags & kVertexTexcoordUnorm16)
+        {
+            glm::vec4 scaleOffset(decode.texcoordScale[0], decode.texcoordScale[1],
+                                  decode.texcoordOffset[0], decode.texcoordOffset[1]);
+            shader.SetUniformVec4("qxrTexcoordScaleOffset", scaleOffset);
+        }
+    }
+}
@@ -0,0 +1,69 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace QtiGL
+{
+    struct ProgramAttribute;
+    class Shader;
+
+    // Quantization flags for the position/normal/texcoord vertex of OBJ meshes.
+    // At most one position and one normal flag may be set; 0 is the 32 byte
+    // all-float vertex.
+    enum VertexQuantization
+    {
+        kVertexFloat                = 0,
+        kVertexPositionHalf         = 1 << 0,   // 4 x GL_HALF_FLOAT
+        kVertexPositionUnorm16      = 1 << 1,   // 4 x normalized GL_UNSIGNED_SHORT over the shape bounds
+        kVertexNormal1010102        = 1 << 2,   // GL_INT_2_10_10_10_REV
+        kVertexNormalOctahedral     = 1 << 3,   // 2 x normalized GL_SHORT, octahedral encoding
+        kVertexTexcoordUnorm16      = 1 << 4,   // 2 x normalized GL_UNSIGNED_SHORT over the texcoord bounds
+        kVertexQuantizeAll          = kVertexPositionUnorm16 | kVertexNormalOctahedral | kVertexTexcoordUnorm16
+    };
+
+    // Per-mesh constants the generated decode functions need
+    struct VertexDecode
+    {
+        float   positionScale[3];
+        float   positionOffset[3];
+        float   texcoordScale[2];
+        float   texcoordOffset[2];
+    };
+
+    // Encodes interleaved float position/normal/texcoord vertices into one of
+    // the quantized layouts, and generates the matching GLSL decode.
+    //
+    // Vertex shaders declare their inputs as usual and read them through
+    // DecodePosition(), DecodeNormal() and DecodeTexcoord().  The functions
+    // come from GetDecodeSource(), which goes between the #version line and
+    // the rest of the shader, and are identities for float data.
+    class VertexFormat
+    {
+    public:
+        static uint32_t Sanitize(uint32_t const flags);
+        static uint32_t GetVertexSize(uint32_t const flags);
+        // Fills up to 3 attributes (position, normal, texcoord0); returns the count
+        static int32_t GetAttributes(uint32_t const flags, ProgramAttribute* pAttribs);
+
+        // pSrc holds vertexCount vertices of 8 floats (position, normal, texcoord).
+        // The bounds are those of the positions and texcoords being encoded.
+        static void Encode(uint32_t const flags, float const* pSrc, size_t const vertexCount,
+                           float const* pBoundsMin, float const* pBoundsMax,
+                           float const* pTexcoordMin, float const* pTexcoordMax, void* pDst);
+        static VertexDecode GetDecode(uint32_t const flags, float const* pBoundsMin, float const* pBoundsMax,
+                                      float const* pTexcoordMin, float const* pTexcoordMax);
+
+        static std::string GetDecodeSource(uint32_t const flags);
+        // Length of the #version line (including its newline), or 0 if the source does not start with one
+        static size_t GetVersionLineLength(char const* pSource, size_t const length);
+        // The shader must be bound
+        static void SetDecodeUniforms(Shader& shader, uint32_t const flags, VertexDecode const& decode);
+    };
+}
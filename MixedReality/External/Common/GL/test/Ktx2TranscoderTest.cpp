@@ -0,0 +1,156 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "Ktx2Transcoder.h"
+
+using namespace QtiGL;
+
+#define KTX2_VK_FORMAT_R8G8B8A8_UNORM   (37)
+#define KTX2_VK_FORMAT_ASTC_4x4_UNORM   (157)
+
+static int gFailures = 0;
+
+#define EXPECT(condition)                                                       \
+    do                                                                          \
+    {                                                                           \
+        if (!(condition))                                                       \
+        {                                                                       \
+            fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__, #condition); \
+            gFailures++;                                                        \
+        }                                                                       \
+    } while (0)
+
+// Builds an uncompressed KTX2 file in memory: header, level index, then the
+// levels (4 bytes per texel, each byte set to its level) back to back
+static std::vector<uint8> MakeKtx2(uint32 vkFormat, uint32 width, uint32 height, uint32 levelCount, uint32 layerCount = 0)
+{
+    uint32 const storedLevels = (levelCount > 0) ? levelCount : 1;
+
+    TKTX2Header header;
+    memset(&header, 0, sizeof(header));
+    uint8 const identifier[12] = KTX2_IDENTIFIER_REF;
+    memcpy(header.identifier, identifier, sizeof(identifier));
+    header.vkFormat = vkFormat;
+    header.typeSize = 1;
+    header.pixelWidth = width;
+    header.pixelHeight = height;
+    header.layerCount = layerCount;
+    header.faceCount = 1;
+    header.levelCount = levelCount;
+
+    std::vector<TKTX2LevelIndex> levels(storedLevels);
+    uint64 offset = KTX2_HEADER_SIZE + storedLevels * sizeof(TKTX2LevelIndex);
+    for (uint32 level = 0; level < storedLevels; level++)
+    {
+        uint32 const levelWidth = (width >> level) ? (width >> level) : 1;
+        uint32 const levelHeight = (height >> level) ? (height >> level) : 1;
+        levels[level].byteOffset = offset;
+        levels[level].byteLength = levelWidth * levelHeight * 4;
+        levels[level].uncompressedByteLength = levels[level].byteLength;
+        offset += levels[level].byteLength;
+    }
+
+    std::vector<uint8> file(offset);
+    memcpy(&file[0], &header, sizeof(header));
+    memcpy(&file[KTX2_HEADER_SIZE], &levels[0], storedLevels * sizeof(TKTX2LevelIndex));
+    for (uint32 level = 0; level < storedLevels; level++)
+    {
+        memset(&file[levels[level].byteOffset], (int)level, levels[level].byteLength);
+    }
+    return file;
+}
+
+static void TestRawLevels()
+{
+    std::vector<uint8> file = MakeKtx2(KTX2_VK_FORMAT_R8G8B8A8_UNORM, 8, 4, 4);
+    Ktx2Transcoder transcoder;
+    EXPECT(Ktx2Transcoder::IsKtx2(&file[0], (uint32)file.size()));
+    EXPECT(transcoder.Transcode(&file[0], (uint32)file.size(), KTX2_TARGET_RGBA8, 2) == KTX_SUCCESS);
+    EXPECT(transcoder.GetWidth() == 8);
+    EXPECT(transcoder.GetHeight() == 4);
+    EXPECT(transcoder.GetNumLevels() == 4);
+    EXPECT(transcoder.GetNumFaces() == 1);
+    EXPECT(!transcoder.NeedsMipGeneration());
+    EXPECT(!transcoder.IsCompressed());
+    EXPECT(transcoder.GetInternalFormat() == GL_RGBA8);
+
+    // Level 3 of an 8x4 texture is 1x1
+    TKTXImage const& last = transcoder.GetImage(3, 0);
+    EXPECT(last.nWidth == 1 && last.nHeight == 1 && last.nSize == 4);
+    EXPECT(last.pData != NULL && last.pData[0] == 3);
+}
+
+static void TestLevelRange()
+{
+    std::vector<uint8> file = MakeKtx2(KTX2_VK_FORMAT_R8G8B8A8_UNORM, 8, 8, 4);
+    Ktx2Transcoder transcoder;
+    EXPECT(transcoder.Transcode(&file[0], (uint32)file.size(), KTX2_TARGET_RGBA8, 1, 2, 0) == KTX_SUCCESS);
+    EXPECT(transcoder.GetImage(0, 0).pData == NULL);
+    EXPECT(transcoder.GetImage(1, 0).pData == NULL);
+    EXPECT(transcoder.GetImage(2, 0).nWidth == 2);
+    EXPECT(transcoder.GetImage(2, 0).pData[0] == 2);
+}
+
+static void TestRuntimeMips()
+{
+    // Level count 0 stores the base level only
+    std::vector<uint8> file = MakeKtx2(KTX2_VK_FORMAT_R8G8B8A8_UNORM, 16, 16, 0);
+    Ktx2Transcoder transcoder;
+    EXPECT(transcoder.Transcode(&file[0], (uint32)file.size(), KTX2_TARGET_ASTC | KTX2_TARGET_RGBA8) == KTX_SUCCESS);
+    EXPECT(transcoder.NeedsMipGeneration());
+    EXPECT(transcoder.GetNumLevels() == 1);
+    EXPECT(transcoder.GetImage(0, 0).nSize == 16 * 16 * 4);
+
+    // Compressed payloads can't be rendered to, so their mips can't be generated
+    std::vector<uint8> astc = MakeKtx2(KTX2_VK_FORMAT_ASTC_4x4_UNORM, 16, 16, 0);
+    EXPECT(transcoder.Transcode(&astc[0], (uint32)astc.size(), KTX2_TARGET_ASTC | KTX2_TARGET_RGBA8) == KTX_UNSUPPORTED_TEXTURE_TYPE);
+    EXPECT(transcoder.Transcode(&file[0], (uint32)file.size(), KTX2_TARGET_ASTC) == KTX_UNSUPPORTED_TEXTURE_TYPE);
+}
+
+static void TestRejected()
+{
+    std::vector<uint8> file = MakeKtx2(KTX2_VK_FORMAT_R8G8B8A8_UNORM, 4, 4, 1);
+    Ktx2Transcoder transcoder;
+
+    std::vector<uint8> badIdentifier = file;
+    badIdentifier[5] = '1';
+    EXPECT(!Ktx2Transcoder::IsKtx2(&badIdentifier[0], (uint32)badIdentifier.size()));
+    EXPECT(transcoder.Transcode(&badIdentifier[0], (uint32)badIdentifier.size(), KTX2_TARGET_RGBA8) == KTX_HEADER_ERROR);
+
+    EXPECT(transcoder.Transcode(&file[0], KTX2_HEADER_SIZE + 8, KTX2_TARGET_RGBA8) == KTX_UNEXPECTED_END_OF_STREAM);
+    EXPECT(transcoder.Transcode(&file[0], (uint32)file.size() - 1, KTX2_TARGET_RGBA8) == KTX_UNEXPECTED_END_OF_STREAM);
+
+    std::vector<uint8> array = MakeKtx2(KTX2_VK_FORMAT_R8G8B8A8_UNORM, 4, 4, 1, 2);
+    EXPECT(transcoder.Transcode(&array[0], (uint32)array.size(), KTX2_TARGET_RGBA8) == KTX_UNSUPPORTED_TEXTURE_TYPE);
+
+    std::vector<uint8> faces = file;
+    uint32 const faceCount = 3;
+    memcpy(&faces[offsetof(TKTX2Header, faceCount)], &faceCount, sizeof(faceCount));
+    EXPECT(transcoder.Transcode(&faces[0], (uint32)faces.size(), KTX2_TARGET_RGBA8) == KTX_INVALID_VALUE);
+
+    // Pass-through formats the device can't sample
+    std::vector<uint8> astc = MakeKtx2(KTX2_VK_FORMAT_ASTC_4x4_UNORM, 4, 4, 1);
+    EXPECT(transcoder.Transcode(&astc[0], (uint32)astc.size(), KTX2_TARGET_ETC2 | KTX2_TARGET_RGBA8) == KTX_UNSUPPORTED_TEXTURE_TYPE);
+}
+
+int main()
+{
+    TestRawLevels();
+    TestLevelRange();
+    TestRuntimeMips();
+    TestRejected();
+
+    if (gFailures > 0)
+    {
+        fprintf(stderr, "Ktx2TranscoderTest: %d failures\n", gFailures);
+        return 1;
+    }
+    printf("Ktx2TranscoderTest: passed\n");
+    return 0;
+}
@@ -0,0 +1,138 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <cstdio>
+#include <cstring>
+#include "OcclusionCuller.h"
+
+using namespace QtiGL;
+
+static int gFailures = 0;
+
+#define EXPECT(condition)                                                       \
+    do                                                                          \
+    {                                                                           \
+        if (!(condition))                                                       \
+        {                                                                       \
+            fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__, #condition); \
+            gFailures++;                                                        \
+        }                                                                       \
+    } while (0)
+
+// Column major GL projection with a 90 degree vertical fov, looking down -z
+static void MakeProjection(float aspect, float nearZ, float farZ, float* m)
+{
+    memset(m, 0, 16 * sizeof(float));
+    m[0] = 1.0f / aspect;
+    m[5] = 1.0f;
+    m[10] = (farZ + nearZ) / (nearZ - farZ);
+    m[11] = -1.0f;
+    m[14] = 2.0f * farZ * nearZ / (nearZ - farZ);
+}
+
+static void TestIsVisible(uint32_t numThreads)
+{
+    OcclusionCuller culler;
+    culler.Initialize(OCCLUSION_DEFAULT_WIDTH, OCCLUSION_DEFAULT_HEIGHT, numThreads);
+
+    float mvp[16];
+    MakeProjection((float)culler.GetWidth() / culler.GetHeight(), 0.1f, 100.0f, mvp);
+
+    // A wall one meter away, far wider than the view
+    float const wall[] = { -10.0f, -10.0f, -1.0f,   10.0f, -10.0f, -1.0f,   10.0f, 10.0f, -1.0f,   -10.0f, 10.0f, -1.0f };
+    uint32_t const indices[] = { 0, 1, 2, 0, 2, 3 };
+
+    culler.BeginFrame();
+    culler.AddOccluder(wall, 3 * sizeof(float), indices, 6, mvp);
+    culler.Rasterize();
+    EXPECT(culler.GetStats().occluderTriangles == 2);
+
+    // Behind the wall
+    float const behindMin[3] = { -0.2f, -0.2f, -3.0f };
+    float const behindMax[3] = { 0.2f, 0.2f, -2.0f };
+    EXPECT(!culler.IsVisible(behindMin, behindMax, mvp));
+
+    // In front of it
+    float const frontMin[3] = { -0.2f, -0.2f, -0.8f };
+    float const frontMax[3] = { 0.2f, 0.2f, -0.6f };
+    EXPECT(culler.IsVisible(frontMin, frontMax, mvp));
+
+    // Poking through it
+    float const throughMin[3] = { -0.2f, -0.2f, -2.0f };
+    float const throughMax[3] = { 0.2f, 0.2f, -0.9f };
+    EXPECT(culler.IsVisible(throughMin, throughMax, mvp));
+
+    // Crossing the near plane always counts as visible
+    float const nearMin[3] = { -0.2f, -0.2f, -3.0f };
+    float const nearMax[3] = { 0.2f, 0.2f, 1.0f };
+    EXPECT(culler.IsVisible(nearMin, nearMax, mvp));
+
+    // Entirely off-screen
+    float const offMin[3] = { 50.0f, -0.2f, -3.0f };
+    float const offMax[3] = { 51.0f, 0.2f, -2.0f };
+    EXPECT(!culler.IsVisible(offMin, offMax, mvp));
+
+    EXPECT(culler.GetStats().tested == 5);
+    EXPECT(culler.GetStats().occluded == 1);
+
+    // Nothing occludes once the next frame has no occluders
+    culler.BeginFrame();
+    culler.Rasterize();
+    EXPECT(culler.IsVisible(behindMin, behindMax, mvp));
+
+    culler.Destroy();
+}
+
+// Occluders don't hide their own bounds, so every object can be one
+static void TestSelfOcclusion()
+{
+    OcclusionCuller culler;
+    culler.Initialize(OCCLUSION_DEFAULT_WIDTH, OCCLUSION_DEFAULT_HEIGHT, 2);
+
+    float mvp[16];
+    MakeProjection((float)culler.GetWidth() / culler.GetHeight(), 0.1f, 100.0f, mvp);
+
+    float const boxMin[3] = { -0.3f, -0.2f, -2.5f };
+    float const boxMax[3] = { 0.1f, 0.2f, -2.0f };
+    float corners[8][3];
+    for (int corner = 0; corner < 8; corner++)
+    {
+        corners[corner][0] = (corner & 1) ? boxMax[0] : boxMin[0];
+        corners[corner][1] = (corner & 2) ? boxMax[1] : boxMin[1];
+        corners[corner][2] = (corner & 4) ? boxMax[2] : boxMin[2];
+    }
+    // Counter-clockwise seen from outside
+    uint32_t const indices[] =
+    {
+        0, 2, 3, 0, 3, 1,   4, 5, 7, 4, 7, 6,   0, 4, 6, 0, 6, 2,
+        1, 3, 7, 1, 7, 5,   0, 1, 5, 0, 5, 4,   2, 6, 7, 2, 7, 3,
+    };
+
+    culler.BeginFrame();
+    culler.AddOccluder(corners, 3 * sizeof(float), indices, 36, mvp);
+    culler.Rasterize();
+    EXPECT(culler.GetStats().occluderTriangles > 0);
+    EXPECT(culler.IsVisible(boxMin, boxMax, mvp));
+
+    // but they do hide what's behind them
+    float const hiddenMin[3] = { -0.15f, -0.05f, -4.0f };
+    float const hiddenMax[3] = { -0.05f, 0.05f, -3.5f };
+    EXPECT(!culler.IsVisible(hiddenMin, hiddenMax, mvp));
+}
+
+int main()
+{
+    TestIsVisible(1);
+    TestIsVisible(4);
+    TestSelfOcclusion();
+
+    if (gFailures > 0)
+    {
+        fprintf(stderr, "OcclusionCullerTest: %d failures\n", gFailures);
+        return 1;
+    }
+    printf("OcclusionCullerTest: passed\n");
+    return 0;
+}
@@ -0,0 +1,53 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <unistd.h>
+
+#include "LogUtils.h"
+#include "AssetSource.h"
+
+namespace QtiIO
+{
+    AssetSource::AssetSource()
+        : mpAssetManager(nullptr)
+    {
+    }
+
+    void AssetSource::Initialize(AAssetManager* pAssetManager, char const* pAssetDir, char const* pOverrideDir,
+                                 char const* pCacheDir)
+    {
+        mpAssetManager = pAssetManager;
+        mAssetDir = pAssetDir ? pAssetDir : "";
+        mOverrideDir = pOverrideDir ? pOverrideDir : "";
+        mCacheDir = pCacheDir ? pCacheDir : "";
+    }
+
+    bool AssetSource::Open(char const* pName, AssetView* pOutView) const
+    {
+        if (!mOverrideDir.empty())
+        {
+            std::string overridePath = mOverrideDir + "/" + pName;
+            if (access(overridePath.c_str(), R_OK) == 0 && pOutView->OpenFile(overridePath.c_str()))
+            {
+                LOGI("AssetSource::Open", "Using override %s", overridePath.c_str());
+                return true;
+            }
+        }
+
+        std::string assetName = mAssetDir.empty() ? std::string(pName) : mAssetDir + "/" + pName;
+        if (pOutView->OpenAsset(mpAssetManager, assetName.c_str()))
+        {
+            return true;
+        }
+
+        LOGE("AssetSource::Open", "Asset %s not found", pName);
+        return false;
+    }
+
+    std::string AssetSource::GetDebugPath(char const* pName) const
+    {
+        return "apk:" + (mAssetDir.empty() ? std::string(pName) : mAssetDir + "/" + pName);
+    }
+}
@@ -0,0 +1,48 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#pragma once
+
+#include <string>
+#include "AssetView.h"
+
+struct AAssetManager;
+
+namespace QtiIO
+{
+    // Resolves asset names to AssetViews.
+    //
+    // Assets are read directly out of the APK through the AAssetManager (they
+    // are packaged uncompressed, so the views point into the mapped APK).  An
+    // optional override directory is checked first, which lets a developer
+    // push a modified file to e.g. the app's external files dir without
+    // rebuilding the APK.  Derived data (e.g. parsed mesh caches) goes to the
+    // separate cache directory, never to the override directory, which is
+    // only ever read from as an asset source.
+    class AssetSource
+    {
+    public:
+        AssetSource();
+
+        void Initialize(AAssetManager* pAssetManager, char const* pAssetDir, char const* pOverrideDir = nullptr,
+                        char const* pCacheDir = nullptr);
+
+        bool Open(char const* pName, AssetView* pOutView) const;
+
+        // Human readable location of an asset, for log messages
+        std::string GetDebugPath(char const* pName) const;
+
+        // Directory checked for asset overrides before the APK, empty if there is none
+        std::string const& GetOverrideDir() const { return mOverrideDir; }
+        // Directory to write derived data (caches) to, empty if there is none
+        std::string const& GetCacheDir() const { return mCacheDir; }
+
+    private:
+        AAssetManager*  mpAssetManager;
+        std::string     mAssetDir;
+        std::string     mOverrideDir;
+        std::string     mCacheDir;
+    };
+}
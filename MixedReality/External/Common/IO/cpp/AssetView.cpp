@@ -0,0 +1,176 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef ANDROID
+#include <android/asset_manager.h>
+#endif
+
+#include "LogUtils.h"
+#include "AssetView.h"
+
+namespace QtiIO
+{
+    AssetView::AssetView()
+        : mpData(nullptr)
+        , mSize(0)
+        , mpMapBase(nullptr)
+        , mMapSize(0)
+        , mpAsset(nullptr)
+    {
+    }
+
+    AssetView::~AssetView()
+    {
+        Close();
+    }
+
+    AssetView::AssetView(AssetView&& other)
+        : mpData(other.mpData)
+        , mSize(other.mSize)
+        , mpMapBase(other.mpMapBase)
+        , mMapSize(other.mMapSize)
+        , mpAsset(other.mpAsset)
+    {
+        other.Reset();
+    }
+
+    AssetView& AssetView::operator=(AssetView&& other)
+    {
+        if (this != &other)
+        {
+            Close();
+            mpData = other.mpData;
+            mSize = other.mSize;
+            mpMapBase = other.mpMapBase;
+            mMapSize = other.mMapSize;
+            mpAsset = other.mpAsset;
+            other.Reset();
+        }
+        return *this;
+    }
+
+    void AssetView::Reset()
+    {
+        mpData = nullptr;
+        mSize = 0;
+        mpMapBase = nullptr;
+        mMapSize = 0;
+        mpAsset = nullptr;
+    }
+
+    bool AssetView::OpenFile(char const* pFilePath)
+    {
+        Close();
+
+        int fd = open(pFilePath, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            LOGD("AssetView::OpenFile", "Could not open %s", pFilePath);
+            return false;
+        }
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0)
+        {
+            LOGE("AssetView::OpenFile", "%s is empty or could not be stat'ed", pFilePath);
+            close(fd);
+            return false;
+        }
+
+        size_t const size = (size_t)fileStat.st_size;
+        void* pMap = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // The mapping holds its own reference to the file
+        close(fd);
+
+        if (pMap == MAP_FAILED)
+        {
+            LOGE("AssetView::OpenFile", "mmap of %s (%zu bytes) failed", pFilePath, size);
+            return false;
+        }
+
+        // Loaders walk assets front to back exactly once.  The advice values are
+        // not flags, each one takes its own call; failing is harmless, just slower
+        if (madvise(pMap, size, MADV_SEQUENTIAL) != 0)
+        {
+            LOGW("AssetView::OpenFile", "madvise(MADV_SEQUENTIAL) on %s failed: %s", pFilePath, strerror(errno));
+        }
+        if (madvise(pMap, size, MADV_WILLNEED) != 0)
+        {
+            LOGW("AssetView::OpenFile", "madvise(MADV_WILLNEED) on %s failed: %s", pFilePath, strerror(errno));
+        }
+
+        mpMapBase = pMap;
+        mMapSize = size;
+        mpData = static_cast<uint8_t const*>(pMap);
+        mSize = size;
+
+        LOGI("AssetView::OpenFile", "Mapped %s (%zu bytes)", pFilePath, mSize);
+        return true;
+    }
+
+    bool AssetView::OpenAsset(AAssetManager* pAssetManager, char const* pAssetName)
+    {
+        Close();
+
+#ifdef ANDROID
+        if (pAssetManager == nullptr)
+        {
+            return false;
+        }
+
+        AAsset* pAsset = AAssetManager_open(pAssetManager, pAssetName, AASSET_MODE_BUFFER);
+        if (pAsset == nullptr)
+        {
+            LOGD("AssetView::OpenAsset", "Could not open asset %s", pAssetName);
+            return false;
+        }
+
+        // For assets stored uncompressed this is a pointer into the mmap()ed APK.
+        // Compressed assets get inflated once by the framework.
+        void const* pBuffer = AAsset_getBuffer(pAsset);
+        off64_t const length = AAsset_getLength64(pAsset);
+        if (pBuffer == nullptr || length <= 0)
+        {
+            LOGE("AssetView::OpenAsset", "Could not get buffer for asset %s", pAssetName);
+            AAsset_close(pAsset);
+            return false;
+        }
+
+        mpAsset = pAsset;
+        mpData = static_cast<uint8_t const*>(pBuffer);
+        mSize = (size_t)length;
+
+        LOGI("AssetView::OpenAsset", "Opened asset %s (%zu bytes, %s)", pAssetName, mSize,
+             AAsset_isAllocated(pAsset) ? "inflated" : "mapped");
+        return true;
+#else
+        (void)pAssetManager;
+        (void)pAssetName;
+        return false;
+#endif
+    }
+
+    void AssetView::Close()
+    {
+        if (mpMapBase != nullptr)
+        {
+            munmap(mpMapBase, mMapSize);
+        }
+#ifdef ANDROID
+        if (mpAsset != nullptr)
+        {
+            AAsset_close(mpAsset);
+        }
+#endif
+        Reset();
+    }
+}
@@ -0,0 +1,66 @@
+/****************************************************************
+ * Copyright (c) 2020-2022 Qualcomm Technologies, Inc.
+ * All Rights Reserved.
+ * Confidential and Proprietary - Qualcomm Technologies, Inc.
+ ****************************************************************/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <streambuf>
+
+struct AAssetManager;
+struct AAsset;
+
+namespace QtiIO
+{
+    // Read-only view of the bytes of one asset.
+    //
+    // Files on disk are mmap()ed and APK-resident assets are exposed through
+    // AAsset_getBuffer(), so the bytes are never copied into a user-space
+    // buffer.  The mapping (or the AAsset) is released when the view is
+    // closed or destroyed.  Views are movable but not copyable.
+    class AssetView
+    {
+    public:
+        AssetView();
+        ~AssetView();
+
+        AssetView(AssetView&& other);
+        AssetView& operator=(AssetView&& other);
+
+        AssetView(AssetView const&) = delete;
+        AssetView& operator=(AssetView const&) = delete;
+
+        bool OpenFile(char const* pFilePath);
+        bool OpenAsset(AAssetManager* pAssetManager, char const* pAssetName);
+        void Close();
+
+        bool IsValid() const { return mpData != nullptr; }
+
+        uint8_t const* GetData() const { return mpData; }
+        char const* GetChars() const { return reinterpret_cast<char const*>(mpData); }
+        size_t GetSize() const { return mSize; }
+
+    private:
+        void Reset();
+
+        uint8_t const*  mpData;
+        size_t          mSize;
+        void*           mpMapBase;
+        size_t          mMapSize;
+        AAsset*         mpAsset;
+    };
+
+    // Input-only streambuf over a const span, so istream based parsers
+    // (tinyobj) read mapped bytes in place.
+    class SpanStreamBuf : public std::streambuf
+    {
+    public:
+        SpanStreamBuf(void const* pData, size_t size)
+        {
+            char* pBegin = const_cast<char*>(static_cast<char const*>(pData));
+            setg(pBegin, pBegin, pBegin + size);
+        }
+    };
+}
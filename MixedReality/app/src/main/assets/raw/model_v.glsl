@@ -13,15 +13,19 @@ out vec3 vWorldNormal;
 
 void main()
 {
-    gl_Position = projectionMatrix * (viewMatrix * (modelMatrix * vec4(position, 1.0)));
-    vWorldPos = (modelMatrix * vec4(position.xyz, 1.0)).xyz;
+    // DecodePosition/DecodeNormal are generated for the mesh's vertex format
+    vec3 objPosition = DecodePosition(position);
+    vec3 objNormal = DecodeNormal(normal);
+
+    gl_Position = projectionMatrix * (viewMatrix * (modelMatrix * vec4(objPosition, 1.0)));
+    vWorldPos = (modelMatrix * vec4(objPosition, 1.0)).xyz;
     // Only rotate the rest of these!
-    vWorldNormal = (modelMatrix * vec4(normal.xyz, 0.0)).xyz;
+    vWorldNormal = (modelMatrix * vec4(objNormal, 0.0)).xyz;
 
    /* gl_Position = projectionMatrix * (viewMatrix * (  vec4(position, 1.0)));
     vWorldPos = (  vec4(position.xyz, 1.0)).xyz;
     // Only rotate the rest of these!
     vWorldNormal = ( vec4(normal.xyz, 0.0)).xyz;*/
 
-//    vTexcoord0 = texcoord0;
+//    vTexcoord0 = DecodeTexcoord(texcoord0);
 }
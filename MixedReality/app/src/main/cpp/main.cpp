@@ -4,9 +4,9 @@
  * Confidential and Proprietary - Qualcomm Technologies, Inc.
  ****************************************************************/
 
-#include <fstream>
-#include <sstream>
 #include <string>
+#include <string.h>
+#include <time.h>
 #include <unordered_map>
 #include <vector>
 
@@ -30,9 +30,24 @@
 #include <glm/gtx/transform.hpp>
 
 #include "AppCommon.h"
+#include "AssetSource.h"
+#include "AssetView.h"
+#include "DynamicBuffer.h"
+#include "Foveation.h"
 #include "Geometry.h"
 #include "KtxLoader.h"
+#include "LayerManager.h"
+#include "OcclusionCuller.h"
+#include "PerfGovernor.h"
+#include "VisibilityMask.h"
+#include "RenderPass.h"
+#include "RenderQueue.h"
+#include "RenderTarget.h"
 #include "Shader.h"
+#include "SpaceWarp.h"
+#include "TextureStreamer.h"
+#include "VelocityPass.h"
+#include "VertexFormat.h"
 
 //#include <GLES3/gl32.h>
 #include <GLES3/gl32.h>
@@ -55,8 +70,66 @@
 
 #define EGL_SAMPLE_COUNT 4
 #define CUBE_COUNT 3 
+// texture streaming: decode threads and bytes uploaded per frame
+#define TEXTURE_STREAM_WORKERS 2
+#define TEXTURE_STREAM_BUDGET_BYTES (1024 * 1024)
+// per-frame boundary line / floor point vertices, both eyes
+#define LINE_STREAM_REGION_BYTES (64 * 1024)
+// frames between logs of the render pass write-back savings, 0 to disable
+#define RENDER_PASS_STATS_INTERVAL 600
+// submit depth with XR_KHR_composition_layer_depth when the runtime takes it
+#define DEPTH_SUBMISSION_ENABLED 1
+// eye projection clip planes, also reported with submitted depth
+#define EYE_NEAR_Z 0.05f
+#define EYE_FAR_Z 100.0f
+// floor star quad layer: size in meters and resolution
+#define FLOOR_LAYER_SIZE 8.0f
+#define FLOOR_LAYER_PIXELS 1024
+// star_g.glsl emits +-0.1 clip space crosses, scaling w shrinks them to
+// +-0.1 * FLOOR_LAYER_SIZE / 2 / FLOOR_LAYER_CROSS_SCALE meters
+#define FLOOR_LAYER_CROSS_SCALE 4.0f
+// equirect background panorama, used when the asset is present. Its widest
+// level is capped by device tier, derived from the eye buffer size unless
+// debug.mixedreality.backgroundTier is set to low, mid or high
+#define BACKGROUND_ASSET "panorama.ktx"
+#define BACKGROUND_WIDTH_LOW 2048
+#define BACKGROUND_WIDTH_MID 4096
+#define BACKGROUND_WIDTH_HIGH 8192
+// fixed foveation level (off, low, medium or high), debug.mixedreality.foveation
+// overrides it and is re-read every FOVEATION_POLL_INTERVAL frames
+#define FOVEATION_DEFAULT_LEVEL "medium"
+#define FOVEATION_POLL_INTERVAL 90
+// eye buffer clear color, transparent so underlay layers show through
+#define EYE_CLEAR_COLOR 0.1f, 0.1f, 0.1f, 0.0f
+// ask for quad views (wide context views plus high resolution insets where
+// the eyes look) when the runtime has XR_VARJO_quad_views
+#define QUAD_VIEWS_ENABLED 1
+// each view's image is its recommended size divided by this
+#define VIEW_RESOLUTION_DIVISOR 4
+// submit motion vectors and depth through XR_FB_space_warp when the runtime
+// has it, so it can run the app at half rate; off by default, set to 1 and
+// debug.mixedreality.spaceWarp to true to turn it on
+#define SPACE_WARP_ENABLED 0
+
+// objects whose transforms the velocity pass tracks, also their index in
+// engine::cubeMatrices
+enum {
+    SCENE_OBJECT_RINGS = 0,
+    SCENE_OBJECT_CUBE,
+    SCENE_OBJECT_COUNT = SCENE_OBJECT_CUBE + CUBE_COUNT
+};
+// cubes in a row in front of the start pose: edge length and spacing in
+// meters, distance along -z
+#define CUBE_SIZE 0.2f
+#define CUBE_SPACING 0.5f
+#define CUBE_DISTANCE 2.0f
+// rasterize the cubes on the cpu as occluders every view and skip the ones
+// hidden behind the others
+#define OCCLUSION_CULLING_ENABLED 1
 
 static int engine_init_xr_swapchains(struct engine *engine);
+static QtiGL::Shader *engine_get_model_shader(struct engine *engine,
+                                              uint32_t vertexFormat);
 
 glm::vec3 CUBE_COLORS[CUBE_COUNT] = {{0.16f, 0.32f, 0.85f},
                                      {1.0f, 0.8f, 0.5f},
@@ -102,8 +175,11 @@ void CheckGlError(const char *file, int line)
     CheckGlError(__FILE__, __LINE__)
 
 struct Swapchain : public AppCommon::Swapchain {
-    std::vector<GLuint> fbos;
-    std::vector<GLuint> dbos;
+    // image size of this view; quad view insets differ from the context views
+    uint32_t width;
+    uint32_t height;
+    // implicit resolve targets over the swapchain images, msaa depth stays on tile
+    std::vector<QtiGL::RenderTarget> targets;
 };
 
 struct StereoSwapchain {
@@ -114,19 +190,26 @@ struct StereoSwapchain {
  * Shared state for our app.
  */
 struct engine : public AppCommon::base_engine {
-    // render target width
+    // render target width of view 0, every view has its own in Swapchain
     uint32_t width;
 
-    // render target height
+    // render target height of view 0
     uint32_t height;
 
     // <sample count, stereo swapchain>
     std::unordered_map<uint32_t, StereoSwapchain> swapchainMap;
 
-    // cube geometry
+    // cube geometry, and the vertices and indices it was built from for the
+    // occlusion culler
     QtiGL::Geometry cube;
+    std::vector<float> cubeVertices;
+    std::vector<uint32_t> cubeIndices;
+
+    // model program per vertex format in use (VertexFormat flags), each
+    // with its own decode functions; see engine_get_model_shader()
+    std::unordered_map<uint32_t, QtiGL::Shader *> modelShaders;
 
-    // cube shader
+    // cube shader, the float vertex format one of modelShaders
     QtiGL::Shader *cubeShader;
     QtiGL::Shader *starShader;
 
@@ -139,19 +222,88 @@ struct engine : public AppCommon::base_engine {
     // cube colors
     std::vector<glm::vec3> cubeColors;
 
+    // level each cube was drawn with last frame, Geometry::SelectLod() only
+    // moves away from it past the hysteresis
+    std::vector<uint32_t> cubeLods;
+
+    // cubes left after occlusion culling for the view being drawn
+    QtiGL::OcclusionCuller occlusionCuller;
+    std::vector<bool> cubeVisible;
+
+    // sorts the cube draws by program, texture and depth
+    QtiGL::RenderQueue renderQueue;
+
     // max sample count
     GLint maxSampleCount;
 
     // current sample count
     GLint currentSampleCount;
 
+    // assets, read in place from the APK (or an override dir)
+    QtiIO::AssetSource assets;
+
+    // uploads texture mips progressively, a bounded amount per frame
+    QtiGL::TextureStreamer textureStreamer;
+
+    // streams the boundary lines and floor points rebuilt every frame
+    QtiGL::DynamicBuffer lineBuffer;
+
+    // eye pass: clear everything up front, keep only the resolved color
+    // (and the resolved depth when it's submitted)
+    QtiGL::RenderPass eyePass;
+    uint32_t frameIndex;
+
+    // QCOM texture foveation, or a low resolution periphery pass composited
+    // under a full resolution inset
+    QtiGL::Foveation foveation;
+    QtiGL::RenderPass peripheryPass;
+
+    // depth is resolved into runtime depth swapchains and submitted
+    bool submitDepth;
+    GLenum depthFormat;
+
+    // static content composited by the runtime, only rendered when dirty
+    AppCommon::LayerManager layers;
+
+    // lens-hidden corners of each eye, primed into depth before drawing
+    AppCommon::VisibilityMask visibilityMask;
+    int backgroundLayer;
+    int floorLayer;
+
+    // motion vectors and depth for the runtime to synthesize frames from
+    AppCommon::SpaceWarp spaceWarp;
+    QtiGL::VelocityPass velocityPass;
+    XrDuration displayPeriod;
+
+    // steps the quality knobs below down on perf settings warnings
+    AppCommon::PerfGovernor governor;
+    // eye images are rendered to this fraction of their size
+    float resolutionScale;
+    // max pixel error engine_select_lods() allows, loosened by the governor
+    float lodPixelError;
+
+    // android_main entry time, for time-to-first-frame reporting
+    int64_t startTimeNs;
+    bool firstFrameSubmitted;
+
     engine()
             : width(0), height(0), cubeShader(nullptr), starShader(nullptr), cubeTexture(0),
-              maxSampleCount(4), currentSampleCount(4)
+              maxSampleCount(4), currentSampleCount(4), frameIndex(0),
+              submitDepth(false), depthFormat(0), backgroundLayer(-1),
+              floorLayer(-1), displayPeriod(0), resolutionScale(1.0f),
+              lodPixelError(GEOMETRY_LOD_PIXEL_ERROR), startTimeNs(0),
+              firstFrameSubmitted(false)
     {
     }
 };
 
+static int64_t get_time_ns()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
 std::vector<glm::vec3> createPositionsPoint(int sector, float yval = -0.5) {
     // 绘制的半径
     std::vector<glm::vec3> dt;
@@ -187,18 +339,39 @@ static int engine_init_openxr(struct engine *engine)
             (void *)engine->app->activity->clazz;
 
     // TODO: should not hard-code these ideally
-    const char *const enabledExtensions[] = {
+    std::vector<const char *> enabledExtensions = {
             XR_KHR_ANDROID_CREATE_INSTANCE_EXTENSION_NAME,
             XR_KHR_COMPOSITION_LAYER_EQUIRECT_EXTENSION_NAME,
             XR_KHR_OPENGL_ES_ENABLE_EXTENSION_NAME};
+    if (DEPTH_SUBMISSION_ENABLED && engine->depthInfo.supported) {
+        enabledExtensions.push_back(
+                XR_KHR_COMPOSITION_LAYER_DEPTH_EXTENSION_NAME);
+    }
+    if (engine->cylinder_layer_supported) {
+        enabledExtensions.push_back(
+                XR_KHR_COMPOSITION_LAYER_CYLINDER_EXTENSION_NAME);
+    }
+    if (engine->visibility_mask_supported) {
+        enabledExtensions.push_back(XR_KHR_VISIBILITY_MASK_EXTENSION_NAME);
+    }
+    if (engine->perf_settings_supported) {
+        enabledExtensions.push_back(
+                XR_EXT_PERFORMANCE_SETTINGS_EXTENSION_NAME);
+    }
+    if (SPACE_WARP_ENABLED && engine->space_warp_supported) {
+        enabledExtensions.push_back(XR_FB_SPACE_WARP_EXTENSION_NAME);
+    }
+    if (QUAD_VIEWS_ENABLED && engine->quad_views_supported) {
+        enabledExtensions.push_back(XR_VARJO_QUAD_VIEWS_EXTENSION_NAME);
+        engine->quad_views_enabled = true;
+    }
 
     XrInstanceCreateInfo instanceCreateInfo = {
             .type = XR_TYPE_INSTANCE_CREATE_INFO,
             .next = &instanceCreateInfoAndroidKHR,
             .createFlags = 0,
-            .enabledExtensionCount =
-                    sizeof(enabledExtensions) / sizeof(*enabledExtensions),
-            .enabledExtensionNames = enabledExtensions,
+            .enabledExtensionCount = (uint32_t)enabledExtensions.size(),
+            .enabledExtensionNames = enabledExtensions.data(),
             .enabledApiLayerCount = 0,
             .applicationInfo =
                     {
@@ -214,9 +387,23 @@ static int engine_init_openxr(struct engine *engine)
     AppCommon::app_get_system_prop(engine);
 
     AppCommon::app_enum_view_configuration(engine);
-    engine->width = engine->state.viewConfigs[0].recommendedImageRectWidth / 4;
-    engine->height =
-            engine->state.viewConfigs[0].recommendedImageRectHeight / 4;
+    engine->width = engine->state.viewConfigs[0].recommendedImageRectWidth /
+                    VIEW_RESOLUTION_DIVISOR;
+    engine->height = engine->state.viewConfigs[0].recommendedImageRectHeight /
+                     VIEW_RESOLUTION_DIVISOR;
+    uint32_t totalPixels = 0;
+    for (uint32_t i = 0; i < engine->state.viewCount; ++i) {
+        uint32_t const width =
+                engine->state.viewConfigs[i].recommendedImageRectWidth /
+                VIEW_RESOLUTION_DIVISOR;
+        uint32_t const height =
+                engine->state.viewConfigs[i].recommendedImageRectHeight /
+                VIEW_RESOLUTION_DIVISOR;
+        LOGI("view %u: %ux%u", i, width, height);
+        totalPixels += width * height;
+    }
+    LOGI("%u views, %u pixels per frame", engine->state.viewCount,
+         totalPixels);
 
     // Create XR session
     assert(!engine->state.xrSession);
@@ -279,134 +466,234 @@ static void engine_shutdown_openxr(struct engine *engine)
 }
 
 /**
- * Create XR swapchains
+ * Pick a depth swapchain format the runtime supports, 0 if there is none
  */
-static int engine_init_xr_swapchains(struct engine *engine)
+static GLenum engine_pick_depth_format(struct engine *engine)
 {
-    AppCommon::app_enum_sc_format(engine);
+    uint32_t formatCount = 0;
+    XrResult result = xrEnumerateSwapchainFormats(engine->state.xrSession, 0,
+                                                  &formatCount, nullptr);
+    if (XR_FAILED(result) || formatCount == 0) {
+        return 0;
+    }
+    std::vector<int64_t> formats(formatCount);
+    result = xrEnumerateSwapchainFormats(engine->state.xrSession, formatCount,
+                                         &formatCount, formats.data());
+    if (XR_FAILED(result)) {
+        return 0;
+    }
 
-    // Looking for multisample extension
-    PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEIMGPROC
-            glFramebufferTexture2DMultisampleEXT = nullptr;
-    glFramebufferTexture2DMultisampleEXT =
-            (PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEIMGPROC)eglGetProcAddress(
-                    "glFramebufferTexture2DMultisampleEXT");
-    if (!glFramebufferTexture2DMultisampleEXT) {
-        LOGW("Couldn't get function pointer to "
-             "glFramebufferTexture2DMultisampleEXT()!");
-        assert(0);
-        return 1;
+    // 24 bits keep reprojection stable out to the far plane
+    const GLenum preferred[] = {GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT16,
+                                GL_DEPTH_COMPONENT32F};
+    for (GLenum format : preferred) {
+        for (int64_t supported : formats) {
+            if (supported == format) {
+                return format;
+            }
+        }
     }
+    return 0;
+}
 
-    PFNGLRENDERBUFFERSTORAGEMULTISAMPLEIMGPROC
-            glRenderbufferStorageMultisampleEXT =
-                    (PFNGLRENDERBUFFERSTORAGEMULTISAMPLEIMGPROC)
-                            eglGetProcAddress(
-                                    "glRenderbufferStorageMultisampleEXT");
-    if (!glRenderbufferStorageMultisampleEXT) {
-        LOGE("Couldn't get function pointer to "
-             "glRenderbufferStorageMultisampleEXT()!");
-        return false;
+/**
+ * Destroys the targets and swapchains of every view of a sample count,
+ * including partially created ones
+ */
+static int engine_destroy_stereo_swapchain(StereoSwapchain &stereoSwapchain)
+{
+    int ret = 0;
+    for (auto &swapchain : stereoSwapchain.eyeSwapchain) {
+        for (auto &target : swapchain.targets) {
+            target.Destroy();
+        }
+        swapchain.targets.clear();
+        if (swapchain.xrSwapchainDepth != XR_NULL_HANDLE) {
+            AppCommon::app_destroy_swapchain_depth(&swapchain);
+        }
+        if (swapchain.xrSwapchain != XR_NULL_HANDLE &&
+            XR_FAILED(xrDestroySwapchain(swapchain.xrSwapchain))) {
+            LOGW("xrDestroySwapchain failed");
+            ret = 1;
+        }
+        swapchain.xrSwapchain = XR_NULL_HANDLE;
     }
+    return ret;
+}
 
-    // Create swapchain with different sample count and cached in map
-	uint32_t samples = engine->currentSampleCount;
-    {
-        StereoSwapchain stereoSwapchain;
-        stereoSwapchain.eyeSwapchain.resize(engine->state.viewCount);
-        std::vector<uint32_t> swapchainLengths;
-        swapchainLengths.resize(engine->state.viewCount);
-        uint32_t maxSwapchainLength = 0;
-
-        for (uint32_t eye = 0; eye < engine->state.viewCount; ++eye) {
-            auto &swapchain = stereoSwapchain.eyeSwapchain[eye];
-            XrSwapchainCreateInfo swapchainCreateInfo = {
-                    .type = XR_TYPE_SWAPCHAIN_CREATE_INFO,
-                    .usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT |
-                                  XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT,
-                    .createFlags = 0,
-                    .format = GL_RGBA8,
-                    .sampleCount = samples,
-                    .width = engine->width,
-                    .height = engine->height,
-                    .faceCount = 1,
-                    .arraySize = 1,
-                    .mipCount = 1,
-                    .next = nullptr,
-            };
+/**
+ * Creates every view's swapchains and resolve targets for a sample count and
+ * adds them to swapchainMap. Nothing is kept if any of them fails.
+ */
+static int engine_create_stereo_swapchain(struct engine *engine,
+                                          uint32_t samples)
+{
+    StereoSwapchain stereoSwapchain;
+    stereoSwapchain.eyeSwapchain.resize(engine->state.viewCount);
+
+    for (uint32_t eye = 0; eye < engine->state.viewCount; ++eye) {
+        auto &swapchain = stereoSwapchain.eyeSwapchain[eye];
+        swapchain.width =
+                engine->state.viewConfigs[eye].recommendedImageRectWidth /
+                VIEW_RESOLUTION_DIVISOR;
+        swapchain.height =
+                engine->state.viewConfigs[eye].recommendedImageRectHeight /
+                VIEW_RESOLUTION_DIVISOR;
+        XrSwapchainCreateInfo swapchainCreateInfo = {
+                .type = XR_TYPE_SWAPCHAIN_CREATE_INFO,
+                .usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT |
+                              XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT,
+                .createFlags = 0,
+                .format = GL_RGBA8,
+                .sampleCount = samples,
+                .width = swapchain.width,
+                .height = swapchain.height,
+                .faceCount = 1,
+                .arraySize = 1,
+                .mipCount = 1,
+                .next = nullptr,
+        };
 
-            XrResult result = xrCreateSwapchain(engine->state.xrSession,
-                                                &swapchainCreateInfo,
-                                                &swapchain.xrSwapchain);
-            if (XR_FAILED(result)) {
-                LOGW("xrCreateSwapchain failed");
-                assert(0);
+        XrResult result = xrCreateSwapchain(engine->state.xrSession,
+                                            &swapchainCreateInfo,
+                                            &swapchain.xrSwapchain);
+        if (XR_FAILED(result)) {
+            LOGW("xrCreateSwapchain failed");
+            swapchain.xrSwapchain = XR_NULL_HANDLE;
+            engine_destroy_stereo_swapchain(stereoSwapchain);
+            return 1;
+        }
+
+        uint32_t swapchainLength = 0;
+        result = xrEnumerateSwapchainImages(swapchain.xrSwapchain, 0,
+                                            &swapchainLength, nullptr);
+        if (XR_FAILED(result)) {
+            LOGW("xrEnumerateSwapchainImages failed");
+            engine_destroy_stereo_swapchain(stereoSwapchain);
+            return 1;
+        }
+
+        swapchain.xrImages.resize(swapchainLength,
+                                  {XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_ES_KHR});
+        swapchain.targets.resize(swapchainLength);
+
+        result = xrEnumerateSwapchainImages(
+                swapchain.xrSwapchain, swapchainLength, &swapchainLength,
+                (XrSwapchainImageBaseHeader *)&swapchain.xrImages[0]);
+
+        if (XR_SUCCESS != result) {
+            LOGW("xrEnumerateSwapchainImages failed");
+            engine_destroy_stereo_swapchain(stereoSwapchain);
+            return 1;
+        }
+
+        if (engine->submitDepth) {
+            XrSwapchainCreateInfo depthCreateInfo = swapchainCreateInfo;
+            depthCreateInfo.usageFlags =
+                    XR_SWAPCHAIN_USAGE_SAMPLED_BIT |
+                    XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+            depthCreateInfo.format = engine->depthFormat;
+            depthCreateInfo.sampleCount = 1;
+            AppCommon::app_create_swapchain_depth(
+                    &depthCreateInfo, &engine->state.xrSession, &swapchain);
+        }
+
+        for (uint32_t index = 0; index < swapchainLength; ++index) {
+            // msaa color and depth only live in tile memory, color is
+            // resolved into the swapchain image as tiles are stored
+            LOGI("Implicit resolve target index:%d sample: %d", index,
+                 samples);
+            if (!swapchain.targets[index].InitializeImplicitResolveExternal(
+                        swapchain.width, swapchain.height, samples,
+                        swapchain.xrImages[index].image, true, false,
+                        GL_DEPTH_COMPONENT16)) {
+                LOGE("framebuffer is incomplete! Error code %d",
+                     glGetError());
+                engine_destroy_stereo_swapchain(stereoSwapchain);
                 return 1;
             }
 
-            result = xrEnumerateSwapchainImages(
-                    swapchain.xrSwapchain, 0, &swapchainLengths[eye], nullptr);
-            if (XR_FAILED(result)) {
-                LOGW("xrEnumerateSwapchainImages failed");
-                assert(0);
+            // depth images normally come in step with the color ones,
+            // the frame loop re-points the target if they don't
+            if (engine->submitDepth &&
+                index < swapchain.xrImagesDepth.size() &&
+                !swapchain.targets[index].ResolveDepthInto(
+                        swapchain.xrImagesDepth[index].image,
+                        engine->depthFormat)) {
+                LOGE("depth framebuffer is incomplete!");
+                engine_destroy_stereo_swapchain(stereoSwapchain);
                 return 1;
             }
+        }
+    }
 
-            if (swapchainLengths[eye] > maxSwapchainLength)
-                maxSwapchainLength = swapchainLengths[eye];
+    LOGI("Insert to table, sample :%d", samples);
+    engine->swapchainMap[samples] = std::move(stereoSwapchain);
+    return 0;
+}
 
-            swapchain.xrImages.resize(swapchainLengths[eye],
-                                      {XR_TYPE_SWAPCHAIN_IMAGE_OPENGL_ES_KHR});
-            swapchain.fbos.resize(swapchainLengths[eye]);
-            swapchain.dbos.resize(swapchainLengths[eye]);
+/**
+ * Create XR swapchains
+ */
+static int engine_init_xr_swapchains(struct engine *engine)
+{
+    AppCommon::app_enum_sc_format(engine);
 
-            result = xrEnumerateSwapchainImages(
-                    swapchain.xrSwapchain, swapchainLengths[eye],
-                    &swapchainLengths[eye],
-                    (XrSwapchainImageBaseHeader *)&swapchain.xrImages[0]);
+    // Looking for multisample extension
+    if (!QtiGL::RenderTarget::IsImplicitResolveSupported()) {
+        LOGW("GL_EXT_multisampled_render_to_texture isn't supported!");
+        assert(0);
+        return 1;
+    }
 
-            if (XR_SUCCESS != result) {
-                LOGW("xrEnumerateSwapchainImages failed");
-                assert(0);
-                return 1;
-            }
+    // Create swapchain with different sample count and cached in map
+	uint32_t samples = engine->currentSampleCount;
 
-            for (uint32_t index = 0; index < swapchainLengths[eye]; ++index) {
-                // Create depth buffer
-                GL(glGenRenderbuffers(1, &swapchain.dbos[index]));
-                GL(glBindRenderbuffer(GL_RENDERBUFFER, swapchain.dbos[index]));
-                GL(glRenderbufferStorageMultisampleEXT(
-                        GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT16,
-                        engine->width, engine->height));
-                GL(glBindRenderbuffer(GL_RENDERBUFFER, 0));
-
-                // Create MSAA fbo
-                GL(glGenFramebuffers(1, &swapchain.fbos[index]));
-                GL(glBindFramebuffer(GL_FRAMEBUFFER, swapchain.fbos[index]));
-                GL(glFramebufferRenderbuffer(
-                        GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER,
-                        swapchain.dbos[index]));
-                LOGI("glFramebufferTexture2DMultisampleEXT index:%d sample: %d",
-                     index, samples);
-                GL(glFramebufferTexture2DMultisampleEXT(
-                        GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-                        swapchain.xrImages[index].image, 0, samples));
-
-                GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-                // check frame buffer status
-                if (status != GL_FRAMEBUFFER_COMPLETE) {
-                    LOGE("framebuffer is incomplete, status: %d! Error code %d",
-                         status, glGetError());
-                    assert(0);
-                    return 1;
-                }
-            }
+    // msaa depth has to be resolvable on tile into the single sampled depth
+    // swapchain images, which takes EXT_multisampled_render_to_texture2.
+    // Decided with the first (highest) sample count, lower ones resolve too
+    if (engine->swapchainMap.empty()) {
+        engine->submitDepth = false;
+    }
+    if (engine->swapchainMap.empty() && DEPTH_SUBMISSION_ENABLED &&
+        engine->depthInfo.supported) {
+        engine->depthFormat = engine_pick_depth_format(engine);
+        if (engine->depthFormat == 0) {
+            LOGW("No depth swapchain format, depth won't be submitted");
+        } else if (samples > 1 &&
+                   !QtiGL::RenderTarget::IsImplicitResolveSupported(true)) {
+            LOGW("MSAA depth can't be resolved, depth won't be submitted");
+        } else {
+            engine->submitDepth = true;
+            LOGI("Submitting depth, format 0x%x", engine->depthFormat);
         }
+    }
 
-        LOGI("Insert to table, sample :%d", samples);
-        engine->swapchainMap[samples] = std::move(stereoSwapchain);
+    if (engine_create_stereo_swapchain(engine, samples) != 0) {
+        assert(0);
+        return 1;
     }
 
+    // every image of every eye shares one transient depth buffer per sample count
+    QtiGL::RenderTarget::GetTransientDepthPool().LogStats();
+
+    // depth only leaves the tile when the compositor wants it; color ops
+    // depend on the foveation mode and are set per frame
+    engine->eyePass.SetDepthOps(QtiGL::RenderPass::kLoadOpClear,
+                                engine->submitDepth
+                                        ? QtiGL::RenderPass::kStoreOpResolve
+                                        : QtiGL::RenderPass::kStoreOpDiscard);
+
+    // the periphery is only needed until it's upscaled into the eye image;
+    // sized for the context views, quad view insets aren't foveated
+    engine->foveation.Initialize(engine->width, engine->height,
+                                 engine->currentSampleCount, GL_RGBA8);
+    engine->peripheryPass.SetColorOps(QtiGL::RenderPass::kLoadOpClear,
+                                      QtiGL::RenderPass::kStoreOpStore,
+                                      EYE_CLEAR_COLOR);
+    engine->peripheryPass.SetDepthOps(QtiGL::RenderPass::kLoadOpClear,
+                                      QtiGL::RenderPass::kStoreOpDiscard);
+
     return 0;
 }
 
@@ -415,23 +702,15 @@ static int engine_init_xr_swapchains(struct engine *engine)
  */
 static int engine_destroy_xr_swapchains(struct engine *engine)
 {
+    int ret = 0;
     for (auto it = engine->swapchainMap.begin();
          it != engine->swapchainMap.end(); ++it) {
-        for (auto &swapchain : it->second.eyeSwapchain) {
-            GL(glDeleteFramebuffers(swapchain.fbos.size(),
-                                    swapchain.fbos.data()));
-            GL(glDeleteRenderbuffers(swapchain.dbos.size(),
-                                     swapchain.dbos.data()));
-            if (XR_FAILED(xrDestroySwapchain(swapchain.xrSwapchain))) {
-                LOGW("xrDestroySwapchain failed");
-                assert(0);
-                return 1;
-            }
-        }
+        ret |= engine_destroy_stereo_swapchain(it->second);
     }
     engine->swapchainMap.clear();
+    engine->foveation.Destroy();
 
-    return 0;
+    return ret;
 }
 
 /**
@@ -520,72 +799,30 @@ bool pointInRegion(glm::vec2 pt,std::vector<glm::vec2> plist)
 }
 
 /**
- * Render scene.
+ * True for the high resolution inset views of the quad view configuration.
  */
-static void engine_draw_frame(struct engine *engine,
-                              const uint32_t viewIndex,
-                              const uint32_t imgIndex,
-                              const XrView &xrView)
+static bool engine_is_inset_view(struct engine *engine,
+                                 const uint32_t viewIndex)
 {
-    assert(engine->display);
-    auto &stereoSwapchain = engine->swapchainMap[engine->currentSampleCount];
-    auto &swapchain = stereoSwapchain.eyeSwapchain[viewIndex];
-    GL(glBindFramebuffer(GL_FRAMEBUFFER, swapchain.fbos[imgIndex]));
-
-    GL(glEnable(GL_SCISSOR_TEST));
-    GL(glEnable(GL_DEPTH_TEST));
-    GL(glEnable(GL_CULL_FACE));
-    GL(glDepthFunc(GL_LESS));
-    GL(glDepthMask(GL_TRUE));
-
-    GL(glViewport(0, 0, engine->width, engine->height));
-    GL(glScissor(0, 0, engine->width, engine->height));
-    GL(glClearColor(0.1f, 0.1f, 0.1f, 0.0f));
-    GL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
-
-    glm::mat4 eyeProjMat, eyeViewMat;
-
-    XrMatrix4x4f result;
-    XrMatrix4x4f_CreateProjectionFov(&result, GRAPHICS_OPENGL_ES, xrView.fov,
-                                     0.05f, 100.f);
-    AppCommon::array2matrix(result, eyeProjMat);
-    glm::mat4 rot = glm::mat4_cast(
-            glm::fquat(xrView.pose.orientation.w, xrView.pose.orientation.x,
-                       xrView.pose.orientation.y, xrView.pose.orientation.z));
-    glm::mat4 trans =
-            glm::translate(glm::mat4(1.0f), glm::vec3(xrView.pose.position.x,
-                                                      xrView.pose.position.y,
-                                                      xrView.pose.position.z));
-    eyeViewMat = trans * rot;
-    eyeViewMat = glm::inverse(eyeViewMat);
-
-    engine->cubeShader->Bind();
-    engine->cubeShader->SetUniformMat4("projectionMatrix", eyeProjMat);
-    engine->cubeShader->SetUniformMat4("viewMatrix", eyeViewMat);
-
-    glm::vec3 eyePos =
-            glm::vec3(-eyeViewMat[3][0], -eyeViewMat[3][1], -eyeViewMat[3][2]);
-    engine->cubeShader->SetUniformVec3("eyePos", eyePos);
+    return engine->state.viewConfigType ==
+                   XR_VIEW_CONFIGURATION_TYPE_PRIMARY_QUAD_VARJO &&
+           viewIndex >= 2;
+}
 
-    ////////////////////////////////////
+/**
+ * Draws the boundary rings with whatever program is bound, positions in
+ * attribute 0.
+ */
+static void engine_draw_rings(struct engine *engine)
+{
     int sector = 10;
     int layerNum = 10;
 
     std::vector<glm::vec3> dt;
-    std::vector<glm::vec3> dt2;
-    std::vector<glm::vec2> dt2D;
     for(int k = 0;k<layerNum;++k) {
 
         std::vector<glm::vec3> tmp = createPositionsPoint(sector, -3 + k);
         dt.insert(dt.end(), tmp.begin(),tmp.end());
-        if (k==0)
-        {
-            dt2.insert(dt2.end(), tmp.begin(),tmp.end());
-            for(auto it = tmp.begin();it!=tmp.end();++it)
-            {
-                dt2D.push_back({it->x,it->z});
-            }
-        }
     }
 
     GLfloat vVerticesTop[sector * 3*layerNum];
@@ -596,73 +833,18 @@ static void engine_draw_frame(struct engine *engine,
         vVerticesTop[i*3+2] = dt[i].z;
     }
 
-    GLfloat vVerticesFloorPolygon[sector * 3];
-    for(int i=0;i<dt2.size();++i)
-    {
-        vVerticesFloorPolygon[i*3] = dt2[i].x;
-        vVerticesFloorPolygon[i*3+1] = dt2[i].y;
-        vVerticesFloorPolygon[i*3+2] = dt2[i].z;
-    }
-
-    LOGI("OpenGLa  vVerticesFloor vVerticesFloorPolygon jjjjj -----------------------------------");
-    for(int j=0;j<sizeof(vVerticesFloorPolygon)/sizeof(vVerticesFloorPolygon[0]);++j)
-    {
-        LOGI("OpenGLa  vVerticesFloor vVerticesFloorPolygon jjjjj: %f", vVerticesFloorPolygon[j]);
-
-    }
-
-    LOGI("OpenGLa  vVerticesFloor size: %d", sizeof(vVerticesFloorPolygon)/sizeof(vVerticesFloorPolygon[0]));
-
-    std::vector<glm::vec2> vFloorStar;
-    for (float x=-5.0;x<5.0; x+=1.0)
-    {
-        for(float z=-5.0;z<5.0;z+=1.0)
-        {
-            bool bIn = pointInRegion(glm::vec2(x,z), dt2D);
-            if(bIn)
-            {
-                vFloorStar.push_back(glm::vec2(x,z));
-            }
-        }
-    }
-
-    int floorStarNum = vFloorStar.size();
-    GLfloat vVerticesFloor[3*floorStarNum];
-    for(int i=0;i<floorStarNum;++i)
-    {
-        vVerticesFloor[i*3] = vFloorStar[i].x;
-//        vVerticesFloor[i*3+1] = -4.0;
-        vVerticesFloor[i*3+1] = -3.0;
-        vVerticesFloor[i*3+2] = vFloorStar[i].y;
-    }
-/*
-    LOGI("OpenGLa  vVerticesFloor begin------------------------------------");
-    for(int i=0;i<sizeof(vVerticesFloor)/sizeof(vVerticesFloor[i]);++i)
-    {
-        LOGI("OpenGLa  vVerticesFloor :%f",vVerticesFloor[i]);
-    }*/
-
-    /*  GLfloat vVerticesFloor[3*3]={
-           1.5f,-0.5f,1.5f,
-           -1.5f,0.5f,1.0f,
-           1.0f,-0.5f,1.0f
-   };*/
-
-    ////////////////////////////////////
-    engine->cubeMatrices.push_back(glm::mat4(1.0f));
-    engine->cubeShader->SetUniformMat4("modelMatrix",
-                                       engine->cubeMatrices[0]);
-
 ////////////////////////////////
-    uint32_t mVbId1[2];
     int starNum = 20;
-    //Create the VBO
-    glGenBuffers(2, mVbId1);
-    assert(mVbId1[0] != 0);
-    glBindBuffer(GL_ARRAY_BUFFER, mVbId1[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vVerticesTop), vVerticesTop, GL_STATIC_DRAW);//bufferSize: 24*8*4=768
+    // written into this frame's region of the ring, no reallocation or stall
+    uint32_t topOffset = 0;
+    if (!engine->lineBuffer.Write(vVerticesTop, sizeof(vVerticesTop),
+                                  3 * sizeof(GLfloat), topOffset)) {
+        // the offset means nothing, skip the rings this frame
+        return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, engine->lineBuffer.GetBufferId());
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void *) (0));
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void *) (uint64_t) (topOffset));
     glEnableVertexAttribArray(0);
 
 //    LOGI("OpenGLa  bufferSize1 :%d", bufferSize1);
@@ -688,7 +870,7 @@ static void engine_draw_frame(struct engine *engine,
     int pointInStar = sector/starNum;
     for(int h = 0;h<starNum;++h)
     {
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat)*num, (void *) (h*3 * sizeof(GLfloat)*pointInStar));
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat)*num, (void *) (uint64_t) (topOffset + h*3 * sizeof(GLfloat)*pointInStar));
         glEnableVertexAttribArray(0);
 
         for (int i = 0; i < layerNum; ++i) {
@@ -700,219 +882,666 @@ static void engine_draw_frame(struct engine *engine,
             glDrawArrays(GL_LINE_LOOP, begin, cnt);
         }
     }
+}
+
+/**
+ * Render scene into the bound target, with the given eye matrices.
+ */
+static void engine_draw_scene(struct engine *engine, const uint32_t viewIndex,
+                              const XrView &xrView, glm::mat4 &eyeProjMat,
+                              glm::mat4 &eyeViewMat)
+{
+    GL(glEnable(GL_SCISSOR_TEST));
+    GL(glEnable(GL_DEPTH_TEST));
+    GL(glEnable(GL_CULL_FACE));
+    GL(glDepthFunc(GL_LESS));
+    GL(glDepthMask(GL_TRUE));
+
+    // nothing is shaded where the lens can't see; the synthetic mask assumes
+    // a lens edge, which an inset doesn't have
+    if (!engine_is_inset_view(engine, viewIndex) ||
+        !engine->visibilityMask.is_synthetic()) {
+        engine->visibilityMask.prime_depth(viewIndex, xrView.fov, eyeProjMat);
+    }
+
+    engine->cubeShader->Bind();
+    engine->cubeShader->SetUniformMat4("projectionMatrix", eyeProjMat);
+    engine->cubeShader->SetUniformMat4("viewMatrix", eyeViewMat);
+
+    glm::vec3 eyePos =
+            glm::vec3(-eyeViewMat[3][0], -eyeViewMat[3][1], -eyeViewMat[3][2]);
+    engine->cubeShader->SetUniformVec3("eyePos", eyePos);
+
+    engine->cubeShader->SetUniformMat4("modelMatrix",
+                                       engine->cubeMatrices[SCENE_OBJECT_RINGS]);
+    engine_draw_rings(engine);
 
 ///////////////////////////////////////
 
     engine->cubeShader->Unbind();
 
+    engine->renderQueue.Begin(eyeProjMat, eyeViewMat);
+    QtiGL::DrawPacket packet = {};
+    packet.pShader =
+            engine_get_model_shader(engine, engine->cube.GetVertexFormat());
+    packet.pGeometry = &engine->cube;
+    packet.instanceCount = 1;
+    if (packet.pShader != nullptr) {
+        for (uint32_t i = 0; i < CUBE_COUNT; ++i) {
+            if (!engine->cubeVisible[i]) {
+                continue;
+            }
+            packet.modelMatrix = engine->cubeMatrices[SCENE_OBJECT_CUBE + i];
+            packet.lod = engine->cubeLods[i];
+            engine->renderQueue.Add(packet);
+        }
+    }
+    engine->renderQueue.Flush();
+
     ////////////////////////////////////////////////////////////////
     glUseProgram (GL_NONE);
     ///////////////////////////////////////////////////////////////////////////
 
-    engine->starShader->Bind();
-    engine->starShader->SetUniformMat4("projectionMatrix", eyeProjMat);
-    engine->starShader->SetUniformMat4("viewMatrix", eyeViewMat);
-    engine->starShader->SetUniformVec3("eyePos", eyePos);
+    // the floor stars are a quad layer now, see engine_render_floor_layer()
+    glDisableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-      engine->cubeMatrices.push_back(glm::mat4(1.0f));
-   engine->starShader->SetUniformMat4("modelMatrix",
-                                      engine->cubeMatrices[0]);
+}
 
-    //////
-    uint32_t mVbId2[2];
-    glGenBuffers(2, mVbId2);
+/**
+ * Part of a view's swapchain image that is rendered to and submitted, at
+ * the governor's resolution scale.
+ */
+static void engine_get_render_size(struct engine *engine,
+                                   const Swapchain &swapchain,
+                                   int32_t &width, int32_t &height)
+{
+    width = std::max((int32_t)(swapchain.width * engine->resolutionScale), 1);
+    height = std::max((int32_t)(swapchain.height * engine->resolutionScale),
+                      1);
+}
 
-    assert(mVbId2[0] != 0);
-    glBindBuffer(GL_ARRAY_BUFFER, mVbId2[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vVerticesFloor), vVerticesFloor, GL_STATIC_DRAW);//bufferSize: 24*8*4=768
+/**
+ * Draws the view's motion vectors and depth for space warp, if it's on.
+ */
+static void engine_draw_velocity(struct engine *engine,
+                                 const uint32_t viewIndex,
+                                 const glm::mat4 &eyeProjMat,
+                                 const glm::mat4 &eyeViewMat)
+{
+    if (!engine->spaceWarp.begin_view(viewIndex)) {
+        return;
+    }
+    GL(glEnable(GL_DEPTH_TEST));
+    GL(glDepthFunc(GL_LESS));
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void *) (0));
-    glEnableVertexAttribArray(0);
-//    glDrawArrays(GL_POINTS, 0, floorStarNum);
-    LOGI("OpenGLa vVerticesFloor vertnum:%d starnum:%d",sizeof(vVerticesFloor)/sizeof(vVerticesFloor)[0]/3, floorStarNum);
-//    glDrawArrays(GL_LINE_LOOP, 0, sizeof(vVerticesFloor)/sizeof(vVerticesFloor)[0]/3);
-    glDrawArrays(GL_POINTS, 0, sizeof(vVerticesFloor)/sizeof(vVerticesFloor)[0]/3);
-    ///////////
-  /*  assert(mVbId2[1] != 0);
-    glBindBuffer(GL_ARRAY_BUFFER, mVbId2[1]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vVerticesFloorPolygon), vVerticesFloorPolygon, GL_STATIC_DRAW);//bufferSize: 24*8*4=768
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void *) (0));
-    glEnableVertexAttribArray(0);
-    LOGI("OpenGLa vVerticesFloor 111 vertnum:%d ",sizeof(vVerticesFloorPolygon)/sizeof(vVerticesFloorPolygon)[0]/3);
-//    glDrawArrays(GL_TRIANGLE_STRIP, 0, floorStarNum);
-//    glDrawArrays(GL_TRIANGLE_STRIP, 0, sizeof(vVerticesFloorPolygon)/sizeof(vVerticesFloorPolygon)[0]);
-    glDrawArrays(GL_LINE_LOOP, 0, sizeof(vVerticesFloorPolygon)/sizeof(vVerticesFloorPolygon)[0]/3);*/
-/////////
-
-/*    int starNum = 20;
-    //Create the VBO
-    glGenBuffers(2, mVbId1);
-    assert(mVbId1[0] != 0);
-    glBindBuffer(GL_ARRAY_BUFFER, mVbId1[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vVerticesTop), vVerticesTop, GL_STATIC_DRAW);//bufferSize: 24*8*4=768
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void *) (0));
-    glEnableVertexAttribArray(0);
+    engine->velocityPass.Bind(eyeProjMat * eyeViewMat);
+    engine->velocityPass.SetObject(SCENE_OBJECT_RINGS);
+    engine_draw_rings(engine);
+    for (uint32_t i = 0; i < CUBE_COUNT; ++i) {
+        if (!engine->cubeVisible[i]) {
+            continue;
+        }
+        engine->velocityPass.SetObject(SCENE_OBJECT_CUBE + i);
+        engine->cube.SetLod(engine->cubeLods[i]);
+        engine->cube.Submit();
+    }
+    engine->velocityPass.Unbind();
 
-    int num = sector;
-    for (int i = 0; i < layerNum; ++i) {
-//        glLineWidth((i + 1) * 5);
-        if(i==0)
-        {
-            glLineWidth(5);
-        }else
-        {
-            glLineWidth(1);
+    glDisableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    engine->spaceWarp.end_view(viewIndex);
+}
 
+/**
+ * Picks each cube's level from its projected error for this frame's views.
+ * All views draw the same level, so the eyes never disagree; it's chosen
+ * from the first view's position at the densest view's pixels per unit.
+ */
+static void engine_select_lods(struct engine *engine)
+{
+    auto &stereoSwapchain = engine->swapchainMap[engine->currentSampleCount];
+    QtiGL::LodView lodView = {};
+    for (uint32_t i = 0; i < engine->state.viewCount; ++i) {
+        const XrView &xrView = engine->state.m_views[i];
+        const float eyePosition[3] = {xrView.pose.position.x,
+                                      xrView.pose.position.y,
+                                      xrView.pose.position.z};
+        int32_t renderWidth, renderHeight;
+        engine_get_render_size(engine, stereoSwapchain.eyeSwapchain[i],
+                               renderWidth, renderHeight);
+        QtiGL::LodView view = QtiGL::Geometry::MakeLodView(
+                eyePosition, xrView.fov.angleUp, xrView.fov.angleDown,
+                renderHeight);
+        if (i == 0) {
+            lodView = view;
+        } else if (view.pixelsPerUnit > lodView.pixelsPerUnit) {
+            lodView.pixelsPerUnit = view.pixelsPerUnit;
         }
-        int begin = i * num;
-        int cnt = num;
-//        LOGI("OpenGLa  num:%d begin:%d size:%d starnum:%d", num, begin, cnt, starNum);
-//        glUniform1i(m_bStar, 0);
-        glDrawArrays(GL_LINE_LOOP, begin, cnt);
     }
-    */
-////////
-    engine->starShader->Unbind();
 
-    /////////////////////////////////////////////////////////////
-    GL(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+    for (uint32_t i = 0; i < CUBE_COUNT; ++i) {
+        engine->cubeLods[i] = engine->cube.SelectLod(
+                lodView,
+                glm::value_ptr(engine->cubeMatrices[SCENE_OBJECT_CUBE + i]),
+                engine->cubeLods[i], engine->lodPixelError);
+    }
+}
 
+/**
+ * Rasterizes the cubes as occluders for a view and tests each one's bounds
+ * against them, before anything of the view is queued.
+ */
+static void engine_cull_cubes(struct engine *engine,
+                              const glm::mat4 &viewProjMat)
+{
+    if (!OCCLUSION_CULLING_ENABLED) {
+        return;
+    }
+    glm::mat4 mvps[CUBE_COUNT];
+    engine->occlusionCuller.BeginFrame();
+    for (uint32_t i = 0; i < CUBE_COUNT; ++i) {
+        mvps[i] = viewProjMat * engine->cubeMatrices[SCENE_OBJECT_CUBE + i];
+        engine->occlusionCuller.AddOccluder(
+                engine->cubeVertices.data(), 8 * sizeof(float),
+                engine->cubeIndices.data(), engine->cubeIndices.size(),
+                glm::value_ptr(mvps[i]));
+    }
+    engine->occlusionCuller.Rasterize();
+
+    for (uint32_t i = 0; i < CUBE_COUNT; ++i) {
+        engine->cubeVisible[i] = engine->occlusionCuller.IsVisible(
+                engine->cube.GetBoundsMin(), engine->cube.GetBoundsMax(),
+                glm::value_ptr(mvps[i]));
+    }
 }
 
-static std::string read_text_file(const std::string &file)
+/**
+ * Render a view into its swapchain image.
+ */
+static void engine_draw_frame(struct engine *engine,
+                              const uint32_t viewIndex,
+                              const uint32_t imgIndex,
+                              const XrView &xrView)
 {
-    std::stringstream ss;
-    std::ifstream ifs(file);
-    if (ifs) {
-        ss << ifs.rdbuf();
+    assert(engine->display);
+    auto &stereoSwapchain = engine->swapchainMap[engine->currentSampleCount];
+    auto &swapchain = stereoSwapchain.eyeSwapchain[viewIndex];
+
+    glm::mat4 eyeProjMat, eyeViewMat;
+
+    XrMatrix4x4f result;
+    XrMatrix4x4f_CreateProjectionFov(&result, GRAPHICS_OPENGL_ES, xrView.fov,
+                                     EYE_NEAR_Z, EYE_FAR_Z);
+    AppCommon::array2matrix(result, eyeProjMat);
+    glm::mat4 rot = glm::mat4_cast(
+            glm::fquat(xrView.pose.orientation.w, xrView.pose.orientation.x,
+                       xrView.pose.orientation.y, xrView.pose.orientation.z));
+    glm::mat4 trans =
+            glm::translate(glm::mat4(1.0f), glm::vec3(xrView.pose.position.x,
+                                                      xrView.pose.position.y,
+                                                      xrView.pose.position.z));
+    eyeViewMat = trans * rot;
+    eyeViewMat = glm::inverse(eyeViewMat);
+    engine_cull_cubes(engine, eyeProjMat * eyeViewMat);
+
+    // every view is drawn with its own fov; an inset is already the foveal
+    // region at full resolution, so only the context views are foveated
+    bool const foveated = !engine_is_inset_view(engine, viewIndex);
+    int32_t renderWidth, renderHeight;
+    engine_get_render_size(engine, swapchain, renderWidth, renderHeight);
+    if (foveated) {
+        engine->foveation.SetRenderSize(renderWidth, renderHeight);
+    }
+    GLuint eyeImage = swapchain.xrImages[imgIndex].image;
+    if (foveated && engine->foveation.IsMultiRes()) {
+        // the whole fov at low resolution first, upscaled into the eye image;
+        // the eye pass loads it and only redraws the inset
+        QtiGL::RenderTarget &periphery = engine->foveation.GetPeripheryTarget();
+        engine->peripheryPass.Begin(periphery);
+        GL(glScissor(0, 0, periphery.GetWidth(), periphery.GetHeight()));
+        engine_draw_scene(engine, viewIndex, xrView, eyeProjMat, eyeViewMat);
+        engine->peripheryPass.End();
+        engine->foveation.CompositePeriphery(eyeImage);
+
+        engine->eyePass.SetColorOps(QtiGL::RenderPass::kLoadOpLoad,
+                                    QtiGL::RenderPass::kStoreOpResolve);
     } else {
-        LOGW("Read %s failed", file.c_str());
+        if (foveated) {
+            engine->foveation.ApplyTextureFoveation(eyeImage);
+        }
+        engine->eyePass.SetColorOps(QtiGL::RenderPass::kLoadOpClear,
+                                    QtiGL::RenderPass::kStoreOpResolve,
+                                    EYE_CLEAR_COLOR);
+    }
+
+    int32_t insetX = 0, insetY = 0;
+    int32_t insetWidth = renderWidth, insetHeight = renderHeight;
+    if (foveated) {
+        engine->foveation.GetInsetRect(insetX, insetY, insetWidth,
+                                       insetHeight);
     }
+    engine->eyePass.Begin(swapchain.targets[imgIndex]);
+    GL(glViewport(0, 0, renderWidth, renderHeight));
+    GL(glScissor(insetX, insetY, insetWidth, insetHeight));
+    engine_draw_scene(engine, viewIndex, xrView, eyeProjMat, eyeViewMat);
+    engine->eyePass.End();
 
-    return ss.str();
+    engine_draw_velocity(engine, viewIndex, eyeProjMat, eyeViewMat);
 }
 
 /**
- * Init resources for rendering scene
+ * Picks up foveation level changes from debug.mixedreality.foveation, the
+ * governor can raise the level further
  */
-static int engine_init_scene_resources(struct engine *engine)
+static void engine_update_foveation(struct engine *engine)
 {
-    std::string externalDir =
-            std::string(engine->app->activity->externalDataPath);
+    char level[PROP_VALUE_MAX];
+    AppCommon::GetSysProperty("debug.mixedreality.foveation", level,
+                              sizeof(level), FOVEATION_DEFAULT_LEVEL);
+    QtiGL::Foveation::Level configured = QtiGL::Foveation::ParseLevel(level);
+    QtiGL::Foveation::Level least = engine->governor.get_settings().foveation;
+    engine->foveation.SetLevel(configured > least ? configured : least);
+}
 
-    // load shader
-    {
-        std::string vsFilePath = externalDir + "/model_v.glsl";
-        std::string fsFilePath = externalDir + "/model_f.glsl";
-        std::string gsFilePath = externalDir + "/model_g.glsl";
-        // load shader sources
-        std::string vsSource = read_text_file(vsFilePath);
-        if (vsSource.length() <= 0) {
-            return 1;
-        }
+/**
+ * Switches the eye buffers to another sample count. Swapchains for a count
+ * are created the first time it's used and kept in swapchainMap; if that
+ * fails the current count stays.
+ */
+static void engine_set_sample_count(struct engine *engine, GLint samples)
+{
+    if (samples == engine->currentSampleCount) {
+        return;
+    }
+    if (engine->swapchainMap.find(samples) == engine->swapchainMap.end() &&
+        engine_create_stereo_swapchain(engine, samples) != 0) {
+        LOGE("No swapchains with %d samples, keeping %d", samples,
+             engine->currentSampleCount);
+        return;
+    }
+    LOGI("Sample count %d -> %d", engine->currentSampleCount, samples);
+    engine->currentSampleCount = samples;
 
-        std::string fsSource = read_text_file(fsFilePath);
-        if (fsSource.length() <= 0) {
-            return 1;
-        }
+    // the periphery target has the eye buffers' sample count
+    engine->foveation.Destroy();
+    engine->foveation.Initialize(engine->width, engine->height,
+                                 engine->currentSampleCount, GL_RGBA8);
+}
 
-        std::string gsSource = read_text_file(gsFilePath);
-        if (gsSource.length() <= 0) {
-            LOGI("shader3333 gssource");
-            return 1;
-        }
-        LOGI("shader gssource:%s", gsSource.c_str() );
-        engine->cubeShader = new QtiGL::Shader();
-        std::vector<const char *> vs = {vsSource.c_str()};
-        std::vector<const char *> fs = {fsSource.c_str()};
-        std::vector<const char *> gs = {gsSource.c_str()};
-        if (!engine->cubeShader->Initialize(vs.size(), vs.data(), fs.size(),
-                                            fs.data(), gs.size(), gs.data(), vsFilePath.c_str(),
-                                            fsFilePath.c_str())) {
-            return 1;
-        }
+/**
+ * Applies the governor's current quality tier.
+ */
+static void engine_apply_quality(struct engine *engine)
+{
+    const AppCommon::QualitySettings &settings =
+            engine->governor.get_settings();
+    engine->resolutionScale = settings.resolutionScale;
+    engine->lodPixelError = GEOMETRY_LOD_PIXEL_ERROR * settings.lodErrorScale;
+    engine_update_foveation(engine);
+    engine_set_sample_count(engine, (GLint)settings.samples);
+}
+
+/**
+ * Renders the floor stars into the floor layer, in the layer plane: x to the
+ * right, y away from the viewer (-z in the local space)
+ */
+static void engine_render_floor_layer(void *userData, uint32_t width,
+                                      uint32_t height)
+{
+    struct engine *engine = (struct engine *)userData;
+
+    std::vector<glm::vec2> floorPolygon;
+    std::vector<glm::vec3> ring = createPositionsPoint(10, -3);
+    for (auto it = ring.begin(); it != ring.end(); ++it) {
+        floorPolygon.push_back({it->x, it->z});
     }
 
-    //load starshader
-    {
-        std::string vsFilePath = externalDir + "/star_v.glsl";
-        std::string fsFilePath = externalDir + "/star_f.glsl";
-        std::string gsFilePath = externalDir + "/star_g.glsl";
-        // load shader sources
-        std::string vsSource = read_text_file(vsFilePath);
-        if (vsSource.length() <= 0) {
-            return 1;
+    std::vector<GLfloat> vertices;
+    for (float x = -5.0; x < 5.0; x += 1.0) {
+        for (float z = -5.0; z < 5.0; z += 1.0) {
+            if (pointInRegion(glm::vec2(x, z), floorPolygon)) {
+                vertices.push_back(x);
+                vertices.push_back(-z);
+                vertices.push_back(0.0f);
+            }
         }
+    }
+    if (vertices.empty()) {
+        return;
+    }
 
-        std::string fsSource = read_text_file(fsFilePath);
-        if (fsSource.length() <= 0) {
-            return 1;
+    uint32_t floorOffset = 0;
+    if (!engine->lineBuffer.Write(vertices.data(),
+                                  vertices.size() * sizeof(GLfloat),
+                                  3 * sizeof(GLfloat), floorOffset)) {
+        LOGE("Floor layer stars could not be written, layer left empty");
+        return;
+    }
+
+    GL(glDisable(GL_SCISSOR_TEST));
+    GL(glDisable(GL_DEPTH_TEST));
+    glLineWidth(1);
+
+    const float halfSize = FLOOR_LAYER_SIZE * 0.5f;
+    glm::mat4 layerProjMat =
+            glm::mat4(FLOOR_LAYER_CROSS_SCALE) *
+            glm::ortho(-halfSize, halfSize, -halfSize, halfSize, -1.0f, 1.0f);
+    engine->starShader->Bind();
+    engine->starShader->SetUniformMat4("projectionMatrix", layerProjMat);
+    engine->starShader->SetUniformMat4("viewMatrix", glm::mat4(1.0f));
+    engine->starShader->SetUniformMat4("modelMatrix", glm::mat4(1.0f));
+    engine->starShader->SetUniformVec3("eyePos", glm::vec3(0.0f));
+
+    glBindBuffer(GL_ARRAY_BUFFER, engine->lineBuffer.GetBufferId());
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat),
+                          (void *)(uint64_t)(floorOffset));
+    glEnableVertexAttribArray(0);
+    glDrawArrays(GL_POINTS, 0, vertices.size() / 3);
+
+    engine->starShader->Unbind();
+    glDisableVertexAttribArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    LOGI("Floor layer rendered: %zu stars, %ux%u", vertices.size() / 3,
+         width, height);
+}
+
+/**
+ * Widest panorama level worth uploading on this device
+ */
+static uint32_t engine_pick_background_width(struct engine *engine)
+{
+    uint32_t eyeWidth = engine->state.viewConfigs[0].recommendedImageRectWidth;
+    const char *defaultTier =
+            eyeWidth < 1600 ? "low" : (eyeWidth < 2048 ? "mid" : "high");
+    char tier[PROP_VALUE_MAX];
+    AppCommon::GetSysProperty("debug.mixedreality.backgroundTier", tier,
+                              sizeof(tier), defaultTier);
+
+    uint32_t width = BACKGROUND_WIDTH_HIGH;
+    if (strcmp(tier, "low") == 0) {
+        width = BACKGROUND_WIDTH_LOW;
+    } else if (strcmp(tier, "mid") == 0) {
+        width = BACKGROUND_WIDTH_MID;
+    }
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    if (maxTextureSize > 0 && (uint32_t)maxTextureSize < width) {
+        width = maxTextureSize;
+    }
+    LOGI("Background tier %s, up to %u pixels wide", tier, width);
+    return width;
+}
+
+/**
+ * Creates the composition layers, once the session exists
+ */
+static int engine_init_layers(struct engine *engine)
+{
+    engine->layers.init(engine->state.xrSession, engine->state.xrLocalSpace,
+                        engine->cylinder_layer_supported);
+
+    // environment backdrop at infinity, composited by the runtime instead
+    // of shaded behind the scene; added first so it's the bottom layer
+    QtiIO::AssetView panorama;
+    if (engine->assets.Open(BACKGROUND_ASSET, &panorama)) {
+        AppCommon::LayerDesc background;
+        background.radius = 0.0f;
+        background.underlay = true;
+        background.flags = 0;
+        engine->backgroundLayer = engine->layers.add_equirect_layer(
+                background, panorama.GetData(), (uint32_t)panorama.GetSize(),
+                engine_pick_background_width(engine));
+        if (engine->backgroundLayer < 0) {
+            LOGW("Failed to create the background layer");
         }
+    }
 
-        std::string gsSource = read_text_file(gsFilePath);
-        if (gsSource.length() <= 0) {
-            LOGI("shader3333 gssource");
-            return 1;
+    // horizontal quad 3m below the origin, seen through wherever the
+    // projection layer is transparent
+    AppCommon::LayerDesc floor;
+    floor.shape = AppCommon::LAYER_SHAPE_QUAD;
+    floor.width = FLOOR_LAYER_PIXELS;
+    floor.height = FLOOR_LAYER_PIXELS;
+    floor.pose.orientation = {-0.70710678f, 0.0f, 0.0f, 0.70710678f};
+    floor.pose.position = {0.0f, -3.0f, 0.0f};
+    floor.size = {FLOOR_LAYER_SIZE, FLOOR_LAYER_SIZE};
+    floor.underlay = true;
+    floor.render = engine_render_floor_layer;
+    floor.userData = engine;
+    engine->floorLayer = engine->layers.add_layer(floor);
+    if (engine->floorLayer < 0) {
+        LOGW("Failed to create the floor layer");
+        return 1;
+    }
+    return 0;
+}
+
+static bool map_asset(const QtiIO::AssetSource &assets, const std::string &name,
+                      QtiIO::AssetView *view)
+{
+    if (!assets.Open(name.c_str(), view)) {
+        LOGW("Read %s failed", name.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Compile a shader straight from its mapped source files. vsDecode, if given,
+ * is spliced in after the vertex shader's #version line (see
+ * QtiGL::VertexFormat::GetDecodeSource).
+ */
+static bool load_shader(const QtiIO::AssetSource &assets, const char *name,
+                        bool withGeometryStage, const char *vsDecode,
+                        QtiGL::Shader **shader)
+{
+    std::string vsName = std::string(name) + "_v.glsl";
+    std::string fsName = std::string(name) + "_f.glsl";
+    std::string gsName = std::string(name) + "_g.glsl";
+
+    QtiIO::AssetView vsView, fsView, gsView;
+    if (!map_asset(assets, vsName, &vsView) ||
+        !map_asset(assets, fsName, &fsView)) {
+        return false;
+    }
+    if (withGeometryStage && !map_asset(assets, gsName, &gsView)) {
+        return false;
+    }
+
+    const char *vs = vsView.GetChars();
+    const char *fs = fsView.GetChars();
+    const char *gs = gsView.GetChars();
+    GLint vsLength = (GLint)vsView.GetSize();
+    GLint fsLength = (GLint)fsView.GetSize();
+    GLint gsLength = (GLint)gsView.GetSize();
+
+    const char *vsStrings[3] = {vs, nullptr, nullptr};
+    GLint vsLengths[3] = {vsLength, 0, 0};
+    int32_t numVsStrings = 1;
+    if (vsDecode != nullptr) {
+        GLint versionLength = (GLint)QtiGL::VertexFormat::GetVersionLineLength(
+                vs, vsView.GetSize());
+        vsLengths[0] = versionLength;
+        vsStrings[1] = vsDecode;
+        vsLengths[1] = (GLint)strlen(vsDecode);
+        vsStrings[2] = vs + versionLength;
+        vsLengths[2] = vsLength - versionLength;
+        numVsStrings = 3;
+    }
+
+    std::string vsDbgName = assets.GetDebugPath(vsName.c_str());
+    std::string fsDbgName = assets.GetDebugPath(fsName.c_str());
+    *shader = new QtiGL::Shader();
+    return (*shader)->Initialize(numVsStrings, vsStrings, vsLengths,
+                                 1, &fs, &fsLength,
+                                 withGeometryStage ? 1 : 0, &gs, &gsLength,
+                                 vsDbgName.c_str(), fsDbgName.c_str());
+}
+
+/**
+ * Model program for meshes in the given vertex format (a mesh's
+ * Geometry::GetVertexFormat()), built the first time the format is used.
+ * Null if it doesn't compile.
+ */
+static QtiGL::Shader *engine_get_model_shader(struct engine *engine,
+                                              uint32_t vertexFormat)
+{
+    vertexFormat = QtiGL::VertexFormat::Sanitize(vertexFormat);
+    auto it = engine->modelShaders.find(vertexFormat);
+    if (it != engine->modelShaders.end()) {
+        return it->second;
+    }
+
+    std::string modelDecode =
+            QtiGL::VertexFormat::GetDecodeSource(vertexFormat);
+    QtiGL::Shader *shader = nullptr;
+    if (!load_shader(engine->assets, "model", false, modelDecode.c_str(),
+                     &shader)) {
+        LOGE("Model shader for vertex format 0x%x failed", vertexFormat);
+        if (shader != nullptr) {
+            shader->Destroy();
+            delete shader;
         }
-        LOGI("shader gssource:%s", gsSource.c_str() );
-        engine->starShader = new QtiGL::Shader();
-        std::vector<const char *> vs = {vsSource.c_str()};
-        std::vector<const char *> fs = {fsSource.c_str()};
-        std::vector<const char *> gs = {gsSource.c_str()};
-        if (!engine->starShader->Initialize(vs.size(), vs.data(), fs.size(),
-                                            fs.data(), gs.size(), gs.data(), vsFilePath.c_str(),
-                                            fsFilePath.c_str(), true)) {
-            return 1;
+        return nullptr;
+    }
+    engine->modelShaders[vertexFormat] = shader;
+    return shader;
+}
+
+/**
+ * Builds the cube mesh, float vertices with a normal per face, and lays the
+ * cubes out in a row
+ */
+static void engine_init_cube(struct engine *engine)
+{
+    static const float faceNormals[6][3] = {{1, 0, 0},  {-1, 0, 0}, {0, 1, 0},
+                                            {0, -1, 0}, {0, 0, 1},  {0, 0, -1}};
+    std::vector<float> &vertices = engine->cubeVertices;
+    std::vector<uint32_t> &indices = engine->cubeIndices;
+    vertices.clear();
+    indices.clear();
+    for (uint32_t f = 0; f < 6; ++f) {
+        glm::vec3 n(faceNormals[f][0], faceNormals[f][1], faceNormals[f][2]);
+        // u x v = n, so the corners wind counter-clockwise seen from outside
+        glm::vec3 u(n.y, n.z, n.x);
+        glm::vec3 v = glm::cross(n, u);
+        uint32_t base = vertices.size() / 8;
+        for (uint32_t c = 0; c < 4; ++c) {
+            float su = (c == 1 || c == 2) ? 1.0f : -1.0f;
+            float sv = (c >= 2) ? 1.0f : -1.0f;
+            glm::vec3 p = (n + u * su + v * sv) * 0.5f;
+            float vertex[8] = {p.x, p.y, p.z, n.x, n.y, n.z,
+                               su * 0.5f + 0.5f, sv * 0.5f + 0.5f};
+            vertices.insert(vertices.end(), vertex, vertex + 8);
         }
+        uint32_t quad[6] = {base, base + 1, base + 2, base, base + 2, base + 3};
+        indices.insert(indices.end(), quad, quad + 6);
+    }
+
+    QtiGL::ProgramAttribute attribs[3];
+    int32_t numAttribs =
+            QtiGL::VertexFormat::GetAttributes(QtiGL::kVertexFloat, attribs);
+    engine->cube.Initialize(attribs, numAttribs, indices.data(),
+                            indices.size(), vertices.data(),
+                            vertices.size() * sizeof(float),
+                            vertices.size() / 8);
+    const float boundsMin[3] = {-0.5f, -0.5f, -0.5f};
+    const float boundsMax[3] = {0.5f, 0.5f, 0.5f};
+    engine->cube.SetMeshInfo(0, boundsMin, boundsMax);
+
+    engine->cubeColors.assign(CUBE_COLORS, CUBE_COLORS + CUBE_COUNT);
+    engine->cubeLods.assign(CUBE_COUNT, 0);
+    engine->cubeVisible.assign(CUBE_COUNT, true);
+    for (uint32_t i = 0; i < CUBE_COUNT; ++i) {
+        float x = ((float)i - (CUBE_COUNT - 1) * 0.5f) * CUBE_SPACING;
+        engine->cubeMatrices[SCENE_OBJECT_CUBE + i] =
+                glm::translate(glm::vec3(x, 0.0f, -CUBE_DISTANCE)) *
+                glm::scale(glm::vec3(CUBE_SIZE));
+    }
+}
+
+/**
+ * Init resources for rendering scene
+ */
+static int engine_init_scene_resources(struct engine *engine)
+{
+    // Assets are read in place from the APK. Files pushed to
+    // <external data dir>/override take precedence, which is handy while
+    // iterating on shaders without reinstalling. Derived data is cached in
+    // the internal data dir.
+    std::string overrideDir =
+            std::string(engine->app->activity->externalDataPath) + "/override";
+    engine->assets.Initialize(engine->app->activity->assetManager, "raw",
+                              overrideDir.c_str(),
+                              engine->app->activity->internalDataPath);
+
+    // load shader; the model shader reads its attributes through decode
+    // functions generated for the vertex format, quantized meshes get their
+    // own variant from engine_get_model_shader()
+    engine->cubeShader =
+            engine_get_model_shader(engine, QtiGL::kVertexFloat);
+    if (engine->cubeShader == nullptr) {
+        return 1;
     }
 
-    // load texture
+    //load starshader
+    if (!load_shader(engine->assets, "star", true, nullptr,
+                     &engine->starShader)) {
+        return 1;
+    }
+
+    // load texture; only the mip tail is uploaded here, the rest streams in
+    // from engine_stream_textures() once frames are running
+    engine->textureStreamer.Initialize(TEXTURE_STREAM_WORKERS,
+                                       TEXTURE_STREAM_BUDGET_BYTES);
+    engine->lineBuffer.Initialize(GL_ARRAY_BUFFER, LINE_STREAM_REGION_BYTES);
+    engine->cubeMatrices.assign(SCENE_OBJECT_COUNT, glm::mat4(1.0f));
+    engine_init_cube(engine);
+    engine->occlusionCuller.Initialize();
     {
-        std::string textureFilePath = externalDir + "/white.ktx";
-        std::ifstream ifs(textureFilePath);
-        if (!ifs) {
-            return false;
+        QtiIO::AssetView texView;
+        if (!map_asset(engine->assets, "white.ktx", &texView)) {
+            return 1;
         }
 
-        std::streampos texBuffSize = ifs.tellg();
-        ifs.seekg(0, std::ios::end);
-        texBuffSize = ifs.tellg() - texBuffSize;
-        ifs.seekg(0);
-
-        std::vector<char> data(texBuffSize);
-        ifs.read(data.data(), data.size());
-        ifs.close();
-
-        GLenum texTarget;
-        QtiGL::KtxTexture texHelper;
-        QtiGL::TKTXHeader pOutHeader;
-        QtiGL::TKTXErrorCode result = texHelper.LoadKtxFromBuffer(
-                data.data(), data.size(), &engine->cubeTexture, &texTarget,
-                &pOutHeader, false);
-        LOGI("texture width: %d, height: %d", pOutHeader.pixelWidth,
-             pOutHeader.pixelHeight);
-
-        if (result != QtiGL::KTX_SUCCESS || 0 == engine->cubeTexture) {
+        engine->cubeTexture =
+                engine->textureStreamer.Request(std::move(texView));
+        if (0 == engine->cubeTexture) {
             return 1;
         }
     }
 
+    LOGI("Scene resources ready %.1f ms after start",
+         (get_time_ns() - engine->startTimeNs) * 1e-6);
     return 0;
 }
 
+/**
+ * Uploads the next slice of streamed texture levels, once per frame
+ */
+static void engine_stream_textures(struct engine *engine)
+{
+    engine->textureStreamer.Update();
+}
+
 /**
  * Destroys resources for rendering scene
  */
 static void engine_destroy_scene_resources(struct engine *engine)
 {
     engine->cube.Destroy();
+    engine->occlusionCuller.Destroy();
 
-    engine->cubeShader->Destroy();
-    delete engine->cubeShader;
+    for (auto &it : engine->modelShaders) {
+        it.second->Destroy();
+        delete it.second;
+    }
+    engine->modelShaders.clear();
     engine->cubeShader = nullptr;
 
+    engine->textureStreamer.Destroy();
+    engine->lineBuffer.Destroy();
     glDeleteTextures(1, &engine->cubeTexture);
     engine->cubeTexture = 0;
 
@@ -924,6 +1553,7 @@ static void engine_destroy_scene_resources(struct engine *engine)
 void android_main(struct android_app *state)
 {
     struct engine engine;
+    engine.startTimeNs = get_time_ns();
 
     state->userData = &engine;
     state->onAppCmd = AppCommon::app_handle_cmd;
@@ -951,6 +1581,29 @@ void android_main(struct android_app *state)
 
     AppCommon::app_wait_window((AppCommon::base_engine *)&engine);
     engine_init_openxr(&engine);
+    engine_init_layers(&engine);
+    engine.visibilityMask.init(engine.state.xrInstance, engine.state.xrSession,
+                               engine.state.viewConfigType,
+                               engine.state.viewCount,
+                               engine.visibility_mask_supported);
+    // debug.mixedreality.perfGovernorCheck runs the governor against a stub
+    // runtime first, see the log for the result
+    char governorCheck[PROP_VALUE_MAX];
+    AppCommon::GetSysProperty("debug.mixedreality.perfGovernorCheck",
+                              governorCheck, sizeof(governorCheck), "false");
+    if (governorCheck[0] == 't') {
+        AppCommon::perf_governor_check();
+    }
+    engine.governor.init(engine.state.xrInstance, engine.state.xrSession,
+                         engine.perf_settings_supported,
+                         engine.currentSampleCount);
+    if (engine.spaceWarp.init(engine.state.xrInstance, engine.state.xrSysId,
+                              engine.state.xrSession, engine.state.viewCount,
+                              SPACE_WARP_ENABLED &&
+                                      engine.space_warp_supported) &&
+        engine.spaceWarp.is_enabled() && !engine.velocityPass.Initialize()) {
+        engine.spaceWarp.destroy();
+    }
     app_create_action(&engine);
     while (1) {
         // Read all pending events.
@@ -979,6 +1632,10 @@ void android_main(struct android_app *state)
 
             // Check if we are exiting.
             if (state->destroyRequested != 0) {
+                engine.layers.destroy();
+                engine.visibilityMask.destroy();
+                engine.spaceWarp.destroy();
+                engine.velocityPass.Destroy();
                 engine_destroy_xr_swapchains(&engine);
                 engine_shutdown_openxr(&engine);
                 engine_destroy_scene_resources(&engine);
@@ -1016,14 +1673,23 @@ void android_main(struct android_app *state)
             LOGW("android_main xrBeginFrame failed");
             continue;
         }
+
+        // the runtime halves the rate while frames carry space warp info
+        if (frameState.predictedDisplayPeriod != engine.displayPeriod) {
+            engine.displayPeriod = frameState.predictedDisplayPeriod;
+            LOGI("Frame period %.2f ms, space warp %s",
+                 engine.displayPeriod * 1e-6,
+                 engine.spaceWarp.is_enabled() ? "on" : "off");
+        }
+
+        engine_stream_textures(&engine);
 //        app_locate_space(&engine, frameState.predictedDisplayTime);//获取手柄位置信息
         XrViewState viewState{XR_TYPE_VIEW_STATE};
         uint32_t viewCapacityInput = (uint32_t)engine.state.m_views.size();
         uint32_t viewCountOutput;
 
         XrViewLocateInfo viewLocateInfo{XR_TYPE_VIEW_LOCATE_INFO};
-        viewLocateInfo.viewConfigurationType =
-                XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO;
+        viewLocateInfo.viewConfigurationType = engine.state.viewConfigType;
         viewLocateInfo.displayTime = frameState.predictedDisplayTime;
         viewLocateInfo.space = engine.state.xrLocalSpace;
         result = xrLocateViews(engine.state.xrSession, &viewLocateInfo,
@@ -1033,8 +1699,38 @@ void android_main(struct android_app *state)
             LOGW("android_main xrLocateViews failed");
         }
 
+        // boosted cpu while textures stream in, then steady state
+        engine.governor.set_loading(!engine.textureStreamer.IsIdle());
+        for (const auto &event : engine.perf_settings_events) {
+            engine.governor.on_event(event);
+        }
+        engine.perf_settings_events.clear();
+        if (engine.governor.update(engine.frameIndex)) {
+            engine_apply_quality(&engine);
+        } else if (engine.frameIndex % FOVEATION_POLL_INTERVAL == 0) {
+            engine_update_foveation(&engine);
+        }
+        QtiGL::RenderPass::ResetFrameStats();
+        for (uint32_t i = 0; i < engine.state.viewCount; ++i) {
+            if (engine.visibility_mask_changed & (1u << i)) {
+                engine.visibilityMask.invalidate(i);
+            }
+        }
+        engine.visibility_mask_changed = 0;
+        // layer content is only redrawn when it changed
+        engine.layers.update();
+        if (engine.spaceWarp.is_enabled()) {
+            engine.velocityPass.BeginFrame();
+            for (uint32_t i = 0; i < SCENE_OBJECT_COUNT; ++i) {
+                engine.velocityPass.SetTransform(i, engine.cubeMatrices[i]);
+            }
+        }
+
+        engine_select_lods(&engine);
+
         XrCompositionLayerProjectionView
                 projectionViews[engine.state.viewCount];
+        XrCompositionLayerDepthInfoKHR depthInfos[engine.state.viewCount];
         auto &stereoSwapchain = engine.swapchainMap[engine.currentSampleCount];
         for (uint32_t i = 0; i < engine.state.viewCount; ++i) {//2
             auto &swapchain = stereoSwapchain.eyeSwapchain[i];
@@ -1071,13 +1767,57 @@ void android_main(struct android_app *state)
             projectionViews[i].subImage.imageArrayIndex = 0;
             projectionViews[i].subImage.imageRect.offset.x = 0;
             projectionViews[i].subImage.imageRect.offset.y = 0;
-            projectionViews[i].subImage.imageRect.extent.width = engine.width;
-            projectionViews[i].subImage.imageRect.extent.height = engine.height;
+            int32_t renderWidth, renderHeight;
+            engine_get_render_size(&engine, swapchain, renderWidth,
+                                   renderHeight);
+            projectionViews[i].subImage.imageRect.extent.width = renderWidth;
+            projectionViews[i].subImage.imageRect.extent.height = renderHeight;
+
+            if (engine.submitDepth) {
+                uint32_t depthIndex;
+                result = xrAcquireSwapchainImage(swapchain.xrSwapchainDepth,
+                                                 &swapchainImageAcquireInfo,
+                                                 &depthIndex);
+                if (XR_FAILED(result)) {
+                    LOGW("android_main xrAcquireSwapchainImage depth failed");
+                }
+                result = xrWaitSwapchainImage(swapchain.xrSwapchainDepth,
+                                              &swapchainImageWaitInfo);
+                if (XR_FAILED(result)) {
+                    LOGW("android_main xrWaitSwapchainImage depth failed");
+                }
+
+                // with multi-res foveation the eye pass only draws the inset,
+                // so the periphery's depth would read as the far plane. No
+                // view submits depth then, the layer's views should agree.
+                // The image is still acquired, resolved and released so the
+                // target never writes an image it doesn't hold
+                bool const peripheryOnlyColor = engine.foveation.IsMultiRes();
+                auto &target = swapchain.targets[bufferIndex];
+                GLuint depthImage = swapchain.xrImagesDepth[depthIndex].image;
+                if (target.GetDepthAttachment() != depthImage) {
+                    target.ResolveDepthInto(depthImage, engine.depthFormat);
+                }
+
+                depthInfos[i].type = XR_TYPE_COMPOSITION_LAYER_DEPTH_INFO_KHR;
+                depthInfos[i].next = nullptr;
+                depthInfos[i].subImage = projectionViews[i].subImage;
+                depthInfos[i].subImage.swapchain = swapchain.xrSwapchainDepth;
+                depthInfos[i].minDepth = 0.0f;
+                depthInfos[i].maxDepth = 1.0f;
+                depthInfos[i].nearZ = EYE_NEAR_Z;
+                depthInfos[i].farZ = EYE_FAR_Z;
+                if (!peripheryOnlyColor) {
+                    projectionViews[i].next = &depthInfos[i];
+                }
+            }
 
 //            LOGW("android_main engine_draw_frame begin-----------");
 
             // Draw scene
             engine_draw_frame(&engine, i, bufferIndex, engine.state.m_views[i]);
+            engine.spaceWarp.chain_layer_info(i, projectionViews[i],
+                                              EYE_NEAR_Z, EYE_FAR_Z);
 
             XrSwapchainImageReleaseInfo swapchainImageReleaseInfo = {
                     .type = XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO,
@@ -1090,10 +1830,40 @@ void android_main(struct android_app *state)
             if (XR_FAILED(result)) {
                 LOGW("android_main xrReleaseSwapchainImage failed");
             }
+
+            if (engine.submitDepth) {
+                result = xrReleaseSwapchainImage(swapchain.xrSwapchainDepth,
+                                                 &swapchainImageReleaseInfo);
+                if (XR_FAILED(result)) {
+                    LOGW("android_main xrReleaseSwapchainImage depth failed");
+                }
+            }
         }
 
+        // fences this frame's line vertices so the ring can come back to them
+        engine.lineBuffer.EndFrame();
         glFlush();
 
+        if (RENDER_PASS_STATS_INTERVAL > 0 &&
+            engine.frameIndex % RENDER_PASS_STATS_INTERVAL == 0) {
+            const QtiGL::RenderPassStats &passStats =
+                    QtiGL::RenderPass::GetFrameStats();
+            LOGI("Render passes: %u, invalidates: %u, write-back avoided: %.1f KB",
+                 passStats.passes, passStats.invalidates,
+                 passStats.writeBackBytesAvoided / 1024.0);
+            const QtiGL::RenderQueueStats &queueStats =
+                    engine.renderQueue.GetStats();
+            LOGI("Render queue, last view: %u draws, %u program, %u texture, %u vao switches",
+                 queueStats.draws, queueStats.programSwitches,
+                 queueStats.textureSwitches, queueStats.vaoSwitches);
+            const QtiGL::OcclusionStats &occlusionStats =
+                    engine.occlusionCuller.GetStats();
+            LOGI("Occlusion, last view: %u occluder triangles, %u of %u culled",
+                 occlusionStats.occluderTriangles, occlusionStats.occluded,
+                 occlusionStats.tested);
+        }
+        engine.frameIndex++;
+
         XrCompositionLayerProjection projectionLayer = {
                 .type = XR_TYPE_COMPOSITION_LAYER_PROJECTION,
                 .next = nullptr,
@@ -1105,19 +1875,20 @@ void android_main(struct android_app *state)
                 .views = projectionViews,
         };
 
-        const XrCompositionLayerBaseHeader *const layers[] = {
-                (const XrCompositionLayerBaseHeader *const) & projectionLayer,
-        };
+        const XrCompositionLayerBaseHeader *layers[LAYER_MANAGER_MAX_LAYERS + 1];
+        uint32_t layerCount = engine.layers.assemble_layers(
+                (const XrCompositionLayerBaseHeader *)&projectionLayer, layers,
+                sizeof(layers) / sizeof(layers[0]));
 
         XrFrameEndInfo frameEndInfo = {
                 .type = XR_TYPE_FRAME_END_INFO,
                 .displayTime = frameState.predictedDisplayTime,
-                .layerCount = sizeof(layers) / sizeof(layers[0]),
+                .layerCount = layerCount,
                 .layers = layers,
                 .environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE,
 //                .environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_ALPHA_BLEND,
                 .next = nullptr};
-        LOGW("android_main layerCount:%u", sizeof(layers) / sizeof(layers[0]));
+        LOGW("android_main layerCount:%u", layerCount);
 
         result = xrEndFrame(engine.state.xrSession, &frameEndInfo);//不清楚为啥容易卡，直接黑屏
 
@@ -1133,6 +1904,10 @@ void android_main(struct android_app *state)
 
         if (XR_FAILED(result)) {
             LOGW("android_main xrEndFrame failed");
+        } else if (!engine.firstFrameSubmitted) {
+            engine.firstFrameSubmitted = true;
+            LOGI("Time to first frame: %.1f ms",
+                 (get_time_ns() - engine.startTimeNs) * 1e-6);
         }
     }
 }